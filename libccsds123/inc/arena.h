@@ -0,0 +1,75 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef ARENA_H
+#define ARENA_H
+
+/**
+ * @file arena.h
+ * @brief Region allocator holding all the buffers of a compression or decompression: samples,
+ * residuals, weights, tables, encoder statistics and stream buffers are carved out of a few big
+ * blocks and they are all released at once when the arena is reset, so no error path can leak them.
+ * Every allocation is aligned to ARENA_ALIGNMENT bytes, suiting the SIMD kernels.
+ * When the same arena is used for consecutive images, resetting it merges its blocks into a single
+ * one as big as the most memory ever used: from then on, images needing no more memory than the
+ * previous ones are processed without any heap allocation.
+ * Optionally the blocks are backed by transparent huge pages (madvise(MADV_HUGEPAGE), Linux only).
+ */
+
+#include <stddef.h>
+
+/// Alignment, in bytes, of every allocation
+#define ARENA_ALIGNMENT 64
+
+/// Block of memory from which the allocations are carved
+typedef struct arena_block arena_block_t;
+
+///Type representing the arena; it has to be initialized with arena_init before use
+typedef struct arena
+{
+	arena_block_t *blocks;
+	size_t used_bytes;
+	size_t peak_bytes;
+	unsigned char huge_pages;
+} arena_t;
+
+///Position in the arena, used to release together all the allocations performed after it
+typedef struct arena_mark
+{
+	arena_block_t *block;
+	size_t block_used;
+	size_t used_bytes;
+} arena_mark_t;
+
+///Initializes the arena, pre-allocating capacity bytes (nothing when 0);
+///when huge_pages is not 0 the blocks are backed by huge pages, where available
+///@return a negative number if the memory could not be allocated
+int arena_init(arena_t *arena, size_t capacity, int huge_pages);
+
+///Allocates size bytes, aligned to ARENA_ALIGNMENT
+///@return NULL if the memory could not be allocated
+void *arena_alloc(arena_t *arena, size_t size);
+
+///Allocates count elements of size bytes, setting them to 0
+///@return NULL if the memory could not be allocated
+void *arena_calloc(arena_t *arena, size_t count, size_t size);
+
+///Returns the current position of the arena
+arena_mark_t arena_get_mark(const arena_t *arena);
+
+///Releases all the allocations performed after mark was taken
+void arena_rewind(arena_t *arena, arena_mark_t mark);
+
+///Releases all the allocations, keeping the memory for the next use of the arena
+void arena_reset(arena_t *arena);
+
+///Gives back all the memory of the arena to the system
+void arena_release(arena_t *arena);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
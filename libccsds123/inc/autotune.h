@@ -0,0 +1,106 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+/**
+ * @file autotune.h
+ * @brief Search of the predictor and encoder parameters giving the smallest stream for the images of a
+ * sensor. The candidates are compared on the size of their stream, computed without writing it (see
+ * estimate_encoding) on a subset of the lines of a representative image, which is read only once: the
+ * candidates are evaluated in parallel, each thread predicting and encoding the shared samples with its
+ * own buffers.
+ * The search proceeds in two phases:
+ * - the predictor parameters are tuned by coordinate descent: the values of one parameter are tried at a
+ *   time, the other ones being kept at the best values found so far, and the passes over all the
+ *   parameters are repeated until none of them improves the stream (or for TUNING_MAX_PASSES passes).
+ *   This evaluates a number of candidates growing with the sum of the numbers of values, not with their
+ *   product; as the parameters interact, the result is a local optimum of the grid.
+ * - the image is predicted once with the best predictor, and every combination of the values of u_max,
+ *   y_star and k is encoded from these residuals, as the encoder parameters do not change them.
+ * The candidates the compression would reject (e.g. a y_star smaller than y_0 + 1) are skipped.
+ */
+
+#include "compress_ccsds123.h"
+
+// Maximum number of values tried for each parameter
+#define TUNING_MAX_VALUES 16
+
+// Maximum number of passes of the coordinate descent over the predictor parameters
+#define TUNING_MAX_PASSES 4
+
+///Parameters tuned by autotune_ccsds123; the first ones, up to TUNE_WEIGHT_FINAL, are the ones of the
+///predictor. TUNE_FULL and TUNE_NEIGHBOUR_SUM take 0 or 1.
+typedef enum
+{
+	TUNE_PRED_BANDS,
+	TUNE_FULL,
+	TUNE_NEIGHBOUR_SUM,
+	TUNE_WEIGHT_RESOLUTION,
+	TUNE_WEIGHT_INTERVAL,
+	TUNE_WEIGHT_INITIAL,
+	TUNE_WEIGHT_FINAL,
+	TUNE_U_MAX,
+	TUNE_Y_STAR,
+	TUNE_K,
+	TUNING_PARAMETERS
+} tuning_parameter_t;
+
+///Values tried for every parameter: the first num_values[p] elements of values[p]; a parameter without
+///values keeps the one of the configuration given to autotune_ccsds123
+typedef struct tuning_grid
+{
+	int values[TUNING_PARAMETERS][TUNING_MAX_VALUES];
+	unsigned int num_values[TUNING_PARAMETERS];
+} tuning_grid_t;
+
+///Outcome of a search
+typedef struct tuning_report
+{
+	// rate of the codewords (bits per sample, header excluded) of the lines evaluated, with the parameters
+	// given to autotune_ccsds123 and with the best ones
+	double baseline_rate;
+	double best_rate;
+	// candidates whose stream was computed, how many of them were predicted (the other ones reusing the
+	// residuals of the best predictor), and candidates skipped as invalid
+	unsigned int evaluated;
+	unsigned int predicted;
+	unsigned int skipped;
+	// passes of the coordinate descent over the predictor parameters
+	unsigned int passes;
+} tuning_report_t;
+
+///Sets the values tried for parameter to the count elements of values (at most TUNING_MAX_VALUES are kept)
+void tuning_grid_set(tuning_grid_t *grid, tuning_parameter_t parameter, const int *values, unsigned int count);
+
+/**
+ * @brief Searches the grid of parameters for the ones giving the smallest stream for the image of config,
+ * and sets the predictor and encoder parameters of config to them.
+ * @param config configuration of the compression of a representative image of the sensor, as for
+ * estimate_ccsds123: its parameters are the starting point of the search and must be valid. The sample
+ * adaptive encoder is required, and the initialization tables are not supported: init_table_file and
+ * init_weight_file must be empty (k and weight_init_resolution are used). memory_budget, when not 0, caps
+ * the memory of all the threads, whose number is reduced to fit in it.
+ * @param grid values tried for every parameter.
+ * @param line_step only one run of 16 lines every line_step ones is evaluated, as by estimate_ccsds123
+ * (0 or 1 evaluate the whole image).
+ * @param num_threads number of threads evaluating the candidates, the calling one included (0 means one
+ * per online processor).
+ * @param bestFile optional (NULL or empty when not used): file receiving the best parameters, on one line,
+ * as options of the compressor (e.g. "--pred_bands 3 --full --w_resolution 13 ... --k 7"), so that the
+ * settings tuned for a sensor can be saved and passed to the compressions of its images.
+ * @param report optional (NULL when not used), filled in with the outcome of the search.
+ * @retval 0 if the search went OK.
+ * @retval <0 the status code (see ccsds_status_t) of the problem the search ran into.
+ */
+int autotune_ccsds123(compressConfig_t *config, const tuning_grid_t *grid, unsigned int line_step, unsigned int num_threads,
+		char bestFile[128], tuning_report_t *report);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,40 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef BAND_INDEX_H
+#define BAND_INDEX_H
+
+/**
+ * @file band_index.h
+ * @brief Sidecar index of a compressed stream with BSQ output and the sample adaptive encoder, where the
+ * codewords of every band are contiguous and the statistics of the encoder are kept per band: with the
+ * position of the first codeword of every band each band can be decoded on its own, so that the bands can
+ * be decoded in parallel and a range of bands can be extracted without decoding the other ones.
+ * The stream itself is not modified and stays standard compliant.
+ * The index file holds, all in big endian order:
+ * - the 4 characters "CBIX";
+ * - the x, y and z sizes of the image, on 32 bits each;
+ * - z + 1 bit offsets on 64 bits: the one of the first codeword of every band, counted from the first bit
+ *   after the header of the stream, followed by the one of the end of the last band.
+ */
+
+#include "utils.h"
+
+///Writes to fileName the index of the stream of the image described by input_params, given the number
+///of bits of the codewords of every band (see band_bits in encoder_config_t)
+///@return 0 if the index was written, a negative value otherwise
+int write_band_index(char fileName[128], input_feature_t input_params, const unsigned long long *band_bits);
+
+///Reads from fileName the index of the stream of the image described by input_params, filling in the
+///z_size + 1 elements of band_offsets
+///@return 0 if the index was read, a negative value if it cannot be read or it was written for an image
+///of a different size
+int read_band_index(char fileName[128], input_feature_t input_params, unsigned long long *band_offsets);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
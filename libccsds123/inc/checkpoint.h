@@ -0,0 +1,90 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+/**
+ * @file checkpoint.h
+ * @brief Sidecar file of decode checkpoints of a compressed stream with BI output and the sample adaptive
+ * encoder, where the lines (row y of all the bands) follow each other in the stream: every interval lines
+ * the compressor saves what the decoder needs to resume from the line instead of from the first one, i.e.
+ * the position of the first codeword of the line, the statistics of the encoder, the weights of every band,
+ * the (0, 0) samples of the bands and the previous line. A range of lines of a long strip can then be
+ * extracted decoding only from the checkpoint before it, and the segments between the checkpoints can be
+ * decoded in parallel. The stream itself is not modified and stays standard compliant.
+ * The checkpoint file holds, all in big endian order:
+ * - the 4 characters "CBCP";
+ * - the x, y and z sizes of the image, the interval and the number of weights saved for a band, on 32 bits
+ *   each: the min(P, z - 1) weights of the previous bands (the compressor caps P to z - 1, while the header
+ *   of the stream keeps the requested P) followed, in full mode, by the 3 directional ones;
+ * - a record for every line y multiple of the interval (0 excluded) with: y on 32 bits; the bit offset of
+ *   the first codeword of the line on 64 bits, counted from the first bit after the header of the stream;
+ *   the counter and the accumulator of every band on 32 bits; the (0, 0) sample of every band on 16 bits;
+ *   the weights of every band on 32 bits (two's complement); the line y - 1 (row y - 1 of band z at z * x)
+ *   on 16 bits per sample.
+ */
+
+#include <stdio.h>
+
+#include "utils.h"
+#include "predictor.h"
+
+///Type holding the state of the decoding at the beginning of line y; the arrays are provided by the user
+typedef struct line_checkpoint
+{
+	unsigned int y;
+	unsigned long long bit_offset;
+	unsigned int *counter;
+	unsigned int *accumulator;
+	unsigned short int *origins;
+	int *weights;
+	unsigned short int *prev_line;
+} line_checkpoint_t;
+
+///Type representing an open checkpoint file; its fields are private to checkpoint.c
+typedef struct checkpoint_file
+{
+	FILE *file;
+	input_feature_t input_params;
+	// the weights of band z are at weights + z * (pred_bands + 3 * full) for the user of the file
+	unsigned int pred_bands;
+	unsigned int full;
+	unsigned int interval;
+	unsigned int weights_len;
+	unsigned char *record;
+	size_t record_size;
+} checkpoint_file_t;
+
+///Creates the checkpoint file fileName for the image described by input_params, with a checkpoint every
+///interval lines; the record buffer is allocated from arena
+///@return 0 if the file was created, a negative value otherwise
+int checkpoint_create(checkpoint_file_t *checkpoints, char fileName[128], input_feature_t input_params, predictor_config_t predictor_params,
+		unsigned int interval, arena_t *arena);
+
+///Appends to the file the checkpoint of line checkpoint->y, which must be the next multiple of the interval;
+///the weights of band z are at checkpoint->weights + z * (pred_bands + (full != 0 ? 3 : 0)), as in the predictor
+///@return 0 if the checkpoint was written, a negative value otherwise
+int checkpoint_write(checkpoint_file_t *checkpoints, const line_checkpoint_t *checkpoint);
+
+///Opens the checkpoint file fileName, checking that it was written for the image described by input_params
+///and the given predictor; the record buffer is allocated from arena
+///@return 0 if the file was opened, a negative value otherwise
+int checkpoint_open(checkpoint_file_t *checkpoints, char fileName[128], input_feature_t input_params, predictor_config_t predictor_params,
+		arena_t *arena);
+
+///Reads the checkpoint number index (the one of line (index + 1) * interval) into the arrays of checkpoint
+///@return 0 if the checkpoint was read, a negative value otherwise
+int checkpoint_read(checkpoint_file_t *checkpoints, unsigned int index, line_checkpoint_t *checkpoint);
+
+///Closes the checkpoint file
+///@return 0 if the operation succesfully completes, a negative value otherwise
+int checkpoint_close(checkpoint_file_t *checkpoints);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -13,15 +13,39 @@ extern "C"
  * and call the compress function on it. The library will perform some checks that the 
  * parameters are valid and, if so, will compress the image provided.
  * 
- * TODO: if there was any problem during compression, the library will return an error message.
- * 
- * TODO: the compress function will also return a structure with some statistics like compression
- * time, bytes of the compressed image, etc.
+ * If there was any problem during compression, a negative status code (see log.h) is returned; the
+ * error messages and the statistics of the compression (duration, compressed size) are reported to
+ * the optional log callback of the configuration. Nothing is written to stdout or stderr.
  */
 
 #include "predictor.h"
 #include "entropy_encoder.h"
 
+/**
+ * @typedef compress_engine_t
+ * @brief engines performing the compression, from the fastest to the one using the least memory;
+ * all of them produce the same compressed stream.
+ * - ENGINE_AUTO: the fastest engine whose estimated peak memory fits in the memory budget is used.
+ * - ENGINE_IN_MEMORY: the image and its residuals are kept in memory; prediction proceeds row by row,
+ *   keeping only the local differences of the current row of the last pred_bands + 1 bands (sliding window),
+ *   and it is followed by the encoding of the whole residuals cube.
+ * - ENGINE_FUSED: the image is kept in memory, but the residuals are encoded and written out as soon as
+ *   they are computed (see out_of_core.h).
+ * - ENGINE_OUT_OF_CORE: the image is streamed from the input file too (see out_of_core.h); it requires
+ *   the regular (16 bits per sample) input representation.
+ * - ENGINE_PIPELINED: as ENGINE_OUT_OF_CORE, but reading, prediction and encoding run on three threads,
+ *   overlapping the input and output with the prediction (see out_of_core.h). It is never chosen by
+ *   ENGINE_AUTO, which only uses the calling thread.
+ */
+typedef enum
+{
+	ENGINE_AUTO,
+	ENGINE_IN_MEMORY,
+	ENGINE_FUSED,
+	ENGINE_OUT_OF_CORE,
+	ENGINE_PIPELINED
+} compress_engine_t;
+
 /**
  * @typedef compressConfig_t
  * @brief this is the main configuration structure that has to be filled in to call the compression algorithm.
@@ -29,9 +53,35 @@ extern "C"
  * @param out_file the name of the file where the compressed image has to be written.
  * @param init_table_file optional, name of the file where the initial table is.
  * @param init_weight_file optional, file where the initial weights are specified.
+ * @param band_index_file optional, file where the band index of the compressed stream is written (see
+ * band_index.h), allowing the bands to be decoded in parallel; it requires the BSQ output interleaving and
+ * the sample adaptive encoder.
+ * @param checkpoint_file optional, file where a decode checkpoint is saved every checkpoint_interval lines
+ * (see checkpoint.h), allowing a range of lines to be decoded without decoding the ones before it and the
+ * segments between the checkpoints to be decoded in parallel; it requires the BI output interleaving, the
+ * sample adaptive encoder and the fused or out of core engine (ENGINE_AUTO then only chooses among those).
+ * @param checkpoint_interval number of lines between two checkpoints, when checkpoint_file is given.
+ * @param adapted_weights_file optional, file where the weights of every band, as adapted by the predictor
+ * at the end of the band, are written in the format of init_weight_file, so that the next images of the same
+ * sensor can start from them instead of the default weights.
+ * @param adapted_weights_resolution weight_init_resolution the weights are written with, between 3 and
+ * weight_resolution + 3; at weight_resolution + 3 the compressions starting from the file get back the weights
+ * saved (but for the largest possible one, which comes back one less), at lower resolutions the weights rounded
+ * as described by write_weights_table. The compressions reading the file must use this resolution.
  * @param input_params characteristics of the input image (size, resolution, mode).
  * @param encoder_params parameters that control the encoding stage.
  * @param predictor_params parameters that control the prediction stage of the algorithm.
+ * @param engine optional, engine performing the compression (ENGINE_AUTO by default).
+ * @param io_backend optional, backend used to read the samples and to write the compressed stream
+ * (IO_BACKEND_STDIO by default), to match the storage they are on (see io_backend.h).
+ * @param memory_budget optional, maximum number of bytes of memory used by the compression (0 means no
+ * limit); the compression fails when the estimated peak memory of the selected engine is bigger.
+ * @param arena optional, arena (see arena.h) the buffers of the compression are allocated from; it is reset
+ * when the compression ends. When NULL, a temporary arena is used. Using the same arena for consecutive
+ * images avoids any heap allocation once it has grown to the needed size.
+ * @param log_callback optional, callback receiving the error messages and the statistics (e.g. log_to_stdio);
+ * when NULL nothing is reported.
+ * @param log_user_data optional, passed to log_callback with every message.
  */
 typedef struct compressConfig
 {
@@ -39,19 +89,155 @@ typedef struct compressConfig
 	char out_file[128];
 	char init_table_file[128];
 	char init_weight_file[128];
+	char band_index_file[128];
+	char checkpoint_file[128];
+	unsigned int checkpoint_interval;
+	char adapted_weights_file[128];
+	unsigned char adapted_weights_resolution;
 	input_feature_t input_params;
 	encoder_config_t encoder_params;
 	predictor_config_t predictor_params;
+	compress_engine_t engine;
+	io_backend_t io_backend;
+	size_t memory_budget;
+	arena_t *arena;
+	log_callback_t log_callback;
+	void *log_user_data;
 } compressConfig_t;
 
 /**
  * @brief Receives the configuration for the compression algorithm and performs compression.
  * @param config structure where all the configuration is available.
  * @retval 0 if compression went OK.
- * @retval -1 if compression ran into any problem.
+ * @retval <0 the status code (see ccsds_status_t) of the problem compression ran into.
  */
 int compress_ccsds123(compressConfig_t *config);
 
+/**
+ * @brief Transcodes a compressed stream into one using a different entropy encoder: the stream is decoded
+ * into its mapped residuals only, which are then encoded again, so the predictor never runs (neither to
+ * reconstruct the samples nor to predict them again). The transcoded stream is the one compress_ccsds123
+ * writes for the original image with the predictor of compressedFile and the encoder of config.
+ * @param config configuration of the transcoded stream: encoder_params (sample or block adaptive encoder
+ * and its parameters, output interleaving, word size) and init_table_file describe the new encoder;
+ * out_file, band_index_file, io_backend, arena and the log callback are used as by compress_ccsds123.
+ * input_params and predictor_params are filled in with the ones of the header of compressedFile (the weight
+ * initialization table it holds, if any, is kept); samples_file, init_weight_file, engine and memory_budget
+ * are not used and checkpoint_file and adapted_weights_file must be empty.
+ * @param compressedFile file holding the compressed stream to be transcoded, read through io_backend.
+ * @retval 0 if the transcoding went OK.
+ * @retval <0 the status code (see ccsds_status_t) of the problem transcoding ran into.
+ */
+int transcode_ccsds123(compressConfig_t *config, char compressedFile[128]);
+
+/**
+ * @brief Computes the size of the stream compress_ccsds123 would write for the image, without writing it:
+ * the image is predicted in memory and the encoder only counts the bits of the codewords it selects, so
+ * that parameters can be compared by running the estimation many times.
+ * @param config configuration of the compression, as for compress_ccsds123: out_file, band_index_file,
+ * checkpoint_file, adapted_weights_file and engine are not used.
+ * @param line_step when greater than 1 only one line every line_step ones is predicted and encoded, giving
+ * an approximate answer in a fraction of the time: the lines are taken in runs of 16 consecutive ones (the
+ * first run included), which are put together into an image of their own, and the sizes of its codewords
+ * are scaled to the whole image. 0 or 1 give the exact sizes of the stream of the whole image.
+ * @param estimate filled in with the size of the stream, the number of escapes and, when its arrays are
+ * not NULL, the bits and the escapes of every band (see rate_estimate_t).
+ * @retval 0 if the estimation went OK.
+ * @retval <0 the status code (see ccsds_status_t) of the problem the estimation ran into.
+ */
+int estimate_ccsds123(compressConfig_t *config, unsigned int line_step, rate_estimate_t *estimate);
+
+/**
+ * @brief Checks the parameters of the image, of the predictor and of the encoder of a compression, as
+ * compress_ccsds123 does before touching any file (e.g. to filter out the invalid candidates of a search over
+ * the parameters): pred_bands is capped to the number of bands as by compress_ccsds123.
+ * @param config configuration of the compression; only input_params, encoder_params, predictor_params,
+ * init_table_file, init_weight_file and the log callback are used, and no file is opened.
+ * @retval 0 if the parameters are valid.
+ * @retval <0 the status code of the problem.
+ */
+int compress_check_config(compressConfig_t *config);
+
+/**
+ * @brief Checks the configuration and the files of a compression and parses its initialization tables,
+ * for the drivers performing the compression stages on their own (e.g. the scheduler of scheduler.h).
+ * @param config configuration of the compression; the tables (encoder_params.k_init and, when
+ * init_weight_file is given, predictor_params.weight_init_table) are set to point to the parsed ones. The
+ * checkpoints and the adapted weights are not supported by these drivers: checkpoint_file and
+ * adapted_weights_file must be empty.
+ * @param arena arena the tables are allocated from.
+ * @retval 0 if the configuration is valid.
+ * @retval <0 the status code of the problem.
+ */
+int compress_prepare(compressConfig_t *config, arena_t *arena);
+
+/**
+ * @typedef compress_session_t
+ * @brief compression session, for compressing many images sharing the same size and parameters: the
+ * configuration is checked and the initialization tables are parsed once, when the session is created,
+ * and the memory needed by the compressions is allocated once too and then reused. Samples are read
+ * from and the compressed stream is written to memory buffers, and no statistics are printed.
+ * A session must not be used by two threads at the same time, but different sessions are independent
+ * and can be used concurrently.
+ */
+typedef struct compress_session compress_session_t;
+
+/**
+ * @brief Creates a compression session.
+ * @param config configuration of the compressions; samples_file, out_file, engine, memory_budget and arena
+ * are not used (the session owns its memory and always uses the fused streaming engine), io_backend only by
+ * compress_session_compress_files. The band index, the checkpoints and the adapted weights are not written
+ * by the sessions: band_index_file, checkpoint_file and adapted_weights_file must be empty. The log callback
+ * is used for the creation and for all the compressions of the session.
+ * @param session where the created session is returned (NULL in case of error).
+ * @retval 0 if the session was created.
+ * @retval <0 the status code of the problem, e.g. an invalid configuration or table.
+ */
+int compress_session_create(const compressConfig_t *config, compress_session_t **session);
+
+/**
+ * @brief Returns the maximum number of bytes of the compressed stream of an image compressed by the session.
+ */
+size_t compress_session_bound(const compress_session_t *session);
+
+/**
+ * @brief Compresses an image with the parameters of the session.
+ * @param session the session.
+ * @param samples the samples of the image, one per element (in the host byte ordering) in the order given by
+ * the input interleaving of the session; signed samples are in two's complement.
+ * @param stream buffer where the compressed stream is written.
+ * @param stream_capacity size in bytes of stream; compress_session_bound bytes are always enough.
+ * @return the number of bytes of the compressed stream, the negative status code (see ccsds_status_t) of the
+ * problem compression ran into otherwise.
+ */
+long long compress_session_compress(compress_session_t *session, const unsigned short int *samples, unsigned char *stream, size_t stream_capacity);
+
+/**
+ * @brief Compresses a batch of image files with the parameters of the session, overlapping the input and
+ * output of the images with their compression: while the calling thread compresses image n, a reader
+ * thread loads image n + 1 (converting it to BSQ order) into a second image buffer and a writer thread
+ * writes the compressed stream of image n - 1 from a second stream buffer. The files are read and written
+ * through the I/O backend of the session; the compressed streams are identical to the ones of
+ * compress_ccsds123. The buffers of the batch are allocated from the memory of the session, which keeps
+ * it for the next batches.
+ * @param session the session.
+ * @param inputFiles names of the files holding the samples of the images, as samples_file of compressConfig_t.
+ * @param outputFiles names of the files where the compressed streams of the images are written.
+ * @param count number of images of the batch.
+ * @param compressed_bytes when not NULL, filled in with the number of bytes of the compressed stream of
+ * every image, or with the negative status code of the problem it ran into; the problem of an image does
+ * not stop the compression of the other ones.
+ * @retval 0 if all the images were compressed.
+ * @retval <0 the status code of the problem of the first image which could not be compressed.
+ */
+int compress_session_compress_files(compress_session_t *session, const char *const *inputFiles, const char *const *outputFiles,
+		unsigned int count, long long *compressed_bytes);
+
+/**
+ * @brief Destroys the session, giving back all its memory.
+ */
+void compress_session_destroy(compress_session_t *session);
+
 #endif
 
 #ifdef __cplusplus
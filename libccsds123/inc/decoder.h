@@ -64,43 +64,126 @@ typedef struct encoder_config
 	unsigned char block_size;
 	unsigned char restricted;
 	unsigned int ref_interval;
+	// optional: when not NULL, the number of bits of the codewords of every band is accumulated here,
+	// for the band index (see band_index.h)
+	unsigned long long *band_bits;
+	// optional: when not NULL, the streaming engines with BI output save a decode checkpoint here every
+	// interval lines (see checkpoint.h)
+	struct checkpoint_file *checkpoints;
 } encoder_config_t;
 
 /// Reads a compressed sample when compressed using the sample adaptive encoding method.
 int read_element_sample(FILE *compressedStream, encoder_config_t encoder_params, input_feature_t input_params,
 		unsigned int temp_k, unsigned char *buffer, unsigned int *buffer_len);
+/// Returns the parameter k of the codeword of the next residual of a band compressed with the sample
+/// adaptive method, from the statistics of the band (its counter and accumulator)
+unsigned int sample_codeword_k(input_feature_t input_params, unsigned int counter, unsigned int accumulator);
+/// Updates the statistics of a band compressed with the sample adaptive method with its residual just decoded
+void update_sample_statistics(encoder_config_t encoder_params, unsigned int *counter, unsigned int *accumulator, unsigned int residual);
 /// Main routine for decoding the input stream compressed according to the sample adaptive
 /// method: it iterates over the various compressed samples, calling read_element_sample to extract
 /// each of them from the compressed stream
 int decode_sample_adaptive(FILE *compressedStream, input_feature_t input_params, encoder_config_t encoder_params,
-		unsigned short int *residuals);
+		void *residuals, arena_t *arena);
 
-/// Reads a compressed block when using the block adaptive encoding method.
+/// Reads a compressed block when using the block adaptive encoding method; the residuals of the
+/// block are saved in block, in the order of the stream.
 int read_nocomp_block(input_feature_t input_params, encoder_config_t encoder_params, FILE *compressedStream,
-		unsigned short int *residuals, unsigned int *read_elems, unsigned char *buffer,
+		unsigned int *block, size_t *read_elems, unsigned char *buffer,
 		unsigned int *buffer_len, unsigned int block_size);
 int read_second_block(input_feature_t input_params, encoder_config_t encoder_params, FILE *compressedStream,
-		unsigned short int *residuals, unsigned int *read_elems, unsigned char *buffer,
+		unsigned int *block, size_t *read_elems, unsigned char *buffer,
 		unsigned int *buffer_len, unsigned int block_size);
 int read_ksplit_block(input_feature_t input_params, encoder_config_t encoder_params, FILE *compressedStream,
-		unsigned int k, unsigned short int *residuals, unsigned int *read_elems,
+		unsigned int k, unsigned int *block, size_t *read_elems,
 		unsigned char *buffer, unsigned int *buffer_len, unsigned int block_size);
 int read_zero_block(input_feature_t input_params, encoder_config_t encoder_params, FILE *compressedStream,
-		unsigned short int *residuals, unsigned int *read_elems, unsigned char *buffer, unsigned int *buffer_len);
+		size_t *read_elems, unsigned char *buffer, unsigned int *buffer_len);
 /// Main routine for decoding the input stream compressed according to the block adaptive
 /// method: it determines the compression method for the block and the calls the appropriate
 /// routine for its decoding.
 int decode_block_adaptive(FILE *compressedStream, input_feature_t input_params,
-		encoder_config_t encoder_params, unsigned short int *residuals);
+		encoder_config_t encoder_params, void *residuals);
 
-/// Reads the compressed file header, filling-in the appropriate data structures
+///Type holding the state of the decoding of a stream whose residuals are returned a chunk at a time
+///(see decode_residuals): the position in the stream, the bits read ahead and the statistics of the
+///encoder
+typedef struct decoder_state
+{
+	size_t read_elems;
+	unsigned char buffer;
+	unsigned int buffer_len;
+	// sample adaptive: statistics of every band
+	unsigned int *counter;
+	unsigned int *accumulator;
+	// block adaptive: residuals of the last block read not returned yet
+	unsigned int block[64];
+	unsigned int block_len;
+	unsigned int block_pos;
+	size_t zero_residuals;
+} decoder_state_t;
+
+/// Returns the number of bytes of memory allocated by init_decoder_state
+size_t decoder_state_size(input_feature_t input_params);
+
+/// Prepares the decoding of the stream from its first residual (the header has already been read),
+/// allocating the statistics of the sample adaptive encoder from arena
+int init_decoder_state(input_feature_t input_params, encoder_config_t encoder_params, decoder_state_t *state, arena_t *arena);
+
+/// Brings the decoding back to the first residual of the stream (the initial statistics, nothing read ahead),
+/// keeping the buffers of state; the stream itself is not moved
+void reset_decoder_state(input_feature_t input_params, encoder_config_t encoder_params, decoder_state_t *state);
+
+/// Moves the decoding to residual read_elems (in the order of the stream) of a stream compressed with the
+/// sample adaptive method, whose codeword starts at bit first_bit of the stream (e.g. from a checkpoint,
+/// see checkpoint.h); the statistics in state are not modified, they are restored by the caller
+/// @return 0 if the stream was moved, a negative value in case of error
+int seek_decoder_state(FILE *compressedStream, decoder_state_t *state, size_t read_elems, unsigned long long first_bit);
+
+/// Decodes the next count residuals of the stream, saving them in residuals in the order of the stream
+/// (i.e. out_interleaving); the residuals decoded by consecutive calls are the same ones decode produces.
+/// @return 0 if the residuals were decoded, a negative value in case of error
+int decode_residuals(FILE *compressedStream, input_feature_t input_params, encoder_config_t encoder_params,
+		decoder_state_t *state, unsigned short int *residuals, size_t count);
+
+/// Decodes the residuals of band z of a BSQ stream compressed with the sample adaptive method, whose
+/// first codeword starts at bit first_bit of the stream (see band_index.h), saving them in residuals
+/// (in BSQ order); the statistics of the band in state must be the initial ones (see init_decoder_state).
+/// Different bands can be decoded at the same time, by different threads, with the same state.
+/// @return 0 if the band was decoded, a negative value in case of error
+int decode_band(FILE *compressedStream, input_feature_t input_params, encoder_config_t encoder_params,
+		decoder_state_t *state, unsigned int z, unsigned long long first_bit, void *residuals);
+
+/// Reads the compressed file header, filling-in the appropriate data structures; the
+/// accumulator and weight initialization tables are allocated from arena
 int read_header(FILE *compressedStream, input_feature_t *input_params, encoder_config_t *encoder_params,
-		predictor_config_t *predictor_params);
+		predictor_config_t *predictor_params, arena_t *arena);
+
+/// Reads the header of the compressed stream saved in inputFile, filling in the image and predictor
+/// parameters without decoding the stream; the tables contained in the header are not kept
+int peek_header(char inputFile[128], input_feature_t *input_params, predictor_config_t *predictor_params, arena_t *arena);
+
+/// Returns the number of bytes of memory allocated by decode: the residuals and the decoder statistics
+size_t decode_working_set(input_feature_t input_params);
 
 /// Main decoder function, from the file containing the compressed stream it produces the
 /// file containins the mapped residuals, stored in BSQ format.
-int decode(input_feature_t *input_params, predictor_config_t *predictor_params,
-		unsigned short int **residuals, char inputFile[128]);
+/// The residuals and the weight initialization table of predictor_params are allocated from arena; inputFile
+/// is read through the given I/O backend (see io_open_stream).
+/// When bandIndexFile is not NULL nor empty, the bands are found through the band index it holds (see
+/// band_index.h) and decoded by num_threads threads, the calling one included (0 means one per online
+/// processor).
+/// When num_bands is not 0 only the first num_bands bands of a BSQ stream are decoded, stopping the decoding
+/// after the last residual of band num_bands - 1: residuals then holds the x_size * y_size * num_bands
+/// residuals of those bands, while input_params is still filled in with the image of the stream.
+int decode(input_feature_t *input_params, predictor_config_t *predictor_params, void **residuals, char inputFile[128],
+		char bandIndexFile[128], unsigned int num_threads, unsigned int num_bands, io_backend_t backend, arena_t *arena);
+
+/// Decodes, as decode does, the stream whose header starts at the current position of compressedStream
+/// (e.g. one of the streams of a container, see tile_container.h), without the band index; the rest of
+/// compressedStream after the stream is not read.
+int decode_stream(FILE *compressedStream, input_feature_t *input_params, predictor_config_t *predictor_params, void **residuals,
+		unsigned int num_bands, arena_t *arena);
 
 #endif
 
@@ -13,40 +13,108 @@ extern "C"
  * and call the decompress function on it. The library will perform some checks that the 
  * parameters are valid and, if so, will decompress the compressed image provided.
  * 
- * TODO: if there was any problem during decompression, the library will return an error message.
- * 
- * TODO: the decompress function will also return a structure with some statistics.
+ * If there was any problem during decompression, a negative status code (see log.h) is returned; the
+ * error messages and the statistics of the decompression are reported to the optional log callback
+ * of the configuration. Nothing is written to stdout or stderr.
  */
 
 #include "utils.h"
 #include "predictor.h"
 
+/**
+ * @typedef decompress_engine_t
+ * @brief engines performing the decompression:
+ * - DECOMPRESS_ENGINE_IN_MEMORY: the whole stream is decoded into the residuals of the image, which is
+ *   then reconstructed in memory and written out.
+ * - DECOMPRESS_ENGINE_PIPELINED: decoding, unprediction and the writing of the samples run on three
+ *   threads passing each other lines or bands of the image (see pipelined_decoder.h); neither the
+ *   residuals nor the image are kept in memory. Residuals cannot be dumped with this engine.
+ */
+typedef enum
+{
+	DECOMPRESS_ENGINE_IN_MEMORY,
+	DECOMPRESS_ENGINE_PIPELINED
+} decompress_engine_t;
+
 /**
  * @typedef decompressConfig_t
  * @brief this is the main configuration structure that has to be filled in to perform decompression.
  * @param in_file name of the input file with the compressed image.
  * @param out_file name of the output file with the decompressed image.
+ * @param band_index_file optional, name of the file with the band index written with the compressed image
+ * (see band_index.h): the bands are then decoded in parallel. Only used by DECOMPRESS_ENGINE_IN_MEMORY.
+ * @param num_threads optional, number of threads decoding the bands when band_index_file is given (0 means
+ * one per online processor).
+ * @param checkpoint_file optional, name of the file with the checkpoints written with the compressed image
+ * (see checkpoint.h): the decoding resumes from the checkpoint before first_line and the segments between
+ * the checkpoints are decoded in parallel by num_threads threads.
+ * @param first_line optional, first line of the range of lines to decompress (0 by default).
+ * @param num_lines optional, number of lines to decompress (0 means all the lines from first_line on); the
+ * output file then holds an image of num_lines lines.
+ * When checkpoint_file, first_line or num_lines is given, the stream must have the BI output interleaving
+ * and it is decompressed a line at a time (see segment_decoder.h), with neither engine: the residuals
+ * cannot be dumped and the band index is not used.
+ * @param num_bands optional, number of bands to decompress (0 means all the bands): the stream must have the
+ * BSQ output interleaving, its decoding stops after band num_bands - 1 and the output file holds an image of
+ * the first num_bands bands. It cannot be combined with a range of lines.
  * @param dump_residuals if the user wants to dump the residuals to an external file or not.
  * @param input_params parameters of the original input image.
  * @param predictor_params parameters that were used in the predictor and that are needed now to decompress.
+ * @param engine optional, engine performing the decompression (DECOMPRESS_ENGINE_IN_MEMORY by default).
+ * @param io_backend optional, backend used to read the compressed stream and to write the decompressed
+ * image (IO_BACKEND_STDIO by default), to match the storage they are on (see io_backend.h).
+ * @param memory_budget optional, maximum number of bytes of memory used by the decompression (0 means no
+ * limit); the decompression fails when its estimated peak memory is bigger.
+ * @param arena optional, arena (see arena.h) the buffers of the decompression are allocated from; it is
+ * reset when the decompression ends. When NULL, a temporary arena is used.
+ * @param log_callback optional, callback receiving the error messages and the statistics (e.g. log_to_stdio);
+ * when NULL nothing is reported.
+ * @param log_user_data optional, passed to log_callback with every message.
  */ 
 typedef struct decompressConfig
 {
 	char in_file[128];
 	char out_file[128];
+	char band_index_file[128];
+	unsigned int num_threads;
+	char checkpoint_file[128];
+	unsigned int first_line;
+	unsigned int num_lines;
+	unsigned int num_bands;
 	unsigned char dump_residuals;
 	input_feature_t input_params;
 	predictor_config_t predictor_params;
+	decompress_engine_t engine;
+	io_backend_t io_backend;
+	size_t memory_budget;
+	arena_t *arena;
+	log_callback_t log_callback;
+	void *log_user_data;
 } decompressConfig_t;
 
 /**
  * @brief Receives the configuration for the decompression algorithm and performs decompression.
  * @param config structure where all the configuration is available.
  * @retval 0 if decompression went OK.
- * @retval -1 if decompression ran into any problem.
+ * @retval <0 the status code (see ccsds_status_t) of the problem decompression ran into.
  */
 int decompress_ccsds123(decompressConfig_t *config);
 
+/**
+ * @brief Decodes the compressed stream config->in_file into its mapped residuals, without reconstructing the
+ * samples, e.g. to encode them again with a different encoder (see transcode_ccsds123).
+ * @param config configuration of the decompression: input_params and predictor_params are filled in with
+ * the parameters of the header; in_file is read through io_backend and, when band_index_file is given, its
+ * bands are decoded in parallel by num_threads threads. The other options are not used.
+ * @param residuals where the residuals are returned, stored in BSQ order with SAMPLE_BYTES(input_params)
+ * bytes each (see utils.h).
+ * @param arena arena the residuals and the weight initialization table of predictor_params are allocated
+ * from; they are valid until the caller resets it.
+ * @retval 0 if the residuals were decoded.
+ * @retval <0 the status code (see ccsds_status_t) of the problem decoding ran into.
+ */
+int decompress_residuals(decompressConfig_t *config, void **residuals, arena_t *arena);
+
 #endif
 
 #ifdef __cplusplus
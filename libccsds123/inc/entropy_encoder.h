@@ -62,8 +62,70 @@ typedef struct encoder_config
 	unsigned char block_size;
 	unsigned char restricted;
 	unsigned int ref_interval;
+	// optional: when not NULL, the number of bits of the codewords of every band is accumulated here,
+	// for the band index (see band_index.h)
+	unsigned long long *band_bits;
+	// optional: when not NULL, the streaming engines with BI output save a decode checkpoint here every
+	// interval lines (see checkpoint.h)
+	struct checkpoint_file *checkpoints;
 } encoder_config_t;
 
+///State of the entropy encoder when the residuals are encoded one at a time, in the order in
+///which they are saved in the output stream: the statistics of each band for the sample adaptive
+///encoder, the block being filled and the pending zero blocks for the block adaptive one
+typedef struct encoder_state
+{
+	unsigned int *counter;
+	unsigned int *accumulator;
+	unsigned short int *block_samples;
+	int read_samples;
+	int all_zero;
+	int num_zero_blocks;
+	int segment_idx;
+	int reference_samples;
+	unsigned long long *band_bits;
+	// residuals of the sample adaptive encoder saved uncompressed after u_max zeros (only counted together
+	// with band_bits), blocks of the block adaptive encoder coded without compression
+	unsigned long long escapes;
+	// optional: when not NULL (and band_bits is not NULL either), the escapes of every band of the sample
+	// adaptive encoder are counted here
+	unsigned long long *band_escapes;
+} encoder_state_t;
+
+///Allocates from arena and initializes the state of the encoder
+///@return a negative number if an error occurred
+int init_encoder_state(input_feature_t input_params, encoder_config_t encoder_params, encoder_state_t *state, arena_t *arena);
+
+///Returns the number of bytes of memory allocated by init_encoder_state
+size_t encoder_state_size(input_feature_t input_params, encoder_config_t encoder_params);
+
+///Encodes the residual of the sample (x, y, z), which must be the next one in the order
+///used by the output stream (BSQ or BI with the configured interleaving depth)
+///@return a negative number if an error occurred
+int encode_residual(input_feature_t input_params, encoder_config_t encoder_params, encoder_state_t *state,
+		unsigned int x, unsigned int y, unsigned int z, unsigned short int residual,
+		unsigned char *compressed_stream, size_t *written_bytes, unsigned int *written_bits);
+
+///Completes the encoding once all the residuals have been passed to encode_residual
+void finish_encoding(input_feature_t input_params, encoder_config_t encoder_params, encoder_state_t *state,
+		unsigned char *compressed_stream, size_t *written_bytes, unsigned int *written_bits);
+
+///Returns the maximum number of bytes of the header, including the optional tables
+size_t header_size_bound(input_feature_t input_params, predictor_config_t predictor_params);
+
+///Creates the header and adds it to the output stream.
+void create_header(size_t *written_bytes, unsigned int *written_bits, unsigned char *compressed_stream,
+		input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params);
+
+///Pads the compressed stream with zeros up to a multiple of the output word size;
+///flushed_bytes is the number of bytes of the stream already written out of compressed_stream
+void pad_to_word(encoder_config_t encoder_params, unsigned char *compressed_stream, size_t *written_bytes,
+		unsigned int *written_bits, size_t flushed_bytes);
+
+///Returns the number of bytes of memory allocated by encode: the buffer holding the whole
+///compressed stream and the encoder state (the residuals are allocated by the caller)
+size_t encode_working_set(input_feature_t input_params, encoder_config_t encoder_params);
+
 ///Main function for the entropy encoding of a given input file; while it works for any input file,
 ///it is though to be used when the input file encodes the residuals of each pixel of an image after
 ///the lossless compression step
@@ -71,10 +133,38 @@ typedef struct encoder_config
 ///@param encoder_params set of options determining the behavior of the encoder
 ///@param inputFile file containing the information to be compressed
 ///@param outputFile file where the compressed information will be stored
+///@param backend I/O backend the output file is written with
+///@param arena allocator providing the temporary buffers, which are released before returning
 ///@return the number of bytes which compose the compressed stream, a negative value if an error
 ///occurred
-int encode(input_feature_t input_params, encoder_config_t encoder_params, predictor_config_t predictor_params,
-		unsigned short int *residuals, char outputFile[128]);
+long long encode(input_feature_t input_params, encoder_config_t encoder_params, predictor_config_t predictor_params,
+		void *residuals, char outputFile[128], io_backend_t backend, arena_t *arena);
+
+///Size of the stream the encoder produces for an image, computed by estimate_encoding without writing it
+typedef struct rate_estimate
+{
+	// bytes of the stream, header and padding to the output word included
+	unsigned long long stream_bytes;
+	// bits of the header, tables included
+	unsigned long long header_bits;
+	// bits of the codewords of the residuals (and of the blocks for the block adaptive encoder)
+	unsigned long long codeword_bits;
+	// residuals saved uncompressed after u_max zeros by the sample adaptive encoder, blocks coded without
+	// compression by the block adaptive one
+	unsigned long long escapes;
+	// optional (NULL when not used): z_size elements receiving the bits of the codewords and the escapes of
+	// every band; they are only filled in by the sample adaptive encoder, and are all 0 with the block
+	// adaptive one
+	unsigned long long *band_bits;
+	unsigned long long *band_escapes;
+} rate_estimate_t;
+
+///Computes the size of the stream encode would produce for the residuals (stored in BSQ order), running the
+///encoder without writing the stream: the result is exact, and the time taken is the one of the codeword
+///selection alone. The temporary buffers are allocated from arena and released before returning.
+///@return 0 if the size was computed, a negative value otherwise
+int estimate_encoding(input_feature_t input_params, encoder_config_t encoder_params, predictor_config_t predictor_params,
+		void *residuals, rate_estimate_t *estimate, arena_t *arena);
 
 #endif
 
@@ -0,0 +1,119 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef IO_BACKEND_H
+#define IO_BACKEND_H
+
+/**
+ * @file io_backend.h
+ * @brief Access to the files of the compression and of the decompression (the samples, the compressed
+ * stream and the decompressed image) through interchangeable backends, so that the way the bulk data is
+ * moved can match the storage it lives on:
+ * - IO_BACKEND_STDIO: buffered stdio streams with a large buffer; good default for local disks.
+ * - IO_BACKEND_MMAP: the file is mapped in memory with a sequential access hint (madvise), so that the
+ *   kernel reads ahead aggressively and no copy through a stdio buffer is made.
+ * - IO_BACKEND_PREAD: positioned reads and writes; the big ones (e.g. a whole band) are split in
+ *   contiguous ranges transferred by several threads at once, which keeps many requests in flight on
+ *   NVMe drives and network file systems.
+ * - IO_BACKEND_DIRECT: O_DIRECT transfers through aligned buffers, bypassing the page cache, for cubes
+ *   bigger than it; when the file system does not support O_DIRECT the transfers go through the page
+ *   cache, with the same aligned buffers.
+ * On systems without mmap and pread (e.g. WIN32) all the backends use stdio.
+ * The buffers of the backends are allocated from the heap when the file is opened and released when it
+ * is closed.
+ */
+
+#include <stdio.h>
+#include <stddef.h>
+
+///Backends available to access the files
+typedef enum
+{
+	IO_BACKEND_STDIO,
+	IO_BACKEND_MMAP,
+	IO_BACKEND_PREAD,
+	IO_BACKEND_DIRECT
+} io_backend_t;
+
+///Mode a file is opened with: IO_WRITE creates the file (truncating it if it exists), which can then be
+///read back too
+typedef enum
+{
+	IO_READ,
+	IO_WRITE
+} io_mode_t;
+
+///Type representing a file opened through a backend; its fields are private to io_backend.c
+typedef struct io_file
+{
+	io_backend_t backend;
+	io_mode_t mode;
+	// IO_BACKEND_STDIO: the stream and its current position
+	FILE *stream;
+	unsigned long long position;
+	// the other backends: the file descriptor
+	int fd;
+	// IO_BACKEND_MMAP: the mapping, which is bigger than the file when writing
+	unsigned char *map;
+	size_t map_size;
+	// IO_BACKEND_DIRECT: the aligned buffer and the written bytes it holds, not yet on the file
+	unsigned char *buffer;
+	unsigned long long pending_offset;
+	size_t pending_bytes;
+	// IO_BACKEND_STDIO: whether the last operation on the stream was a write
+	int writing;
+	// io_open_stream: the copy of the file the stream reads from
+	unsigned char *contents;
+	// number of bytes of the file
+	unsigned long long size;
+} io_file_t;
+
+///Returns the name of the backend, for the statistics
+const char *io_backend_name(io_backend_t backend);
+
+///Opens the file name through the given backend
+///@return 0 if the file was opened, a negative value otherwise
+int io_open(io_file_t *file, io_backend_t backend, const char *name, io_mode_t mode);
+
+///Returns the number of bytes of the file
+unsigned long long io_size(const io_file_t *file);
+
+///Reads up to bytes bytes of the file, starting at offset, into buffer
+///@return the number of bytes read, smaller than bytes only when the end of the file is reached,
+///a negative value in case of error
+long long io_read(io_file_t *file, unsigned long long offset, void *buffer, size_t bytes);
+
+///Writes bytes bytes of buffer in the file, starting at offset (which can be past the end of the file)
+///@return 0 if the operation succesfully completes, a negative value otherwise
+int io_write(io_file_t *file, unsigned long long offset, const void *buffer, size_t bytes);
+
+///Writes bytes bytes of buffer at the end of the file
+///@return 0 if the operation succesfully completes, a negative value otherwise
+int io_append(io_file_t *file, const void *buffer, size_t bytes);
+
+///Closes the file, completing the writes still pending
+///@return 0 if the operation succesfully completes, a negative value otherwise
+int io_close(io_file_t *file);
+
+///Opens the file name for reading as a stdio stream, for the parsers consuming it a few bits at a time
+///(e.g. the entropy decoder): with IO_BACKEND_STDIO the file is opened with a large buffer; with the
+///other backends the whole file is read through the backend (or mapped, for IO_BACKEND_MMAP) and the
+///stream reads from memory. file must be passed to io_close_stream when the stream is not needed anymore.
+///@return the stream, NULL in case of error
+FILE *io_open_stream(io_file_t *file, io_backend_t backend, const char *name);
+
+///Closes a stream opened with io_open_stream
+void io_close_stream(io_file_t *file, FILE *stream);
+
+///Moves the stdio stream (e.g. one opened with io_open_stream) to the byte offset from its start, with
+///64 bits offsets also on the systems where long has 32 bits
+///@return 0 if the operation succesfully completes, a negative value otherwise
+int io_seek_stream(FILE *stream, unsigned long long offset);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
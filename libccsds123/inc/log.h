@@ -0,0 +1,78 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef LOG_H
+#define LOG_H
+
+/**
+ * @file log.h
+ * @brief Status codes returned by the library and reporting of its errors and statistics.
+ * The library never writes to stdout or stderr: every public function installs, for the duration of
+ * the call, a log context holding the callback chosen by the user (see compressConfig_t and
+ * decompressConfig_t). Contexts are per thread, so concurrent calls from different threads each
+ * report to their own callback; when no callback is set, nothing is reported. The calls running parts
+ * of their work on other threads (e.g. the pipelined engine and the scheduler) invoke the callback from
+ * those threads too.
+ * The first error reported during a call determines the status code the call returns.
+ */
+
+/// Status codes of the public functions; errors are negative
+typedef enum
+{
+	CCSDS_OK = 0,
+	CCSDS_ERROR_CONFIG = -1,
+	CCSDS_ERROR_MEMORY = -2,
+	CCSDS_ERROR_IO = -3,
+	CCSDS_ERROR_DATA = -4,
+	CCSDS_ERROR_BUFFER = -5,
+	CCSDS_ERROR_INTERNAL = -6
+} ccsds_status_t;
+
+/// Kind of the reported message
+typedef enum
+{
+	LOG_ERROR,
+	LOG_INFO
+} log_level_t;
+
+/// Receives a message, without trailing new lines, with the user_data given with the callback
+typedef void (*log_callback_t)(log_level_t level, const char *message, void *user_data);
+
+/// Context installed by a public function for the duration of its call
+typedef struct log_context
+{
+	log_callback_t callback;
+	void *user_data;
+	ccsds_status_t status;
+	struct log_context *previous;
+} log_context_t;
+
+/// Callback printing the errors to stderr and the other messages to stdout
+void log_to_stdio(log_level_t level, const char *message, void *user_data);
+
+/// Installs context as the log context of the calling thread, reporting to callback (which can be NULL)
+void log_begin(log_context_t *context, log_callback_t callback, void *user_data);
+
+/// Restores the log context active before context was installed, given the result of the call (0 or
+/// a negative value in case of error)
+/// @return CCSDS_OK if result is 0, otherwise the status of the first error reported while context was
+/// installed (CCSDS_ERROR_INTERNAL if none was)
+ccsds_status_t log_end(log_context_t *context, int result);
+
+/// Returns the callback and the user data of the log context of the calling thread (NULL outside of the
+/// library), so that the threads started by a call can report to the same callback
+void log_current_callback(log_callback_t *callback, void **user_data);
+
+/// Reports an error with the given status, formatting the message as printf
+void log_error(ccsds_status_t status, const char *format, ...);
+
+/// Reports an information message (e.g. statistics), formatting it as printf
+void log_info(const char *format, ...);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
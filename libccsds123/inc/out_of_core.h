@@ -0,0 +1,89 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef OUT_OF_CORE_H
+#define OUT_OF_CORE_H
+
+/**
+ * @file out_of_core.h
+ * @brief Streaming compression engines, where the residuals are encoded as soon as they are
+ * computed and the compressed stream is written to the output file as it is produced, so that
+ * neither the residuals nor the whole compressed stream are kept in memory:
+ * - fused: the image is loaded in memory as by predict.
+ * - out of core: for images bigger than the available memory, the input file is streamed from
+ *   disk too and only the working set needed by the predictor is kept in memory. The input file
+ *   can use any interleaving, but it must use the regular representation (16 bits for every
+ *   sample), as samples are read at arbitrary positions.
+ * - pipelined: as out of core, but reading, prediction and encoding (with the writing of the stream)
+ *   run on three threads connected by bounded lock-free queues (see ring_buffer.h) of chunks, so that
+ *   the input and output are overlapped with the prediction.
+ * Two traversals are used, depending on the order of the output stream:
+ * - BI output: the image is processed by line groups (row y of all the bands); two rows of
+ *   every band are kept in memory.
+ * - BSQ output: the image is processed band by band; the band being compressed and the
+ *   pred_bands previous ones (the P-band window) are kept in memory.
+ * The input and output files are accessed through the I/O backend given to the engines (see io_backend.h).
+ */
+
+#include "utils.h"
+#include "predictor.h"
+#include "entropy_encoder.h"
+
+/// Returns the number of bytes of memory used by compress_out_of_core for the given image
+/// and configuration.
+size_t out_of_core_working_set(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params);
+
+/// Returns the number of bytes of memory used by compress_fused for the given image and
+/// configuration, including the image itself.
+size_t fused_working_set(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params);
+
+/// Compresses the image in inputFile into outputFile, streaming both of them. The produced
+/// stream is identical to the one of the in-memory compression (predict followed by encode).
+/// When memory_budget is not 0 and the working set is bigger than memory_budget bytes
+/// nothing is done and an error is returned. The buffers are allocated from arena and released
+/// before returning.
+/// @return the number of bytes of the compressed stream, a negative value in case of error
+long long compress_out_of_core(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params,
+		char inputFile[128], char outputFile[128], io_backend_t backend, size_t memory_budget, arena_t *arena);
+
+/// Compresses the image in inputFile into outputFile: the image is loaded in memory, but its
+/// residuals are encoded and written to outputFile as soon as they are computed. The produced
+/// stream is identical to the one of the in-memory compression. The buffers are allocated from
+/// arena and released before returning.
+/// @return the number of bytes of the compressed stream, a negative value in case of error
+long long compress_fused(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params,
+		char inputFile[128], char outputFile[128], io_backend_t backend, arena_t *arena);
+
+/// Returns the number of bytes of memory used by compress_pipelined for the given image and
+/// configuration.
+size_t pipelined_working_set(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params);
+
+/// Compresses the image in inputFile into outputFile with three threads: the reader, the predictor (the
+/// calling thread) and the encoder, which also writes the stream out. The chunks passed among them are
+/// lines with BI output and bands with BSQ output; as for compress_out_of_core the input file must use the
+/// regular representation. The produced stream is identical to the one of the in-memory compression.
+/// The buffers are allocated from arena and released before returning.
+/// @return the number of bytes of the compressed stream, a negative value in case of error
+long long compress_pipelined(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params,
+		char inputFile[128], char outputFile[128], io_backend_t backend, arena_t *arena);
+
+/// Returns the maximum number of bytes of the compressed stream of an image with the given
+/// configuration, i.e. the capacity of a buffer always able to hold it.
+size_t compress_bound(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params);
+
+/// Compresses the image whose samples are already loaded in samples (in BSQ order, as by read_samples
+/// or load_samples) into the destination buffer of capacity bytes, encoding the residuals as soon as
+/// they are computed as compress_fused does. The buffers are allocated from arena and released before
+/// returning.
+/// @return the number of bytes of the compressed stream, a negative value in case of error (including
+/// a compressed stream not fitting in destination)
+long long compress_fused_to_buffer(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params,
+		const void *samples, unsigned char *destination, size_t capacity, arena_t *arena);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,46 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef PIPELINED_DECODER_H
+#define PIPELINED_DECODER_H
+
+/**
+ * @file pipelined_decoder.h
+ * @brief Pipelined decompression: the entropy decoding, the unprediction and the writing of the samples
+ * run on three threads connected by bounded lock-free queues (see ring_buffer.h), so that the time of the
+ * decompression is close to the one of its slowest stage instead of the sum of the three:
+ * - decoder: decodes the residuals of the stream a chunk at a time (see decode_residuals);
+ * - unpredictor (the calling thread): reconstructs the samples of every chunk of residuals;
+ * - writer: converts the samples to the representation of the output file and writes them out.
+ * The chunks are the lines (row y of all the bands) of a BI stream and the bands of a BSQ stream; only
+ * the chunks in the queues, the previous line or the P-band window (the band and the pred_bands previous
+ * ones) are kept in memory, never the whole image or its residuals.
+ * The decompressed file is identical to the one written by unpredict.
+ */
+
+#include "utils.h"
+#include "predictor.h"
+
+/**
+ * @brief Decompresses the stream in inputFile into outputFile with the three stages of the pipeline.
+ * @param input_params filled in with the parameters of the image read from the header of the stream.
+ * @param predictor_params filled in with the parameters of the predictor read from the header of the
+ * stream; its weight initialization table is allocated from arena.
+ * @param num_bands when not 0, only the first num_bands bands of a BSQ stream are decoded and written:
+ * the decoder stops after the last residual of band num_bands - 1, and outputFile holds an image of
+ * num_bands bands.
+ * @param backend I/O backend the compressed stream is read and the decompressed file written with.
+ * @param memory_budget when not 0, the decompression fails if the memory needed by the pipeline is bigger.
+ * @param arena the buffers of the pipeline are allocated from it and released before returning.
+ * @return 0 if the decompression succeeded, a negative value in case of error.
+ */
+int decompress_pipelined(char inputFile[128], char outputFile[128], input_feature_t *input_params,
+		predictor_config_t *predictor_params, unsigned int num_bands, io_backend_t backend, size_t memory_budget, arena_t *arena);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -39,6 +39,7 @@ extern "C"
 #define PREDICTOR_H
 
 #include "utils.h"
+#include "arena.h"
 
 ///Type representing the configuration of the predictor
 typedef struct predictor_config
@@ -54,63 +55,110 @@ typedef struct predictor_config
 	char weight_final;
 	unsigned char weight_init_resolution;
 	int **weight_init_table;
+	// optional: when not NULL, the weights of every band are saved here once its last row is predicted,
+	// those of band z at adapted_weights + z * (pred_bands + 3 * full) as in the predictor (see
+	// write_weights_table)
+	int *adapted_weights;
 } predictor_config_t;
 
-/// Computes the local sum for the given sample index
-int local_sum(input_feature_t input_params, predictor_config_t predictor_params,
-				unsigned int x, unsigned int y, unsigned int z, unsigned short int *samples);
-
-#ifdef NO_COMPUTE_LOCAL
-/// Computes the local differences (central and directional) for the given sample
-/// and puts them in the pre-allocated local_difference array
-int get_central_difference(input_feature_t input_params, predictor_config_t predictor_params,
-							int *central_difference, unsigned short int *samples, unsigned int x, unsigned int y, unsigned int z);
-int get_directional_difference(input_feature_t input_params, predictor_config_t predictor_params,
-								int directional_difference[3], unsigned short int *samples, unsigned int x, unsigned int y, unsigned int z);
-#endif
-
-#ifndef NO_COMPUTE_LOCAL
-/// Computes the local differences for the whole image and saves them in the local_differences
-/// array
-int compute_local_differences(input_feature_t input_params, predictor_config_t predictor_params,
-								int ***local_differences, unsigned short int *samples);
-#endif
-
-#ifndef NO_COMPUTE_LOCAL
-/// Given the prediction error, it updates the weight matrix (local and
-/// prediction weights per band).
-void update_weights(int *weights, input_feature_t input_params, predictor_config_t predictor_params,
-					unsigned int x, unsigned int y, unsigned int z, int error, int **local_differences, unsigned short *samples);
-#else
-/// Given the prediction error, it updates the weight matrix (local and
-/// prediction weights per band).
-void update_weights(int *weights, input_feature_t input_params, predictor_config_t predictor_params,
-					unsigned int x, unsigned int y, unsigned int z, int error, unsigned short *samples);
-#endif
-
-#ifndef NO_COMPUTE_LOCAL
-/// given the local differences and the samples, it computes the scaled predicted
-/// sample value
-int compute_predicted_sample(input_feature_t input_params, predictor_config_t predictor_params,
-								unsigned int x, unsigned int y, unsigned int z, unsigned int s_min, unsigned int s_mid, unsigned int s_max,
-								int **local_differences, unsigned short int *samples, int *weights);
-#else
-/// given the local differences and the samples, it computes the scaled predicted
-/// sample value
-int compute_predicted_sample(input_feature_t input_params, predictor_config_t predictor_params,
-								unsigned int x, unsigned int y, unsigned int z, unsigned int s_min, unsigned int s_mid, unsigned int s_max,
-								unsigned short int *samples, int *weights);
-#endif
+///Type holding the local sums and the local differences of a whole row of one band;
+///each array has x_size elements. The directional (north, west, north-west) arrays
+///are only filled in when the full prediction mode is used
+typedef struct row_differences
+{
+	int *local_sum;
+	int *central;
+	int *north;
+	int *west;
+	int *north_west;
+} row_differences_t;
+
+/// Sets up the rows of local sums and differences of the P-band window over buffer, which has to hold
+/// window * (2 or 5) rows of x_size elements
+void init_differences_window(predictor_config_t predictor_params, unsigned int x_size, unsigned int window,
+		int *buffer, row_differences_t *window_differences);
+
+/// Computes the local sums and the local differences of the whole row y of a band at once;
+/// cur_row points to row y of the band and prev_row to row y - 1 (ignored when y == 0).
+/// The interior of the row is processed with SIMD instructions when available
+void compute_row_differences(input_feature_t input_params, predictor_config_t predictor_params, unsigned int y,
+								const unsigned short int *cur_row, const unsigned short int *prev_row, row_differences_t *differences);
+
+/// Computes the local sum and the local differences of the sample in column x of the row y;
+/// only cur_row[0 .. x] and prev_row[x - 1 .. x + 1] are read, the central difference being
+/// the only value depending on cur_row[x]
+void compute_sample_differences(input_feature_t input_params, predictor_config_t predictor_params, unsigned int y, unsigned int x,
+									const unsigned short int *cur_row, const unsigned short int *prev_row, row_differences_t *differences);
+
+/// Computes the scaled predicted value of the sample in column x of the row y of band z, given
+/// the differences of the row (differences[0]) and the central differences of the previous bands
+/// (differences[i] for band z - i); prev_band_origin is the sample (0, 0, z - 1)
+int predict_sample(input_feature_t input_params, predictor_config_t predictor_params, unsigned int x, unsigned int y, unsigned int z,
+					unsigned short int prev_band_origin, row_differences_t **differences, const int *weights);
+
+/// Given the prediction error of the sample in column x of row y of band z, it updates the weights
+/// of the band reading the same differences used by predict_sample
+void update_sample_weights(input_feature_t input_params, predictor_config_t predictor_params, unsigned int x, unsigned int y, unsigned int z,
+							int error, row_differences_t **differences, int *weights);
+
+/// Predicts the row y of band z from its precomputed local sums and differences
+/// (differences[0]) and the central differences of the previous bands at the same
+/// row (differences[i] for band z - i), updating the band weights sample by sample.
+/// The scaled predictions are saved in predicted_row and the mapped residuals in residual_row;
+/// prev_band_origin is the sample (0, 0, z - 1), only used when z > 0
+void predict_row(input_feature_t input_params, predictor_config_t predictor_params, unsigned int y, unsigned int z,
+					const unsigned short int *cur_row, unsigned short int prev_band_origin, row_differences_t **differences,
+					int *weights, int *predicted_row, unsigned short int *residual_row);
 
 void init_weights(int *weights, predictor_config_t predictor_params, unsigned int z);
 
+/// Writes the weights of every band (those of band z at weights + z * (pred_bands + 3 * full), as in the
+/// predictor) to fileName in the format read by parse_weights_table, as a weight initialization table with
+/// the given weight_init_resolution Q. With s = weight_resolution + 3 - Q, each weight w is written as
+/// (w + 1) >> s, from which init_weights gives back 2^s * ((w + 1) >> s) + floor(2^(s - 1)) - 1, within
+/// 2^(s - 1) of w; when s is 0 this is w itself, but for the largest weight, 2^(Q - 1) - 1, which the table
+/// cannot hold plus one and which comes back one less
+/// A value different from 0 is returned in case of error
+int write_weights_table(char fileName[128], input_feature_t input_params, predictor_config_t predictor_params, const int *weights,
+		unsigned int resolution);
+
+/// Given the sample and its scaled predicted value it maps the prediction residual
+/// to an unsigned value enabling it to be represented with D bits
+unsigned short int compute_mapped_residual(unsigned short int sample, int scaled_predicted, unsigned int s_min, unsigned int s_max);
+
+/// Maps length samples given their scaled predicted values (e.g. a whole row of a band),
+/// using blends instead of branches and SIMD instructions when available
+void compute_mapped_residual_row(const unsigned short int *samples, const int *scaled_predicted, unsigned short int *residuals,
+									unsigned int length, unsigned int s_min, unsigned int s_max);
+
+/// Returns the number of bytes of memory allocated by predict: the image samples and the rows of
+/// the row engine (the residuals are allocated by the caller)
+size_t predict_working_set(input_feature_t input_params, predictor_config_t predictor_params);
+
+/// Returns the number of bytes of memory allocated by predict_bands for the given band range
+size_t predict_bands_working_set(input_feature_t input_params, predictor_config_t predictor_params,
+									unsigned int first_band, unsigned int end_band);
+
+/// Predicts the bands [first_band, end_band) of the image loaded in samples (in BSQ order, as by
+/// read_samples), saving their mapped residuals at the same positions of residuals. As the prediction
+/// of a band only depends on the samples of the pred_bands previous ones, disjoint band ranges can be
+/// predicted independently (e.g. concurrently); the local differences of the pred_bands bands preceding
+/// first_band are computed again for this purpose. The temporary buffers are allocated from arena and
+/// released before returning.
+/// A value different from 0 is returned in case of error
+int predict_bands(input_feature_t input_params, predictor_config_t predictor_params, const void *samples, void *residuals,
+					unsigned int first_band, unsigned int end_band, arena_t *arena);
+
 /// High-level routine which actually performs the prediction, by calling the
 /// in the right order the other sub-routines.
 /// A value different from 0 is returned in case of error
-int predict(input_feature_t input_params, predictor_config_t predictor_params, char inputFile[128], unsigned short int *residuals);
+/// The residuals are stored with SAMPLE_BYTES(input_params) bytes each; the temporary buffers are
+/// allocated from arena and released before returning; inputFile is read through the given I/O backend
+int predict(input_feature_t input_params, predictor_config_t predictor_params, char inputFile[128], io_backend_t backend, void *residuals, arena_t *arena);
 
-/// NOTE: we execute the computation in BSQ order, for simplicity; this means that conversion
-/// from the input format into BSQ might be needed.
+/// NOTE: the samples are stored in BSQ order, for simplicity; this means that conversion
+/// from the input format into BSQ might be needed. The computation itself proceeds row by row
+/// (all the bands of row y before row y + 1), as the weights are kept separately for each band.
 
 #endif
 
@@ -0,0 +1,43 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef REINTERLEAVE_H
+#define REINTERLEAVE_H
+
+/**
+ * @file reinterleave.h
+ * @brief Conversion of a stream compressed with the sample adaptive encoder between the BSQ and the BI
+ * output interleavings, without decompressing it. The codeword of every residual only depends on the
+ * statistics of its own band, which see the residuals of the band in the same order in every interleaving:
+ * the streams of an image in BSQ and in BI order of any depth hold exactly the same codewords, in a
+ * different order. The boundaries of the codewords are found from their lengths alone, tracking the
+ * statistics of every band to know the parameter k of its next codeword, and the codewords are moved in
+ * the order of the other interleaving; neither the residuals nor the samples of the image are built.
+ */
+
+#include "decompress_ccsds123.h"
+
+/**
+ * @brief Writes to config->out_file the stream config->in_file would be had it been compressed with the
+ * given output interleaving: the result is identical to the stream compress_ccsds123 produces with the
+ * same parameters and out_interleaving / out_interleaving_depth, and has the same size as the source.
+ * @param config configuration of the conversion: in_file is the source stream, which must be compressed
+ * with the sample adaptive encoder; the files are read and written through io_backend, arena (when not
+ * NULL) provides the memory and memory_budget, when not 0, caps it. input_params and predictor_params are
+ * filled in from the header of the source (without the weight initialization table); the other options
+ * of the decompression are not used.
+ * @param out_interleaving interleaving of the stream written.
+ * @param out_interleaving_depth number of bands interleaved by the BI order, between 1 and the number of
+ * bands of the image; not used for BSQ.
+ * @retval 0 if the stream was written.
+ * @retval <0 the status code (see ccsds_status_t) of the problem the conversion ran into.
+ */
+int reinterleave_ccsds123(decompressConfig_t *config, interleaving_t out_interleaving, unsigned int out_interleaving_depth);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,67 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef RING_BUFFER_H
+#define RING_BUFFER_H
+
+/**
+ * @file ring_buffer.h
+ * @brief Bounded single producer, single consumer queue connecting two threads of a pipeline: it holds
+ * num_slots chunks (e.g. lines or bands) of slot_size bytes, which are filled in place by the producer
+ * and read in place by the consumer, in the same order. No lock is used: the producer only writes the
+ * number of committed slots and the consumer only the number of released ones.
+ * The consumer can hold several slots at once (e.g. the previous line or the P-band window), releasing
+ * them oldest first. A thread waiting for a slot spins for a short while and then yields the processor.
+ * Either side can cancel the queue (e.g. after an error), which stops the waits of both.
+ */
+
+#include <stddef.h>
+
+#include "arena.h"
+
+///Type representing the queue; it has to be initialized with ring_init before use
+typedef struct ring_buffer
+{
+	unsigned char *slots;
+	size_t slot_size;
+	size_t num_slots;
+	// written by the producer only (the counters are kept on different cache lines)
+	size_t head;
+	unsigned char producer_padding[ARENA_ALIGNMENT];
+	// written by the consumer only
+	size_t tail;
+	size_t acquired;
+	unsigned char consumer_padding[ARENA_ALIGNMENT];
+	int cancelled;
+} ring_buffer_t;
+
+///Initializes the queue, allocating from arena num_slots slots of slot_size bytes each
+///@return a negative number if the memory could not be allocated
+int ring_init(ring_buffer_t *ring, size_t slot_size, size_t num_slots, arena_t *arena);
+
+///Returns the number of bytes allocated by ring_init
+size_t ring_size(size_t slot_size, size_t num_slots);
+
+///Producer: waits for a free slot and returns it, NULL if the queue has been cancelled
+void *ring_acquire_write(ring_buffer_t *ring);
+
+///Producer: hands the slot returned by the last ring_acquire_write to the consumer
+void ring_commit_write(ring_buffer_t *ring);
+
+///Consumer: waits for the next committed slot and returns it, NULL if the queue has been cancelled;
+///the slot stays valid until it is released
+void *ring_acquire_read(ring_buffer_t *ring);
+
+///Consumer: gives back to the producer the oldest slot it holds
+void ring_release_read(ring_buffer_t *ring);
+
+///Stops the queue: the pending and future waits of both threads return NULL
+void ring_cancel(ring_buffer_t *ring);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
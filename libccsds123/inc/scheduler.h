@@ -0,0 +1,76 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+/**
+ * @file scheduler.h
+ * @brief Pool of threads compressing many images at once. Each image (job) is split into tasks:
+ * - ingest: the configuration is checked, the buffers of the image allocated and its samples read;
+ * - prediction: one task per range of bands (see predict_bands), the band ranges of an image being
+ *   predicted concurrently;
+ * - encoding: with the sample adaptive encoder and BSQ output every band is encoded by its own task
+ *   into a separate stream, as the statistics are kept per band; otherwise the whole image is encoded
+ *   by a single task once all its bands have been predicted;
+ * - write: the streams of the bands are concatenated after the header and written to the output file.
+ * Every worker thread owns a double ended queue of tasks: it pushes the tasks it spawns and pops the
+ * next one to run at the bottom, while idle workers steal tasks from the top of the queues of the
+ * other ones, so that the tasks of all the queued images are spread over all the threads. At most
+ * max_in_flight images are being compressed (i.e. hold their buffers) at the same time; the other
+ * submitted ones wait in a queue, in submission order.
+ * The produced streams are identical to the ones of compress_ccsds123.
+ */
+
+#include "compress_ccsds123.h"
+
+/// Pool of worker threads and the queue of the images to be compressed
+typedef struct scheduler scheduler_t;
+
+/// Compression of an image submitted to a scheduler
+typedef struct compress_job compress_job_t;
+
+/**
+ * @brief Creates the scheduler and starts its worker threads.
+ * @param num_threads number of worker threads; 0 means one per online processor.
+ * @param max_in_flight maximum number of images compressed at the same time; 0 means as many as the
+ * worker threads.
+ * @param scheduler where the created scheduler is returned (NULL in case of error).
+ * @retval 0 if the scheduler was created.
+ * @retval <0 the status code of the problem.
+ */
+int scheduler_create(unsigned int num_threads, unsigned int max_in_flight, scheduler_t **scheduler);
+
+/**
+ * @brief Queues the compression of an image, which is started as soon as less than max_in_flight
+ * images are being compressed.
+ * @param scheduler the scheduler.
+ * @param config configuration of the compression, copied by the call; engine and arena are not used
+ * (each image owns its memory) and memory_budget applies to the memory of each image. Errors and
+ * statistics are reported to the log callback from the worker threads.
+ * @param job where the queued job is returned (NULL in case of error).
+ * @retval 0 if the compression was queued.
+ * @retval <0 the status code of the problem.
+ */
+int scheduler_submit(scheduler_t *scheduler, const compressConfig_t *config, compress_job_t **job);
+
+/**
+ * @brief Waits for the end of the compression of an image and frees the job.
+ * @return the number of bytes of the compressed stream, the negative status code (see ccsds_status_t)
+ * of the problem compression ran into otherwise.
+ */
+long long scheduler_wait(scheduler_t *scheduler, compress_job_t *job);
+
+/**
+ * @brief Waits for the end of all the submitted compressions, stops the worker threads and frees the
+ * scheduler, together with the jobs which have not been waited for.
+ */
+void scheduler_destroy(scheduler_t *scheduler);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
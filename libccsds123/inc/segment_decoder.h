@@ -0,0 +1,51 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef SEGMENT_DECODER_H
+#define SEGMENT_DECODER_H
+
+/**
+ * @file segment_decoder.h
+ * @brief Decompression of a range of lines of a stream with BI output, where the lines (row y of all the
+ * bands) follow each other in the stream. Without checkpoints the stream is decoded from its first line,
+ * stopping after the last line of the range. With the checkpoints written by the compressor (see
+ * checkpoint.h) the decoding resumes from the checkpoint at or before the first line of the range, and the
+ * range is split at the checkpoints in segments decoded in parallel: every thread decodes a segment at a
+ * time with its own stream, and the segments are written in order, a thread keeping the lines of its
+ * segment in memory until the ones before it have been written.
+ * Only the lines of the range, the two lines being reconstructed and the weights and statistics of every
+ * band are kept in memory, never the whole image or its residuals.
+ */
+
+#include "utils.h"
+#include "predictor.h"
+
+/**
+ * @brief Decompresses the lines [first_line, first_line + num_lines) of the stream in inputFile into
+ * outputFile, which then holds an image of num_lines lines in the interleaving of input_params.
+ * @param checkpointFile optional (NULL or empty when not used), checkpoint file written with the stream;
+ * it requires the stream to be compressed with the sample adaptive encoder.
+ * @param num_lines number of lines to decompress, 0 meaning all the lines from first_line on.
+ * @param input_params filled in with the parameters of the image read from the header of the stream.
+ * @param predictor_params filled in with the parameters of the predictor read from the header of the
+ * stream; its weight initialization table is allocated from arena.
+ * @param num_threads number of threads decoding the segments between the checkpoints, the calling one
+ * included (0 means one per online processor); without checkpoints only the calling thread is used.
+ * @param backend I/O backend the decompressed file is written with; the compressed stream is read through
+ * it by the calling thread, while the other threads use their own streams (mapped with IO_BACKEND_MMAP,
+ * stdio otherwise).
+ * @param memory_budget when not 0, the decompression fails if the memory it needs is bigger.
+ * @param arena the buffers are allocated from it and released before returning.
+ * @return 0 if the decompression succeeded, a negative value in case of error.
+ */
+int decompress_lines(char inputFile[128], char checkpointFile[128], unsigned int first_line, unsigned int num_lines, char outputFile[128],
+		input_feature_t *input_params, predictor_config_t *predictor_params, unsigned int num_threads, io_backend_t backend,
+		size_t memory_budget, arena_t *arena);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,209 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+/**
+ * @file simd.h
+ * @brief Thin abstraction over the vector instructions used by the row kernels of the
+ * predictor. Each vector holds ROW_LANES 32 bits signed integers; unsigned samples are
+ * zero-extended when loaded. AVX2 is used when the library is compiled with it enabled
+ * (e.g. make SIMDFLAGS=-mavx2), SSE2 otherwise on x86-64. When no vector
+ * instruction set is available ROW_LANES is not defined and the kernels fall back to
+ * their scalar loops.
+ * This header is private to the library.
+ */
+
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+#define ROW_LANES 8
+
+typedef __m256i row_vector_t;
+
+static inline row_vector_t row_load_samples(const unsigned short int *samples)
+{
+	return _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)samples));
+}
+
+static inline row_vector_t row_add(row_vector_t a, row_vector_t b)
+{
+	return _mm256_add_epi32(a, b);
+}
+
+static inline row_vector_t row_sub(row_vector_t a, row_vector_t b)
+{
+	return _mm256_sub_epi32(a, b);
+}
+
+static inline row_vector_t row_times4(row_vector_t a)
+{
+	return _mm256_slli_epi32(a, 2);
+}
+
+static inline row_vector_t row_zero()
+{
+	return _mm256_setzero_si256();
+}
+
+static inline void row_store(int *destination, row_vector_t a)
+{
+	_mm256_storeu_si256((__m256i *)destination, a);
+}
+
+static inline row_vector_t row_load(const int *source)
+{
+	return _mm256_loadu_si256((const __m256i *)source);
+}
+
+static inline row_vector_t row_set(int value)
+{
+	return _mm256_set1_epi32(value);
+}
+
+static inline row_vector_t row_and(row_vector_t a, row_vector_t b)
+{
+	return _mm256_and_si256(a, b);
+}
+
+static inline row_vector_t row_xor(row_vector_t a, row_vector_t b)
+{
+	return _mm256_xor_si256(a, b);
+}
+
+/// All bits set in the lanes where a > b, cleared elsewhere
+static inline row_vector_t row_greater(row_vector_t a, row_vector_t b)
+{
+	return _mm256_cmpgt_epi32(a, b);
+}
+
+/// Selects a in the lanes where mask is set, b elsewhere
+static inline row_vector_t row_blend(row_vector_t mask, row_vector_t a, row_vector_t b)
+{
+	return _mm256_blendv_epi8(b, a, mask);
+}
+
+/// Arithmetic shift right by one position, i.e. floor division by 2
+static inline row_vector_t row_half(row_vector_t a)
+{
+	return _mm256_srai_epi32(a, 1);
+}
+
+static inline row_vector_t row_sign_mask(row_vector_t a)
+{
+	return _mm256_srai_epi32(a, 31);
+}
+
+/// Stores the lanes as unsigned 16 bits values; the lanes must be in the [0, 0xFFFF] range
+static inline void row_store_samples(unsigned short int *destination, row_vector_t a)
+{
+	_mm_storeu_si128((__m128i *)destination, _mm_packus_epi32(_mm256_castsi256_si128(a), _mm256_extracti128_si256(a, 1)));
+}
+
+#elif defined(__SSE2__)
+
+#include <emmintrin.h>
+
+#define ROW_LANES 4
+
+typedef __m128i row_vector_t;
+
+static inline row_vector_t row_load_samples(const unsigned short int *samples)
+{
+	return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *)samples), _mm_setzero_si128());
+}
+
+static inline row_vector_t row_add(row_vector_t a, row_vector_t b)
+{
+	return _mm_add_epi32(a, b);
+}
+
+static inline row_vector_t row_sub(row_vector_t a, row_vector_t b)
+{
+	return _mm_sub_epi32(a, b);
+}
+
+static inline row_vector_t row_times4(row_vector_t a)
+{
+	return _mm_slli_epi32(a, 2);
+}
+
+static inline row_vector_t row_zero()
+{
+	return _mm_setzero_si128();
+}
+
+static inline void row_store(int *destination, row_vector_t a)
+{
+	_mm_storeu_si128((__m128i *)destination, a);
+}
+
+static inline row_vector_t row_load(const int *source)
+{
+	return _mm_loadu_si128((const __m128i *)source);
+}
+
+static inline row_vector_t row_set(int value)
+{
+	return _mm_set1_epi32(value);
+}
+
+static inline row_vector_t row_and(row_vector_t a, row_vector_t b)
+{
+	return _mm_and_si128(a, b);
+}
+
+static inline row_vector_t row_xor(row_vector_t a, row_vector_t b)
+{
+	return _mm_xor_si128(a, b);
+}
+
+/// All bits set in the lanes where a > b, cleared elsewhere
+static inline row_vector_t row_greater(row_vector_t a, row_vector_t b)
+{
+	return _mm_cmpgt_epi32(a, b);
+}
+
+/// Selects a in the lanes where mask is set, b elsewhere
+static inline row_vector_t row_blend(row_vector_t mask, row_vector_t a, row_vector_t b)
+{
+	return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+/// Arithmetic shift right by one position, i.e. floor division by 2
+static inline row_vector_t row_half(row_vector_t a)
+{
+	return _mm_srai_epi32(a, 1);
+}
+
+static inline row_vector_t row_sign_mask(row_vector_t a)
+{
+	return _mm_srai_epi32(a, 31);
+}
+
+/// Stores the lanes as unsigned 16 bits values; the lanes must be in the [0, 0xFFFF] range
+static inline void row_store_samples(unsigned short int *destination, row_vector_t a)
+{
+	// SSE2 only packs with signed saturation: the low 16 bits are sign extended first so
+	// that the packing keeps them unchanged
+	a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+	_mm_storel_epi64((__m128i *)destination, _mm_packs_epi32(a, a));
+}
+
+#endif
+
+#ifdef ROW_LANES
+
+/// Changes the sign of the lanes where mask is set (mask lanes are either all ones or all zeros)
+static inline row_vector_t row_negate_where(row_vector_t mask, row_vector_t a)
+{
+	return row_sub(row_xor(a, mask), mask);
+}
+
+static inline row_vector_t row_abs(row_vector_t a)
+{
+	return row_negate_where(row_sign_mask(a), a);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,189 @@
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+#ifndef TILE_CONTAINER_H
+#define TILE_CONTAINER_H
+
+/**
+ * @file tile_container.h
+ * @brief Container of a scene split into independent spatial tiles, each one compressed into its own
+ * standard compliant CCSDS 123 stream. The prediction of a tile never looks outside of it, so the tiles
+ * are compressed and decompressed in parallel and any of them can be decoded on its own, at the price of
+ * the predictor and the encoder adapting again from scratch in every tile, and of the header of every
+ * stream (see tiled_report_t). The tiles hold all the bands of their rectangle; they all have the width and
+ * the height given to compress_tiled, except the ones of the last column and of the last row, which hold
+ * what is left of the scene.
+ * The container holds, all in big endian order:
+ * - the 4 characters "CBTC";
+ * - the x, y and z sizes of the scene and the width and height of the tiles, on 32 bits each;
+ * - the offset of the stream of every tile from the beginning of the container, the tiles following each
+ *   other by rows, followed by the offset of the end of the last stream, on 64 bits each;
+ * - the streams of the tiles, in the same order.
+ */
+
+#include <stdio.h>
+
+#include "decompress_ccsds123.h"
+
+// Characters opening every container
+#define CONTAINER_MAGIC "CBTC"
+
+// Number of bytes of the header of the container: the magic and five 32 bits fields
+#define CONTAINER_HEADER_SIZE 24
+
+// compressConfig_t, see compress_ccsds123.h: the decoder and the encoder headers cannot be included together
+struct compressConfig;
+
+///Split of a scene into tiles, row by row
+typedef struct tile_grid
+{
+	unsigned int x_size;
+	unsigned int y_size;
+	unsigned int z_size;
+	unsigned int tile_width;
+	unsigned int tile_height;
+	unsigned int tiles_x;
+	unsigned int tiles_y;
+} tile_grid_t;
+
+///Window of a scene: the samples with x0 <= x < x1, y0 <= y < y1 and z0 <= z < z1
+typedef struct tile_region
+{
+	unsigned int x0;
+	unsigned int y0;
+	unsigned int x1;
+	unsigned int y1;
+	unsigned int z0;
+	unsigned int z1;
+} tile_region_t;
+
+///Size of a compressed container, compared with the single stream compression of the same scene
+typedef struct tiled_report
+{
+	unsigned int num_tiles;
+	unsigned long long container_bytes;
+	// bytes of the header and of the directory of the container
+	unsigned long long directory_bytes;
+	// bytes of the single stream, 0 when it was not compressed
+	unsigned long long single_stream_bytes;
+	// relative increase of the size of the container over the single stream (e.g. 0.02 for 2%)
+	double ratio_cost;
+} tiled_report_t;
+
+/**
+ * @brief Compresses the scene described by config into a container of tiles of tile_width x tile_height
+ * pixels, written to config->out_file.
+ * @param config configuration of the compression of the whole scene; every tile is compressed with its
+ * parameters by a compression session (see compress_session_create), so engine, memory_budget and arena
+ * are not used. The samples are read through config->io_backend and must use the regular (16 bits per
+ * sample) input representation; band_index_file, checkpoint_file and adapted_weights_file must
+ * be empty.
+ * @param tile_width width of the tiles, capped to the width of the scene.
+ * @param tile_height height of the tiles, capped to the height of the scene.
+ * @param num_threads number of threads compressing the tiles, the calling one included (0 means one per
+ * online processor).
+ * @param referenceFile optional (NULL or empty when not used): the scene is also compressed into a single
+ * stream saved in this file with compress_ccsds123, to measure the cost of the tiling.
+ * @param report optional (NULL when not used), filled in with the sizes of the container and of the single
+ * stream.
+ * @retval 0 if the compression went OK.
+ * @retval <0 the status code (see ccsds_status_t) of the problem compression ran into.
+ */
+int compress_tiled(struct compressConfig *config, unsigned int tile_width, unsigned int tile_height, unsigned int num_threads,
+		char referenceFile[128], tiled_report_t *report);
+
+/**
+ * @brief Compresses the tile number tile (tiles numbered by rows) of the container compress_tiled would
+ * write into a stream of its own, saved in shardFile: the stream is the one compress_tiled stores in the
+ * container for this tile, so that the tiles of a scene can be compressed by different processes (or
+ * machines) and gathered with merge_tile_shards.
+ * @param config configuration of the compression of the whole scene, as for compress_tiled; out_file is
+ * not used.
+ * @param tile_width width of the tiles, capped to the width of the scene.
+ * @param tile_height height of the tiles, capped to the height of the scene.
+ * @param tile index of the tile, smaller than the number of tiles of the grid.
+ * @param shardFile file receiving the stream, written through config->io_backend.
+ * @retval 0 if the compression went OK.
+ * @retval <0 the status code (see ccsds_status_t) of the problem compression ran into.
+ */
+int compress_tile_shard(struct compressConfig *config, unsigned int tile_width, unsigned int tile_height, unsigned int tile,
+		char shardFile[128]);
+
+/**
+ * @brief Gathers the streams of all the tiles of a scene, written by compress_tile_shard, into the
+ * container config->out_file, which is then the one compress_tiled would have written.
+ * @param config configuration of the compression of the whole scene: only input_params (the size of the
+ * scene), out_file and io_backend are used.
+ * @param tile_width width of the tiles, capped to the width of the scene.
+ * @param tile_height height of the tiles, capped to the height of the scene.
+ * @param shardFiles the tile_grid_tiles files of the streams of the tiles, in the order of the tiles; the
+ * header of every stream is checked against the size of its tile.
+ * @param report optional (NULL when not used), filled in with the sizes of the container.
+ * @retval 0 if the container was written.
+ * @retval <0 the status code (see ccsds_status_t) of the problem the merge ran into.
+ */
+int merge_tile_shards(struct compressConfig *config, unsigned int tile_width, unsigned int tile_height, const char *const *shardFiles,
+		tiled_report_t *report);
+
+/**
+ * @brief Decompresses the container config->in_file into config->out_file, the tiles being decoded in
+ * parallel by config->num_threads threads (the calling one included, 0 meaning one per online processor)
+ * and written to their place in the scene.
+ * @param config configuration of the decompression: input_params is filled in with the parameters of the
+ * scene and predictor_params with the ones of its tiles (without the weight initialization table); the
+ * output file is written in the interleaving and byte ordering given in input_params, through io_backend.
+ * The other options of the decompression (engine, band index, checkpoints, lines, bands, residuals dump)
+ * are not used; memory_budget applies to the memory of all the threads.
+ * @retval 0 if the decompression went OK.
+ * @retval <0 the status code (see ccsds_status_t) of the problem decompression ran into.
+ */
+int decompress_tiled(decompressConfig_t *config);
+
+/**
+ * @brief Decompresses a window of the scene held in the container config->in_file into the buffer of the
+ * caller: only the tiles intersecting the window are decoded, in parallel as by decompress_tiled, and each
+ * of them is cropped directly into samples, so that the time and the memory taken depend on the window
+ * and not on the scene. When the tiles were compressed with the BSQ output interleaving, the bands after
+ * the window are not decoded either.
+ * @param config configuration of the decompression, as for decompress_tiled except that out_file is not
+ * used: the samples of the window are stored in the interleaving (and depth) given in input_params.
+ * @param region the window, which must not be empty and must lie in the scene; NULL means the whole scene.
+ * @param samples buffer receiving the (x1 - x0) * (y1 - y0) * (z1 - z0) samples of the window (band z0 and
+ * row y0 first, as if the window were a scene of its own), in the host byte ordering; signed samples are
+ * stored in two's complement on dyn_range bits, as in the files written by decompress_ccsds123.
+ * @param capacity number of samples the buffer can hold.
+ * @retval 0 if the decompression went OK.
+ * @retval <0 the status code (see ccsds_status_t) of the problem decompression ran into.
+ */
+int decompress_tiled_region(decompressConfig_t *config, const tile_region_t *region, unsigned short int *samples, size_t capacity);
+
+///Sets up the grid of tiles of tile_width x tile_height pixels (capped to the size of the scene) covering a
+///scene of x_size x y_size x z_size samples
+void tile_grid_init(tile_grid_t *grid, unsigned int x_size, unsigned int y_size, unsigned int z_size, unsigned int tile_width,
+		unsigned int tile_height);
+
+///Number of tiles of the grid
+unsigned int tile_grid_tiles(const tile_grid_t *grid);
+
+///Fills in the origin and the size of the rectangle of the scene covered by tile
+void tile_rectangle(const tile_grid_t *grid, unsigned int tile, unsigned int *x0, unsigned int *y0, unsigned int *width,
+		unsigned int *height);
+
+///Number of bytes of the header and of the directory of the container, i.e. the offset of the first stream
+size_t tile_directory_size(const tile_grid_t *grid);
+
+///Writes the header and the directory (the tile_grid_tiles(grid) + 1 offsets) at the beginning of the container
+///@return 0 if the directory was written, a negative value otherwise
+int tile_directory_write(io_file_t *container, const tile_grid_t *grid, const unsigned long long *offsets, arena_t *arena);
+
+///Reads the header and the directory of the container fileName from its beginning, allocating the offsets from arena
+///@return 0 if a valid directory was read, a negative value otherwise
+int tile_directory_read(FILE *container, const char *fileName, tile_grid_t *grid, unsigned long long **offsets, arena_t *arena);
+
+#endif
+
+#ifdef __cplusplus
+}
+#endif
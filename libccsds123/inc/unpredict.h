@@ -42,9 +42,28 @@ extern "C"
 /// Given the mapped residual and the prediction it extracts the original sample
 unsigned short int get_sample(unsigned short int residual, int scaled_predicted, unsigned int s_min, unsigned int s_maxs);
 
+/// Reconstructs the row y of band z from its mapped residuals, updating the weights of the band:
+/// differences[0] receives the local sums and differences of the row, computed one sample at a time,
+/// differences[i] holds the ones of the row y of band z - i. prev_row is the row y - 1 of the band (NULL
+/// when y == 0) and prev_band_origin the sample (0, 0, z - 1)
+void unpredict_row(input_feature_t input_params, predictor_config_t predictor_params, unsigned int y, unsigned int z,
+		unsigned short int *cur_row, const unsigned short int *prev_row, unsigned short int prev_band_origin,
+		row_differences_t **differences, int *weights, const unsigned short int *residual_row);
+
+/// Returns the number of bytes of memory allocated by unpredict: the image samples and the rows of
+/// the row engine (the residuals are allocated by the caller)
+size_t unpredict_working_set(input_feature_t input_params, predictor_config_t predictor_params);
+
+/// Reconstructs the image from its mapped residuals saved in BSQ format into samples, which holds
+/// IMAGE_SAMPLES(input_params) elements of SAMPLE_BYTES(input_params) bytes (BSQ order) and must be zeroed;
+/// the temporary buffers are allocated from arena and released before returning
+int unpredict_samples(input_feature_t input_params, predictor_config_t predictor_params, void *residuals, void *samples, arena_t *arena);
+
 /// Given the mapped residuals saved in BSQ format it iterates over them, computing
 /// the prediction and, then extracting the original sample.
-int unpredict(input_feature_t input_params, predictor_config_t predictor_params, unsigned short int *residuals, char outputFile[128]);
+/// The residuals are stored with SAMPLE_BYTES(input_params) bytes each; the temporary buffers are
+/// allocated from arena and released before returning; outputFile is written through the given I/O backend
+int unpredict(input_feature_t input_params, predictor_config_t predictor_params, void *residuals, char outputFile[128], io_backend_t backend, arena_t *arena);
 
 #endif
 
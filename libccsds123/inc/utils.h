@@ -38,6 +38,9 @@ extern "C"
 
 #include <stdio.h>
 
+#include "log.h"
+#include "io_backend.h"
+
 #define MIN(x, y) ((x) < (y) ? x : y)
 
 #define SEGMENT_SIZE 64
@@ -45,7 +48,31 @@ extern "C"
 //Macro used to move from a matrix notation to a linear array, when the matrix
 //is ordered according to the BSQ order
 //#define MATRIX_BSQ_INDEX(matrix, input_params, x, y, z) matrix[(z)*input_params.x_size*input_params.y_size + (y)*input_params.x_size + (x)]
-#define MATRIX_BSQ_INDEX(matrix, input_params, x, y, z) matrix[input_params.x_size * ((z)*input_params.y_size + (y)) + (x)]
+//The offsets are computed with size_t arithmetic, as images can hold more than 4G samples
+#define MATRIX_BSQ_INDEX(matrix, input_params, x, y, z) matrix[BSQ_OFFSET(input_params, x, y, z)]
+#define BSQ_OFFSET(input_params, x, y, z) ((size_t)input_params.x_size * ((size_t)(z)*input_params.y_size + (y)) + (x))
+
+//Number of samples in the image
+#define IMAGE_SAMPLES(input_params) ((size_t)(input_params).x_size * (input_params).y_size * (input_params).z_size)
+
+//Maximum value for each of the image dimensions, as they are saved with 16 bits in the header
+#define MAX_DIMENSION_SIZE 0xFFFF
+
+//Number of bytes used to store each sample, or mapped residual, in the memory buffers:
+//images with a dynamic range up to 8 bits are stored with one byte per element
+#define SAMPLE_BYTES(input_params) ((input_params).dyn_range <= 8 ? 1 : 2)
+
+//Macros used to read and write element i of a samples or residuals buffer stored with
+//the given number of bytes per element (see SAMPLE_BYTES)
+#define GET_ELEMENT(buffer, bytes, i) ((bytes) == 1 ? (unsigned short int)((unsigned char *)(buffer))[i] : ((unsigned short int *)(buffer))[i])
+#define SET_ELEMENT(buffer, bytes, i, value) \
+	do \
+	{ \
+		if ((bytes) == 1) \
+			((unsigned char *)(buffer))[i] = (unsigned char)(value); \
+		else \
+			((unsigned short int *)(buffer))[i] = (unsigned short int)(value); \
+	} while (0)
 
 typedef enum
 {
@@ -97,13 +124,19 @@ long long mod_star(long long arg, long long op, int debug);
 /// little endian
 int is_little_endian();
 
-///Given the file samples to be written to files (stored in memory in BSQ order) they
-///are saved to file.
+///Checks that every dimension of the image is between 1 and MAX_DIMENSION_SIZE and that
+///the memory buffers holding the whole image (samples, residuals and compressed stream) can be
+///addressed on this machine
+///@return 0 if the image size is supported, a negative value otherwise
+int check_image_size(input_feature_t input_params);
+
+///Given the file samples to be written to files (stored in memory in BSQ order, with
+///SAMPLE_BYTES(input_params) bytes per element) they are saved to file through the given I/O backend.
 ///While the samples are provided as unsigned integers, if needed they are converted
 ///to signed integers. Note also that, disrespective of the actual width of the samples,
 ///they are always saved on 16 bits (in case they are negative and they use less than 16 bits
 ///the most significant bits will be stored as 0s, i.e. no sign extension is done)
-int write_samples(input_feature_t input_params, char fileName[128], unsigned short int *samples, unsigned int s_mid);
+int write_samples(input_feature_t input_params, io_backend_t backend, char fileName[128], void *samples, unsigned int s_mid);
 
 ///Given the file encoding the input samples, it reads them into the pre-allocated samples
 ///array. The bit width of the samples in the file to read is encoded with input_params.residual_width
@@ -115,32 +148,105 @@ int write_samples(input_feature_t input_params, char fileName[128], unsigned sho
 ///Also, the input elements could be either signed or unsigned values, I will transform it to unsigned
 ///by adding the quantity 2^(D-1) so that the rest of the compressor only has to deal with
 ///unsigned images
-int read_samples(input_feature_t input_params, char fileName[128], unsigned short int *samples);
+///The samples array stores SAMPLE_BYTES(input_params) bytes per element; the file is read through the given
+///I/O backend
+int read_samples(input_feature_t input_params, io_backend_t backend, char fileName[128], void *samples);
+
+///Reads count consecutive samples, starting from the first-th one, from a file using the regular
+///representation (16 bits for every sample, in the file order); the samples are converted as
+///read_samples does (byte ordering, dynamic range check and signed to unsigned conversion)
+///@return 0 if the operation succesfully completes, a negative value otherwise
+int read_regular_samples(input_feature_t input_params, io_file_t *inputFile, size_t first, size_t count, unsigned short int *samples);
+
+///Loads the samples of an image held in memory, one unsigned short int per sample in the host byte
+///ordering and in the order given by input_params.in_interleaving, into the samples array (in BSQ
+///order, SAMPLE_BYTES(input_params) bytes per element); the samples are converted as read_samples does
+///(dynamic range check and signed to unsigned conversion)
+///@return 0 if the operation succesfully completes, a negative value otherwise
+int load_samples(input_feature_t input_params, const unsigned short int *buffer, void *samples);
+
+///Number of consecutive lines of the runs kept by sample_lines
+#define SAMPLED_RUN_LINES 16
+
+///Number of lines of an image y_size lines tall kept by sample_lines: one run of SAMPLED_RUN_LINES
+///consecutive lines every line_step runs (all of them when line_step is 0 or 1)
+unsigned int sampled_lines(unsigned int y_size, unsigned int line_step);
+
+///Copies into sampled the lines kept by sampled_lines of the image loaded in samples (in BSQ order, as by
+///read_samples), band by band: sampled then holds, in BSQ order, an image of sampled_lines(y_size, line_step)
+///lines, most of which follow in it the line they follow in the image
+void sample_lines(input_feature_t input_params, unsigned int line_step, const void *samples, void *sampled);
+
+///Reorders a line of the image (row y of all the bands) stored band interleaved by groups of
+///interleaving_depth bands, as in BI files and streams, so that row y of band z starts at line + z * x_size
+void deinterleave_line(const unsigned short int *raw_line, unsigned short int *line, unsigned int x_size, unsigned int z_size,
+		unsigned int interleaving_depth);
+
+///Inverse of deinterleave_line: stores the line (row y of band z at line + z * x_size) band interleaved by
+///groups of interleaving_depth bands
+void interleave_line(const unsigned short int *line, unsigned short int *raw_line, unsigned int x_size, unsigned int z_size,
+		unsigned int interleaving_depth);
+
+///Number of bytes of every sample in the files written by write_samples
+#define OUTPUT_SAMPLE_BYTES(input_params) ((input_params).dyn_range > 8 ? 2 : 1)
+
+///Converts count decompressed samples into the representation used by write_samples (signed samples,
+///byte ordering, OUTPUT_SAMPLE_BYTES(input_params) bytes per sample), saving them in destination
+void format_samples(input_feature_t input_params, const unsigned short int *samples, size_t count, unsigned int s_mid,
+		unsigned char *destination);
+
+///Copies length 8 bits elements into a 16 bits buffer, using SIMD instructions when available
+void widen_row(const unsigned char *source, unsigned short int *destination, unsigned int length);
+
+///Copies length 16 bits elements, which must all be smaller than 256, into an 8 bits buffer,
+///using SIMD instructions when available
+void narrow_row(const unsigned short int *source, unsigned char *destination, unsigned int length);
+
+///Stores value in buffer on bytes bytes, most significant first, returning the first byte after it;
+///used by the headers and the records of the band index, checkpoint and tile container files
+unsigned char *put_big_endian(unsigned char *buffer, unsigned long long value, unsigned int bytes);
+
+///Loads from buffer a value stored on bytes bytes, most significant first, returning the first byte after it
+const unsigned char *get_big_endian(const unsigned char *buffer, unsigned long long *value, unsigned int bytes);
 
 ///Writes the numBitsToWrite bits from bitToWrite into compressedStream, starting at byte
 ///writtenBytes and in that byte at bit writtenBits. It also updates writtenBytes and
 ///writtenBits according to the number of bits written
-///@param compressed_stream pointer to the array holding the stream cotnaining the compressed data
+///@param compressed_stream pointer to the array holding the stream cotnaining the compressed data; when
+///NULL the bits are not written, written_bytes and written_bits are only moved past them
 ///@param written_bytes number of bytes so far written to the stream
 ///@param written_bits number of bits so far written to the stream
 ///@param num_bits_to_write number of least significant bits of the bits_to_write word which we have to
 ///write into the stream
 ///@param bits_to_write word containing the bits to be written to the stream
-void bitStream_store(unsigned char *compressed_stream, unsigned int *written_bytes,
+void bitStream_store(unsigned char *compressed_stream, size_t *written_bytes,
 		unsigned int *written_bits, unsigned int num_bits_to_write, unsigned int bits_to_write);
 
 ///Writes bitToRepeat a number of times equal to numBitsToWrite into compressedStream, starting at byte
 ///writtenBytes and in that byte at bit writtenBits. It also updates writtenBytes and
 ///writtenBits according to the number of bits written
-///@param compressed_stream pointer to the array holding the stream cotnaining the compressed data
+///@param compressed_stream pointer to the array holding the stream cotnaining the compressed data; when
+///NULL the bits are only counted, as by bitStream_store
 ///@param written_bytes number of bytes so far written to the stream
 ///@param written_bits number of bits so far written to the stream
 ///@param num_bits_to_write number of times the bit in the least significant position of bit_to_repeat
 ///has to be added to the stream
 ///@param bit_to_repeat byte whose least significant bit is to be added to the stream num_bits_to_write times
-void bitStream_store_constant(unsigned char *compressed_stream, unsigned int *written_bytes,
+void bitStream_store_constant(unsigned char *compressed_stream, size_t *written_bytes,
 		unsigned int *written_bits, unsigned int num_bits_to_write, unsigned char bit_to_repeat);
 
+///Appends to compressedStream, starting at byte writtenBytes and in that byte at bit writtenBits,
+///the first source_bytes bytes and source_bits bits of the source stream (e.g. a stream produced
+///separately). It also updates writtenBytes and writtenBits according to the number of bits written
+void bitStream_append(unsigned char *compressed_stream, size_t *written_bytes, unsigned int *written_bits,
+		const unsigned char *source, size_t source_bytes, unsigned int source_bits);
+
+///Writes to file the complete bytes of the compressed stream, moving the partially written
+///byte to the beginning of compressed_stream so that the writing can continue (the rest of
+///the array is cleared); written_bytes is reset accordingly
+///@return 0 if the operation succesfully completes, a negative value otherwise
+int bitStream_flush(io_file_t *outFile, unsigned char *compressed_stream, size_t *written_bytes);
+
 ///Reads from file the specified ammount of bits and returns the read value into
 ///as unsigned integer.
 unsigned int read_bits(FILE *compressedStream, unsigned int num_bits, unsigned char *buffer, unsigned int *buffer_len);
@@ -155,14 +261,16 @@ int sign_extend(unsigned int orig_value, unsigned int bit_width);
 ///Given the index of an element in an array where pixels are stored according to
 ///the specified ordering, it returns the index of the same image element
 ///in an array specified using BSQ ordering.
-unsigned int indexToBSQ(interleaving_t interleaving, unsigned int interleaving_depth,
-		unsigned int x_size, unsigned int y_size, unsigned int z_size, unsigned int index);
+///The index must be smaller than the number of samples of the image.
+size_t indexToBSQ(interleaving_t interleaving, unsigned int interleaving_depth,
+		unsigned int x_size, unsigned int y_size, unsigned int z_size, size_t index);
 
 ///Given the index of an element in an array where pixels are stored according
 ///to the BSQ ordering, it returns the index of the same image element
 ///in an array ordered using the specified ordering
-unsigned int BSQToIndex(interleaving_t interleaving, unsigned int interleaving_depth,
-		unsigned int x_size, unsigned int y_size, unsigned int z_size, unsigned int index);
+///The index must be smaller than the number of samples of the image.
+size_t BSQToIndex(interleaving_t interleaving, unsigned int interleaving_depth,
+		unsigned int x_size, unsigned int y_size, unsigned int z_size, size_t index);
 
 #endif
 
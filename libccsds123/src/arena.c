@@ -0,0 +1,197 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+#include "arena.h"
+
+// Blocks smaller than this are never allocated: the small buffers (weights, rows, tables)
+// share the same blocks
+#define MIN_BLOCK_SIZE (0x1 << 20)
+// Granularity of the blocks backed by huge pages
+#define HUGE_PAGE_SIZE (0x1 << 21)
+
+/// Header at the beginning of every block; the allocations follow it
+struct arena_block
+{
+	arena_block_t *next;
+	size_t capacity;
+	size_t used;
+	unsigned char mapped;
+};
+
+#define BLOCK_HEADER_SIZE (((sizeof(arena_block_t) + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT) * ARENA_ALIGNMENT)
+
+/// Allocates a block able to hold capacity bytes
+static arena_block_t *new_block(size_t capacity, int huge_pages)
+{
+	size_t size = BLOCK_HEADER_SIZE + capacity;
+	arena_block_t *block = NULL;
+	unsigned char mapped = 0;
+
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (huge_pages != 0)
+	{
+		void *memory = NULL;
+		size = ((size + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE) * HUGE_PAGE_SIZE;
+		memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (memory != MAP_FAILED)
+		{
+			// This is only a hint: the kernel may still use normal pages
+			madvise(memory, size, MADV_HUGEPAGE);
+			block = (arena_block_t *)memory;
+			mapped = 1;
+		}
+	}
+#else
+	(void)huge_pages;
+#endif
+	if (block == NULL)
+	{
+		size = BLOCK_HEADER_SIZE + capacity;
+#ifdef WIN32
+		block = (arena_block_t *)_aligned_malloc(size, ARENA_ALIGNMENT);
+#else
+		if (posix_memalign((void **)&block, ARENA_ALIGNMENT, size) != 0)
+			block = NULL;
+#endif
+		if (block == NULL)
+			return NULL;
+	}
+	block->next = NULL;
+	block->capacity = size - BLOCK_HEADER_SIZE;
+	block->used = 0;
+	block->mapped = mapped;
+	return block;
+}
+
+/// Gives the block back to the system
+static void free_block(arena_block_t *block)
+{
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+	if (block->mapped != 0)
+	{
+		munmap(block, BLOCK_HEADER_SIZE + block->capacity);
+		return;
+	}
+#endif
+#ifdef WIN32
+	_aligned_free(block);
+#else
+	free(block);
+#endif
+}
+
+///Initializes the arena, pre-allocating capacity bytes (nothing when 0);
+///when huge_pages is not 0 the blocks are backed by huge pages, where available
+///@return a negative number if the memory could not be allocated
+int arena_init(arena_t *arena, size_t capacity, int huge_pages)
+{
+	memset(arena, 0, sizeof(arena_t));
+	arena->huge_pages = huge_pages != 0;
+	if (capacity > 0 && (arena->blocks = new_block(capacity, huge_pages)) == NULL)
+		return -1;
+	return 0;
+}
+
+///Allocates size bytes, aligned to ARENA_ALIGNMENT
+///@return NULL if the memory could not be allocated
+void *arena_alloc(arena_t *arena, size_t size)
+{
+	arena_block_t *block = arena->blocks;
+	size_t aligned = 0;
+	void *memory = NULL;
+
+	if (size > (size_t)-1 - BLOCK_HEADER_SIZE - HUGE_PAGE_SIZE)
+		return NULL;
+	// zero sized allocations still get their own address
+	aligned = size > 0 ? ((size + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT) * ARENA_ALIGNMENT : ARENA_ALIGNMENT;
+	if (block == NULL || block->capacity - block->used < aligned)
+	{
+		block = new_block(aligned > MIN_BLOCK_SIZE ? aligned : MIN_BLOCK_SIZE, arena->huge_pages);
+		if (block == NULL)
+			return NULL;
+		block->next = arena->blocks;
+		arena->blocks = block;
+	}
+	memory = (unsigned char *)block + BLOCK_HEADER_SIZE + block->used;
+	block->used += aligned;
+	arena->used_bytes += aligned;
+	if (arena->used_bytes > arena->peak_bytes)
+		arena->peak_bytes = arena->used_bytes;
+	return memory;
+}
+
+///Allocates count elements of size bytes, setting them to 0
+///@return NULL if the memory could not be allocated
+void *arena_calloc(arena_t *arena, size_t count, size_t size)
+{
+	void *memory = NULL;
+	if (size != 0 && count > (size_t)-1 / size)
+		return NULL;
+	if ((memory = arena_alloc(arena, count * size)) != NULL)
+		memset(memory, 0, count * size);
+	return memory;
+}
+
+///Returns the current position of the arena
+arena_mark_t arena_get_mark(const arena_t *arena)
+{
+	arena_mark_t mark;
+	mark.block = arena->blocks;
+	mark.block_used = arena->blocks != NULL ? arena->blocks->used : 0;
+	mark.used_bytes = arena->used_bytes;
+	return mark;
+}
+
+///Releases all the allocations performed after mark was taken
+void arena_rewind(arena_t *arena, arena_mark_t mark)
+{
+	// the blocks added after the mark only hold released allocations
+	while (arena->blocks != NULL && arena->blocks != mark.block)
+	{
+		arena_block_t *block = arena->blocks;
+		arena->blocks = block->next;
+		free_block(block);
+	}
+	if (arena->blocks != NULL)
+		arena->blocks->used = mark.block_used;
+	arena->used_bytes = mark.used_bytes;
+}
+
+///Releases all the allocations, keeping the memory for the next use of the arena
+void arena_reset(arena_t *arena)
+{
+	arena->used_bytes = 0;
+	if (arena->blocks != NULL && arena->blocks->next == NULL && arena->blocks->capacity >= arena->peak_bytes)
+	{
+		arena->blocks->used = 0;
+		return;
+	}
+	// The blocks are merged into a single one holding all the memory used so far, so that the same
+	// sequence of allocations does not need any new block. Should the allocation fail, blocks will be
+	// allocated again on demand
+	while (arena->blocks != NULL)
+	{
+		arena_block_t *block = arena->blocks;
+		arena->blocks = block->next;
+		free_block(block);
+	}
+	if (arena->peak_bytes > 0)
+		arena->blocks = new_block(arena->peak_bytes, arena->huge_pages);
+}
+
+///Gives back all the memory of the arena to the system
+void arena_release(arena_t *arena)
+{
+	while (arena->blocks != NULL)
+	{
+		arena_block_t *block = arena->blocks;
+		arena->blocks = block->next;
+		free_block(block);
+	}
+	arena->used_bytes = 0;
+	arena->peak_bytes = 0;
+}
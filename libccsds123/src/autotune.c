@@ -0,0 +1,594 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "autotune.h"
+#include "entropy_encoder.h"
+#include "predictor.h"
+#include "utils.h"
+
+// Largest number of prediction bands the header of the stream can hold
+#define TUNING_MAX_PRED_BANDS 15
+
+// Largest number of candidates of a batch: the combinations of the encoder parameters
+#define TUNING_MAX_CANDIDATES (TUNING_MAX_VALUES * TUNING_MAX_VALUES * TUNING_MAX_VALUES)
+
+/// Parameters of a candidate and the bits of the codewords of the lines evaluated with them
+typedef struct
+{
+	predictor_config_t predictor_params;
+	encoder_config_t encoder_params;
+	unsigned long long codeword_bits;
+} tuning_candidate_t;
+
+/// Candidates evaluated by a group of threads on the lines kept from the image
+typedef struct
+{
+	input_feature_t sampled_params;
+	const void *samples;
+	// residuals shared by all the candidates, which then only differ in the encoder parameters; NULL when
+	// every candidate is predicted
+	void *residuals;
+	tuning_candidate_t *candidates;
+	unsigned int num_candidates;
+	log_callback_t log_callback;
+	void *log_user_data;
+	// next candidate to be evaluated and whether a thread failed, accessed atomically
+	unsigned int next_candidate;
+	int failed;
+} tuning_batch_t;
+
+/// Thread evaluating the candidates of a batch, with buffers of its own
+typedef struct
+{
+	tuning_batch_t *batch;
+	// provides the temporary buffers of the prediction and of the encoder
+	arena_t arena;
+	// residuals of the lines evaluated and accumulator initialization table of the candidate
+	void *residuals;
+	unsigned int *k_init;
+	pthread_t thread;
+	ccsds_status_t status;
+} tuning_worker_t;
+
+/// Returns the value of parameter in the predictor and encoder parameters
+static int get_parameter(const predictor_config_t *predictor_params, const encoder_config_t *encoder_params, tuning_parameter_t parameter)
+{
+	switch (parameter)
+	{
+		case TUNE_PRED_BANDS:
+			return predictor_params->pred_bands;
+		case TUNE_FULL:
+			return predictor_params->full;
+		case TUNE_NEIGHBOUR_SUM:
+			return predictor_params->neighbour_sum;
+		case TUNE_WEIGHT_RESOLUTION:
+			return predictor_params->weight_resolution;
+		case TUNE_WEIGHT_INTERVAL:
+			return predictor_params->weight_interval;
+		case TUNE_WEIGHT_INITIAL:
+			return predictor_params->weight_initial;
+		case TUNE_WEIGHT_FINAL:
+			return predictor_params->weight_final;
+		case TUNE_U_MAX:
+			return (int)encoder_params->u_max;
+		case TUNE_Y_STAR:
+			return (int)encoder_params->y_star;
+		default:
+			return (int)encoder_params->k;
+	}
+}
+
+/// Sets parameter to value in the predictor and encoder parameters; the values out of the range of the
+/// fields holding them are stored as an invalid value of the parameter
+static void set_parameter(predictor_config_t *predictor_params, encoder_config_t *encoder_params, tuning_parameter_t parameter, int value)
+{
+	switch (parameter)
+	{
+		case TUNE_PRED_BANDS:
+			predictor_params->pred_bands = value < 0 || value > TUNING_MAX_PRED_BANDS ? 0xFF : (unsigned char)value;
+			predictor_params->user_input_pred_bands = predictor_params->pred_bands;
+			break;
+		case TUNE_FULL:
+			predictor_params->full = (unsigned char)(value != 0);
+			break;
+		case TUNE_NEIGHBOUR_SUM:
+			predictor_params->neighbour_sum = (unsigned char)(value != 0);
+			break;
+		case TUNE_WEIGHT_RESOLUTION:
+			predictor_params->weight_resolution = value < 0 || value > 0xFF ? 0 : (unsigned char)value;
+			break;
+		case TUNE_WEIGHT_INTERVAL:
+			predictor_params->weight_interval = value;
+			break;
+		case TUNE_WEIGHT_INITIAL:
+			predictor_params->weight_initial = value < -128 || value > 127 ? 127 : (char)value;
+			break;
+		case TUNE_WEIGHT_FINAL:
+			predictor_params->weight_final = value < -128 || value > 127 ? 127 : (char)value;
+			break;
+		case TUNE_U_MAX:
+			encoder_params->u_max = (unsigned int)value;
+			break;
+		case TUNE_Y_STAR:
+			encoder_params->y_star = (unsigned int)value;
+			break;
+		default:
+			encoder_params->k = (unsigned int)value;
+			break;
+	}
+}
+
+/// Checks, without reporting anything, that the compression accepts the parameters of candidate for the
+/// image of config; pred_bands is capped to the number of bands as by the compression
+static int check_candidate(const compressConfig_t *config, tuning_candidate_t *candidate)
+{
+	compressConfig_t check = *config;
+
+	if (candidate->predictor_params.pred_bands > TUNING_MAX_PRED_BANDS)
+		return -1;
+	check.predictor_params = candidate->predictor_params;
+	check.encoder_params = candidate->encoder_params;
+	check.log_callback = NULL;
+	if (compress_check_config(&check) != CCSDS_OK)
+		return -1;
+	candidate->predictor_params = check.predictor_params;
+	return 0;
+}
+
+/// Computes the bits of the codewords of the lines of the batch with the parameters of candidate,
+/// predicting them unless the batch shares its residuals
+static int evaluate_candidate(tuning_worker_t *worker, tuning_candidate_t *candidate)
+{
+	tuning_batch_t *batch = worker->batch;
+	encoder_config_t encoder_params = candidate->encoder_params;
+	void *residuals = batch->residuals;
+	rate_estimate_t estimate;
+	unsigned int z = 0;
+
+	if (residuals == NULL)
+	{
+		if (predict_bands(batch->sampled_params, candidate->predictor_params, batch->samples, worker->residuals, 0,
+					batch->sampled_params.z_size, &worker->arena) != 0)
+		{
+			log_error(CCSDS_ERROR_INTERNAL, "\nError during the computation of the residuals (i.e. prediction)\n\n");
+			return -1;
+		}
+		residuals = worker->residuals;
+	}
+	for (z = 0; z < batch->sampled_params.z_size; z++)
+	{
+		worker->k_init[z] = encoder_params.k;
+	}
+	encoder_params.k_init = worker->k_init;
+	memset(&estimate, 0, sizeof(rate_estimate_t));
+	if (estimate_encoding(batch->sampled_params, encoder_params, candidate->predictor_params, residuals, &estimate, &worker->arena) != 0)
+	{
+		return -1;
+	}
+	candidate->codeword_bits = estimate.codeword_bits;
+	return 0;
+}
+
+/// Evaluates the next candidate not taken by another thread, until all of them are evaluated or a thread fails
+static void *evaluate_candidates(void *argument)
+{
+	tuning_worker_t *worker = (tuning_worker_t *)argument;
+	tuning_batch_t *batch = worker->batch;
+	log_context_t log_context;
+	int result = 0;
+
+	log_begin(&log_context, batch->log_callback, batch->log_user_data);
+	while (result == 0 && __atomic_load_n(&batch->failed, __ATOMIC_RELAXED) == 0)
+	{
+		unsigned int i = __atomic_fetch_add(&batch->next_candidate, 1, __ATOMIC_RELAXED);
+		if (i >= batch->num_candidates)
+			break;
+		result = evaluate_candidate(worker, &batch->candidates[i]);
+	}
+	if (result != 0)
+		__atomic_store_n(&batch->failed, 1, __ATOMIC_RELAXED);
+	worker->status = log_end(&log_context, result);
+	return NULL;
+}
+
+/// Evaluates all the candidates of batch with up to num_workers threads, the calling one included
+static int evaluate_batch(tuning_batch_t *batch, tuning_worker_t *workers, unsigned int num_workers)
+{
+	unsigned int started = 0;
+	unsigned int i = 0;
+
+	if (num_workers > batch->num_candidates)
+		num_workers = batch->num_candidates;
+	batch->next_candidate = 0;
+	batch->failed = 0;
+	for (i = 0; i < num_workers; i++)
+	{
+		workers[i].batch = batch;
+		workers[i].status = CCSDS_OK;
+	}
+	for (started = 1; started < num_workers; started++)
+	{
+		if (pthread_create(&workers[started].thread, NULL, evaluate_candidates, &workers[started]) != 0)
+			break;
+	}
+	evaluate_candidates(&workers[0]);
+	for (i = 1; i < started; i++)
+		pthread_join(workers[i].thread, NULL);
+
+	// The errors of the other threads have been reported to the log callback already
+	for (i = 0; i < started; i++)
+	{
+		if (workers[i].status != CCSDS_OK)
+		{
+			log_error(workers[i].status, "Error in evaluating the candidate parameters\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/// Index of the candidate of batch with the fewest bits, or num_candidates if none has fewer than best_bits
+static unsigned int best_candidate(const tuning_batch_t *batch, unsigned long long best_bits)
+{
+	unsigned int best = batch->num_candidates;
+	unsigned int i = 0;
+
+	for (i = 0; i < batch->num_candidates; i++)
+	{
+		if (batch->candidates[i].codeword_bits < best_bits)
+		{
+			best = i;
+			best_bits = batch->candidates[i].codeword_bits;
+		}
+	}
+	return best;
+}
+
+/// Formats the parameters of candidate as options of the compressor
+static void format_parameters(const tuning_candidate_t *candidate, char *buffer, size_t size)
+{
+	snprintf(buffer, size, "--pred_bands %u%s%s --w_resolution %u --w_interval %d --w_initial %d --w_final %d --u_max %u --y_star %u --k %u",
+			candidate->predictor_params.pred_bands, candidate->predictor_params.full != 0 ? " --full" : "",
+			candidate->predictor_params.neighbour_sum != 0 ? " --neighbour_sum" : "", candidate->predictor_params.weight_resolution,
+			candidate->predictor_params.weight_interval, candidate->predictor_params.weight_initial, candidate->predictor_params.weight_final,
+			candidate->encoder_params.u_max, candidate->encoder_params.y_star, candidate->encoder_params.k);
+}
+
+// Checks that config and grid can be tuned.
+static int check_tuning(compressConfig_t *config, const tuning_grid_t *grid)
+{
+	unsigned int p = 0;
+
+	if (grid == NULL)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the values of the parameters to be tried\n\n");
+		return -1;
+	}
+	for (p = 0; p < TUNING_PARAMETERS; p++)
+	{
+		if (grid->num_values[p] > TUNING_MAX_VALUES)
+		{
+			log_error(CCSDS_ERROR_CONFIG, "\nError, at most %d values can be tried for each parameter\n\n", TUNING_MAX_VALUES);
+			return -1;
+		}
+	}
+	if (config->samples_file[0] == '\x0')
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the file containing the input samples to be compressed\n\n");
+		return -1;
+	}
+	if (config->encoder_params.encoding_method != SAMPLE)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the parameters can only be tuned for the sample adaptive encoder\n\n");
+		return -1;
+	}
+	if (config->init_table_file[0] != '\x0' || config->init_weight_file[0] != '\x0')
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the parameters cannot be tuned when initialization tables are used\n\n");
+		return -1;
+	}
+	if (config->io_backend > IO_BACKEND_DIRECT)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, unknown I/O backend %d\n\n", (int)config->io_backend);
+		return -1;
+	}
+	if (compress_check_config(config) != CCSDS_OK || config->predictor_params.pred_bands > TUNING_MAX_PRED_BANDS)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the parameters the search starts from are not valid\n\n");
+		return -1;
+	}
+	return 0;
+}
+
+// Writes the parameters of best to bestFile, on one line.
+static int write_parameters(const tuning_candidate_t *best, const char *bestFile)
+{
+	char options[256];
+	FILE *parametersFile = NULL;
+	int result = 0;
+
+	format_parameters(best, options, sizeof(options));
+	if ((parametersFile = fopen(bestFile, "w")) == NULL)
+	{
+		log_error(CCSDS_ERROR_IO, "\nError in creating file %s for the tuned parameters\n\n", bestFile);
+		return -1;
+	}
+	if (fprintf(parametersFile, "%s\n", options) < 0)
+		result = -1;
+	if (fclose(parametersFile) != 0)
+		result = -1;
+	if (result != 0)
+		log_error(CCSDS_ERROR_IO, "\nError in writing the tuned parameters to file %s\n\n", bestFile);
+	return result;
+}
+
+// Tunes the parameters of config with num_workers threads, allocating the shared buffers from arena.
+static int tune_parameters(compressConfig_t *config, const tuning_grid_t *grid, unsigned int line_step, unsigned int num_workers,
+		char bestFile[128], tuning_report_t *report, tuning_worker_t *workers, arena_t *arena)
+{
+	double tuningStartTime = ((double)clock()) / CLOCKS_PER_SEC;
+	const unsigned int sample_bytes = SAMPLE_BYTES(config->input_params);
+	const unsigned int num_values[3] = {grid->num_values[TUNE_U_MAX], grid->num_values[TUNE_Y_STAR], grid->num_values[TUNE_K]};
+	tuning_batch_t batch;
+	tuning_candidate_t best;
+	tuning_report_t outcome;
+	char options[256];
+	unsigned long long best_bits = 0;
+	void *samples = NULL;
+	unsigned int improved = 1;
+	unsigned int p = 0, i = 0, u = 0, y = 0, k = 0;
+
+	memset(&batch, 0, sizeof(tuning_batch_t));
+	memset(&outcome, 0, sizeof(tuning_report_t));
+	batch.sampled_params = config->input_params;
+	batch.sampled_params.y_size = sampled_lines(config->input_params.y_size, line_step);
+	log_current_callback(&batch.log_callback, &batch.log_user_data);
+	samples = arena_alloc(arena, sample_bytes * IMAGE_SAMPLES(config->input_params));
+	batch.samples = line_step > 1 ? arena_alloc(arena, sample_bytes * IMAGE_SAMPLES(batch.sampled_params)) : samples;
+	batch.candidates = (tuning_candidate_t *)arena_alloc(arena, sizeof(tuning_candidate_t) * TUNING_MAX_CANDIDATES);
+	if (samples == NULL || batch.samples == NULL || batch.candidates == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the samples and the candidates\n\n");
+		return -1;
+	}
+	for (i = 0; i < num_workers; i++)
+	{
+		workers[i].residuals = arena_alloc(arena, sample_bytes * IMAGE_SAMPLES(batch.sampled_params));
+		workers[i].k_init = (unsigned int *)arena_alloc(arena, sizeof(unsigned int) * config->input_params.z_size);
+		if (workers[i].residuals == NULL || workers[i].k_init == NULL)
+		{
+			log_error(CCSDS_ERROR_MEMORY, "Error in allocating the residuals of the threads\n\n");
+			return -1;
+		}
+	}
+	if (read_samples(config->input_params, config->io_backend, config->samples_file, samples) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "\nError in reading the input samples\n\n");
+		return -1;
+	}
+	if (line_step > 1)
+		sample_lines(config->input_params, line_step, samples, (void *)batch.samples);
+
+	// The parameters given are the first candidate
+	memset(&best, 0, sizeof(tuning_candidate_t));
+	best.predictor_params = config->predictor_params;
+	best.encoder_params = config->encoder_params;
+	best.encoder_params.k_init = NULL;
+	best.encoder_params.band_bits = NULL;
+	best.encoder_params.checkpoints = NULL;
+	best.predictor_params.adapted_weights = NULL;
+	batch.candidates[0] = best;
+	batch.num_candidates = 1;
+	if (evaluate_batch(&batch, workers, num_workers) != 0)
+		return -1;
+	best = batch.candidates[0];
+	best_bits = best.codeword_bits;
+	outcome.baseline_rate = ((double)best_bits) / IMAGE_SAMPLES(batch.sampled_params);
+	outcome.evaluated++;
+	outcome.predicted++;
+
+	// Coordinate descent over the predictor parameters: the values of a parameter are evaluated in parallel
+	for (outcome.passes = 0; improved != 0 && outcome.passes < TUNING_MAX_PASSES; outcome.passes++)
+	{
+		improved = 0;
+		for (p = TUNE_PRED_BANDS; p <= TUNE_WEIGHT_FINAL; p++)
+		{
+			batch.num_candidates = 0;
+			for (i = 0; i < grid->num_values[p]; i++)
+			{
+				tuning_candidate_t *candidate = &batch.candidates[batch.num_candidates];
+				*candidate = best;
+				set_parameter(&candidate->predictor_params, &candidate->encoder_params, (tuning_parameter_t)p, grid->values[p][i]);
+				if (check_candidate(config, candidate) != 0)
+				{
+					outcome.skipped += outcome.passes == 0 ? 1 : 0;
+					continue;
+				}
+				// the current value, or one capped to it, is the best candidate itself
+				if (get_parameter(&candidate->predictor_params, &candidate->encoder_params, (tuning_parameter_t)p) ==
+						get_parameter(&best.predictor_params, &best.encoder_params, (tuning_parameter_t)p))
+					continue;
+				batch.num_candidates++;
+			}
+			if (batch.num_candidates == 0)
+				continue;
+			if (evaluate_batch(&batch, workers, num_workers) != 0)
+				return -1;
+			outcome.evaluated += batch.num_candidates;
+			outcome.predicted += batch.num_candidates;
+			if ((i = best_candidate(&batch, best_bits)) < batch.num_candidates)
+			{
+				best = batch.candidates[i];
+				best_bits = best.codeword_bits;
+				improved = 1;
+			}
+		}
+	}
+
+	// The encoder parameters do not change the residuals: every combination of their values is encoded
+	// from the residuals of the best predictor
+	batch.residuals = workers[0].residuals;
+	if (predict_bands(batch.sampled_params, best.predictor_params, batch.samples, batch.residuals, 0, batch.sampled_params.z_size, arena) != 0)
+	{
+		log_error(CCSDS_ERROR_INTERNAL, "\nError during the computation of the residuals (i.e. prediction)\n\n");
+		return -1;
+	}
+	batch.num_candidates = 0;
+	for (u = 0; u < (num_values[0] > 0 ? num_values[0] : 1); u++)
+	{
+		for (y = 0; y < (num_values[1] > 0 ? num_values[1] : 1); y++)
+		{
+			for (k = 0; k < (num_values[2] > 0 ? num_values[2] : 1); k++)
+			{
+				tuning_candidate_t *candidate = &batch.candidates[batch.num_candidates];
+				*candidate = best;
+				if (num_values[0] > 0)
+					set_parameter(&candidate->predictor_params, &candidate->encoder_params, TUNE_U_MAX, grid->values[TUNE_U_MAX][u]);
+				if (num_values[1] > 0)
+					set_parameter(&candidate->predictor_params, &candidate->encoder_params, TUNE_Y_STAR, grid->values[TUNE_Y_STAR][y]);
+				if (num_values[2] > 0)
+					set_parameter(&candidate->predictor_params, &candidate->encoder_params, TUNE_K, grid->values[TUNE_K][k]);
+				if (check_candidate(config, candidate) != 0)
+				{
+					outcome.skipped++;
+					continue;
+				}
+				if (candidate->encoder_params.u_max == best.encoder_params.u_max && candidate->encoder_params.y_star == best.encoder_params.y_star &&
+						candidate->encoder_params.k == best.encoder_params.k)
+					continue;
+				batch.num_candidates++;
+			}
+		}
+	}
+	if (batch.num_candidates > 0)
+	{
+		if (evaluate_batch(&batch, workers, num_workers) != 0)
+			return -1;
+		outcome.evaluated += batch.num_candidates;
+		if ((i = best_candidate(&batch, best_bits)) < batch.num_candidates)
+		{
+			best = batch.candidates[i];
+			best_bits = best.codeword_bits;
+		}
+	}
+	outcome.best_rate = ((double)best_bits) / IMAGE_SAMPLES(batch.sampled_params);
+
+	if (bestFile != NULL && bestFile[0] != '\x0' && write_parameters(&best, bestFile) != 0)
+	{
+		return -1;
+	}
+	config->predictor_params = best.predictor_params;
+	config->encoder_params.u_max = best.encoder_params.u_max;
+	config->encoder_params.y_star = best.encoder_params.y_star;
+	config->encoder_params.k = best.encoder_params.k;
+	if (report != NULL)
+		*report = outcome;
+
+	format_parameters(&best, options, sizeof(options));
+	log_info("Overall Tuning duration %lf (sec)\n", ((double)clock()) / CLOCKS_PER_SEC - tuningStartTime);
+	log_info("%u candidates evaluated (%u of them predicted) in %u passes, %u skipped as invalid\n", outcome.evaluated, outcome.predicted,
+			outcome.passes, outcome.skipped);
+	log_info("Rate of the codewords %lf bits/sample with the parameters given, %lf bits/sample with the best ones\n", outcome.baseline_rate,
+			outcome.best_rate);
+	log_info("Best parameters: %s\n", options);
+	return 0;
+}
+
+// Implementation of public functions.
+
+void tuning_grid_set(tuning_grid_t *grid, tuning_parameter_t parameter, const int *values, unsigned int count)
+{
+	if (count > TUNING_MAX_VALUES)
+		count = TUNING_MAX_VALUES;
+	memcpy(grid->values[parameter], values, sizeof(int) * count);
+	grid->num_values[parameter] = count;
+}
+
+int autotune_ccsds123(compressConfig_t *config, const tuning_grid_t *grid, unsigned int line_step, unsigned int num_threads,
+		char bestFile[128], tuning_report_t *report)
+{
+	arena_t local_arena;
+	arena_t *arena = config->arena;
+	log_context_t log_context;
+	tuning_worker_t *workers = NULL;
+	input_feature_t sampled_params = config->input_params;
+	predictor_config_t largest_predictor = config->predictor_params;
+	size_t shared_memory = 0;
+	size_t worker_memory = 0;
+	unsigned int num_workers = 0;
+	unsigned int i = 0;
+	int result = -1;
+
+	log_begin(&log_context, config->log_callback, config->log_user_data);
+	if (check_tuning(config, grid) != 0)
+		return log_end(&log_context, -1);
+	if (num_threads == 0)
+	{
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		num_threads = online > 0 ? (unsigned int)online : 1;
+	}
+	if (line_step == 0)
+		line_step = 1;
+
+	// Every thread holds the residuals of the lines evaluated and the buffers of the prediction and of the
+	// encoder, bounded with the largest predictor of the grid
+	sampled_params.y_size = sampled_lines(config->input_params.y_size, line_step);
+	largest_predictor.full = 1;
+	largest_predictor.pred_bands = MIN(TUNING_MAX_PRED_BANDS, config->input_params.z_size - 1);
+	shared_memory = SAMPLE_BYTES(config->input_params) * (IMAGE_SAMPLES(config->input_params) + (line_step > 1 ? IMAGE_SAMPLES(sampled_params) : 0)) +
+			sizeof(tuning_candidate_t) * TUNING_MAX_CANDIDATES;
+	worker_memory = SAMPLE_BYTES(config->input_params) * IMAGE_SAMPLES(sampled_params) + sizeof(unsigned int) * config->input_params.z_size +
+			predict_bands_working_set(sampled_params, largest_predictor, 0, sampled_params.z_size) +
+			encoder_state_size(sampled_params, config->encoder_params) + sizeof(unsigned long long) * sampled_params.z_size + sizeof(tuning_worker_t);
+	if (config->memory_budget != 0)
+	{
+		if (config->memory_budget < shared_memory + worker_memory)
+		{
+			log_error(CCSDS_ERROR_MEMORY, "\nError, the tuning needs %zu bytes of memory, more than the budget of %zu bytes\n\n",
+					shared_memory + worker_memory, config->memory_budget);
+			return log_end(&log_context, -1);
+		}
+		num_threads = MIN(num_threads, (unsigned int)((config->memory_budget - shared_memory) / worker_memory));
+	}
+
+	if (arena == NULL)
+	{
+		arena = &local_arena;
+		arena_init(arena, 0, 0);
+	}
+	// Everything used by the threads but their temporary buffers is allocated up front, as the arena is not
+	// shared among them
+	if ((workers = (tuning_worker_t *)arena_calloc(arena, num_threads, sizeof(tuning_worker_t))) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the threads of the tuning\n");
+	}
+	else
+	{
+		for (num_workers = 0; num_workers < num_threads; num_workers++)
+		{
+			if (arena_init(&workers[num_workers].arena, 0, 0) != 0)
+				break;
+		}
+		if (num_workers == 0)
+			log_error(CCSDS_ERROR_MEMORY, "Error in allocating the memory of the threads of the tuning\n");
+		else
+			result = tune_parameters(config, grid, line_step, num_workers, bestFile, report, workers, arena);
+		for (i = 0; i < num_workers; i++)
+			arena_release(&workers[i].arena);
+	}
+
+	// As for compress_ccsds123, the tables point to the memory given back here.
+	config->encoder_params.k_init = NULL;
+	config->encoder_params.band_bits = NULL;
+	config->encoder_params.checkpoints = NULL;
+	config->predictor_params.weight_init_table = NULL;
+	if (arena == config->arena)
+		arena_reset(arena);
+	else
+		arena_release(arena);
+	return log_end(&log_context, result);
+}
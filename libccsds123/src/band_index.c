@@ -0,0 +1,97 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "band_index.h"
+
+// Characters opening every index file
+#define BAND_INDEX_MAGIC "CBIX"
+
+/// Writes value to file on bytes bytes, most significant first
+static int write_big_endian(FILE *file, unsigned long long value, unsigned int bytes)
+{
+	unsigned char buffer[8];
+
+	put_big_endian(buffer, value, bytes);
+	return fwrite(buffer, 1, bytes, file) == bytes ? 0 : -1;
+}
+
+/// Reads from file a value stored on bytes bytes, most significant first
+static int read_big_endian(FILE *file, unsigned long long *value, unsigned int bytes)
+{
+	unsigned char buffer[8];
+
+	if (fread(buffer, 1, bytes, file) != bytes)
+		return -1;
+	get_big_endian(buffer, value, bytes);
+	return 0;
+}
+
+///Writes to fileName the index of the stream of the image described by input_params, given the number
+///of bits of the codewords of every band
+int write_band_index(char fileName[128], input_feature_t input_params, const unsigned long long *band_bits)
+{
+	FILE *indexFile = NULL;
+	unsigned long long offset = 0;
+	unsigned int z = 0;
+	int result = 0;
+
+	if ((indexFile = fopen(fileName, "wb")) == NULL)
+	{
+		log_error(CCSDS_ERROR_IO, "\nError, in creating the band index file %s\n\n", fileName);
+		return -1;
+	}
+	if (fwrite(BAND_INDEX_MAGIC, 1, 4, indexFile) != 4 || write_big_endian(indexFile, input_params.x_size, 4) != 0 ||
+			write_big_endian(indexFile, input_params.y_size, 4) != 0 || write_big_endian(indexFile, input_params.z_size, 4) != 0)
+		result = -1;
+	for (z = 0; z <= input_params.z_size && result == 0; z++)
+	{
+		result = write_big_endian(indexFile, offset, 8);
+		if (z < input_params.z_size)
+			offset += band_bits[z];
+	}
+	if (fclose(indexFile) != 0)
+		result = -1;
+	if (result != 0)
+		log_error(CCSDS_ERROR_IO, "\nError, in writing the band index file %s\n\n", fileName);
+	return result;
+}
+
+///Reads from fileName the index of the stream of the image described by input_params, filling in the
+///z_size + 1 elements of band_offsets
+int read_band_index(char fileName[128], input_feature_t input_params, unsigned long long *band_offsets)
+{
+	FILE *indexFile = NULL;
+	char magic[4];
+	unsigned long long x_size = 0, y_size = 0, z_size = 0;
+	unsigned int z = 0;
+	int result = 0;
+
+	if ((indexFile = fopen(fileName, "rb")) == NULL)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in opening the band index file %s\n", fileName);
+		return -1;
+	}
+	if (fread(magic, 1, 4, indexFile) != 4 || memcmp(magic, BAND_INDEX_MAGIC, 4) != 0 || read_big_endian(indexFile, &x_size, 4) != 0 ||
+			read_big_endian(indexFile, &y_size, 4) != 0 || read_big_endian(indexFile, &z_size, 4) != 0)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error, %s is not a band index file\n", fileName);
+		fclose(indexFile);
+		return -1;
+	}
+	if (x_size != input_params.x_size || y_size != input_params.y_size || z_size != input_params.z_size)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error, the band index %s was written for an image of %llux%llux%llu samples\n", fileName, x_size, y_size, z_size);
+		fclose(indexFile);
+		return -1;
+	}
+	for (z = 0; z <= input_params.z_size && result == 0; z++)
+	{
+		result = read_big_endian(indexFile, &band_offsets[z], 8);
+		if (result == 0 && z > 0 && band_offsets[z] < band_offsets[z - 1])
+			result = -1;
+	}
+	fclose(indexFile);
+	if (result != 0)
+		log_error(CCSDS_ERROR_DATA, "Error, the band index %s is truncated or corrupted\n", fileName);
+	return result;
+}
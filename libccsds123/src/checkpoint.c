@@ -0,0 +1,224 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "checkpoint.h"
+
+// Characters opening every checkpoint file
+#define CHECKPOINT_MAGIC "CBCP"
+
+// Number of bytes of the header of the file: the magic and five 32 bits fields
+#define CHECKPOINT_HEADER_SIZE 24
+
+/// Number of bytes of every record of the file
+static size_t record_size(input_feature_t input_params, unsigned int weights_len)
+{
+	const size_t z_size = input_params.z_size;
+	return 4 + 8 + z_size * (4 + 4 + 2 + 4 * (size_t)weights_len) + 2 * (size_t)input_params.x_size * z_size;
+}
+
+/// Number of weights saved for every band: the ones of the previous bands which can be used by the
+/// predictor, followed by the directional ones
+static unsigned int saved_weights(input_feature_t input_params, predictor_config_t predictor_params)
+{
+	return MIN(predictor_params.pred_bands, input_params.z_size - 1) + (predictor_params.full != 0 ? 3 : 0);
+}
+
+/// Sets the layout of the weights of the user of the file
+static void set_weights_layout(checkpoint_file_t *checkpoints, input_feature_t input_params, predictor_config_t predictor_params)
+{
+	checkpoints->input_params = input_params;
+	checkpoints->pred_bands = predictor_params.pred_bands;
+	checkpoints->full = predictor_params.full != 0;
+	checkpoints->weights_len = saved_weights(input_params, predictor_params);
+	checkpoints->record_size = record_size(input_params, checkpoints->weights_len);
+}
+
+/// Returns the index, in the weights of a band of the user of the file, of the saved weight i
+static size_t weight_index(const checkpoint_file_t *checkpoints, unsigned int i)
+{
+	unsigned int central = checkpoints->weights_len - (checkpoints->full != 0 ? 3 : 0);
+	return i < central ? i : checkpoints->pred_bands + i - central;
+}
+
+///Creates the checkpoint file fileName for the image described by input_params, with a checkpoint every
+///interval lines
+int checkpoint_create(checkpoint_file_t *checkpoints, char fileName[128], input_feature_t input_params, predictor_config_t predictor_params,
+		unsigned int interval, arena_t *arena)
+{
+	unsigned char header[CHECKPOINT_HEADER_SIZE];
+	unsigned char *field = header + 4;
+
+	memset(checkpoints, 0, sizeof(checkpoint_file_t));
+	set_weights_layout(checkpoints, input_params, predictor_params);
+	checkpoints->interval = interval;
+	if ((checkpoints->record = (unsigned char *)arena_alloc(arena, checkpoints->record_size)) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "\nError, in allocating the checkpoint buffer\n\n");
+		return -1;
+	}
+	if ((checkpoints->file = fopen(fileName, "wb")) == NULL)
+	{
+		log_error(CCSDS_ERROR_IO, "\nError, in creating the checkpoint file %s\n\n", fileName);
+		return -1;
+	}
+	memcpy(header, CHECKPOINT_MAGIC, 4);
+	field = put_big_endian(field, input_params.x_size, 4);
+	field = put_big_endian(field, input_params.y_size, 4);
+	field = put_big_endian(field, input_params.z_size, 4);
+	field = put_big_endian(field, interval, 4);
+	put_big_endian(field, checkpoints->weights_len, 4);
+	if (fwrite(header, 1, CHECKPOINT_HEADER_SIZE, checkpoints->file) != CHECKPOINT_HEADER_SIZE)
+	{
+		log_error(CCSDS_ERROR_IO, "\nError, in writing the checkpoint file %s\n\n", fileName);
+		fclose(checkpoints->file);
+		checkpoints->file = NULL;
+		return -1;
+	}
+	return 0;
+}
+
+///Appends to the file the checkpoint of line checkpoint->y
+int checkpoint_write(checkpoint_file_t *checkpoints, const line_checkpoint_t *checkpoint)
+{
+	const input_feature_t input_params = checkpoints->input_params;
+	const size_t line_samples = (size_t)input_params.x_size * input_params.z_size;
+	const size_t stride = checkpoints->pred_bands + (checkpoints->full != 0 ? 3 : 0);
+	unsigned char *field = checkpoints->record;
+	size_t i = 0;
+	unsigned int w = 0;
+
+	field = put_big_endian(field, checkpoint->y, 4);
+	field = put_big_endian(field, checkpoint->bit_offset, 8);
+	for (i = 0; i < input_params.z_size; i++)
+		field = put_big_endian(field, checkpoint->counter[i], 4);
+	for (i = 0; i < input_params.z_size; i++)
+		field = put_big_endian(field, checkpoint->accumulator[i], 4);
+	for (i = 0; i < input_params.z_size; i++)
+		field = put_big_endian(field, checkpoint->origins[i], 2);
+	for (i = 0; i < input_params.z_size; i++)
+	{
+		for (w = 0; w < checkpoints->weights_len; w++)
+			field = put_big_endian(field, (unsigned int)checkpoint->weights[i * stride + weight_index(checkpoints, w)], 4);
+	}
+	for (i = 0; i < line_samples; i++)
+		field = put_big_endian(field, checkpoint->prev_line[i], 2);
+	if (fwrite(checkpoints->record, 1, checkpoints->record_size, checkpoints->file) != checkpoints->record_size)
+	{
+		log_error(CCSDS_ERROR_IO, "\nError, in writing the checkpoint of line %u\n\n", checkpoint->y);
+		return -1;
+	}
+	return 0;
+}
+
+///Opens the checkpoint file fileName, checking that it was written for the image described by input_params
+///and the given predictor
+int checkpoint_open(checkpoint_file_t *checkpoints, char fileName[128], input_feature_t input_params, predictor_config_t predictor_params,
+		arena_t *arena)
+{
+	unsigned char header[CHECKPOINT_HEADER_SIZE];
+	const unsigned char *field = header + 4;
+	unsigned long long x_size = 0, y_size = 0, z_size = 0, interval = 0, weights_len = 0;
+
+	memset(checkpoints, 0, sizeof(checkpoint_file_t));
+	if ((checkpoints->file = fopen(fileName, "rb")) == NULL)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in opening the checkpoint file %s\n", fileName);
+		return -1;
+	}
+	if (fread(header, 1, CHECKPOINT_HEADER_SIZE, checkpoints->file) != CHECKPOINT_HEADER_SIZE || memcmp(header, CHECKPOINT_MAGIC, 4) != 0)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error, %s is not a checkpoint file\n", fileName);
+		checkpoint_close(checkpoints);
+		return -1;
+	}
+	field = get_big_endian(field, &x_size, 4);
+	field = get_big_endian(field, &y_size, 4);
+	field = get_big_endian(field, &z_size, 4);
+	field = get_big_endian(field, &interval, 4);
+	get_big_endian(field, &weights_len, 4);
+	if (x_size != input_params.x_size || y_size != input_params.y_size || z_size != input_params.z_size ||
+			weights_len != saved_weights(input_params, predictor_params) || interval == 0)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error, the checkpoints %s were written for an image of %llux%llux%llu samples with %llu weights per band\n",
+				fileName, x_size, y_size, z_size, weights_len);
+		checkpoint_close(checkpoints);
+		return -1;
+	}
+	set_weights_layout(checkpoints, input_params, predictor_params);
+	checkpoints->interval = (unsigned int)interval;
+	if ((checkpoints->record = (unsigned char *)arena_alloc(arena, checkpoints->record_size)) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the checkpoint buffer\n");
+		checkpoint_close(checkpoints);
+		return -1;
+	}
+	return 0;
+}
+
+///Reads the checkpoint number index into the arrays of checkpoint
+int checkpoint_read(checkpoint_file_t *checkpoints, unsigned int index, line_checkpoint_t *checkpoint)
+{
+	const input_feature_t input_params = checkpoints->input_params;
+	const size_t line_samples = (size_t)input_params.x_size * input_params.z_size;
+	const size_t stride = checkpoints->pred_bands + (checkpoints->full != 0 ? 3 : 0);
+	unsigned int w = 0;
+	unsigned long long y = (unsigned long long)(index + 1) * checkpoints->interval;
+	unsigned long long value = 0;
+	const unsigned char *field = checkpoints->record;
+	size_t i = 0;
+
+	if (fseek(checkpoints->file, (long)(CHECKPOINT_HEADER_SIZE + index * checkpoints->record_size), SEEK_SET) != 0 ||
+			fread(checkpoints->record, 1, checkpoints->record_size, checkpoints->file) != checkpoints->record_size)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error, the checkpoint of line %llu is missing\n", y);
+		return -1;
+	}
+	field = get_big_endian(field, &value, 4);
+	if (value != y)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error, the checkpoint of line %llu is corrupted\n", y);
+		return -1;
+	}
+	checkpoint->y = (unsigned int)value;
+	field = get_big_endian(field, &checkpoint->bit_offset, 8);
+	for (i = 0; i < input_params.z_size; i++)
+	{
+		field = get_big_endian(field, &value, 4);
+		checkpoint->counter[i] = (unsigned int)value;
+	}
+	for (i = 0; i < input_params.z_size; i++)
+	{
+		field = get_big_endian(field, &value, 4);
+		checkpoint->accumulator[i] = (unsigned int)value;
+	}
+	for (i = 0; i < input_params.z_size; i++)
+	{
+		field = get_big_endian(field, &value, 2);
+		checkpoint->origins[i] = (unsigned short int)value;
+	}
+	for (i = 0; i < input_params.z_size; i++)
+	{
+		for (w = 0; w < checkpoints->weights_len; w++)
+		{
+			field = get_big_endian(field, &value, 4);
+			checkpoint->weights[i * stride + weight_index(checkpoints, w)] = (int)(unsigned int)value;
+		}
+	}
+	for (i = 0; i < line_samples; i++)
+	{
+		field = get_big_endian(field, &value, 2);
+		checkpoint->prev_line[i] = (unsigned short int)value;
+	}
+	return 0;
+}
+
+///Closes the checkpoint file
+int checkpoint_close(checkpoint_file_t *checkpoints)
+{
+	int result = 0;
+
+	if (checkpoints->file != NULL && fclose(checkpoints->file) != 0)
+		result = -1;
+	checkpoints->file = NULL;
+	return result;
+}
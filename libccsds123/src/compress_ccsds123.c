@@ -3,90 +3,170 @@
 #include <string.h>
 #include <math.h>
 #include <time.h>
+#include <pthread.h>
 
 #include "compress_ccsds123.h"
+#include "decompress_ccsds123.h"
 #include "entropy_encoder.h"
 #include "utils.h"
 #include "predictor.h"
+#include "out_of_core.h"
+#include "ring_buffer.h"
+#include "band_index.h"
+#include "checkpoint.h"
 
-// Implementation of public functions.
+/// Compression session: the validated parameters and the tables parsed from their files, together with
+/// the memory used by every compression
+struct compress_session
+{
+	log_callback_t log_callback;
+	void *log_user_data;
+	input_feature_t input_params;
+	predictor_config_t predictor_params;
+	encoder_config_t encoder_params;
+	io_backend_t io_backend;
+	// holds the initialization tables for the whole life of the session
+	arena_t tables;
+	// holds the buffers of a compression; it is reset at the end of each of them
+	arena_t work;
+	// holds the image and stream buffers of a batch of files; it is reset at the end of each batch
+	arena_t batch;
+};
 
-int compress_ccsds123(compressConfig_t *config)
+// Number of images being read, compressed and written at the same time by a batch of files
+#define BATCH_DEPTH 2
+
+// Bytes preceding the samples or the stream in the slots of the queues of a batch, which hold the
+// result of the image (keeping the data aligned for the SIMD kernels)
+#define BATCH_SLOT_HEADER ARENA_ALIGNMENT
+
+/// Compression of a batch of files by a session: the reader thread loads the images in the slots of
+/// images, the calling thread compresses them in the slots of streams and the writer thread writes
+/// those out
+typedef struct
 {
-	// Create some variables for statistic purposes.
-	double compressionStartTime = 0.0;
-	double compressionEndTime = 0.0;
-	double predictionEndTime = 0.0;
-	unsigned int compressed_bytes = 0;
-	unsigned int dump_residuals = 0;
+	compress_session_t *session;
+	const char *const *input_files;
+	const char *const *output_files;
+	unsigned int count;
+	size_t stream_capacity;
+	ring_buffer_t images;
+	ring_buffer_t streams;
+	// bytes of the compressed stream or status code of every image, set by the writer
+	long long *results;
+} session_batch_t;
 
-	// Initialization of some values.
-	unsigned short int *residuals = NULL;
+// Names of the compression engines, as reported before compressing.
+static const char *engine_names[] = {"auto", "in memory", "fused streaming", "out of core", "pipelined"};
 
-	// Perform a few checks that the necessary options have been provided.
-	if (config->samples_file[0] == '\x0')
+// Estimates the peak memory, in bytes, of the given compression engine.
+static size_t engine_peak_memory(compress_engine_t engine, const compressConfig_t *config)
+{
+	size_t residuals_bytes = SAMPLE_BYTES(config->input_params) * IMAGE_SAMPLES(config->input_params);
+	size_t predict_bytes = 0;
+	size_t encode_bytes = 0;
+
+	switch (engine)
 	{
-		fprintf(stderr, "\nError, please indicate the file containing the input samples to be compressed\n\n");
+	case ENGINE_FUSED:
+		return fused_working_set(config->input_params, config->predictor_params, config->encoder_params);
+	case ENGINE_OUT_OF_CORE:
+		return out_of_core_working_set(config->input_params, config->predictor_params, config->encoder_params);
+	case ENGINE_PIPELINED:
+		return pipelined_working_set(config->input_params, config->predictor_params, config->encoder_params);
+	default:
+		// The residuals are kept both during the prediction and during the encoding.
+		predict_bytes = predict_working_set(config->input_params, config->predictor_params);
+		encode_bytes = encode_working_set(config->input_params, config->encoder_params);
+		return residuals_bytes + (predict_bytes > encode_bytes ? predict_bytes : encode_bytes);
+	}
+}
+
+// Checks that the parameters of the encoder are valid for the image described by config->input_params.
+static int check_encoder_config(const compressConfig_t *config)
+{
+	if (config->encoder_params.out_interleaving == BI && (config->encoder_params.out_interleaving_depth < 1 || config->encoder_params.out_interleaving_depth > config->input_params.z_size))
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the output interleaving depth has to be a positive integer not bigger than the number of bands\n\n");
 		return -1;
 	}
-	if (config->out_file[0] == '\x0')
+	if (config->encoder_params.encoding_method == SAMPLE && (config->encoder_params.y_0 > 8 || config->encoder_params.y_0 < 1))
 	{
-		fprintf(stderr, "\nError, please indicate the file where the compressed stream will be saved\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, specify a value between 1 and 8 for the initial count exponent y_0\n\n");
 		return -1;
 	}
-	if (config->input_params.y_size * config->input_params.x_size * config->input_params.z_size == 0)
+	if (config->encoder_params.encoding_method == SAMPLE && (config->encoder_params.y_star > 9 || config->encoder_params.y_star < 4 || config->encoder_params.y_star < (config->encoder_params.y_0 + 1)))
 	{
-		fprintf(stderr, "\nError, please specify all the x, y, and z dimensions with a number > 0\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, specify a value between max{4, y_0 + 1} and 9 for the rescaling counter size parameter y_star\n\n");
 		return -1;
 	}
-	if (config->input_params.in_interleaving == BI && (config->input_params.in_interleaving_depth < 1 || config->input_params.in_interleaving_depth > config->input_params.z_size))
+	if (config->encoder_params.encoding_method == SAMPLE && (config->encoder_params.u_max > 32 || config->encoder_params.u_max < 8))
 	{
-		fprintf(stderr, "\nError, the input interleaving depth has to be a positive integer not bigger than the number of bands\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, specify a value between 8 and 32 for the unary length limit u_max\n\n");
 		return -1;
 	}
-	if (config->encoder_params.out_interleaving == BI && (config->encoder_params.out_interleaving_depth < 1 || config->encoder_params.out_interleaving_depth > config->input_params.z_size))
+	if (config->encoder_params.encoding_method == SAMPLE && config->encoder_params.out_wordsize <= 0)
 	{
-		fprintf(stderr, "\nError, the output interleaving depth has to be a positive integer not bigger than the number of bands\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, specify a value for the word length\n\n");
 		return -1;
 	}
-	if (config->encoder_params.encoding_method == SAMPLE && (config->encoder_params.y_0 > 8 || config->encoder_params.y_0 < 1))
+	if (config->encoder_params.encoding_method == SAMPLE && config->init_table_file[0] == '\x0' && config->encoder_params.k == (unsigned int)-1)
 	{
-		fprintf(stderr, "\nError, specify a value between 1 and 8 for the initial count exponent y_0\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please specify one between initialization constant and the initialization table (k and k_init_file)\n\n");
 		return -1;
 	}
-	if (config->encoder_params.encoding_method == SAMPLE && (config->encoder_params.y_star > 9 || config->encoder_params.y_star < 4 || config->encoder_params.y_star < (config->encoder_params.y_0 + 1)))
+	else if (config->init_table_file[0] != '\x0' && config->encoder_params.k != (unsigned int)-1)
 	{
-		fprintf(stderr, "\nError, specify a value between max{4, y_0 + 1} and 9 for the rescaling counter size parameter y_star\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, both the initialization constant and the initialization table (k and k_init_file) are specified: only one is allowed\n\n");
 		return -1;
 	}
-	if (config->encoder_params.encoding_method == SAMPLE && (config->encoder_params.u_max > 32 || config->encoder_params.u_max < 8))
+	if (config->encoder_params.k != (unsigned int)-1 && config->encoder_params.k > config->input_params.dyn_range - 2)
 	{
-		fprintf(stderr, "\nError, specify a value between 8 and 32 for the unary length limit u_max\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the initialization constant k cannot be bigger than %d\n\n", config->input_params.dyn_range - 2);
 		return -1;
 	}
-	if (config->encoder_params.encoding_method == SAMPLE && config->encoder_params.out_wordsize <= 0)
+	if (config->encoder_params.encoding_method == SAMPLE && (config->encoder_params.block_size != 0 || config->encoder_params.ref_interval != 0))
 	{
-		fprintf(stderr, "\nError, specify a value for the word length\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, when the sample adaptive encoder is used, the block size or reference interval need not be specified, as they refer to the adaptive encoder\n\n");
 		return -1;
 	}
-	if (config->encoder_params.encoding_method == SAMPLE && config->init_table_file[0] == '\x0' && config->encoder_params.k == (unsigned int)-1)
+	if (config->encoder_params.encoding_method == BLOCK && (config->encoder_params.ref_interval <= 0 || config->encoder_params.ref_interval > 4096))
 	{
-		fprintf(stderr, "\nError, please specify one between initialization constant and the initialization table (k and k_init_file)\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the reference interval must be a positive integer not larger than 4096\n\n");
 		return -1;
 	}
-	else if (config->init_table_file[0] != '\x0' && config->encoder_params.k != (unsigned int)-1)
+	if (config->encoder_params.encoding_method == BLOCK && (log2(config->encoder_params.block_size) < 3 || log2(config->encoder_params.block_size) > 6))
 	{
-		fprintf(stderr, "\nError, both the initialization constant and the initialization table (k and k_init_file) are specified: only one is allowed\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, either block size must be equal to 8, 16, 32, or 64\n\n");
+		return -1;
+	}
+	return 0;
+}
+
+// Checks that the parameters of the image, of the predictor and of the encoder are valid.
+static int check_config(compressConfig_t *config)
+{
+	if (config->input_params.y_size == 0 || config->input_params.x_size == 0 || config->input_params.z_size == 0)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please specify all the x, y, and z dimensions with a number > 0\n\n");
+		return -1;
+	}
+	if (check_image_size(config->input_params) != 0)
+	{
+		return -1;
+	}
+	if (config->input_params.in_interleaving == BI && (config->input_params.in_interleaving_depth < 1 || config->input_params.in_interleaving_depth > config->input_params.z_size))
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the input interleaving depth has to be a positive integer not bigger than the number of bands\n\n");
 		return -1;
 	}
 	if (config->input_params.dyn_range < 2 || config->input_params.dyn_range > 16)
 	{
-		fprintf(stderr, "\nError, please specify the bit width of the residuals between 2 and 16 bits\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please specify the bit width of the residuals between 2 and 16 bits\n\n");
 		return -1;
 	}
-	if (config->encoder_params.k != (unsigned int)-1 && config->encoder_params.k > config->input_params.dyn_range - 2)
+	if (check_encoder_config(config) != 0)
 	{
-		fprintf(stderr, "\nError, the initialization constant k cannot be bigger than %d\n\n", config->input_params.dyn_range - 2);
 		return -1;
 	}
 	if (config->predictor_params.pred_bands > config->input_params.z_size)
@@ -95,72 +175,111 @@ int compress_ccsds123(compressConfig_t *config)
 	}
 	if (config->predictor_params.register_size > 64)
 	{
-		fprintf(stderr, "\nError, the register size cannot be bigger than 64\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the register size cannot be bigger than 64\n\n");
 		return -1;
 	}
 	if (config->predictor_params.weight_resolution > 19 || config->predictor_params.weight_resolution < 4)
 	{
-		fprintf(stderr, "\nError, the weight resolution must be in the range [4, 19]\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the weight resolution must be in the range [4, 19]\n\n");
 		return -1;
 	}
 	if (config->predictor_params.weight_interval > (0x1 << 11) || config->predictor_params.weight_interval < (0x1 << 4))
 	{
-		fprintf(stderr, "\nError, the weight update interval must be in the range [%d, %d]\n\n", (0x1 << 11), (0x1 << 4));
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the weight update interval must be in the range [%d, %d]\n\n", (0x1 << 11), (0x1 << 4));
 		return -1;
 	}
 	if ((0x1 << (int)log2(config->predictor_params.weight_interval)) != config->predictor_params.weight_interval)
 	{
-		fprintf(stderr, "\nError, the weight update interval must be a power of 2\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the weight update interval must be a power of 2\n\n");
 		return -1;
 	}
 	if (config->predictor_params.weight_initial > 9 || config->predictor_params.weight_initial < -6)
 	{
-		fprintf(stderr, "\nError, the weight initial value must be in the range [-6, 9]\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the weight initial value must be in the range [-6, 9]\n\n");
 		return -1;
 	}
 	if (config->predictor_params.weight_final > 9 || config->predictor_params.weight_final < -6)
 	{
-		fprintf(stderr, "\nError, the weight final value must be in the range [-6, 9]\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the weight final value must be in the range [-6, 9]\n\n");
 		return -1;
 	}
 	if (config->init_weight_file[0] != '\x0' && (config->predictor_params.weight_init_resolution > (config->predictor_params.weight_resolution + 3) || config->predictor_params.weight_init_resolution < 3))
 	{
-		fprintf(stderr, "\nError, the weight initial resolution must be in the range [3, %d]\n\n", config->predictor_params.weight_resolution + 3);
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the weight initial resolution must be in the range [3, %d]\n\n", config->predictor_params.weight_resolution + 3);
 		return -1;
 	}
 	if (config->predictor_params.weight_init_resolution != 0 && config->init_weight_file[0] == '\x0')
 	{
-		fprintf(stderr, "\nError, either both the weight initialization table and the weight initial resolution are specified or none of them\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, either both the weight initialization table and the weight initial resolution are specified or none of them\n\n");
 		return -1;
 	}
-	if (config->encoder_params.encoding_method == SAMPLE && (config->encoder_params.block_size != 0 || config->encoder_params.ref_interval != 0))
+	return 0;
+}
+
+// Checks that the output file has been provided, and that the band index, the checkpoints and the adapted
+// weights can be written.
+static int check_output_files(const compressConfig_t *config)
+{
+	if (config->out_file[0] == '\x0')
 	{
-		fprintf(stderr, "\nError, when the sample adaptive encoder is used, the block size or reference interval need not be specified, as they refer to the adaptive encoder\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the file where the compressed stream will be saved\n\n");
 		return -1;
 	}
-	if (config->encoder_params.encoding_method == BLOCK && (config->encoder_params.ref_interval <= 0 || config->encoder_params.ref_interval > 4096))
+	if (config->band_index_file[0] != '\x0' && (config->encoder_params.out_interleaving != BSQ || config->encoder_params.encoding_method != SAMPLE))
 	{
-		fprintf(stderr, "\nError, the reference interval must be a positive integer not larger than 4096\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the band index requires the BSQ output interleaving and the sample adaptive encoder\n\n");
 		return -1;
 	}
-	if (config->encoder_params.encoding_method == BLOCK && (log2(config->encoder_params.block_size) < 3 || log2(config->encoder_params.block_size) > 6))
+	if (config->checkpoint_file[0] != '\x0' && (config->encoder_params.out_interleaving != BI || config->encoder_params.encoding_method != SAMPLE))
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the checkpoints require the BI output interleaving and the sample adaptive encoder\n\n");
+		return -1;
+	}
+	if (config->checkpoint_file[0] != '\x0' && config->checkpoint_interval == 0)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the number of lines between two checkpoints\n\n");
+		return -1;
+	}
+	if (config->adapted_weights_file[0] != '\x0' && (config->adapted_weights_resolution < 3 || config->adapted_weights_resolution > config->predictor_params.weight_resolution + 3))
 	{
-		fprintf(stderr, "\nError, either block size must be equal to 8, 16, 32, or 64\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the resolution of the adapted weights must be in the range [3, %d]\n\n", config->predictor_params.weight_resolution + 3);
 		return -1;
 	}
+	if (config->adapted_weights_file[0] != '\x0' && config->predictor_params.pred_bands == 0 && config->predictor_params.full == 0)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the predictor has no weights to be written: use at least one prediction band or the full mode\n\n");
+		return -1;
+	}
+	return 0;
+}
+
+// Checks that the input and output files have been provided, and that the band index and the checkpoints
+// can be written.
+static int check_files(const compressConfig_t *config)
+{
+	if (config->samples_file[0] == '\x0')
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the file containing the input samples to be compressed\n\n");
+		return -1;
+	}
+	return check_output_files(config);
+}
 
+// Allocates from arena the accumulator initialization table, parsing it from its file if requested.
+static int load_accumulator_table(compressConfig_t *config, arena_t *arena)
+{
 	// Now I can allocate the accumulation constant table, either
 	// with all constant values or with the specified accumulator table.
-	if ((config->encoder_params.k_init = (unsigned int *)malloc(config->input_params.z_size * sizeof(unsigned int))) == NULL)
+	if ((config->encoder_params.k_init = (unsigned int *)arena_alloc(arena, config->input_params.z_size * sizeof(unsigned int))) == NULL)
 	{
-		fprintf(stderr, "\nError, in allocating the accumulator initialization table\n\n");
+		log_error(CCSDS_ERROR_MEMORY, "\nError, in allocating the accumulator initialization table\n\n");
 		return -1;
 	}
 	if (config->init_table_file[0] != '\x0')
 	{
 		if (parse_acc_table(config->init_table_file, config->encoder_params.k_init, 0x0F, config->input_params.z_size) != 0)
 		{
-			fprintf(stderr, "\nError, in parsing the accumulator initialization table\n\n");
+			log_error(CCSDS_ERROR_CONFIG, "\nError, in parsing the accumulator initialization table\n\n");
 			return -1;
 		}
 	}
@@ -172,6 +291,21 @@ int compress_ccsds123(compressConfig_t *config)
 			config->encoder_params.k_init[i] = config->encoder_params.k;
 		}
 	}
+	return 0;
+}
+
+// Allocates from arena the accumulator initialization table and, if requested, the weights
+// initialization table, parsing them from their files.
+static int load_tables(compressConfig_t *config, arena_t *arena)
+{
+	// The band index, the checkpoint file and the adapted weights, when requested, are allocated by compress_image.
+	config->encoder_params.band_bits = NULL;
+	config->encoder_params.checkpoints = NULL;
+	config->predictor_params.adapted_weights = NULL;
+	if (load_accumulator_table(config, arena) != 0)
+	{
+		return -1;
+	}
 
 	// Now allocate the weights table, if needed.
 	if (config->init_weight_file[0] != '\x0')
@@ -180,16 +314,16 @@ int compress_ccsds123(compressConfig_t *config)
 		int prediction_len = config->predictor_params.pred_bands;
 		if (config->predictor_params.full != 0)
 			prediction_len += 3;
-		if ((config->predictor_params.weight_init_table = (int **)malloc(sizeof(int *) * config->input_params.z_size)) == NULL)
+		if ((config->predictor_params.weight_init_table = (int **)arena_alloc(arena, sizeof(int *) * config->input_params.z_size)) == NULL)
 		{
-			fprintf(stderr, "\nError, in allocating the weight initialization table - 1\n\n");
+			log_error(CCSDS_ERROR_MEMORY, "\nError, in allocating the weight initialization table - 1\n\n");
 			return -1;
 		}
 		for (i = 0; i < config->input_params.z_size; i++)
 		{
-			if ((config->predictor_params.weight_init_table[i] = (int *)malloc(sizeof(int) * prediction_len)) == NULL)
+			if ((config->predictor_params.weight_init_table[i] = (int *)arena_alloc(arena, sizeof(int) * prediction_len)) == NULL)
 			{
-				fprintf(stderr, "\nError, in allocating the weight initialization table - 2\n\n");
+				log_error(CCSDS_ERROR_MEMORY, "\nError, in allocating the weight initialization table - 2\n\n");
 				return -1;
 			}
 		}
@@ -197,87 +331,789 @@ int compress_ccsds123(compressConfig_t *config)
 					(0x1 << (config->predictor_params.weight_init_resolution - 1)) - 1, -1 * (0x1 << (config->predictor_params.weight_init_resolution - 1)),
 					config->input_params.z_size * prediction_len, prediction_len) != 0)
 		{
-			fprintf(stderr, "\nError, in parsing the weights initialization table\n\n");
+			log_error(CCSDS_ERROR_CONFIG, "\nError, in parsing the weights initialization table\n\n");
 			return -1;
 		}
 	}
+	return 0;
+}
 
-	// Here is the actual compression algorithm.
+// Compresses the image described by config, allocating all the buffers from arena.
+static int compress_image(compressConfig_t *config, arena_t *arena)
+{
+	// Create some variables for statistic purposes.
+	double compressionStartTime = 0.0;
+	double compressionEndTime = 0.0;
+	double predictionEndTime = 0.0;
+	long long compressed_bytes = 0;
+	unsigned int dump_residuals = 0;
+	compress_engine_t engine = ENGINE_IN_MEMORY;
+	size_t peak_memory = 0;
+	checkpoint_file_t checkpoints;
+
+	// Initialization of some values.
+	void *residuals = NULL;
 
-	// Allocate memory for the residuals.
-	residuals = (unsigned short int *)malloc(sizeof(unsigned short int) * config->input_params.x_size * config->input_params.y_size * config->input_params.z_size);
-	if (residuals == NULL)
+	// Perform a few checks that the necessary options have been provided.
+	if (check_files(config) != 0 || check_config(config) != 0)
 	{
-		fprintf(stderr, "Error in allocating %lf kBytes for the residuals buffer\n\n", ((double)sizeof(unsigned short int) * config->input_params.x_size * config->input_params.y_size * config->input_params.z_size) / 1024.0);
 		return -1;
 	}
 
-	// Mark the initial time of the compression algorithm.
-	compressionStartTime = ((double)clock()) / CLOCKS_PER_SEC;
+	if (config->engine > ENGINE_PIPELINED)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, unknown compression engine %d\n\n", config->engine);
+		return -1;
+	}
+	if (config->io_backend > IO_BACKEND_DIRECT)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, unknown I/O backend %d\n\n", (int)config->io_backend);
+		return -1;
+	}
+	if ((config->engine == ENGINE_OUT_OF_CORE || config->engine == ENGINE_PIPELINED) && config->input_params.regular_input == 0)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the %s compression requires the input samples to be stored with 16 bits each\n\n", engine_names[config->engine]);
+		return -1;
+	}
+	// The checkpoints are taken by the streaming engines running on the calling thread, which traverse
+	// the image line by line.
+	if ((config->engine == ENGINE_IN_MEMORY || config->engine == ENGINE_PIPELINED) && config->checkpoint_file[0] != '\x0')
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the checkpoints cannot be written by the %s compression\n\n", engine_names[config->engine]);
+		return -1;
+	}
 
-	// Perform the prediction part of the algorithm (computation of the residuals).
-	if (predict(config->input_params, config->predictor_params, config->samples_file, residuals) != 0)
+	// Select the engine: the requested one, or the fastest one fitting in the memory budget.
+	if (config->engine != ENGINE_AUTO)
 	{
-		fprintf(stderr, "\nError during the computation of the residuals (i.e. prediction)\n\n");
+		engine = config->engine;
+		peak_memory = engine_peak_memory(engine, config);
+	}
+	else
+	{
+		engine = config->checkpoint_file[0] != '\x0' ? ENGINE_FUSED : ENGINE_IN_MEMORY;
+		for (; engine <= ENGINE_OUT_OF_CORE; engine++)
+		{
+			if (engine == ENGINE_OUT_OF_CORE && config->input_params.regular_input == 0)
+				break;
+			peak_memory = engine_peak_memory(engine, config);
+			if (config->memory_budget == 0 || peak_memory <= config->memory_budget)
+				break;
+		}
+		if (engine > ENGINE_OUT_OF_CORE || (engine == ENGINE_OUT_OF_CORE && config->input_params.regular_input == 0))
+		{
+			log_error(CCSDS_ERROR_MEMORY, "\nError, no compression engine fits in the memory budget of %zu bytes (the smallest one needs %zu bytes)\n\n",
+					config->memory_budget, peak_memory);
+			return -1;
+		}
+	}
+	if (config->memory_budget != 0 && peak_memory > config->memory_budget)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "\nError, the %s compression needs %zu bytes of memory, more than the budget of %zu bytes\n\n",
+				engine_names[engine], peak_memory, config->memory_budget);
+		return -1;
+	}
+	log_info("Compression engine: %s, estimated peak memory %zu bytes (%.2lf kb)\n", engine_names[engine], peak_memory, ((double)peak_memory) / 1024.0);
+	log_info("I/O backend: %s\n", io_backend_name(config->io_backend));
+
+	if (load_tables(config, arena) != 0)
+	{
+		return -1;
+	}
+	// The engines accumulate the length of the codewords of every band while encoding.
+	if (config->band_index_file[0] != '\x0' &&
+			(config->encoder_params.band_bits = (unsigned long long *)arena_alloc(arena, sizeof(unsigned long long) * config->input_params.z_size)) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "\nError, in allocating the band index\n\n");
 		return -1;
 	}
+	// The predictor saves the weights of every band when it is done with it.
+	if (config->adapted_weights_file[0] != '\x0' &&
+			(config->predictor_params.adapted_weights = (int *)arena_alloc(arena, sizeof(int) * (config->predictor_params.pred_bands + 3) * config->input_params.z_size)) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "\nError, in allocating the adapted weights\n\n");
+		return -1;
+	}
+	if (config->checkpoint_file[0] != '\x0')
+	{
+		if (checkpoint_create(&checkpoints, config->checkpoint_file, config->input_params, config->predictor_params, config->checkpoint_interval, arena) != 0)
+			return -1;
+		config->encoder_params.checkpoints = &checkpoints;
+	}
 
-	// Dump the residuals into an external file if requested.
-	if (dump_residuals != 0)
+	// Here is the actual compression algorithm.
+
+	if (engine != ENGINE_IN_MEMORY)
 	{
-		// Dumps the residuals as unsigned short int (16 bits each) in little endian format in
-		// BIP order
-		char residuals_name[200];
-		FILE *residuals_file = NULL;
-		int x = 0, y = 0, z = 0;
-		sprintf(residuals_name, "residuals_%s.bip", config->out_file);
-		if ((residuals_file = fopen(residuals_name, "w+b")) == NULL)
+		// The compressed stream is written while the image is predicted: prediction and encoding are
+		// interleaved, so their durations cannot be told apart.
+		compressionStartTime = ((double)clock()) / CLOCKS_PER_SEC;
+		if (engine == ENGINE_FUSED)
+			compressed_bytes = compress_fused(config->input_params, config->predictor_params, config->encoder_params,
+					config->samples_file, config->out_file, config->io_backend, arena);
+		else if (engine == ENGINE_OUT_OF_CORE)
+			compressed_bytes = compress_out_of_core(config->input_params, config->predictor_params, config->encoder_params,
+					config->samples_file, config->out_file, config->io_backend, config->memory_budget, arena);
+		else
+			compressed_bytes = compress_pipelined(config->input_params, config->predictor_params, config->encoder_params,
+					config->samples_file, config->out_file, config->io_backend, arena);
+		compressionEndTime = ((double)clock()) / CLOCKS_PER_SEC;
+		predictionEndTime = compressionEndTime;
+		if (config->encoder_params.checkpoints != NULL && checkpoint_close(&checkpoints) != 0 && compressed_bytes >= 0)
+		{
+			log_error(CCSDS_ERROR_IO, "\nError, in writing the checkpoint file %s\n\n", config->checkpoint_file);
+			return -1;
+		}
+		if (compressed_bytes < 0)
 		{
-			fprintf(stderr, "\nError in creating the file holding the residuals\n\n");
+			log_error(CCSDS_ERROR_INTERNAL, "\nError during the %s compression\n\n", engine_names[engine]);
 			return -1;
 		}
-		for (y = 0; y < config->input_params.y_size; y++)
+	}
+	else
+	{
+		// Allocate memory for the residuals: one byte each when the dynamic range allows it.
+		residuals = arena_alloc(arena, SAMPLE_BYTES(config->input_params) * IMAGE_SAMPLES(config->input_params));
+		if (residuals == NULL)
 		{
-			for (x = 0; x < config->input_params.x_size; x++)
+			log_error(CCSDS_ERROR_MEMORY, "Error in allocating %lf kBytes for the residuals buffer\n\n", ((double)SAMPLE_BYTES(config->input_params) * IMAGE_SAMPLES(config->input_params)) / 1024.0);
+			return -1;
+		}
+
+		// Mark the initial time of the compression algorithm.
+		compressionStartTime = ((double)clock()) / CLOCKS_PER_SEC;
+
+		// Perform the prediction part of the algorithm (computation of the residuals).
+		if (predict(config->input_params, config->predictor_params, config->samples_file, config->io_backend, residuals, arena) != 0)
+		{
+			log_error(CCSDS_ERROR_INTERNAL, "\nError during the computation of the residuals (i.e. prediction)\n\n");
+			return -1;
+		}
+
+		// Dump the residuals into an external file if requested.
+		if (dump_residuals != 0)
+		{
+			// Dumps the residuals as unsigned short int (16 bits each) in little endian format in
+			// BIP order
+			char residuals_name[200];
+			FILE *residuals_file = NULL;
+			int x = 0, y = 0, z = 0;
+			sprintf(residuals_name, "residuals_%s.bip", config->out_file);
+			if ((residuals_file = fopen(residuals_name, "w+b")) == NULL)
 			{
-				for (z = 0; z < config->input_params.z_size; z++)
+				log_error(CCSDS_ERROR_IO, "\nError in creating the file holding the residuals\n\n");
+				return -1;
+			}
+			for (y = 0; y < config->input_params.y_size; y++)
+			{
+				for (x = 0; x < config->input_params.x_size; x++)
 				{
-					fwrite(&(MATRIX_BSQ_INDEX(residuals, config->input_params, x, y, z)), 2, 1, residuals_file);
+					for (z = 0; z < config->input_params.z_size; z++)
+					{
+						unsigned short int residual = GET_ELEMENT(residuals, SAMPLE_BYTES(config->input_params), BSQ_OFFSET(config->input_params, x, y, z));
+						fwrite(&residual, 2, 1, residuals_file);
+					}
 				}
 			}
+			fclose(residuals_file);
 		}
-		fclose(residuals_file);
+
+		// Close the prediction statistics.
+		predictionEndTime = ((double)clock()) / CLOCKS_PER_SEC;
+
+		// Perform encoding and close the compression statistics.
+		compressed_bytes = encode(config->input_params, config->encoder_params, config->predictor_params, residuals, config->out_file, config->io_backend, arena);
+		compressionEndTime = ((double)clock()) / CLOCKS_PER_SEC;
+		if (compressed_bytes < 0)
+		{
+			log_error(CCSDS_ERROR_INTERNAL, "\nError during the encoding of the residuals\n\n");
+			return -1;
+		}
+	}
+
+	if (config->band_index_file[0] != '\x0' && write_band_index(config->band_index_file, config->input_params, config->encoder_params.band_bits) != 0)
+	{
+		return -1;
+	}
+	if (config->adapted_weights_file[0] != '\x0' && write_weights_table(config->adapted_weights_file, config->input_params, config->predictor_params,
+				config->predictor_params.adapted_weights, config->adapted_weights_resolution) != 0)
+	{
+		return -1;
+	}
+
+	// Print out some statistics.
+	log_info("Overall Compression duration %lf (sec)\n", compressionEndTime - compressionStartTime);
+	log_info("Prediction duration %lf (sec)\n", predictionEndTime - compressionStartTime);
+	log_info("Encoding duration %lf (sec)\n", compressionEndTime - predictionEndTime);
+	log_info("%lld bytes (%.2lf kb) in the compressed image\n", compressed_bytes, ((double)compressed_bytes) / (1024.0));
+	log_info("Compressed rate %lf bits/sample\n", ((double)compressed_bytes * 8) / IMAGE_SAMPLES(config->input_params));
+
+	return 0;
+}
+
+// Re-encodes the residuals of the stream compressedFile with the encoder described by config, allocating all
+// the buffers from arena.
+static int transcode_stream(compressConfig_t *config, char compressedFile[128], arena_t *arena)
+{
+	decompressConfig_t source;
+	double transcodingStartTime = 0.0;
+	double decodingEndTime = 0.0;
+	double transcodingEndTime = 0.0;
+	long long compressed_bytes = 0;
+	void *residuals = NULL;
+
+	if (compressedFile == NULL || compressedFile[0] == '\x0')
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the file containing the compressed stream to be transcoded\n\n");
+		return -1;
+	}
+	if (check_output_files(config) != 0)
+	{
+		return -1;
+	}
+	if (config->checkpoint_file[0] != '\x0' || config->adapted_weights_file[0] != '\x0')
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the checkpoints and the adapted weights are only written by compress_ccsds123\n\n");
+		return -1;
+	}
+	if (config->io_backend > IO_BACKEND_DIRECT)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, unknown I/O backend %d\n\n", (int)config->io_backend);
+		return -1;
+	}
+
+	// The residuals, the image and the predictor (with its weight initialization table) are the ones of the
+	// stream: only the encoder changes.
+	memset(&source, 0, sizeof(decompressConfig_t));
+	strcpy(source.in_file, compressedFile);
+	source.io_backend = config->io_backend;
+	source.log_callback = config->log_callback;
+	source.log_user_data = config->log_user_data;
+	transcodingStartTime = ((double)clock()) / CLOCKS_PER_SEC;
+	if (decompress_residuals(&source, &residuals, arena) != 0)
+	{
+		log_error(CCSDS_ERROR_DATA, "\nError during the decoding of the residuals of %s\n\n", compressedFile);
+		return -1;
+	}
+	decodingEndTime = ((double)clock()) / CLOCKS_PER_SEC;
+	config->input_params = source.input_params;
+	config->predictor_params = source.predictor_params;
+	if (check_encoder_config(config) != 0 || load_accumulator_table(config, arena) != 0)
+	{
+		return -1;
+	}
+	config->encoder_params.band_bits = NULL;
+	config->encoder_params.checkpoints = NULL;
+	if (config->band_index_file[0] != '\x0' &&
+			(config->encoder_params.band_bits = (unsigned long long *)arena_alloc(arena, sizeof(unsigned long long) * config->input_params.z_size)) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "\nError, in allocating the band index\n\n");
+		return -1;
+	}
+
+	compressed_bytes = encode(config->input_params, config->encoder_params, config->predictor_params, residuals, config->out_file, config->io_backend, arena);
+	transcodingEndTime = ((double)clock()) / CLOCKS_PER_SEC;
+	if (compressed_bytes < 0)
+	{
+		log_error(CCSDS_ERROR_INTERNAL, "\nError during the encoding of the residuals\n\n");
+		return -1;
+	}
+	if (config->band_index_file[0] != '\x0' && write_band_index(config->band_index_file, config->input_params, config->encoder_params.band_bits) != 0)
+	{
+		return -1;
+	}
+
+	log_info("Overall Transcoding duration %lf (sec)\n", transcodingEndTime - transcodingStartTime);
+	log_info("Decoding duration %lf (sec)\n", decodingEndTime - transcodingStartTime);
+	log_info("Encoding duration %lf (sec)\n", transcodingEndTime - decodingEndTime);
+	log_info("%lld bytes (%.2lf kb) in the transcoded image\n", compressed_bytes, ((double)compressed_bytes) / (1024.0));
+	log_info("Compressed rate %lf bits/sample\n", ((double)compressed_bytes * 8) / IMAGE_SAMPLES(config->input_params));
+
+	return 0;
+}
+
+// Scales the estimate of the stream of the lines predicted to the whole image, factor times taller: only
+// the header is not scaled.
+static void scale_estimate(rate_estimate_t *estimate, const compressConfig_t *config, double factor)
+{
+	const unsigned long long word_bytes = config->encoder_params.out_wordsize;
+	unsigned long long stream_bits = 0;
+	unsigned int z = 0;
+
+	estimate->codeword_bits = (unsigned long long)(estimate->codeword_bits * factor + 0.5);
+	estimate->escapes = (unsigned long long)(estimate->escapes * factor + 0.5);
+	for (z = 0; z < config->input_params.z_size; z++)
+	{
+		if (estimate->band_bits != NULL)
+			estimate->band_bits[z] = (unsigned long long)(estimate->band_bits[z] * factor + 0.5);
+		if (estimate->band_escapes != NULL)
+			estimate->band_escapes[z] = (unsigned long long)(estimate->band_escapes[z] * factor + 0.5);
 	}
+	// the stream is padded to the output word, as pad_to_word does
+	stream_bits = estimate->header_bits + estimate->codeword_bits;
+	estimate->stream_bytes = ((stream_bits + 8 * word_bytes - 1) / (8 * word_bytes)) * word_bytes;
+}
 
-	// Close the prediction statistics.
+// Estimates the size of the stream of the image described by config, predicting one run of
+// SAMPLED_RUN_LINES lines every line_step ones (see sample_lines), allocating all the buffers from arena.
+static int estimate_image(compressConfig_t *config, unsigned int line_step, rate_estimate_t *estimate, arena_t *arena)
+{
+	double estimationStartTime = 0.0;
+	double predictionEndTime = 0.0;
+	double estimationEndTime = 0.0;
+	input_feature_t sampled_params;
+	const unsigned int sample_bytes = SAMPLE_BYTES(config->input_params);
+	void *samples = NULL;
+	void *sampled = NULL;
+	void *residuals = NULL;
+	size_t peak_memory = 0;
+
+	if (estimate == NULL)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate where the estimate will be saved\n\n");
+		return -1;
+	}
+	if (config->samples_file[0] == '\x0')
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the file containing the input samples to be compressed\n\n");
+		return -1;
+	}
+	if (check_config(config) != 0)
+	{
+		return -1;
+	}
+	if (config->io_backend > IO_BACKEND_DIRECT)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, unknown I/O backend %d\n\n", (int)config->io_backend);
+		return -1;
+	}
+
+	// The lines kept are predicted as an image of their own: they are taken in runs of consecutive lines,
+	// so that most of them are predicted from the line they follow in the image.
+	if (line_step == 0)
+		line_step = 1;
+	sampled_params = config->input_params;
+	sampled_params.y_size = sampled_lines(config->input_params.y_size, line_step);
+	peak_memory = sample_bytes * (IMAGE_SAMPLES(config->input_params) + (line_step > 1 ? 2 : 1) * IMAGE_SAMPLES(sampled_params)) +
+			predict_bands_working_set(sampled_params, config->predictor_params, 0, sampled_params.z_size) +
+			encoder_state_size(sampled_params, config->encoder_params) + 2 * sizeof(unsigned long long) * sampled_params.z_size;
+	if (config->memory_budget != 0 && peak_memory > config->memory_budget)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "\nError, the estimation needs %zu bytes of memory, more than the budget of %zu bytes\n\n", peak_memory,
+				config->memory_budget);
+		return -1;
+	}
+	if (load_tables(config, arena) != 0)
+	{
+		return -1;
+	}
+	samples = arena_alloc(arena, sample_bytes * IMAGE_SAMPLES(config->input_params));
+	residuals = arena_alloc(arena, sample_bytes * IMAGE_SAMPLES(sampled_params));
+	sampled = line_step > 1 ? arena_alloc(arena, sample_bytes * IMAGE_SAMPLES(sampled_params)) : samples;
+	if (samples == NULL || residuals == NULL || sampled == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating %lf kBytes for the samples and the residuals\n\n", ((double)peak_memory) / 1024.0);
+		return -1;
+	}
+
+	estimationStartTime = ((double)clock()) / CLOCKS_PER_SEC;
+	if (read_samples(config->input_params, config->io_backend, config->samples_file, samples) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "\nError in reading the input samples\n\n");
+		return -1;
+	}
+	if (line_step > 1)
+		sample_lines(config->input_params, line_step, samples, sampled);
+	if (predict_bands(sampled_params, config->predictor_params, sampled, residuals, 0, sampled_params.z_size, arena) != 0)
+	{
+		log_error(CCSDS_ERROR_INTERNAL, "\nError during the computation of the residuals (i.e. prediction)\n\n");
+		return -1;
+	}
 	predictionEndTime = ((double)clock()) / CLOCKS_PER_SEC;
+	if (estimate_encoding(sampled_params, config->encoder_params, config->predictor_params, residuals, estimate, arena) != 0)
+	{
+		return -1;
+	}
+	if (line_step > 1)
+		scale_estimate(estimate, config, ((double)config->input_params.y_size) / sampled_params.y_size);
+	estimationEndTime = ((double)clock()) / CLOCKS_PER_SEC;
+
+	log_info("Overall Estimation duration %lf (sec)\n", estimationEndTime - estimationStartTime);
+	log_info("Prediction duration %lf (sec)\n", predictionEndTime - estimationStartTime);
+	log_info("Encoding duration %lf (sec)\n", estimationEndTime - predictionEndTime);
+	log_info("%llu bytes (%.2lf kb) %s in the compressed image, %llu escapes\n", estimate->stream_bytes, ((double)estimate->stream_bytes) / (1024.0),
+			line_step > 1 ? "estimated" : "exactly", estimate->escapes);
+	log_info("Compressed rate %lf bits/sample\n", ((double)estimate->stream_bytes * 8) / IMAGE_SAMPLES(config->input_params));
+
+	return 0;
+}
 
-	// Perform encoding and close the compression statistics.
-	compressed_bytes = encode(config->input_params, config->encoder_params, config->predictor_params, residuals, config->out_file);
-	compressionEndTime = ((double)clock()) / CLOCKS_PER_SEC;
+// Implementation of public functions.
 
-	// Deallocate all the memory used by this function.
-	if (config->encoder_params.k_init != NULL)
-		free(config->encoder_params.k_init);
-	if (config->predictor_params.weight_init_table != NULL)
+int compress_ccsds123(compressConfig_t *config)
+{
+	arena_t local_arena;
+	arena_t *arena = config->arena;
+	log_context_t log_context;
+	int result = 0;
+
+	log_begin(&log_context, config->log_callback, config->log_user_data);
+	if (arena == NULL)
 	{
-		int i = 0;
-		for (i = 0; i < config->input_params.z_size; i++)
+		arena = &local_arena;
+		arena_init(arena, 0, 0);
+	}
+	result = compress_image(config, arena);
+
+	// All the memory used by the compression is given back at once; the tables point to it.
+	config->encoder_params.k_init = NULL;
+	config->encoder_params.band_bits = NULL;
+	config->encoder_params.checkpoints = NULL;
+	config->predictor_params.weight_init_table = NULL;
+	config->predictor_params.adapted_weights = NULL;
+	if (arena == config->arena)
+		arena_reset(arena);
+	else
+		arena_release(arena);
+	return log_end(&log_context, result);
+}
+
+int transcode_ccsds123(compressConfig_t *config, char compressedFile[128])
+{
+	arena_t local_arena;
+	arena_t *arena = config->arena;
+	log_context_t log_context;
+	int result = 0;
+
+	log_begin(&log_context, config->log_callback, config->log_user_data);
+	if (arena == NULL)
+	{
+		arena = &local_arena;
+		arena_init(arena, 0, 0);
+	}
+	result = transcode_stream(config, compressedFile, arena);
+
+	// As for compress_ccsds123, the tables point to the memory given back here.
+	config->encoder_params.k_init = NULL;
+	config->encoder_params.band_bits = NULL;
+	config->encoder_params.checkpoints = NULL;
+	config->predictor_params.weight_init_table = NULL;
+	if (arena == config->arena)
+		arena_reset(arena);
+	else
+		arena_release(arena);
+	return log_end(&log_context, result);
+}
+
+int estimate_ccsds123(compressConfig_t *config, unsigned int line_step, rate_estimate_t *estimate)
+{
+	arena_t local_arena;
+	arena_t *arena = config->arena;
+	log_context_t log_context;
+	int result = 0;
+
+	log_begin(&log_context, config->log_callback, config->log_user_data);
+	if (arena == NULL)
+	{
+		arena = &local_arena;
+		arena_init(arena, 0, 0);
+	}
+	result = estimate_image(config, line_step, estimate, arena);
+
+	// As for compress_ccsds123, the tables point to the memory given back here.
+	config->encoder_params.k_init = NULL;
+	config->encoder_params.band_bits = NULL;
+	config->encoder_params.checkpoints = NULL;
+	config->predictor_params.weight_init_table = NULL;
+	if (arena == config->arena)
+		arena_reset(arena);
+	else
+		arena_release(arena);
+	return log_end(&log_context, result);
+}
+
+int compress_check_config(compressConfig_t *config)
+{
+	log_context_t log_context;
+
+	log_begin(&log_context, config->log_callback, config->log_user_data);
+	return log_end(&log_context, check_config(config));
+}
+
+int compress_prepare(compressConfig_t *config, arena_t *arena)
+{
+	log_context_t log_context;
+	int result = -1;
+
+	log_begin(&log_context, config->log_callback, config->log_user_data);
+	if (config->checkpoint_file[0] != '\x0' || config->adapted_weights_file[0] != '\x0')
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the checkpoints and the adapted weights are only written by compress_ccsds123\n\n");
+	else if (check_files(config) == 0 && check_config(config) == 0 && load_tables(config, arena) == 0)
+		result = 0;
+	return log_end(&log_context, result);
+}
+
+int compress_session_create(const compressConfig_t *config, compress_session_t **session)
+{
+	compressConfig_t session_config = *config;
+	log_context_t log_context;
+	int result = -1;
+
+	log_begin(&log_context, config->log_callback, config->log_user_data);
+	*session = NULL;
+	if (config->band_index_file[0] != '\x0' || config->checkpoint_file[0] != '\x0' || config->adapted_weights_file[0] != '\x0')
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the band index, the checkpoints and the adapted weights are only written by compress_ccsds123\n\n");
+		return log_end(&log_context, result);
+	}
+	if (check_config(&session_config) != 0)
+	{
+		return log_end(&log_context, result);
+	}
+	if ((*session = (compress_session_t *)calloc(1, sizeof(compress_session_t))) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "\nError, in allocating the compression session\n\n");
+		return log_end(&log_context, result);
+	}
+	arena_init(&(*session)->tables, 0, 0);
+	arena_init(&(*session)->batch, 0, 0);
+	// The work arena is sized up front for the image and the fused engine buffers: the compressions
+	// then need no heap allocation at all.
+	if (arena_init(&(*session)->work, fused_working_set(session_config.input_params, session_config.predictor_params, session_config.encoder_params), 0) != 0)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "\nError, in allocating the memory of the compression session\n\n");
+	}
+	else if (load_tables(&session_config, &(*session)->tables) == 0)
+	{
+		result = 0;
+	}
+	if (result != 0)
+	{
+		compress_session_destroy(*session);
+		*session = NULL;
+		return log_end(&log_context, result);
+	}
+	if (session_config.init_weight_file[0] == '\x0')
+		session_config.predictor_params.weight_init_table = NULL;
+	(*session)->log_callback = config->log_callback;
+	(*session)->log_user_data = config->log_user_data;
+	(*session)->input_params = session_config.input_params;
+	(*session)->predictor_params = session_config.predictor_params;
+	(*session)->encoder_params = session_config.encoder_params;
+	(*session)->io_backend = session_config.io_backend;
+	return log_end(&log_context, result);
+}
+
+size_t compress_session_bound(const compress_session_t *session)
+{
+	return compress_bound(session->input_params, session->predictor_params, session->encoder_params);
+}
+
+long long compress_session_compress(compress_session_t *session, const unsigned short int *samples, unsigned char *stream, size_t stream_capacity)
+{
+	void *image = NULL;
+	long long compressed_bytes = -1;
+	log_context_t log_context;
+
+	log_begin(&log_context, session->log_callback, session->log_user_data);
+	image = arena_alloc(&session->work, SAMPLE_BYTES(session->input_params) * IMAGE_SAMPLES(session->input_params));
+	if (image == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating %lf kBytes for the input image buffer\n\n", ((double)SAMPLE_BYTES(session->input_params) * IMAGE_SAMPLES(session->input_params)) / 1024.0);
+	}
+	else if (load_samples(session->input_params, samples, image) == 0)
+	{
+		compressed_bytes = compress_fused_to_buffer(session->input_params, session->predictor_params, session->encoder_params,
+				image, stream, stream_capacity, &session->work);
+	}
+	arena_reset(&session->work);
+	if (compressed_bytes < 0)
+		return log_end(&log_context, -1);
+	log_end(&log_context, 0);
+	return compressed_bytes;
+}
+
+/// Reader thread of a batch: loads every image, converted to BSQ order, into the next free slot of
+/// images; the slot holds the status of the reading
+static void *batch_reader(void *argument)
+{
+	session_batch_t *batch = (session_batch_t *)argument;
+	compress_session_t *session = batch->session;
+	log_context_t log_context;
+	char fileName[128];
+	unsigned int index = 0;
+	int result = 0;
+
+	for (index = 0; index < batch->count; index++)
+	{
+		unsigned char *slot = (unsigned char *)ring_acquire_write(&batch->images);
+		// a NULL slot means that the batch has been stopped
+		if (slot == NULL)
+			break;
+		log_begin(&log_context, session->log_callback, session->log_user_data);
+		strcpy(fileName, batch->input_files[index]);
+		result = read_samples(session->input_params, session->io_backend, fileName, slot + BATCH_SLOT_HEADER);
+		*(long long *)slot = log_end(&log_context, result);
+		ring_commit_write(&batch->images);
+	}
+	return NULL;
+}
+
+/// Writer thread of a batch: writes the compressed stream of every image to its file, recording the
+/// number of bytes written or the status code of the problem met by the image
+static void *batch_writer(void *argument)
+{
+	session_batch_t *batch = (session_batch_t *)argument;
+	compress_session_t *session = batch->session;
+	log_context_t log_context;
+	io_file_t outFile;
+	unsigned int index = 0;
+	int result = 0;
+
+	for (index = 0; index < batch->count; index++)
+	{
+		unsigned char *slot = (unsigned char *)ring_acquire_read(&batch->streams);
+		long long compressed_bytes = 0;
+		if (slot == NULL)
+			break;
+		compressed_bytes = *(long long *)slot;
+		if (compressed_bytes >= 0)
 		{
-			if (config->predictor_params.weight_init_table[i] != NULL)
-				free(config->predictor_params.weight_init_table[i]);
+			log_begin(&log_context, session->log_callback, session->log_user_data);
+			result = io_open(&outFile, session->io_backend, batch->output_files[index], IO_WRITE);
+			if (result != 0)
+			{
+				log_error(CCSDS_ERROR_IO, "\nError, in opening output file %s\n\n", batch->output_files[index]);
+			}
+			else
+			{
+				result = io_append(&outFile, slot + BATCH_SLOT_HEADER, (size_t)compressed_bytes);
+				if (io_close(&outFile) != 0)
+					result = -1;
+				if (result != 0)
+					log_error(CCSDS_ERROR_IO, "\nError, in writing the compressed stream to %s\n\n", batch->output_files[index]);
+			}
+			if (result != 0)
+				compressed_bytes = log_end(&log_context, result);
+			else
+				log_end(&log_context, result);
 		}
-		free(config->predictor_params.weight_init_table);
+		batch->results[index] = compressed_bytes;
+		ring_release_read(&batch->streams);
 	}
-	if (residuals != NULL)
-		free(residuals);
+	return NULL;
+}
 
-	// Print out some statistics.
-	printf("Overall Compression duration %lf (sec)\n", compressionEndTime - compressionStartTime);
-	printf("Prediction duration %lf (sec)\n", predictionEndTime - compressionStartTime);
-	printf("Encoding duration %lf (sec)\n", compressionEndTime - predictionEndTime);
-	printf("%d bytes (%.2lf kb) in the compressed image\n", compressed_bytes, ((double)compressed_bytes) / (1024.0));
-	printf("Compressed rate %lf bits/sample\n", ((double)compressed_bytes * 8) / (config->input_params.y_size * config->input_params.x_size * config->input_params.z_size));
+/// Compresses every image loaded by the reader of the batch into the next free slot of streams: the
+/// slot holds the number of bytes of the stream or the status code of the problem met by the image
+static void batch_compress(session_batch_t *batch)
+{
+	compress_session_t *session = batch->session;
+	log_context_t log_context;
+	unsigned int index = 0;
 
-	return 0;
+	for (index = 0; index < batch->count; index++)
+	{
+		unsigned char *image = (unsigned char *)ring_acquire_read(&batch->images);
+		unsigned char *stream = image != NULL ? (unsigned char *)ring_acquire_write(&batch->streams) : NULL;
+		long long compressed_bytes = 0;
+		if (stream == NULL)
+			break;
+		compressed_bytes = *(long long *)image;
+		if (compressed_bytes == CCSDS_OK)
+		{
+			log_begin(&log_context, session->log_callback, session->log_user_data);
+			compressed_bytes = compress_fused_to_buffer(session->input_params, session->predictor_params, session->encoder_params,
+					image + BATCH_SLOT_HEADER, stream + BATCH_SLOT_HEADER, batch->stream_capacity, &session->work);
+			arena_reset(&session->work);
+			if (compressed_bytes < 0)
+				compressed_bytes = log_end(&log_context, -1);
+			else
+				log_end(&log_context, 0);
+		}
+		*(long long *)stream = compressed_bytes;
+		ring_release_read(&batch->images);
+		ring_commit_write(&batch->streams);
+	}
+}
+
+int compress_session_compress_files(compress_session_t *session, const char *const *inputFiles, const char *const *outputFiles,
+		unsigned int count, long long *compressed_bytes)
+{
+	const size_t image_bytes = SAMPLE_BYTES(session->input_params) * IMAGE_SAMPLES(session->input_params);
+	session_batch_t batch;
+	pthread_t reader, writer;
+	int reader_started = 0, writer_started = 0;
+	log_context_t log_context;
+	unsigned int index = 0;
+	int result = 0;
+
+	log_begin(&log_context, session->log_callback, session->log_user_data);
+	for (index = 0; index < count; index++)
+	{
+		if (strlen(inputFiles[index]) >= 128 || strlen(outputFiles[index]) >= 128)
+		{
+			log_error(CCSDS_ERROR_CONFIG, "\nError, the name of the files of image %u is longer than 127 characters\n\n", index);
+			return log_end(&log_context, -1);
+		}
+	}
+	if (count == 0)
+		return log_end(&log_context, 0);
+	memset(&batch, 0, sizeof(session_batch_t));
+	batch.session = session;
+	batch.input_files = inputFiles;
+	batch.output_files = outputFiles;
+	batch.count = count;
+	batch.stream_capacity = compress_session_bound(session);
+	batch.results = compressed_bytes;
+	// Two image and two stream buffers, so that reading, compressing and writing can proceed at once
+	if (ring_init(&batch.images, BATCH_SLOT_HEADER + image_bytes, BATCH_DEPTH, &session->batch) != 0 ||
+			ring_init(&batch.streams, BATCH_SLOT_HEADER + batch.stream_capacity, BATCH_DEPTH, &session->batch) != 0 ||
+			(batch.results == NULL && (batch.results = (long long *)arena_alloc(&session->batch, sizeof(long long) * count)) == NULL))
+	{
+		log_error(CCSDS_ERROR_MEMORY, "\nError, in allocating the buffers of the batch of images\n\n");
+		arena_reset(&session->batch);
+		return log_end(&log_context, -1);
+	}
+	for (index = 0; index < count; index++)
+		batch.results[index] = CCSDS_ERROR_INTERNAL;
+
+	reader_started = pthread_create(&reader, NULL, batch_reader, &batch) == 0;
+	writer_started = reader_started && pthread_create(&writer, NULL, batch_writer, &batch) == 0;
+	if (writer_started)
+	{
+		batch_compress(&batch);
+	}
+	else
+	{
+		log_error(CCSDS_ERROR_INTERNAL, "\nError in starting the threads of the batch of images\n\n");
+		ring_cancel(&batch.images);
+		ring_cancel(&batch.streams);
+	}
+	if (reader_started)
+		pthread_join(reader, NULL);
+	if (writer_started)
+		pthread_join(writer, NULL);
+
+	// The problems of the single images have been reported to the log callback already
+	for (index = 0; index < count && result == 0; index++)
+	{
+		if (batch.results[index] < 0)
+		{
+			log_error((ccsds_status_t)batch.results[index], "\nError in the batch of images, image %u could not be compressed\n\n", index);
+			result = -1;
+		}
+	}
+	arena_reset(&session->batch);
+	return log_end(&log_context, result);
+}
+
+void compress_session_destroy(compress_session_t *session)
+{
+	if (session == NULL)
+		return;
+	arena_release(&session->batch);
+	arena_release(&session->work);
+	arena_release(&session->tables);
+	free(session);
 }
@@ -36,14 +36,13 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "utils.h"
 #include "decoder.h"
-
-// Declaration of private functions.
-// This function frees memory inside a encoder_config_t struct after decoding
-// or if there is any problem during decoding.
-int freeDecoderMemory(encoder_config_t *encoder_config);
+#include "band_index.h"
+#include "io_backend.h"
 
 /******************************************************
  * Routines for the Sample Adaptive Encoder
@@ -57,7 +56,7 @@ int read_element_sample(FILE *compressedStream, encoder_config_t encoder_params,
 #ifndef NDEBUG
 	if (divisor == (unsigned int)-1)
 	{
-		fprintf(stderr, "Error in reading the FS sample\n");
+		log_error(CCSDS_ERROR_DATA, "Error in reading the FS sample\n");
 		return -1;
 	}
 #endif
@@ -68,7 +67,7 @@ int read_element_sample(FILE *compressedStream, encoder_config_t encoder_params,
 #ifndef NDEBUG
 		if (sample == -1)
 		{
-			fprintf(stderr, "Error in reading uncompressed sample, asked %d bits\n", input_params.dyn_range);
+			log_error(CCSDS_ERROR_DATA, "Error in reading uncompressed sample, asked %d bits\n", input_params.dyn_range);
 			return -1;
 		}
 #endif
@@ -80,7 +79,7 @@ int read_element_sample(FILE *compressedStream, encoder_config_t encoder_params,
 #ifndef NDEBUG
 		if (temp_bits == (unsigned int)-1)
 		{
-			fprintf(stderr, "Error in reading sample\n");
+			log_error(CCSDS_ERROR_DATA, "Error in reading sample\n");
 			return -1;
 		}
 #endif
@@ -89,120 +88,300 @@ int read_element_sample(FILE *compressedStream, encoder_config_t encoder_params,
 	return sample;
 }
 
-/// Main routine for decoding the input stream compressed according to the sample adaptive
-/// method: it iterates over the various compressed samples, calling read_element_sample to extract
-/// each of them from the compressed stream
-int decode_sample_adaptive(FILE *compressedStream, input_feature_t input_params, encoder_config_t encoder_params,
-		unsigned short int *residuals)
+/// Returns the parameter k of the codeword of the next residual of a band compressed with the sample
+/// adaptive method, from the statistics of the band
+unsigned int sample_codeword_k(input_feature_t input_params, unsigned int counter, unsigned int accumulator)
 {
-	unsigned int read_elems = 0;
-	unsigned char buffer = 0;
-	unsigned int buffer_len = 0;
-	unsigned int *counter = NULL;
-	unsigned int *accumulator = NULL;
-	const unsigned int samplesNum = input_params.x_size * input_params.y_size * input_params.z_size;
-	const unsigned int band_size = input_params.x_size * input_params.y_size;
-	unsigned int i = 0;
+	int temp_k = (int)log2(((49 * counter) / 0x080 + accumulator) / ((double)counter));
+	if (temp_k < 0)
+		temp_k = 0;
+	if (temp_k > (input_params.dyn_range - 2))
+		temp_k = input_params.dyn_range - 2;
+	return (unsigned int)temp_k;
+}
 
-	counter = (unsigned int *)malloc(sizeof(unsigned int) * input_params.z_size);
-	if (counter == NULL)
+/// Updates the statistics of a band compressed with the sample adaptive method with its residual just decoded
+void update_sample_statistics(encoder_config_t encoder_params, unsigned int *counter, unsigned int *accumulator, unsigned int residual)
+{
+	if (*counter < ((((unsigned int)0x1) << encoder_params.y_star) - 1))
 	{
-		fprintf(stderr, "Error in the allocation of the counter statistic\n\n");
-		return -1;
+		*accumulator += residual;
+		(*counter)++;
 	}
-	accumulator = (unsigned int *)malloc(sizeof(unsigned int) * input_params.z_size);
-	if (accumulator == NULL)
+	else
 	{
-		fprintf(stderr, "Error in the allocation of the accumulator statistic\n\n");
-		free(counter);
-		return -1;
+		*accumulator = (*accumulator + residual + 1) / 2;
+		*counter = (*counter + 1) / 2;
 	}
-	for (i = 0; i < input_params.z_size; i++)
+}
+
+/// Decodes the residual with index BSQidx (in BSQ order) of an image compressed with the sample adaptive
+/// method, updating the statistics of its band; the first sample of every band is stored uncompressed
+static unsigned int decode_sample(FILE *compressedStream, input_feature_t input_params, encoder_config_t encoder_params,
+		unsigned int *counter, unsigned int *accumulator, size_t BSQidx, unsigned char *buffer, unsigned int *buffer_len)
+{
+	const size_t band_size = (size_t)input_params.x_size * input_params.y_size;
+	unsigned int temp_sample = 0;
+	unsigned int z = BSQidx / band_size;
+	int temp_k = 0;
+
+	if ((BSQidx % (band_size)) == 0)
 	{
-		counter[i] = 0x1 << encoder_params.y_0;
-		accumulator[i] = (counter[i] * (3 * (0x1 << (encoder_params.k_init[i] + 6)) - 49)) / 0x080;
+		// uncompressed element
+		return read_bits(compressedStream, input_params.dyn_range, buffer, buffer_len);
 	}
+	// normal element
+	temp_k = sample_codeword_k(input_params, counter[z], accumulator[z]);
+	temp_sample = read_element_sample(compressedStream, encoder_params, input_params, temp_k, buffer, buffer_len);
+
+	// ... and finally update the statistics and prepare for the next sample
+	update_sample_statistics(encoder_params, &counter[z], &accumulator[z], temp_sample);
+	return temp_sample;
+}
+
+/// Main routine for decoding the input stream compressed according to the sample adaptive
+/// method: it iterates over the various compressed samples, calling read_element_sample to extract
+/// each of them from the compressed stream
+int decode_sample_adaptive(FILE *compressedStream, input_feature_t input_params, encoder_config_t encoder_params,
+		void *residuals, arena_t *arena)
+{
+	decoder_state_t state;
+	const size_t samplesNum = IMAGE_SAMPLES(input_params);
+
+	if (init_decoder_state(input_params, encoder_params, &state, arena) != 0)
+		return -1;
 
 	// Let's read until the end of the file
-	while ((read_elems < samplesNum) && feof(compressedStream) == 0)
+	while ((state.read_elems < samplesNum) && feof(compressedStream) == 0)
 	{
-		unsigned int temp_sample = 0;
-		unsigned int BSQidx = indexToBSQ(encoder_params.out_interleaving, encoder_params.out_interleaving_depth,
-				input_params.x_size, input_params.y_size, input_params.z_size, read_elems);
-		if ((BSQidx % (band_size)) == 0)
-		{
-			// uncompressed element
-			temp_sample = read_bits(compressedStream, input_params.dyn_range, &buffer, &buffer_len);
-		}
-		else
-		{
-			unsigned int z = BSQidx / band_size;
-			int temp_k = 0;
-			// normal element
-			temp_k = (int)log2(((49 * counter[z]) / 0x080 + accumulator[z]) / ((double)counter[z]));
-			if (temp_k < 0)
-				temp_k = 0;
-			if (temp_k > (input_params.dyn_range - 2))
-				temp_k = input_params.dyn_range - 2;
-
-			temp_sample = read_element_sample(compressedStream, encoder_params, input_params, temp_k, &buffer, &buffer_len);
-
-			// ... and finally update the statistics and prepare for the next sample
-			if (counter[z] < ((((unsigned int)0x1) << encoder_params.y_star) - 1))
-			{
-				accumulator[z] += temp_sample;
-				counter[z]++;
-			}
-			else
-			{
-				accumulator[z] = (accumulator[z] + temp_sample + 1) / 2;
-				counter[z] = (counter[z] + 1) / 2;
-			}
-		}
+		size_t BSQidx = indexToBSQ(encoder_params.out_interleaving, encoder_params.out_interleaving_depth,
+				input_params.x_size, input_params.y_size, input_params.z_size, state.read_elems);
+		unsigned int temp_sample = decode_sample(compressedStream, input_params, encoder_params, state.counter, state.accumulator,
+				BSQidx, &state.buffer, &state.buffer_len);
 #ifndef NDEBUG
 		if (temp_sample == (unsigned int)-1)
 		{
-			fprintf(stderr, "Error in reading sample with BSQidx = %d, element %d\n", BSQidx, read_elems);
-			free(counter);
-			free(accumulator);
+			log_error(CCSDS_ERROR_DATA, "Error in reading sample with BSQidx = %zu, element %zu\n", BSQidx, state.read_elems);
 			return -1;
 		}
 #endif
-		residuals[BSQidx] = (unsigned short int)temp_sample;
+		SET_ELEMENT(residuals, SAMPLE_BYTES(input_params), BSQidx, temp_sample);
 
-		read_elems++;
+		state.read_elems++;
 	}
 
 #ifndef NDEBUG
-	if (read_elems < samplesNum)
+	if (state.read_elems < samplesNum)
 	{
-		fprintf(stderr, "Error read only %d samples out of %d\n", read_elems, samplesNum);
-		free(counter);
-		free(accumulator);
+		log_error(CCSDS_ERROR_DATA, "Error read only %zu samples out of %zu\n", state.read_elems, samplesNum);
 		return -1;
 	}
 #endif
 
-	free(counter);
-	free(accumulator);
+	return 0;
+}
+
+/// Moves the stream to bit first_bit, filling in the bits of its first byte left to be read: the codewords
+/// can start in the middle of a byte
+static int seek_bit(FILE *compressedStream, unsigned long long first_bit, unsigned char *buffer, unsigned int *buffer_len)
+{
+	*buffer = 0;
+	*buffer_len = 0;
+	if (io_seek_stream(compressedStream, first_bit / 8) != 0)
+		return -1;
+	if (first_bit % 8 != 0)
+	{
+		if (fread(buffer, 1, 1, compressedStream) < 1)
+			return -1;
+		*buffer = *buffer << (first_bit % 8);
+		*buffer_len = 8 - (unsigned int)(first_bit % 8);
+	}
+	return 0;
+}
+
+/// Decodes the residuals of band z of a BSQ stream compressed with the sample adaptive method, whose first
+/// codeword starts at bit first_bit of the stream; the statistics of the band in state must be the
+/// initial ones (see init_decoder_state)
+int decode_band(FILE *compressedStream, input_feature_t input_params, encoder_config_t encoder_params,
+		decoder_state_t *state, unsigned int z, unsigned long long first_bit, void *residuals)
+{
+	const size_t band_size = (size_t)input_params.x_size * input_params.y_size;
+	unsigned char buffer = 0;
+	unsigned int buffer_len = 0;
+	size_t i = 0;
+
+	if (seek_bit(compressedStream, first_bit, &buffer, &buffer_len) != 0)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error, band %u starts past the end of the compressed stream\n", z);
+		return -1;
+	}
+	for (i = 0; i < band_size; i++)
+	{
+		size_t BSQidx = z * band_size + i;
+		unsigned int temp_sample = decode_sample(compressedStream, input_params, encoder_params, state->counter, state->accumulator,
+				BSQidx, &buffer, &buffer_len);
+		if (temp_sample == (unsigned int)-1)
+		{
+			log_error(CCSDS_ERROR_DATA, "Error in reading sample with BSQidx = %zu of band %u\n", BSQidx, z);
+			return -1;
+		}
+		SET_ELEMENT(residuals, SAMPLE_BYTES(input_params), BSQidx, temp_sample);
+	}
+	return 0;
+}
+
+/// Decoding of the bands of a stream through its band index, shared by the threads taking part in it
+typedef struct
+{
+	const char *inputFile;
+	io_backend_t backend;
+	input_feature_t input_params;
+	encoder_config_t encoder_params;
+	decoder_state_t *state;
+	const unsigned long long *band_offsets;
+	unsigned long long header_bits;
+	// the bands [0, num_bands) are decoded
+	unsigned int num_bands;
+	void *residuals;
+	log_callback_t log_callback;
+	void *log_user_data;
+	// next band to be decoded and whether a thread failed, accessed atomically
+	unsigned int next_band;
+	int failed;
+} band_decoding_t;
+
+/// Thread decoding bands until none is left; stream is the one of the calling thread, NULL for the
+/// other threads, which open their own
+typedef struct
+{
+	band_decoding_t *decoding;
+	FILE *stream;
+	pthread_t thread;
+	ccsds_status_t status;
+} band_decoder_t;
+
+/// Decodes the next band not taken by another thread, until all of them are decoded or a thread fails
+static void *decode_bands(void *argument)
+{
+	band_decoder_t *decoder = (band_decoder_t *)argument;
+	band_decoding_t *decoding = decoder->decoding;
+	FILE *compressedStream = decoder->stream;
+	io_file_t streamFile;
+	log_context_t log_context;
+	int result = 0;
+
+	log_begin(&log_context, decoding->log_callback, decoding->log_user_data);
+	// the threads seek to their bands: the pread and O_DIRECT backends would read the whole stream for each
+	// of them, so they go through stdio
+	if (compressedStream == NULL &&
+			(compressedStream = io_open_stream(&streamFile, decoding->backend == IO_BACKEND_MMAP ? IO_BACKEND_MMAP : IO_BACKEND_STDIO, decoding->inputFile)) == NULL)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in opening file %s containing the compressed stream\n", decoding->inputFile);
+		result = -1;
+	}
+	while (result == 0 && __atomic_load_n(&decoding->failed, __ATOMIC_RELAXED) == 0)
+	{
+		unsigned int z = __atomic_fetch_add(&decoding->next_band, 1, __ATOMIC_RELAXED);
+		if (z >= decoding->num_bands)
+			break;
+		result = decode_band(compressedStream, decoding->input_params, decoding->encoder_params, decoding->state, z,
+				decoding->header_bits + decoding->band_offsets[z], decoding->residuals);
+	}
+	if (result != 0)
+		__atomic_store_n(&decoding->failed, 1, __ATOMIC_RELAXED);
+	if (decoder->stream == NULL && compressedStream != NULL)
+		io_close_stream(&streamFile, compressedStream);
+	decoder->status = log_end(&log_context, result);
+	return NULL;
+}
+
+/// Decodes the first num_bands bands of the stream, whose header has just been read from compressedStream,
+/// with num_threads threads (the calling one included) finding the bands through the band index
+static int decode_indexed(FILE *compressedStream, input_feature_t input_params, encoder_config_t encoder_params, char inputFile[128],
+		char bandIndexFile[128], unsigned int num_bands, unsigned int num_threads, io_backend_t backend, void *residuals, arena_t *arena)
+{
+	band_decoding_t decoding;
+	band_decoder_t *decoders = NULL;
+	decoder_state_t state;
+	unsigned long long *band_offsets = NULL;
+	unsigned int started = 0;
+	unsigned int i = 0;
+	long header_bytes = ftell(compressedStream);
+
+	if (encoder_params.encoding_method != SAMPLE || encoder_params.out_interleaving != BSQ)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "Error, the band index can only be used with BSQ streams compressed with the sample adaptive encoder\n");
+		return -1;
+	}
+	if (num_threads == 0)
+	{
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		num_threads = online > 0 ? (unsigned int)online : 1;
+	}
+	if (num_threads > num_bands)
+		num_threads = num_bands;
+	// Everything used by the threads is allocated up front, as the arena is not shared among them
+	band_offsets = (unsigned long long *)arena_alloc(arena, sizeof(unsigned long long) * (input_params.z_size + 1));
+	decoders = (band_decoder_t *)arena_calloc(arena, num_threads, sizeof(band_decoder_t));
+	if (band_offsets == NULL || decoders == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the band index\n");
+		return -1;
+	}
+	if (header_bytes < 0 || read_band_index(bandIndexFile, input_params, band_offsets) != 0 || init_decoder_state(input_params, encoder_params, &state, arena) != 0)
+		return -1;
+
+	memset(&decoding, 0, sizeof(band_decoding_t));
+	decoding.inputFile = inputFile;
+	decoding.backend = backend;
+	decoding.input_params = input_params;
+	decoding.encoder_params = encoder_params;
+	decoding.state = &state;
+	decoding.band_offsets = band_offsets;
+	decoding.header_bits = (unsigned long long)header_bytes * 8;
+	decoding.num_bands = num_bands;
+	decoding.residuals = residuals;
+	log_current_callback(&decoding.log_callback, &decoding.log_user_data);
+
+	// The calling thread decodes bands too, with the stream the header was read from
+	decoders[0].decoding = &decoding;
+	decoders[0].stream = compressedStream;
+	for (started = 1; started < num_threads; started++)
+	{
+		decoders[started].decoding = &decoding;
+		if (pthread_create(&decoders[started].thread, NULL, decode_bands, &decoders[started]) != 0)
+			break;
+	}
+	decode_bands(&decoders[0]);
+	for (i = 1; i < started; i++)
+		pthread_join(decoders[i].thread, NULL);
+
+	// The errors of the other threads have been reported to the log callback already
+	for (i = 0; i < started; i++)
+	{
+		if (decoders[i].status != CCSDS_OK)
+		{
+			log_error(decoders[i].status, "Error in decoding the bands of the stream through the band index\n");
+			return -1;
+		}
+	}
 	return 0;
 }
 
 /******************************************************
  * Routines for the Block Adaptive Encoder
  *******************************************************/
-/// Reads a compressed block when using the block adaptive encoding method.
+/// Reads a compressed block when using the block adaptive encoding method; the residuals of the
+/// block are saved in block, in the order of the stream.
 int read_nocomp_block(input_feature_t input_params, encoder_config_t encoder_params, FILE *compressedStream,
-		unsigned short int *residuals, unsigned int *read_elems, unsigned char *buffer,
+		unsigned int *block, size_t *read_elems, unsigned char *buffer,
 		unsigned int *buffer_len, unsigned int block_size)
 {
 	// no compression applied
 	unsigned int i = 0;
 	for (i = 0; i < block_size; i++)
 	{
-		residuals[indexToBSQ(encoder_params.out_interleaving, encoder_params.out_interleaving_depth,
-				input_params.x_size, input_params.y_size, input_params.z_size, *read_elems + i)] =
-			read_bits(compressedStream, input_params.dyn_range, buffer, buffer_len);
+		block[i] = read_bits(compressedStream, input_params.dyn_range, buffer, buffer_len);
 	}
 	*read_elems += block_size;
 	return 0;
@@ -220,7 +399,7 @@ void decorrelate(unsigned int value, unsigned int *a, unsigned int *b)
 }
 
 int read_second_block(input_feature_t input_params, encoder_config_t encoder_params, FILE *compressedStream,
-		unsigned short int *residuals, unsigned int *read_elems, unsigned char *buffer,
+		unsigned int *block, size_t *read_elems, unsigned char *buffer,
 		unsigned int *buffer_len, unsigned int block_size)
 {
 	unsigned int second_extension_values[32];
@@ -236,10 +415,8 @@ int read_second_block(input_feature_t input_params, encoder_config_t encoder_par
 		unsigned int a = 0, b = 0;
 		unsigned int cur_value = second_extension_values[i / 2];
 		decorrelate(cur_value, &a, &b);
-		residuals[indexToBSQ(encoder_params.out_interleaving, encoder_params.out_interleaving_depth,
-				input_params.x_size, input_params.y_size, input_params.z_size, *read_elems + i)] = b + a - cur_value;
-		residuals[indexToBSQ(encoder_params.out_interleaving, encoder_params.out_interleaving_depth,
-				input_params.x_size, input_params.y_size, input_params.z_size, *read_elems + i + 1)] = cur_value - a;
+		block[i] = b + a - cur_value;
+		block[i + 1] = cur_value - a;
 	}
 	*read_elems += block_size;
 
@@ -247,7 +424,7 @@ int read_second_block(input_feature_t input_params, encoder_config_t encoder_par
 }
 
 int read_ksplit_block(input_feature_t input_params, encoder_config_t encoder_params, FILE *compressedStream,
-		unsigned int k, unsigned short int *residuals, unsigned int *read_elems,
+		unsigned int k, unsigned int *block, size_t *read_elems,
 		unsigned char *buffer, unsigned int *buffer_len, unsigned int block_size)
 {
 	// The various elements are simply saved with the FS code of the
@@ -266,15 +443,13 @@ int read_ksplit_block(input_feature_t input_params, encoder_config_t encoder_par
 	}
 	for (i = 0; i < block_size; i++)
 	{
-		residuals[indexToBSQ(encoder_params.out_interleaving, encoder_params.out_interleaving_depth,
-				input_params.x_size, input_params.y_size, input_params.z_size, *read_elems + i)] =
-			(division_result[i] << k) | reminders[i];
+		block[i] = (division_result[i] << k) | reminders[i];
 	}
 	*read_elems += block_size;
 	return 0;
 }
 int read_zero_block(input_feature_t input_params, encoder_config_t encoder_params, FILE *compressedStream,
-		unsigned short int *residuals, unsigned int *read_elems, unsigned char *buffer, unsigned int *buffer_len)
+		size_t *read_elems, unsigned char *buffer, unsigned int *buffer_len)
 {
 	// While for the other options I always decode one block at a time, here
 	// I might need to decode more than one block
@@ -295,136 +470,152 @@ int read_zero_block(input_feature_t input_params, encoder_config_t encoder_param
 			num_blocks = num_blocks_reference;
 		}
 	}
-	// NOTE: as the whole residuals array has been initialized to 0, there is no need to write
-	// zero blocks.
-	//     for(i = 0; i < encoder_params.block_size*num_blocks; i++){
-	//         residuals[indexToBSQ(encoder_params.out_interleaving, encoder_params.out_interleaving_depth,
-	//                         input_params.x_size, input_params.y_size, input_params.z_size, *read_elems + i)] = 0;
-	//     }
+	// NOTE: the zero residuals are not saved anywhere: the whole residuals array of decode has been
+	// initialized to 0, while decode_residuals writes them itself
 	*read_elems += encoder_params.block_size * num_blocks;
 	return 0;
 }
 
-/// Main routine for decoding the input stream compressed according to the block adaptive
-/// method: it determines the compression method for the block and the calls the appropriate
-/// routine for its decoding.
-int decode_block_adaptive(FILE *compressedStream, input_feature_t input_params,
-		encoder_config_t encoder_params, unsigned short int *residuals)
+/// Reads the next block of the stream compressed according to the block adaptive method: it
+/// determines the compression method for the block and then calls the appropriate routine for
+/// its decoding, advancing read_elems past the residuals of the block
+/// @return 1 for a run of zero blocks, 0 when the residuals of the block have been saved in block,
+/// a negative value in case of error
+static int read_block(FILE *compressedStream, input_feature_t input_params, encoder_config_t encoder_params,
+		unsigned int *block, size_t *read_elems, unsigned char *buffer, unsigned int *buffer_len)
 {
 	unsigned int compression_id = 0;
 	unsigned int mask = 0;
-	unsigned char buffer = 0;
-	unsigned int buffer_len = 0;
-	unsigned int read_elems = 0;
-	const unsigned int samplesNum = input_params.x_size * input_params.y_size * input_params.z_size;
+	unsigned int cur_block_size = (unsigned int)MIN(encoder_params.block_size, IMAGE_SAMPLES(input_params) - *read_elems);
 
-	while ((read_elems < samplesNum) && feof(compressedStream) == 0)
+	if (input_params.dyn_range <= 4 && encoder_params.restricted != 0)
 	{
-		unsigned int cur_block_size = MIN(encoder_params.block_size, samplesNum - read_elems);
-		if (input_params.dyn_range <= 4 && encoder_params.restricted != 0)
+		if (input_params.dyn_range < 3)
 		{
-			if (input_params.dyn_range < 3)
-			{
-				compression_id = read_bits(compressedStream, 1, &buffer, &buffer_len);
-				mask = 0x1;
-			}
-			else
-			{
-				compression_id = read_bits(compressedStream, 2, &buffer, &buffer_len);
-				mask = 0x3;
-			}
+			compression_id = read_bits(compressedStream, 1, buffer, buffer_len);
+			mask = 0x1;
 		}
 		else
 		{
-			if (input_params.dyn_range <= 8)
-			{
-				compression_id = read_bits(compressedStream, 3, &buffer, &buffer_len);
-				mask = 0x7;
-			}
-			else if (input_params.dyn_range <= 16)
-			{
-				compression_id = read_bits(compressedStream, 4, &buffer, &buffer_len);
-				mask = 0xF;
-			}
-			else
-			{
-				compression_id = read_bits(compressedStream, 5, &buffer, &buffer_len);
-				mask = 0x1F;
-			}
+			compression_id = read_bits(compressedStream, 2, buffer, buffer_len);
+			mask = 0x3;
 		}
-		if (compression_id == 0)
+	}
+	else
+	{
+		if (input_params.dyn_range <= 8)
 		{
-			// zero compression or second extension option
-			if (read_bits(compressedStream, 1, &buffer, &buffer_len) == 0)
-			{
-				// zero compression
-				if (read_zero_block(input_params, encoder_params, compressedStream, residuals,
-							&read_elems, &buffer, &buffer_len) != 0)
-				{
-					fprintf(stderr, "Error in reading the zero block\n");
-					return -1;
-				}
-			}
-			else
-			{
-				//second extension
-				if (read_second_block(input_params, encoder_params, compressedStream, residuals, &read_elems,
-							&buffer, &buffer_len, cur_block_size) != 0)
-				{
-					fprintf(stderr, "Error in reading the second block\n");
-					return -1;
-				}
-			}
+			compression_id = read_bits(compressedStream, 3, buffer, buffer_len);
+			mask = 0x7;
 		}
-		else if (compression_id == 1)
+		else if (input_params.dyn_range <= 16)
 		{
-			// FS or no compression (when restricted mode used)
-			if (mask == 1)
-			{
-				//no compression
-				if (read_nocomp_block(input_params, encoder_params, compressedStream, residuals, &read_elems, &buffer,
-							&buffer_len, cur_block_size) != 0)
-				{
-					fprintf(stderr, "Error in reading the no compression\n");
-					return -1;
-				}
-			}
-			else
+			compression_id = read_bits(compressedStream, 4, buffer, buffer_len);
+			mask = 0xF;
+		}
+		else
+		{
+			compression_id = read_bits(compressedStream, 5, buffer, buffer_len);
+			mask = 0x1F;
+		}
+	}
+	if (compression_id == 0)
+	{
+		// zero compression or second extension option
+		if (read_bits(compressedStream, 1, buffer, buffer_len) == 0)
+		{
+			// zero compression
+			if (read_zero_block(input_params, encoder_params, compressedStream, read_elems, buffer, buffer_len) != 0)
 			{
-				// FS (i.e. k-split with with K=0)
-				if (read_ksplit_block(input_params, encoder_params, compressedStream, 0, residuals, &read_elems,
-							&buffer, &buffer_len, cur_block_size) != 0)
-				{
-					fprintf(stderr, "Error in reading the ksplit block with k = 0\n");
-					return -1;
-				}
+				log_error(CCSDS_ERROR_DATA, "Error in reading the zero block\n");
+				return -1;
 			}
+			return 1;
+		}
+		//second extension
+		if (read_second_block(input_params, encoder_params, compressedStream, block, read_elems,
+					buffer, buffer_len, cur_block_size) != 0)
+		{
+			log_error(CCSDS_ERROR_DATA, "Error in reading the second block\n");
+			return -1;
 		}
-		else if (compression_id == mask)
+	}
+	else if (compression_id == 1)
+	{
+		// FS or no compression (when restricted mode used)
+		if (mask == 1)
 		{
-			// no compression
-			if (read_nocomp_block(input_params, encoder_params, compressedStream, residuals, &read_elems,
-						&buffer, &buffer_len, cur_block_size) != 0)
+			//no compression
+			if (read_nocomp_block(input_params, encoder_params, compressedStream, block, read_elems, buffer,
+						buffer_len, cur_block_size) != 0)
 			{
-				fprintf(stderr, "Error in reading the no compression\n");
+				log_error(CCSDS_ERROR_DATA, "Error in reading the no compression\n");
 				return -1;
 			}
 		}
 		else
 		{
-			// k-split with k = (compression_id - 1)
-			if (read_ksplit_block(input_params, encoder_params, compressedStream, compression_id - 1,
-						residuals, &read_elems, &buffer, &buffer_len, cur_block_size) != 0)
+			// FS (i.e. k-split with with K=0)
+			if (read_ksplit_block(input_params, encoder_params, compressedStream, 0, block, read_elems,
+						buffer, buffer_len, cur_block_size) != 0)
 			{
-				fprintf(stderr, "Error in reading the ksplit block with k = %d\n", compression_id - 1);
+				log_error(CCSDS_ERROR_DATA, "Error in reading the ksplit block with k = 0\n");
 				return -1;
 			}
 		}
 	}
+	else if (compression_id == mask)
+	{
+		// no compression
+		if (read_nocomp_block(input_params, encoder_params, compressedStream, block, read_elems,
+					buffer, buffer_len, cur_block_size) != 0)
+		{
+			log_error(CCSDS_ERROR_DATA, "Error in reading the no compression\n");
+			return -1;
+		}
+	}
+	else
+	{
+		// k-split with k = (compression_id - 1)
+		if (read_ksplit_block(input_params, encoder_params, compressedStream, compression_id - 1,
+					block, read_elems, buffer, buffer_len, cur_block_size) != 0)
+		{
+			log_error(CCSDS_ERROR_DATA, "Error in reading the ksplit block with k = %d\n", compression_id - 1);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/// Main routine for decoding the input stream compressed according to the block adaptive
+/// method: it reads one block at a time (see read_block), saving its residuals in BSQ order.
+int decode_block_adaptive(FILE *compressedStream, input_feature_t input_params,
+		encoder_config_t encoder_params, void *residuals)
+{
+	unsigned int block[64];
+	unsigned char buffer = 0;
+	unsigned int buffer_len = 0;
+	size_t read_elems = 0;
+	const size_t samplesNum = IMAGE_SAMPLES(input_params);
+
+	while ((read_elems < samplesNum) && feof(compressedStream) == 0)
+	{
+		size_t first_elem = read_elems;
+		int result = read_block(compressedStream, input_params, encoder_params, block, &read_elems, &buffer, &buffer_len);
+		size_t i = 0;
+		if (result < 0)
+			return -1;
+		// the residuals of the zero blocks are already 0
+		for (i = first_elem; result == 0 && i < read_elems; i++)
+		{
+			SET_ELEMENT(residuals, SAMPLE_BYTES(input_params), indexToBSQ(encoder_params.out_interleaving, encoder_params.out_interleaving_depth,
+					input_params.x_size, input_params.y_size, input_params.z_size, i), block[i - first_elem]);
+		}
+	}
 #ifndef NDEBUG
 	if (read_elems < samplesNum)
 	{
-		fprintf(stderr, "Error read only %d samples out of %d\n", read_elems, samplesNum);
+		log_error(CCSDS_ERROR_DATA, "Error read only %zu samples out of %zu\n", read_elems, samplesNum);
 		return -1;
 	}
 #endif
@@ -432,9 +623,147 @@ int decode_block_adaptive(FILE *compressedStream, input_feature_t input_params,
 	return 0;
 }
 
+/******************************************************
+ * Decoding a chunk at a time
+ *******************************************************/
+/// Returns the number of bytes of memory allocated by init_decoder_state
+size_t decoder_state_size(input_feature_t input_params)
+{
+	return 2 * sizeof(unsigned int) * input_params.z_size;
+}
+
+/// Prepares the decoding of the stream from its first residual, allocating the statistics of the
+/// sample adaptive encoder from arena
+int init_decoder_state(input_feature_t input_params, encoder_config_t encoder_params, decoder_state_t *state, arena_t *arena)
+{
+	memset(state, 0, sizeof(decoder_state_t));
+	if (encoder_params.encoding_method != SAMPLE)
+		return 0;
+	state->counter = (unsigned int *)arena_alloc(arena, sizeof(unsigned int) * input_params.z_size);
+	if (state->counter == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in the allocation of the counter statistic\n\n");
+		return -1;
+	}
+	state->accumulator = (unsigned int *)arena_alloc(arena, sizeof(unsigned int) * input_params.z_size);
+	if (state->accumulator == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in the allocation of the accumulator statistic\n\n");
+		return -1;
+	}
+	reset_decoder_state(input_params, encoder_params, state);
+	return 0;
+}
+
+/// Brings the decoding back to the first residual of the stream, keeping the buffers of state
+void reset_decoder_state(input_feature_t input_params, encoder_config_t encoder_params, decoder_state_t *state)
+{
+	unsigned int i = 0;
+
+	state->read_elems = 0;
+	state->buffer = 0;
+	state->buffer_len = 0;
+	state->block_len = 0;
+	state->block_pos = 0;
+	state->zero_residuals = 0;
+	if (encoder_params.encoding_method != SAMPLE)
+		return;
+	for (i = 0; i < input_params.z_size; i++)
+	{
+		state->counter[i] = 0x1 << encoder_params.y_0;
+		state->accumulator[i] = (state->counter[i] * (3 * (0x1 << (encoder_params.k_init[i] + 6)) - 49)) / 0x080;
+	}
+}
+
+/// Moves the decoding to residual read_elems of a stream compressed with the sample adaptive method,
+/// whose codeword starts at bit first_bit of the stream; the statistics are not modified
+int seek_decoder_state(FILE *compressedStream, decoder_state_t *state, size_t read_elems, unsigned long long first_bit)
+{
+	if (seek_bit(compressedStream, first_bit, &state->buffer, &state->buffer_len) != 0)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error, residual %zu starts past the end of the compressed stream\n", read_elems);
+		return -1;
+	}
+	state->read_elems = read_elems;
+	state->block_len = 0;
+	state->block_pos = 0;
+	state->zero_residuals = 0;
+	return 0;
+}
+
+/// Decodes the next count residuals of the stream, saving them in residuals in the order of the stream
+int decode_residuals(FILE *compressedStream, input_feature_t input_params, encoder_config_t encoder_params,
+		decoder_state_t *state, unsigned short int *residuals, size_t count)
+{
+	const size_t samplesNum = IMAGE_SAMPLES(input_params);
+	size_t decoded = 0;
+
+	if (encoder_params.encoding_method == SAMPLE)
+	{
+		for (decoded = 0; decoded < count; decoded++)
+		{
+			size_t BSQidx = indexToBSQ(encoder_params.out_interleaving, encoder_params.out_interleaving_depth,
+					input_params.x_size, input_params.y_size, input_params.z_size, state->read_elems);
+			unsigned int temp_sample = decode_sample(compressedStream, input_params, encoder_params, state->counter, state->accumulator,
+					BSQidx, &state->buffer, &state->buffer_len);
+			if (temp_sample == (unsigned int)-1)
+			{
+				log_error(CCSDS_ERROR_DATA, "Error in reading sample with BSQidx = %zu, element %zu\n", BSQidx, state->read_elems);
+				return -1;
+			}
+			residuals[decoded] = (unsigned short int)temp_sample;
+			state->read_elems++;
+		}
+	}
+	while (decoded < count)
+	{
+		// block adaptive: the residuals left from the last block are returned first
+		if (state->zero_residuals > 0)
+		{
+			size_t length = MIN(state->zero_residuals, count - decoded);
+			memset(residuals + decoded, 0, length * sizeof(unsigned short int));
+			state->zero_residuals -= length;
+			decoded += length;
+		}
+		else if (state->block_pos < state->block_len)
+		{
+			residuals[decoded++] = (unsigned short int)state->block[state->block_pos++];
+		}
+		else if (state->read_elems < samplesNum)
+		{
+			size_t first_elem = state->read_elems;
+			int result = read_block(compressedStream, input_params, encoder_params, state->block, &state->read_elems,
+					&state->buffer, &state->buffer_len);
+			if (result < 0)
+				return -1;
+			if (result == 1)
+			{
+				state->zero_residuals = state->read_elems - first_elem;
+				state->block_len = 0;
+			}
+			else
+			{
+				state->block_len = (unsigned int)(state->read_elems - first_elem);
+			}
+			state->block_pos = 0;
+		}
+		else
+		{
+			log_error(CCSDS_ERROR_DATA, "Error, the compressed stream holds less residuals than the image samples\n");
+			return -1;
+		}
+	}
+	if (feof(compressedStream) != 0)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error, the compressed stream ended before residual %zu\n", state->read_elems);
+		return -1;
+	}
+	return 0;
+}
+
 /// Reads the compressed file header, filling-in the appropriate data structures
 int read_header(FILE *compressedStream, input_feature_t *input_params, encoder_config_t *encoder_params,
-		predictor_config_t *predictor_params)
+		predictor_config_t *predictor_params, arena_t *arena)
 {
 	unsigned char buffer = 0;
 	unsigned char temp = 0;
@@ -539,16 +868,16 @@ int read_header(FILE *compressedStream, input_feature_t *input_params, encoder_c
 			int prediction_len = predictor_params->pred_bands;
 			if (predictor_params->full != 0)
 				prediction_len += 3;
-			if ((predictor_params->weight_init_table = (int **)malloc(sizeof(int *) * input_params->z_size)) == NULL)
+			if ((predictor_params->weight_init_table = (int **)arena_alloc(arena, sizeof(int *) * input_params->z_size)) == NULL)
 			{
-				fprintf(stderr, "\nError, in allocating the weight initialization table - 1\n\n");
+				log_error(CCSDS_ERROR_MEMORY, "\nError, in allocating the weight initialization table - 1\n\n");
 				return -1;
 			}
 			for (i = 0; i < input_params->z_size; i++)
 			{
-				if ((predictor_params->weight_init_table[i] = (int *)malloc(sizeof(int) * prediction_len)) == NULL)
+				if ((predictor_params->weight_init_table[i] = (int *)arena_alloc(arena, sizeof(int) * prediction_len)) == NULL)
 				{
-					fprintf(stderr, "\nError, in allocating the weight initialization table - 2\n\n");
+					log_error(CCSDS_ERROR_MEMORY, "\nError, in allocating the weight initialization table - 2\n\n");
 					return -1;
 				}
 			}
@@ -582,9 +911,9 @@ int read_header(FILE *compressedStream, input_feature_t *input_params, encoder_c
 	/* ENTROPY CODER METADATA */
 	if (encoder_params->encoding_method == SAMPLE)
 	{
-		if ((encoder_params->k_init = (unsigned int *)malloc(input_params->z_size * sizeof(unsigned int))) == NULL)
+		if ((encoder_params->k_init = (unsigned int *)arena_alloc(arena, input_params->z_size * sizeof(unsigned int))) == NULL)
 		{
-			fprintf(stderr, "\nError, in allocating the accumulator initialization table\n\n");
+			log_error(CCSDS_ERROR_MEMORY, "\nError, in allocating the accumulator initialization table\n\n");
 			return -1;
 		}
 		// Unary length limit
@@ -660,117 +989,219 @@ int read_header(FILE *compressedStream, input_feature_t *input_params, encoder_c
 
 	// !!!!!!!!!!!!!! DEBUGGING STATEMENTS !!!!!!!!!!!!!
 #ifndef NDEBUG
-	printf("Dimensions: x, y, z = %d, %d, %d\n", input_params->x_size, input_params->y_size, input_params->z_size);
+	log_info("Dimensions: x, y, z = %d, %d, %d\n", input_params->x_size, input_params->y_size, input_params->z_size);
 	if (input_params->signed_samples == 0)
-		printf("Unsigned samples\n");
+		log_info("Unsigned samples\n");
 	else
-		printf("Signed samples\n");
-	printf("Dynamic Range = %d\n", input_params->dyn_range);
+		log_info("Signed samples\n");
+	log_info("Dynamic Range = %d\n", input_params->dyn_range);
 	if (encoder_params->out_interleaving == BI)
-		printf("Encoding: BI - interleaving %d\n", encoder_params->out_interleaving_depth);
+		log_info("Encoding: BI - interleaving %d\n", encoder_params->out_interleaving_depth);
 	else
-		printf("Encoding: BSQ\n");
-	printf("Word length = %d\n", encoder_params->out_wordsize);
+		log_info("Encoding: BSQ\n");
+	log_info("Word length = %d\n", encoder_params->out_wordsize);
 
-	printf("Prediction bands = %d\n", predictor_params->user_input_pred_bands);
+	log_info("Prediction bands = %d\n", predictor_params->user_input_pred_bands);
 	if (predictor_params->full != 0)
-		printf("Full prediction\n");
+		log_info("Full prediction\n");
 	else
-		printf("Reduced prediction\n");
+		log_info("Reduced prediction\n");
 	if (predictor_params->neighbour_sum != 0)
-		printf("Neighbor Oriented sum\n");
+		log_info("Neighbor Oriented sum\n");
 	else
-		printf("Column Oriented sum\n");
-	printf("Regsiter size = %d\n", predictor_params->register_size);
-	printf("Weight Resolution = %d\n", predictor_params->weight_resolution);
-	printf("Weight Update Scaling Exponent Change = %d\n", predictor_params->weight_interval);
-	printf("Weight Update Scaling Exponent Init = %d\n", predictor_params->weight_initial);
-	printf("Weight Update Scaling Exponent Final = %d\n", predictor_params->weight_final);
-	printf("Weight Init Resolution = %d\n", predictor_params->weight_init_resolution);
+		log_info("Column Oriented sum\n");
+	log_info("Regsiter size = %d\n", predictor_params->register_size);
+	log_info("Weight Resolution = %d\n", predictor_params->weight_resolution);
+	log_info("Weight Update Scaling Exponent Change = %d\n", predictor_params->weight_interval);
+	log_info("Weight Update Scaling Exponent Init = %d\n", predictor_params->weight_initial);
+	log_info("Weight Update Scaling Exponent Final = %d\n", predictor_params->weight_final);
+	log_info("Weight Init Resolution = %d\n", predictor_params->weight_init_resolution);
 	if (predictor_params->weight_init_table)
 	{
-		printf("Custom weights - table included\n");
+		log_info("Custom weights - table included\n");
 	}
 
 	if (encoder_params->encoding_method == BLOCK)
 	{
-		printf("Block Adaptive Encoder\n");
-		printf("Block Size = %d\n", encoder_params->block_size);
-		printf("Ref Sample Interval = %d\n", encoder_params->ref_interval);
+		log_info("Block Adaptive Encoder\n");
+		log_info("Block Size = %d\n", encoder_params->block_size);
+		log_info("Ref Sample Interval = %d\n", encoder_params->ref_interval);
 	}
 	else
 	{
-		printf("Sample Adaptive Encoder\n");
-		printf("Unary length = %d\n", encoder_params->u_max);
-		printf("Rescaling counter = %d\n", encoder_params->y_star);
-		printf("Initial Exponent = %d\n", encoder_params->y_0);
-		printf("Acc Init Constant = %d\n", encoder_params->k);
+		log_info("Sample Adaptive Encoder\n");
+		log_info("Unary length = %d\n", encoder_params->u_max);
+		log_info("Rescaling counter = %d\n", encoder_params->y_star);
+		log_info("Initial Exponent = %d\n", encoder_params->y_0);
+		log_info("Acc Init Constant = %d\n", encoder_params->k);
 	}
-	fflush(stdout);
 #endif
 
 	return 0;
 }
 
-/// Main decoder function, from the file containing the compressed stream it produces the
-/// file containing the mapped residuals, stored in BSQ format.
-int decode(input_feature_t *input_params, predictor_config_t *predictor_params, unsigned short int **residuals, char inputFile[128])
+/// Reads the header of the compressed stream saved in inputFile, filling in the image and predictor
+/// parameters without decoding the stream; the tables contained in the header are not kept
+int peek_header(char inputFile[128], input_feature_t *input_params, predictor_config_t *predictor_params, arena_t *arena)
 {
 	FILE *compressedStream = NULL;
 	encoder_config_t encoder_params;
+	arena_mark_t mark = arena_get_mark(arena);
+	int result = 0;
+
+	if ((compressedStream = fopen(inputFile, "rb")) == NULL)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in opening file %s containing the compressed stream\n", inputFile);
+		return -1;
+	}
+	memset(&encoder_params, 0, sizeof(encoder_config_t));
+	result = read_header(compressedStream, input_params, &encoder_params, predictor_params, arena);
+	fclose(compressedStream);
+	arena_rewind(arena, mark);
+	predictor_params->weight_init_table = NULL;
+	return result;
+}
+
+/// Decodes the first num_bands bands of a BSQ stream, whose header has just been read from compressedStream,
+/// a row at a time: the decoding stops after the last residual of band num_bands - 1, the rest of the stream
+/// is never read
+static int decode_first_bands(FILE *compressedStream, input_feature_t input_params, encoder_config_t encoder_params,
+		unsigned int num_bands, void *residuals, arena_t *arena)
+{
+	decoder_state_t state;
+	unsigned short int *row = NULL;
+	const size_t rows = (size_t)input_params.y_size * num_bands;
+	size_t r = 0;
+	unsigned int x = 0;
+
+	if (init_decoder_state(input_params, encoder_params, &state, arena) != 0)
+		return -1;
+	if ((row = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * input_params.x_size)) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the row of residuals\n");
+		return -1;
+	}
+	for (r = 0; r < rows; r++)
+	{
+		if (decode_residuals(compressedStream, input_params, encoder_params, &state, row, input_params.x_size) != 0)
+			return -1;
+		for (x = 0; x < input_params.x_size; x++)
+			SET_ELEMENT(residuals, SAMPLE_BYTES(input_params), r * input_params.x_size + x, row[x]);
+	}
+	return 0;
+}
+
+/// Returns the number of bytes of memory allocated by decode: the residuals and the decoder statistics
+size_t decode_working_set(input_feature_t input_params)
+{
+	return SAMPLE_BYTES(input_params) * IMAGE_SAMPLES(input_params) + 2 * sizeof(unsigned int) * input_params.z_size;
+}
+
+/// Decodes the stream starting at the current position of compressedStream (see decode); inputFile is the
+/// file it was opened from, reopened by the threads decoding through the band index
+static int decode_opened(FILE *compressedStream, input_feature_t *input_params, predictor_config_t *predictor_params, void **residuals,
+		char inputFile[128], char bandIndexFile[128], unsigned int num_threads, unsigned int num_bands, io_backend_t backend, arena_t *arena)
+{
+	encoder_config_t encoder_params;
+	// the image whose residuals are decoded: the first num_bands bands of the one of the stream
+	input_feature_t decoded_params;
+	// the tables of the header and the residuals are kept, the statistics of the decoder released
+	arena_mark_t mark = arena_get_mark(arena);
+	arena_mark_t residuals_mark;
+	int result = 0;
+
+	memset(&encoder_params, 0, sizeof(encoder_config_t));
+	predictor_params->weight_init_table = NULL;
+	if (read_header(compressedStream, input_params, &encoder_params, predictor_params, arena) != 0 || check_image_size(*input_params) != 0)
+	{
+		arena_rewind(arena, mark);
+		predictor_params->weight_init_table = NULL;
+		return -1;
+	}
 
-	if ((compressedStream = fopen(inputFile, "r+b")) == NULL)
+	// Only the bands before num_bands are decoded, which requires them to come first in the stream
+	if (num_bands != 0 && (encoder_params.out_interleaving != BSQ || num_bands > input_params->z_size))
 	{
-		fprintf(stderr, "Error in opening file %s containing the compressed stream\n", inputFile);
+		log_error(CCSDS_ERROR_CONFIG, "Error, the first %u bands cannot be decoded alone from a %s stream of %u bands\n", num_bands,
+				encoder_params.out_interleaving == BSQ ? "BSQ" : "BI", input_params->z_size);
+		arena_rewind(arena, mark);
+		predictor_params->weight_init_table = NULL;
 		return -1;
 	}
-	read_header(compressedStream, input_params, &encoder_params, predictor_params);
+	decoded_params = *input_params;
+	if (num_bands != 0)
+		decoded_params.z_size = num_bands;
 
-	// Allocation of the array holding the residuals
-	*residuals = (unsigned short int *)malloc(sizeof(unsigned short int) * input_params->x_size * input_params->y_size * input_params->z_size);
+	// Allocation of the array holding the residuals, each one taking SAMPLE_BYTES bytes
+	*residuals = arena_calloc(arena, SAMPLE_BYTES(decoded_params), IMAGE_SAMPLES(decoded_params));
 	if (*residuals == NULL)
 	{
-		fprintf(stderr, "Error in allocating %lf kBytes for the residuals\n\n", ((double)sizeof(unsigned short int) * input_params->x_size * input_params->y_size * input_params->z_size) / 1024.0);
-		fclose(compressedStream);
-		freeDecoderMemory(&encoder_params);
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating %lf kBytes for the residuals\n\n", ((double)SAMPLE_BYTES(decoded_params) * IMAGE_SAMPLES(decoded_params)) / 1024.0);
+		arena_rewind(arena, mark);
+		predictor_params->weight_init_table = NULL;
 		return -1;
 	}
-	memset(*residuals, 0, sizeof(unsigned short int) * input_params->x_size * input_params->y_size * input_params->z_size);
+	residuals_mark = arena_get_mark(arena);
 
 	// Now it is finally time to decode the stream according to the used encoding method
-	if (encoder_params.encoding_method == SAMPLE)
+	if (bandIndexFile != NULL && bandIndexFile[0] != '\x0')
 	{
-		if (decode_sample_adaptive(compressedStream, *input_params, encoder_params, *residuals) < 0)
-		{
-			fprintf(stderr, "Error in sample adaptive decoding\n");
-			fclose(compressedStream);
-			freeDecoderMemory(&encoder_params);
-			return -1;
-		}
+		if ((result = decode_indexed(compressedStream, *input_params, encoder_params, inputFile, bandIndexFile, decoded_params.z_size, num_threads,
+						backend, *residuals, arena)) < 0)
+			log_error(CCSDS_ERROR_DATA, "Error in decoding the bands in parallel\n");
+	}
+	else if (num_bands != 0)
+	{
+		if ((result = decode_first_bands(compressedStream, *input_params, encoder_params, num_bands, *residuals, arena)) < 0)
+			log_error(CCSDS_ERROR_DATA, "Error in decoding the first %u bands\n", num_bands);
+	}
+	else if (encoder_params.encoding_method == SAMPLE)
+	{
+		if ((result = decode_sample_adaptive(compressedStream, *input_params, encoder_params, *residuals, arena)) < 0)
+			log_error(CCSDS_ERROR_DATA, "Error in sample adaptive decoding\n");
 	}
 	else
 	{
-		if (decode_block_adaptive(compressedStream, *input_params, encoder_params, *residuals) < 0)
-		{
-			fprintf(stderr, "Error in block adaptive decoding\n");
-			fclose(compressedStream);
-			freeDecoderMemory(&encoder_params);
-			return -1;
-		}
+		if ((result = decode_block_adaptive(compressedStream, *input_params, encoder_params, *residuals)) < 0)
+			log_error(CCSDS_ERROR_DATA, "Error in block adaptive decoding\n");
 	}
 
-	fclose(compressedStream);
-	freeDecoderMemory(&encoder_params);
+	if (result < 0)
+	{
+		arena_rewind(arena, mark);
+		*residuals = NULL;
+		predictor_params->weight_init_table = NULL;
+		return -1;
+	}
+	arena_rewind(arena, residuals_mark);
 	return 0;
 }
 
-int freeDecoderMemory(encoder_config_t *encoder_config)
+/// Main decoder function, from the file containing the compressed stream it produces the
+/// file containing the mapped residuals, stored in BSQ format; the file is read through the given
+/// I/O backend. With a band index the bands are decoded by num_threads threads. With num_bands only the
+/// residuals of the first num_bands bands of a BSQ stream are decoded.
+int decode(input_feature_t *input_params, predictor_config_t *predictor_params, void **residuals, char inputFile[128],
+		char bandIndexFile[128], unsigned int num_threads, unsigned int num_bands, io_backend_t backend, arena_t *arena)
 {
-	// Free encoder config memory if needed.
-	if (encoder_config->k_init != NULL)
+	FILE *compressedStream = NULL;
+	io_file_t streamFile;
+	int result = 0;
+
+	if ((compressedStream = io_open_stream(&streamFile, backend, inputFile)) == NULL)
 	{
-		free(encoder_config->k_init);
+		log_error(CCSDS_ERROR_IO, "Error in opening file %s containing the compressed stream\n", inputFile);
+		return -1;
 	}
+	result = decode_opened(compressedStream, input_params, predictor_params, residuals, inputFile, bandIndexFile, num_threads, num_bands, backend, arena);
+	io_close_stream(&streamFile, compressedStream);
+	return result;
+}
 
-	return 0;
+/// Decodes the stream starting at the current position of compressedStream, e.g. one of the streams of a
+/// container
+int decode_stream(FILE *compressedStream, input_feature_t *input_params, predictor_config_t *predictor_params, void **residuals,
+		unsigned int num_bands, arena_t *arena)
+{
+	return decode_opened(compressedStream, input_params, predictor_params, residuals, NULL, NULL, 1, num_bands, IO_BACKEND_STDIO, arena);
 }
@@ -5,41 +5,126 @@
 #include "utils.h"
 #include "unpredict.h"
 #include "decoder.h"
+#include "pipelined_decoder.h"
+#include "segment_decoder.h"
 
-// Implementation of public functions.
-
-int decompress_ccsds123(decompressConfig_t *config)
+// Decompresses the image described by config, allocating all the buffers from arena.
+static int decompress_image(decompressConfig_t *config, arena_t *arena)
 {
 	// Initialize some variables.
 	double decodingStartTime = 0.0;
 	double decodingEndTime = 0.0;
 	double unpredictionEndTime = 0.0;
-	unsigned short int *residuals = NULL;
+	void *residuals = NULL;
+	input_feature_t header_input_params = config->input_params;
+	predictor_config_t header_predictor_params = config->predictor_params;
+	// the image written: the first num_bands bands of the one of the stream when they are requested
+	input_feature_t output_params;
+	size_t decode_bytes = 0;
+	size_t peak_memory = 0;
 
 	// Perform a few checks that the necessary options have been provided.
 	if (config->in_file[0] == '\x0')
 	{
-		fprintf(stderr, "\nError, please indicate the file containing the input compressed file\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the file containing the input compressed file\n\n");
 		return -1;
 	}
 	if (config->out_file[0] == '\x0')
 	{
-		fprintf(stderr, "\nError, please indicate the file where the decompressed image will be saved\n\n");
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the file where the decompressed image will be saved\n\n");
+		return -1;
+	}
+	if (config->engine > DECOMPRESS_ENGINE_PIPELINED)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, unknown decompression engine %d\n\n", (int)config->engine);
+		return -1;
+	}
+	if (config->io_backend > IO_BACKEND_DIRECT)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, unknown I/O backend %d\n\n", (int)config->io_backend);
+		return -1;
+	}
+	log_info("I/O backend: %s\n", io_backend_name(config->io_backend));
+
+	if (config->checkpoint_file[0] != '\x0' || config->first_line != 0 || config->num_lines != 0)
+	{
+		if (config->engine == DECOMPRESS_ENGINE_PIPELINED || config->dump_residuals != 0 || config->band_index_file[0] != '\x0' || config->num_bands != 0)
+		{
+			log_error(CCSDS_ERROR_CONFIG, "\nError, a range of lines cannot be decompressed by the pipelined engine, nor with the residuals dump, the band index or a number of bands\n\n");
+			return -1;
+		}
+		decodingStartTime = ((double)clock()) / CLOCKS_PER_SEC;
+		if (decompress_lines(config->in_file, config->checkpoint_file, config->first_line, config->num_lines, config->out_file, &config->input_params,
+					&config->predictor_params, config->num_threads, config->io_backend, config->memory_budget, arena) != 0)
+		{
+			log_error(CCSDS_ERROR_INTERNAL, "Error during the decompression of the lines\n");
+			return -1;
+		}
+		unpredictionEndTime = ((double)clock()) / CLOCKS_PER_SEC;
+		log_info("Overall Decompression duration %lf (sec)\n", unpredictionEndTime - decodingStartTime);
+		return 0;
+	}
+
+	if (config->engine == DECOMPRESS_ENGINE_PIPELINED)
+	{
+		if (config->dump_residuals != 0)
+		{
+			log_error(CCSDS_ERROR_CONFIG, "\nError, the residuals cannot be dumped by the pipelined decompression\n\n");
+			return -1;
+		}
+		if (config->band_index_file[0] != '\x0')
+		{
+			log_error(CCSDS_ERROR_CONFIG, "\nError, the band index is not used by the pipelined decompression\n\n");
+			return -1;
+		}
+		decodingStartTime = ((double)clock()) / CLOCKS_PER_SEC;
+		if (decompress_pipelined(config->in_file, config->out_file, &config->input_params, &config->predictor_params, config->num_bands, config->io_backend,
+					config->memory_budget, arena) != 0)
+		{
+			log_error(CCSDS_ERROR_INTERNAL, "Error during the pipelined decompression\n");
+			return -1;
+		}
+		unpredictionEndTime = ((double)clock()) / CLOCKS_PER_SEC;
+		log_info("Overall Decompression duration %lf (sec)\n", unpredictionEndTime - decodingStartTime);
+		return 0;
+	}
+
+	// Estimate the memory needed from the image described in the header: the residuals are kept both
+	// during the decoding and during the unprediction.
+	if (peek_header(config->in_file, &header_input_params, &header_predictor_params, arena) != 0 || check_image_size(header_input_params) != 0)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error in reading the header of the compressed stream\n");
+		return -1;
+	}
+	// only the residuals of the requested bands are decoded and unpredicted
+	if (config->num_bands != 0 && config->num_bands < header_input_params.z_size)
+		header_input_params.z_size = config->num_bands;
+	decode_bytes = decode_working_set(header_input_params);
+	peak_memory = SAMPLE_BYTES(header_input_params) * IMAGE_SAMPLES(header_input_params) + unpredict_working_set(header_input_params, header_predictor_params);
+	if (decode_bytes > peak_memory)
+		peak_memory = decode_bytes;
+	if (config->memory_budget != 0 && peak_memory > config->memory_budget)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "\nError, the decompression needs %zu bytes of memory, more than the budget of %zu bytes\n\n", peak_memory, config->memory_budget);
 		return -1;
 	}
+	log_info("Decompression engine: in memory, estimated peak memory %zu bytes (%.2lf kb)\n", peak_memory, ((double)peak_memory) / 1024.0);
 
 	// Start the decoding time statistics.
 	decodingStartTime = ((double)clock()) / CLOCKS_PER_SEC;
 
 	// Perform decoding.
-	if (decode(&config->input_params, &config->predictor_params, &residuals, config->in_file))
+	if (decode(&config->input_params, &config->predictor_params, &residuals, config->in_file, config->band_index_file, config->num_threads,
+				config->num_bands, config->io_backend, arena))
 	{
-		fprintf(stderr, "Error during the decoding stage\n");
-		if (residuals != NULL)
-			free(residuals);
+		log_error(CCSDS_ERROR_DATA, "Error during the decoding stage\n");
 		return -1;
 	}
 
+	output_params = config->input_params;
+	if (config->num_bands != 0)
+		output_params.z_size = config->num_bands;
+
 	// Dump the residuals if requested.
 	if (config->dump_residuals != 0)
 	{
@@ -51,18 +136,17 @@ int decompress_ccsds123(decompressConfig_t *config)
 		sprintf(residuals_name, "residuals_%s.bip", config->out_file);
 		if ((residuals_file = fopen(residuals_name, "w+b")) == NULL)
 		{
-			fprintf(stderr, "\nError in creating the file holding the residuals\n\n");
-			if (residuals != NULL)
-				free(residuals);
+			log_error(CCSDS_ERROR_IO, "\nError in creating the file holding the residuals\n\n");
 			return -1;
 		}
-		for (y = 0; y < config->input_params.y_size; y++)
+		for (y = 0; y < output_params.y_size; y++)
 		{
-			for (x = 0; x < config->input_params.x_size; x++)
+			for (x = 0; x < output_params.x_size; x++)
 			{
-				for (z = 0; z < config->input_params.z_size; z++)
+				for (z = 0; z < output_params.z_size; z++)
 				{
-					fwrite(&(MATRIX_BSQ_INDEX(residuals, config->input_params, x, y, z)), 2, 1, residuals_file);
+					unsigned short int residual = GET_ELEMENT(residuals, SAMPLE_BYTES(output_params), BSQ_OFFSET(output_params, x, y, z));
+					fwrite(&residual, 2, 1, residuals_file);
 				}
 			}
 		}
@@ -73,25 +157,63 @@ int decompress_ccsds123(decompressConfig_t *config)
 	decodingEndTime = ((double)clock()) / CLOCKS_PER_SEC;
 
 	// Go through the unpredict routine.
-	if (unpredict(config->input_params, config->predictor_params, residuals, config->out_file))
+	if (unpredict(output_params, config->predictor_params, residuals, config->out_file, config->io_backend, arena))
 	{
-		fprintf(stderr, "Error during the un-prediction stage\n");
-		if (residuals != NULL)
-			free(residuals);
+		log_error(CCSDS_ERROR_INTERNAL, "Error during the un-prediction stage\n");
 		return -1;
 	}
 
 	// Close the unpredict statistics.
 	unpredictionEndTime = ((double)clock()) / CLOCKS_PER_SEC;
 
-	// Free up memory if needed.
-	if (residuals != NULL)
-		free(residuals);
-
 	// Finally print some stats.
-	printf("Overall Decompression duration %lf (sec)\n", unpredictionEndTime - decodingStartTime);
-	printf("Decoding duration %lf (sec)\n", decodingEndTime - decodingStartTime);
-	printf("Unprediction duration %lf (sec)\n", unpredictionEndTime - decodingEndTime);
+	log_info("Overall Decompression duration %lf (sec)\n", unpredictionEndTime - decodingStartTime);
+	log_info("Decoding duration %lf (sec)\n", decodingEndTime - decodingStartTime);
+	log_info("Unprediction duration %lf (sec)\n", unpredictionEndTime - decodingEndTime);
 
 	return 0;
 }
+
+// Implementation of public functions.
+
+int decompress_ccsds123(decompressConfig_t *config)
+{
+	arena_t local_arena;
+	arena_t *arena = config->arena;
+	log_context_t log_context;
+	int result = 0;
+
+	log_begin(&log_context, config->log_callback, config->log_user_data);
+	if (arena == NULL)
+	{
+		arena = &local_arena;
+		arena_init(arena, 0, 0);
+	}
+	result = decompress_image(config, arena);
+
+	// All the memory used by the decompression is given back at once; the table points to it.
+	config->predictor_params.weight_init_table = NULL;
+	if (arena == config->arena)
+		arena_reset(arena);
+	else
+		arena_release(arena);
+	return log_end(&log_context, result);
+}
+
+int decompress_residuals(decompressConfig_t *config, void **residuals, arena_t *arena)
+{
+	log_context_t log_context;
+	int result = 0;
+
+	log_begin(&log_context, config->log_callback, config->log_user_data);
+	*residuals = NULL;
+	if (config->in_file[0] == '\x0')
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the file containing the compressed stream\n\n");
+		return log_end(&log_context, -1);
+	}
+	if ((result = decode(&config->input_params, &config->predictor_params, residuals, config->in_file, config->band_index_file,
+					 config->num_threads, 0, config->io_backend, arena)) != 0)
+		*residuals = NULL;
+	return log_end(&log_context, result);
+}
@@ -49,16 +49,15 @@
 /// Given a single residual and the statistics accumulated so far, it computes the code
 /// for the residual and it updates the statistics.
 int encode_pixel(unsigned int x, unsigned int y, unsigned int z, unsigned int *counter, unsigned int *accumulator,
-		unsigned int *written_bytes, unsigned int *written_bits, unsigned char *compressed_stream, unsigned short int *residuals,
+		size_t *written_bytes, unsigned int *written_bits, unsigned char *compressed_stream, unsigned short int residual,
 		input_feature_t input_params, encoder_config_t encoder_params)
 {
-	unsigned int curIndex = x + y * input_params.x_size + z * input_params.x_size * input_params.y_size;
 
 	if ((y == 0 && x == 0))
 	{
 		// I simply save on the output stream the unmodified
 		// residual (which should actually be the unmodified pixel)
-		bitStream_store(compressed_stream, written_bytes, written_bits, input_params.dyn_range, residuals[curIndex]);
+		bitStream_store(compressed_stream, written_bytes, written_bits, input_params.dyn_range, residual);
 	}
 	else
 	{
@@ -71,8 +70,8 @@ int encode_pixel(unsigned int x, unsigned int y, unsigned int z, unsigned int *c
 			temp_k = 0;
 		if (temp_k > (input_params.dyn_range - 2))
 			temp_k = input_params.dyn_range - 2;
-		divisor = residuals[curIndex] / (0x1 << temp_k);
-		reminder = residuals[curIndex] & (((unsigned short)0xFFFF) >> (16 - temp_k));
+		divisor = residual / (0x1 << temp_k);
+		reminder = residual & (((unsigned short)0xFFFF) >> (16 - temp_k));
 
 		// ... save the computation on the output stream ...
 		if (divisor < encoder_params.u_max)
@@ -84,122 +83,32 @@ int encode_pixel(unsigned int x, unsigned int y, unsigned int z, unsigned int *c
 		else
 		{
 			bitStream_store_constant(compressed_stream, written_bytes, written_bits, encoder_params.u_max, 0);
-			bitStream_store(compressed_stream, written_bytes, written_bits, input_params.dyn_range, residuals[curIndex]);
+			bitStream_store(compressed_stream, written_bytes, written_bits, input_params.dyn_range, residual);
 		}
 
 		// ... and finally update the statistics
 		if (counter[z] < ((((unsigned int)0x1) << encoder_params.y_star) - 1))
 		{
-			accumulator[z] += residuals[curIndex];
+			accumulator[z] += residual;
 			counter[z]++;
 		}
 		else
 		{
-			accumulator[z] = (accumulator[z] + residuals[curIndex] + 1) / 2;
+			accumulator[z] = (accumulator[z] + residual + 1) / 2;
 			counter[z] = (counter[z] + 1) / 2;
 		}
 	}
 
 #ifndef NDEBUG
-	if (*written_bytes > (((input_params.dyn_range + 7) / 8) * input_params.x_size * input_params.y_size * input_params.z_size))
+	if (compressed_stream != NULL && *written_bytes > (((input_params.dyn_range + 7) / 8) * IMAGE_SAMPLES(input_params)))
 	{
-		fprintf(stderr, "Error in encode_pixel, writing outside the compressed_stream boundaries: it means that the compressed image is greater than the original\n");
+		log_error(CCSDS_ERROR_BUFFER, "Error in encode_pixel, writing outside the compressed_stream boundaries: it means that the compressed image is greater than the original\n");
 		return -1;
 	}
 #endif
 	return 0;
 }
 
-///Given the characteristics of the input stream, the parameters describing the desired behavior
-///of the encoder and the list of residuals to be encoded (note that each residual is treated as
-///an integer) it returs the size in bytes of the stream containing the compressed residuals (saved into compressed_stream)
-///After usage, the caller has to deallocate the memory area pointed by compressed_stream and allocated by this function.
-///@param input_params describe the image whose residuals are contained in the input file
-///@param encoder_params set of options determining the behavior of the encoder
-///@param residuals array containing the information to be compressed
-///@param compressed_stream pointer to the array which, at the end of this function, will contain the compressed information
-///the array is allocated inside this function
-///@return a negative number if an error occurred
-int encode_sampleadaptive(input_feature_t input_params, encoder_config_t encoder_params, unsigned short int *residuals,
-		unsigned char *compressed_stream, unsigned int *written_bytes, unsigned int *written_bits)
-{
-	//First of all we proceed with the compression of the residuals according to the
-	//sample adaptive encodying method, as specified in the header of this file.
-	//For simplicity I proceed with encoding in the order into which the encoded samples
-	//have to be saved into the output stream. Statistics (counter and accumulator) are anyway maintained per band,
-	//so, even if samples from different bands are interleaved on the output stream,
-	//it is as if each band were encoded separately.
-	unsigned int *counter = NULL;
-	unsigned int *accumulator = NULL;
-
-	counter = (unsigned int *)malloc(sizeof(unsigned int) * input_params.z_size);
-	if (counter == NULL)
-	{
-		fprintf(stderr, "Error in the allocation of the counter statistic\n\n");
-		return -1;
-	}
-	accumulator = (unsigned int *)malloc(sizeof(unsigned int) * input_params.z_size);
-	if (accumulator == NULL)
-	{
-		fprintf(stderr, "Error in the allocation of the accumulator statistic\n\n");
-		return -1;
-	}
-
-	// Let's remember that the elements are saved in residuals so that
-	// element(x, y, z) = residuals[x + y*x_size + z*x_size*y_size], i.e.
-	// they are saved in BSQ order
-	if (encoder_params.out_interleaving == BSQ)
-	{
-		unsigned int x = 0, y = 0, z = 0;
-		for (z = 0; z < input_params.z_size; z++)
-		{
-			counter[z] = 0x1 << encoder_params.y_0;
-			accumulator[z] = (counter[z] * (3 * (0x1 << (encoder_params.k_init[z] + 6)) - 49)) / 0x080;
-			for (y = 0; y < input_params.y_size; y++)
-			{
-				for (x = 0; x < input_params.x_size; x++)
-				{
-					if (encode_pixel(x, y, z, counter, accumulator, written_bytes, written_bits, compressed_stream, residuals, input_params, encoder_params) != 0)
-						return -1;
-				}
-			}
-		}
-	}
-	else
-	{
-		unsigned int x = 0, y = 0, z = 0, i = 0;
-		unsigned int interleaving_counter = input_params.z_size / encoder_params.out_interleaving_depth;
-		if ((input_params.z_size % encoder_params.out_interleaving_depth) != 0)
-		{
-			interleaving_counter++;
-		}
-		for (z = 0; z < input_params.z_size; z++)
-		{
-			counter[z] = 0x1 << encoder_params.y_0;
-			accumulator[z] = (counter[z] * (3 * (0x1 << (encoder_params.k_init[z] + 6)) - 49)) / 0x080;
-		}
-		for (y = 0; y < input_params.y_size; y++)
-		{
-			for (i = 0; i < interleaving_counter; i++)
-			{
-				for (x = 0; x < input_params.x_size; x++)
-				{
-					for (z = i * encoder_params.out_interleaving_depth; z < MIN((i + 1) * encoder_params.out_interleaving_depth, input_params.z_size); z++)
-					{
-						if (encode_pixel(x, y, z, counter, accumulator, written_bytes, written_bits, compressed_stream, residuals, input_params, encoder_params) != 0)
-							return -1;
-					}
-				}
-			}
-		}
-	}
-
-	free(counter);
-	free(accumulator);
-
-	return 0;
-}
-
 /******************************************************
  * END Sample Adaptive Routines
  *******************************************************/
@@ -212,7 +121,7 @@ int encode_sampleadaptive(input_feature_t input_params, encoder_config_t encoder
 /// of sequential blocks whose samples are all 0.
 /// Such code is saved in the output bitstream.
 void zero_block_code(input_feature_t input_params, encoder_config_t encoder_params,
-		int num_zero_blocks, unsigned char *compressed_stream, unsigned int *written_bytes, unsigned int *written_bits, int end_of_segment)
+		int num_zero_blocks, unsigned char *compressed_stream, size_t *written_bytes, unsigned int *written_bits, int end_of_segment)
 {
 	//First of all I have to save the ID of the zero block code option
 	if (input_params.dyn_range <= 4 && encoder_params.restricted != 0)
@@ -256,17 +165,21 @@ void zero_block_code(input_feature_t input_params, encoder_config_t encoder_para
 }
 
 /// Computes the values for the second extension compression option and the length
-/// of the compression considering such option
+/// of the compression considering such option; the values of large residuals do not fit in 32
+/// bits, so the length is computed on 64 bits and saturated (the option is then never chosen,
+/// and the truncated values never used)
 unsigned int compute_second_extension(encoder_config_t encoder_params, unsigned short int *block_samples, unsigned int second_extension_values[32])
 {
-	unsigned int code_len = 0;
+	unsigned long long code_len = 0;
 	int i = 0;
 	for (i = 0; i < encoder_params.block_size; i += 2)
 	{
-		second_extension_values[i / 2] = (((unsigned int)block_samples[i] + block_samples[i + 1]) * ((unsigned int)block_samples[i] + block_samples[i + 1] + 1)) / 2 + block_samples[i + 1];
-		code_len += second_extension_values[i / 2] + 1;
+		unsigned long long pair_sum = (unsigned long long)block_samples[i] + block_samples[i + 1];
+		unsigned long long value = pair_sum * (pair_sum + 1) / 2 + block_samples[i + 1];
+		second_extension_values[i / 2] = (unsigned int)value;
+		code_len += value + 1;
 	}
-	return code_len;
+	return code_len < (unsigned int)-2 ? (unsigned int)code_len : (unsigned int)-2;
 }
 
 /// The length of the compression considering the bes k-split option
@@ -310,8 +223,9 @@ unsigned int compute_ksplit(input_feature_t input_params, encoder_config_t encod
 /// This procedure computes the codes for all the different k-split, second-extension and
 /// no compression options and encodes the block according to the code yielding
 /// the highest compression factor.
-void compute_block_code(input_feature_t input_params, encoder_config_t encoder_params,
-		unsigned short int *block_samples, unsigned char *compressed_stream, unsigned int *written_bytes, unsigned int *written_bits)
+/// @return the option chosen: the k of the k-split, -1 for the second extension, -2 for no compression
+int compute_block_code(input_feature_t input_params, encoder_config_t encoder_params,
+		unsigned short int *block_samples, unsigned char *compressed_stream, size_t *written_bytes, unsigned int *written_bits)
 {
 	// I encode the chosen method as the value of k for k-split;
 	// second-extension is -1 and no compression -2
@@ -442,11 +356,12 @@ void compute_block_code(input_feature_t input_params, encoder_config_t encoder_p
 			bitStream_store(compressed_stream, written_bytes, written_bits, chosenMethod, block_samples[i]);
 		}
 	}
+	return chosenMethod;
 }
 
 int create_block(input_feature_t input_params, encoder_config_t encoder_params, unsigned short int *block_samples, int all_zero,
-		int *num_zero_blocks, int *segment_idx, int reference_samples,
-		unsigned char *compressed_stream, unsigned int *written_bytes, unsigned int *written_bits)
+		int *num_zero_blocks, int *segment_idx, int reference_samples, unsigned long long *uncompressed_blocks,
+		unsigned char *compressed_stream, size_t *written_bytes, unsigned int *written_bits)
 {
 	// I have finished reading the block: we now need to pass it to the compressor, unless
 	// it is an all zero block
@@ -459,7 +374,8 @@ int create_block(input_feature_t input_params, encoder_config_t encoder_params,
 			zero_block_code(input_params, encoder_params, *num_zero_blocks, compressed_stream, written_bytes, written_bits, 0);
 			*num_zero_blocks = 0;
 		}
-		compute_block_code(input_params, encoder_params, block_samples, compressed_stream, written_bytes, written_bits);
+		if (compute_block_code(input_params, encoder_params, block_samples, compressed_stream, written_bytes, written_bits) == -2)
+			(*uncompressed_blocks)++;
 	}
 	else
 	{
@@ -478,162 +394,90 @@ int create_block(input_feature_t input_params, encoder_config_t encoder_params,
 		*segment_idx = 0;
 	}
 #ifndef NDEBUG
-	if (*written_bytes > (((input_params.dyn_range + 7) / 8) * input_params.x_size * input_params.y_size * input_params.z_size))
+	if (compressed_stream != NULL && *written_bytes > (((input_params.dyn_range + 7) / 8) * IMAGE_SAMPLES(input_params)))
 	{
-		fprintf(stderr, "Error in create_block, writing outside the compressed_stream boundaries: it means that the compressed image is greater than the original\n");
+		log_error(CCSDS_ERROR_BUFFER, "Error in create_block, writing outside the compressed_stream boundaries: it means that the compressed image is greater than the original\n");
 		return -1;
 	}
 #endif
 	return 0;
 }
 
-///Given the characteristics of the input stream, the parameters describing the desired behavior
-///of the encoder and the list of residuals to be encoded (note that each residual is treated as
-///an integer) it returs the size in bytes of the stream containing the compressed residuals (saved into compressed_stream)
-///After usage, the caller has to deallocate the memory area pointed by compressed_stream and allocated by this function.
-///@param input_params describe the image whose residuals are contained in the input file
-///@param encoder_params set of options determining the behavior of the encoder
-///@param residuals array containing the information to be compressed
-///@param compressed_stream pointer to the array which, at the end of this function, will contain the compressed information
-///the array is allocated inside this function
-///@return a negative number if an error occurred
-int encode_block(input_feature_t input_params, encoder_config_t encoder_params, unsigned short int *residuals,
-		unsigned char *compressed_stream, unsigned int *written_bytes, unsigned int *written_bits)
+/// Adds the residual to the block being filled: when the block is complete it is passed
+/// to create_block. If there are any pending zero blocks when the last sample of the image
+/// (x_size - 1, y_size - 1, z_size - 1) completes a block, they are dumped
+int encode_block_sample(input_feature_t input_params, encoder_config_t encoder_params, encoder_state_t *state,
+		unsigned int x, unsigned int y, unsigned int z, unsigned short int residual,
+		unsigned char *compressed_stream, size_t *written_bytes, unsigned int *written_bits)
 {
-	// First of all I have to pick-up the J elements composing a block and
-	// then pass them to the compressor; if a block is composed of
-	// all zeros, then I read the remaining blocks in the segment, up
-	// to the first block containing a non-zero sample.
-	// Let's remember that the elements are saved in residuals so that
-	// element(x, y, z) = residuals[x + y*x_size + z*x_size*y_size], i.e.
-	// they are saved in BSQ order
-	int read_samples = 0;
-	int all_zero = 1;
-	int segment_idx = 0;
-	int num_zero_blocks = 0;
-	int reference_samples = 0;
-	unsigned short int *block_samples = NULL;
-	if ((block_samples = (unsigned short int *)malloc(encoder_params.block_size * sizeof(unsigned short int))) == NULL)
-	{
-		fprintf(stderr, "Error in allocating space to hold the block");
-		return -1;
-	}
-
-	if (encoder_params.out_interleaving == BSQ)
+	state->block_samples[state->read_samples] = residual;
+	if (state->all_zero != 0 && residual != 0)
 	{
-		unsigned int x = 0, y = 0, z = 0;
-		for (z = 0; z < input_params.z_size; z++)
-		{
-			for (y = 0; y < input_params.y_size; y++)
-			{
-				for (x = 0; x < input_params.x_size; x++)
-				{
-					block_samples[read_samples] = residuals[x + y * input_params.x_size + z * input_params.x_size * input_params.y_size];
-					if (all_zero != 0 && block_samples[read_samples] != 0)
-					{
-						all_zero = 0;
-					}
-					read_samples++;
-					if (read_samples == encoder_params.block_size)
-					{
-						if (y == (input_params.y_size - 1) && z == (input_params.z_size - 1) && x == (input_params.x_size - 1))
-						{
-							// trick used to signal that we are at the end of the residuals, so if there are any
-							// pending 0 blocks they must be dumped
-							//fprintf(stderr, "end of file");
-							segment_idx = SEGMENT_SIZE - 1;
-						}
-						if (create_block(input_params, encoder_params, block_samples, all_zero, &num_zero_blocks, &segment_idx, reference_samples, compressed_stream, written_bytes, written_bits) != 0)
-							return -1;
-						read_samples = 0;
-						all_zero = 1;
-						reference_samples = (reference_samples + 1) % encoder_params.ref_interval;
-					}
-				}
-			}
-		}
+		state->all_zero = 0;
 	}
-	else
+	state->read_samples++;
+	if (state->read_samples == encoder_params.block_size)
 	{
-		unsigned int x = 0, y = 0, z = 0, i = 0;
-		unsigned int interleaving_counter = input_params.z_size / encoder_params.out_interleaving_depth;
-		if ((input_params.z_size % encoder_params.out_interleaving_depth) != 0)
+		if (y == (input_params.y_size - 1) && z == (input_params.z_size - 1) && x == (input_params.x_size - 1))
 		{
-			interleaving_counter++;
-		}
-		for (y = 0; y < input_params.y_size; y++)
-		{
-			for (i = 0; i < interleaving_counter; i++)
-			{
-				for (x = 0; x < input_params.x_size; x++)
-				{
-					for (z = i * encoder_params.out_interleaving_depth; z < MIN((i + 1) * encoder_params.out_interleaving_depth, input_params.z_size); z++)
-					{
-						block_samples[read_samples] = residuals[x + y * input_params.x_size + z * input_params.x_size * input_params.y_size];
-						if (all_zero != 0 && block_samples[read_samples] != 0)
-						{
-							all_zero = 0;
-						}
-						read_samples++;
-						if (read_samples == encoder_params.block_size)
-						{
-							if (y == (input_params.y_size - 1) && z == (input_params.z_size - 1) && x == (input_params.x_size - 1))
-							{
-								// trick used to signal that we are at the end of the residuals, so if there are any
-								// pending 0 blocks they must be dumped
-								//fprintf(stderr, "end of file");
-								segment_idx = SEGMENT_SIZE - 1;
-							}
-							if (create_block(input_params, encoder_params, block_samples, all_zero, &num_zero_blocks, &segment_idx, reference_samples, compressed_stream, written_bytes, written_bits) != 0)
-								return -1;
-							read_samples = 0;
-							all_zero = 1;
-							reference_samples = (reference_samples + 1) % encoder_params.ref_interval;
-						}
-					}
-				}
-			}
+			// trick used to signal that we are at the end of the residuals, so if there are any
+			// pending 0 blocks they must be dumped
+			state->segment_idx = SEGMENT_SIZE - 1;
 		}
+		if (create_block(input_params, encoder_params, state->block_samples, state->all_zero, &state->num_zero_blocks, &state->segment_idx,
+					state->reference_samples, &state->escapes, compressed_stream, written_bytes, written_bits) != 0)
+			return -1;
+		state->read_samples = 0;
+		state->all_zero = 1;
+		state->reference_samples = (state->reference_samples + 1) % encoder_params.ref_interval;
 	}
-	// Now we have to check if the number of samples was a multiple of the block size;
-	// if not we need to add zeros to the block and perform the compression.
-	if (read_samples < encoder_params.block_size && read_samples > 0)
+	return 0;
+}
+
+/// Once all the residuals have been added, it checks if the number of samples was a multiple
+/// of the block size; if not zeros are added to the last block and it is compressed.
+void encode_last_block(input_feature_t input_params, encoder_config_t encoder_params, encoder_state_t *state,
+		unsigned char *compressed_stream, size_t *written_bytes, unsigned int *written_bits)
+{
+	if (state->read_samples < encoder_params.block_size && state->read_samples > 0)
 	{
-		if (all_zero == 0)
+		if (state->all_zero == 0)
 		{
 			int i = 0;
-			for (i = read_samples; i < encoder_params.block_size; i++)
+			for (i = state->read_samples; i < encoder_params.block_size; i++)
 			{
-				block_samples[i] = 0;
+				state->block_samples[i] = 0;
 			}
 		}
 		else
 		{
-			num_zero_blocks++;
+			state->num_zero_blocks++;
 		}
-		if (num_zero_blocks > 0)
+		if (state->num_zero_blocks > 0)
 		{
-			zero_block_code(input_params, encoder_params, num_zero_blocks, compressed_stream, written_bytes, written_bits, 0);
+			zero_block_code(input_params, encoder_params, state->num_zero_blocks, compressed_stream, written_bytes, written_bits, 0);
 		}
-		if (all_zero == 0)
+		if (state->all_zero == 0 &&
+				compute_block_code(input_params, encoder_params, state->block_samples, compressed_stream, written_bytes, written_bits) == -2)
 		{
-			compute_block_code(input_params, encoder_params, block_samples, compressed_stream, written_bytes, written_bits);
+			state->escapes++;
 		}
 	}
-	if (block_samples != NULL)
-	{
-		free(block_samples);
-	}
-
-	return 0;
 }
 
 /******************************************************
  * END Block Adaptive Routines
  *******************************************************/
 
+/// Returns the maximum number of bytes of the header, including the optional tables
+size_t header_size_bound(input_feature_t input_params, predictor_config_t predictor_params)
+{
+	unsigned int weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+	return (size_t)input_params.z_size * (3 * weights_len + 1) + 4096;
+}
+
 /// Creates the header and adds it to the output stream.
-void create_header(unsigned int *written_bytes, unsigned int *written_bits, unsigned char *compressed_stream,
+void create_header(size_t *written_bytes, unsigned int *written_bits, unsigned char *compressed_stream,
 		input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params)
 {
 	/* IMAGE METADATA */
@@ -708,7 +552,7 @@ void create_header(unsigned int *written_bytes, unsigned int *written_bits, unsi
 	bitStream_store_constant(compressed_stream, written_bytes, written_bits, 1, 0);
 	// weight initialization method and weight initialization table flag
 	if (predictor_params.weight_init_table != NULL)
-		bitStream_store_constant(compressed_stream, written_bytes, written_bits, 2, 1);
+		bitStream_store_constant(compressed_stream, written_bytes, written_bits, 2, 3);
 	else
 		bitStream_store_constant(compressed_stream, written_bytes, written_bits, 2, 0);
 	// weight initialization resolution
@@ -737,7 +581,9 @@ void create_header(unsigned int *written_bytes, unsigned int *written_bits, unsi
 				}
 			}
 		}
-		bitStream_store_constant(compressed_stream, written_bytes, written_bits, 8 - (*written_bits), 0);
+		// the table is padded to a whole number of bytes, nothing being added when it already ends at one
+		if (*written_bits != 0)
+			bitStream_store_constant(compressed_stream, written_bytes, written_bits, 8 - (*written_bits), 0);
 	}
 
 	/* ENTROPY CODER METADATA */
@@ -798,6 +644,178 @@ void create_header(unsigned int *written_bytes, unsigned int *written_bits, unsi
 	}
 }
 
+/******************************************************
+ * Incremental encoding
+ *******************************************************/
+
+///Allocates from arena and initializes the state of the encoder: the statistics of each band for the
+///sample adaptive encoder, the block being filled for the block adaptive one
+///@return a negative number if an error occurred
+int init_encoder_state(input_feature_t input_params, encoder_config_t encoder_params, encoder_state_t *state, arena_t *arena)
+{
+	unsigned int z = 0;
+
+	memset(state, 0, sizeof(encoder_state_t));
+	state->all_zero = 1;
+	if (encoder_params.encoding_method == SAMPLE)
+	{
+		state->counter = (unsigned int *)arena_alloc(arena, sizeof(unsigned int) * input_params.z_size);
+		state->accumulator = (unsigned int *)arena_alloc(arena, sizeof(unsigned int) * input_params.z_size);
+		if (state->counter == NULL || state->accumulator == NULL)
+		{
+			log_error(CCSDS_ERROR_MEMORY, "Error in the allocation of the counter and accumulator statistics\n\n");
+			return -1;
+		}
+		// Statistics are maintained per band so, even if samples from different bands are
+		// interleaved on the output stream, it is as if each band were encoded separately.
+		for (z = 0; z < input_params.z_size; z++)
+		{
+			state->counter[z] = 0x1 << encoder_params.y_0;
+			state->accumulator[z] = (state->counter[z] * (3 * (0x1 << (encoder_params.k_init[z] + 6)) - 49)) / 0x080;
+		}
+		state->band_bits = encoder_params.band_bits;
+		if (state->band_bits != NULL)
+			memset(state->band_bits, 0, sizeof(unsigned long long) * input_params.z_size);
+	}
+	else
+	{
+		state->block_samples = (unsigned short int *)arena_alloc(arena, encoder_params.block_size * sizeof(unsigned short int));
+		if (state->block_samples == NULL)
+		{
+			log_error(CCSDS_ERROR_MEMORY, "Error in allocating space to hold the block\n\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+///Returns the number of bytes of memory allocated by init_encoder_state
+size_t encoder_state_size(input_feature_t input_params, encoder_config_t encoder_params)
+{
+	if (encoder_params.encoding_method == SAMPLE)
+		return 2 * sizeof(unsigned int) * input_params.z_size;
+	return sizeof(unsigned short int) * encoder_params.block_size;
+}
+
+///Encodes the residual of the sample (x, y, z), which must be the next one in the order
+///used by the output stream (BSQ or BI with the configured interleaving depth)
+///@return a negative number if an error occurred
+int encode_residual(input_feature_t input_params, encoder_config_t encoder_params, encoder_state_t *state,
+		unsigned int x, unsigned int y, unsigned int z, unsigned short int residual,
+		unsigned char *compressed_stream, size_t *written_bytes, unsigned int *written_bits)
+{
+	if (encoder_params.encoding_method == SAMPLE && state->band_bits != NULL)
+	{
+		// the stream is never flushed while a residual is being encoded, so the difference of the
+		// positions is the length of its codeword
+		size_t start = *written_bytes * 8 + *written_bits;
+		int result = encode_pixel(x, y, z, state->counter, state->accumulator, written_bytes, written_bits, compressed_stream, residual, input_params, encoder_params);
+		size_t length = *written_bytes * 8 + *written_bits - start;
+		state->band_bits[z] += length;
+		// only the residuals saved uncompressed after u_max zeros take u_max + dyn_range bits, the other
+		// codewords being at most u_max + dyn_range - 2 bits long
+		if (length == encoder_params.u_max + input_params.dyn_range)
+		{
+			state->escapes++;
+			if (state->band_escapes != NULL)
+				state->band_escapes[z]++;
+		}
+		return result;
+	}
+	if (encoder_params.encoding_method == SAMPLE)
+		return encode_pixel(x, y, z, state->counter, state->accumulator, written_bytes, written_bits, compressed_stream, residual, input_params, encoder_params);
+	return encode_block_sample(input_params, encoder_params, state, x, y, z, residual, compressed_stream, written_bytes, written_bits);
+}
+
+///Completes the encoding once all the residuals have been passed to encode_residual (i.e. it
+///encodes the last, partial, block of the block adaptive encoder)
+void finish_encoding(input_feature_t input_params, encoder_config_t encoder_params, encoder_state_t *state,
+		unsigned char *compressed_stream, size_t *written_bytes, unsigned int *written_bits)
+{
+	if (encoder_params.encoding_method == BLOCK)
+		encode_last_block(input_params, encoder_params, state, compressed_stream, written_bytes, written_bits);
+}
+
+///Pads the compressed stream with zeros up to a multiple of the output word size;
+///flushed_bytes is the number of bytes of the stream already written out of compressed_stream
+void pad_to_word(encoder_config_t encoder_params, unsigned char *compressed_stream, size_t *written_bytes,
+		unsigned int *written_bits, size_t flushed_bytes)
+{
+	unsigned int word_bits = encoder_params.out_wordsize * 8;
+	unsigned int num_padding_bits = word_bits - (unsigned int)((((flushed_bytes + *written_bytes) % encoder_params.out_wordsize) * 8 + *written_bits) % word_bits);
+	if (num_padding_bits < word_bits && num_padding_bits > 0)
+	{
+		bitStream_store_constant(compressed_stream, written_bytes, written_bits, num_padding_bits, 0);
+	}
+}
+
+///Encodes all the residuals of the image, stored in BSQ order, going over them in the order
+///used by the output stream, with the encoder state initialized by init_encoder_state
+///@return a negative number if an error occurred
+static int encode_residuals(input_feature_t input_params, encoder_config_t encoder_params, encoder_state_t *state, void *residuals,
+		unsigned char *compressed_stream, size_t *written_bytes, unsigned int *written_bits)
+{
+	// Let's remember that the elements are saved in residuals so that
+	// element(x, y, z) = residuals[x + y*x_size + z*x_size*y_size], i.e.
+	// they are saved in BSQ order
+	const unsigned int sample_bytes = SAMPLE_BYTES(input_params);
+
+	if (encoder_params.out_interleaving == BSQ)
+	{
+		unsigned int x = 0, y = 0, z = 0;
+		for (z = 0; z < input_params.z_size; z++)
+		{
+			for (y = 0; y < input_params.y_size; y++)
+			{
+				for (x = 0; x < input_params.x_size; x++)
+				{
+					if (encode_residual(input_params, encoder_params, state, x, y, z, GET_ELEMENT(residuals, sample_bytes, BSQ_OFFSET(input_params, x, y, z)),
+								compressed_stream, written_bytes, written_bits) != 0)
+					{
+						return -1;
+					}
+				}
+			}
+		}
+	}
+	else
+	{
+		unsigned int x = 0, y = 0, z = 0, i = 0;
+		unsigned int interleaving_counter = input_params.z_size / encoder_params.out_interleaving_depth;
+		if ((input_params.z_size % encoder_params.out_interleaving_depth) != 0)
+		{
+			interleaving_counter++;
+		}
+		for (y = 0; y < input_params.y_size; y++)
+		{
+			for (i = 0; i < interleaving_counter; i++)
+			{
+				for (x = 0; x < input_params.x_size; x++)
+				{
+					for (z = i * encoder_params.out_interleaving_depth; z < MIN((i + 1) * encoder_params.out_interleaving_depth, input_params.z_size); z++)
+					{
+						if (encode_residual(input_params, encoder_params, state, x, y, z, GET_ELEMENT(residuals, sample_bytes, BSQ_OFFSET(input_params, x, y, z)),
+									compressed_stream, written_bytes, written_bits) != 0)
+						{
+							return -1;
+						}
+					}
+				}
+			}
+		}
+	}
+	finish_encoding(input_params, encoder_params, state, compressed_stream, written_bytes, written_bits);
+
+	return 0;
+}
+
+///Returns the number of bytes of memory allocated by encode: the buffer holding the whole
+///compressed stream and the encoder state (the residuals are allocated by the caller)
+size_t encode_working_set(input_feature_t input_params, encoder_config_t encoder_params)
+{
+	return ((input_params.dyn_range + 7) / 8) * IMAGE_SAMPLES(input_params) + encoder_state_size(input_params, encoder_params);
+}
+
 ///Main function for the entropy encoding of a given input file; while it works for any input file,
 ///it is though to be used when the input file encodes the residuals of each pixel of an image after
 ///the lossless compression step
@@ -805,72 +823,113 @@ void create_header(unsigned int *written_bytes, unsigned int *written_bits, unsi
 ///@param encoder_params set of options determining the behavior of the encoder
 ///@param inputFile file containing the information to be compressed
 ///@param outputFile file where the compressed information will be stored
+///@param backend I/O backend the output file is written with
+///@param arena allocator providing the temporary buffers, which are released before returning
 ///@return the number of bytes which compose the compressed stream, a negative value if an error
 ///occurred
-int encode(input_feature_t input_params, encoder_config_t encoder_params, predictor_config_t predictor_params,
-		unsigned short int *residuals, char outputFile[128])
+long long encode(input_feature_t input_params, encoder_config_t encoder_params, predictor_config_t predictor_params,
+		void *residuals, char outputFile[128], io_backend_t backend, arena_t *arena)
 {
 	// The function is pretty simple; it mainly simply parses the input files,
 	// and calls the encode_core routine. After the encoding has ended it writes the
 	// result to the output file.
-	// all memory allocation/de-allocation takes place inside this routine
+	// all memory allocation takes place inside this routine, from arena, and it is
+	// released before returning
 	unsigned char *compressed_stream = NULL;
-	int encoding_outcome = 0, write_result = 0;
-	unsigned int num_padding_bits = 0;
-	unsigned int written_bytes = 0, written_bits = 0;
-	FILE *outFile = NULL;
+	int encoding_outcome = 0;
+	size_t written_bytes = 0;
+	unsigned int written_bits = 0;
+	io_file_t outFile;
+	encoder_state_t state;
+	arena_mark_t mark = arena_get_mark(arena);
 
 	// Note how the compressed stream shall never be greater than the original size of the
 	// residuals
-	compressed_stream = (unsigned char *)malloc(((input_params.dyn_range + 7) / 8) * input_params.x_size * input_params.y_size * input_params.z_size);
+	compressed_stream = (unsigned char *)arena_calloc(arena, (input_params.dyn_range + 7) / 8, IMAGE_SAMPLES(input_params));
 	if (compressed_stream == NULL)
 	{
-		fprintf(stderr, "Error in the allocation of the compressed stream\n\n");
+		log_error(CCSDS_ERROR_MEMORY, "Error in the allocation of the compressed stream\n\n");
 		return -1;
 	}
-	memset(compressed_stream, 0, ((input_params.dyn_range + 7) / 8) * input_params.x_size * input_params.y_size * input_params.z_size);
 
 	// First of all we need to write the headers to the file
 	create_header(&written_bytes, &written_bits, compressed_stream, input_params, predictor_params, encoder_params);
 
 	// Finally I can perform the encoding
-	if (encoder_params.encoding_method == SAMPLE)
-	{
-		encoding_outcome = encode_sampleadaptive(input_params, encoder_params, residuals, compressed_stream, &written_bytes, &written_bits);
-	}
-	else
-	{
-		encoding_outcome = encode_block(input_params, encoder_params, residuals, compressed_stream, &written_bytes, &written_bits);
-	}
+	encoding_outcome = init_encoder_state(input_params, encoder_params, &state, arena);
+	if (encoding_outcome == 0)
+		encoding_outcome = encode_residuals(input_params, encoder_params, &state, residuals, compressed_stream, &written_bytes, &written_bits);
 	if (encoding_outcome < 0)
 	{
-		fprintf(stderr, "Error in encodying the residuals\n\n");
+		log_error(CCSDS_ERROR_INTERNAL, "Error in encodying the residuals\n\n");
+		arena_rewind(arena, mark);
 		return -1;
 	}
 
 	// Compression has finished; I fill up the compressed stream bits to pad it to
 	// word length and deallocate memory
-	num_padding_bits = encoder_params.out_wordsize * 8 - ((written_bytes * 8 + written_bits) % (encoder_params.out_wordsize * 8));
-	if (num_padding_bits < encoder_params.out_wordsize * 8 && num_padding_bits > 0)
-	{
-		bitStream_store_constant(compressed_stream, &written_bytes, &written_bits, num_padding_bits, 0);
-	}
+	pad_to_word(encoder_params, compressed_stream, &written_bytes, &written_bits, 0);
 
 	// and saving the results on the output file
-	if ((outFile = fopen(outputFile, "wb")) == NULL)
+	if (io_open(&outFile, backend, outputFile, IO_WRITE) != 0)
 	{
-		fprintf(stderr, "Error in creating file %s for writing the compression result\n\n", outputFile);
+		log_error(CCSDS_ERROR_IO, "Error in creating file %s for writing the compression result\n\n", outputFile);
+		arena_rewind(arena, mark);
 		return -1;
 	}
-	write_result = fwrite(compressed_stream, 1, written_bytes, outFile);
-	if (write_result != written_bytes)
+	encoding_outcome = io_append(&outFile, compressed_stream, written_bytes);
+	if (io_close(&outFile) != 0)
+		encoding_outcome = -1;
+	arena_rewind(arena, mark);
+	if (encoding_outcome != 0)
 	{
-		fprintf(stderr, "Error in writing compressed stream to %s: only %d bytes out of %d written\n\n", outputFile, write_result, written_bytes);
+		log_error(CCSDS_ERROR_IO, "Error in writing the %zu bytes of the compressed stream to %s\n\n", written_bytes, outputFile);
 		return -1;
 	}
-	fclose(outFile);
 
-	if (compressed_stream != NULL)
-		free(compressed_stream);
-	return written_bytes;
+	return (long long)written_bytes;
+}
+
+///Computes the size of the stream encode would produce for the residuals, running the same encoder
+///without writing the stream
+int estimate_encoding(input_feature_t input_params, encoder_config_t encoder_params, predictor_config_t predictor_params,
+		void *residuals, rate_estimate_t *estimate, arena_t *arena)
+{
+	size_t written_bytes = 0;
+	unsigned int written_bits = 0;
+	encoder_state_t state;
+	arena_mark_t mark = arena_get_mark(arena);
+	int result = 0;
+
+	create_header(&written_bytes, &written_bits, NULL, input_params, predictor_params, encoder_params);
+	estimate->header_bits = written_bytes * 8 + written_bits;
+	encoder_params.band_bits = estimate->band_bits;
+	if (encoder_params.encoding_method == SAMPLE && encoder_params.band_bits == NULL &&
+			(encoder_params.band_bits = (unsigned long long *)arena_alloc(arena, sizeof(unsigned long long) * input_params.z_size)) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the bits of the bands\n\n");
+		return -1;
+	}
+	if (estimate->band_bits != NULL)
+		memset(estimate->band_bits, 0, sizeof(unsigned long long) * input_params.z_size);
+	if (estimate->band_escapes != NULL)
+		memset(estimate->band_escapes, 0, sizeof(unsigned long long) * input_params.z_size);
+	if (init_encoder_state(input_params, encoder_params, &state, arena) != 0)
+	{
+		arena_rewind(arena, mark);
+		return -1;
+	}
+	state.band_escapes = encoder_params.encoding_method == SAMPLE ? estimate->band_escapes : NULL;
+	result = encode_residuals(input_params, encoder_params, &state, residuals, NULL, &written_bytes, &written_bits);
+	arena_rewind(arena, mark);
+	if (result < 0)
+	{
+		log_error(CCSDS_ERROR_INTERNAL, "Error in encodying the residuals\n\n");
+		return -1;
+	}
+	estimate->codeword_bits = written_bytes * 8 + written_bits - estimate->header_bits;
+	estimate->escapes = state.escapes;
+	pad_to_word(encoder_params, NULL, &written_bytes, &written_bits, 0);
+	estimate->stream_bytes = written_bytes;
+	return 0;
 }
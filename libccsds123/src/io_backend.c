@@ -0,0 +1,568 @@
+#ifdef WIN32
+#define _CRT_SECURE_NO_WARNINGS
+#else
+// O_DIRECT and 64 bits file offsets
+#define _GNU_SOURCE
+#define _FILE_OFFSET_BITS 64
+#endif
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#include "io_backend.h"
+#include "log.h"
+
+// Size of the buffer of the stdio streams
+#define IO_STREAM_BUFFER (1 << 20)
+// Alignment of the offsets, sizes and buffers of the O_DIRECT transfers (the biggest logical block size
+// of the common devices), and size of the aligned buffer
+#define IO_ALIGNMENT 4096
+#define IO_DIRECT_BUFFER (1 << 20)
+// Transfers of IO_BACKEND_PREAD from this size on are split among up to IO_THREADS threads, each moving
+// at least IO_MIN_RANGE bytes; the threads wait for the storage, so their number does not depend on the
+// processors
+#define IO_PARALLEL_THRESHOLD (4 << 20)
+#define IO_MIN_RANGE (1 << 20)
+#define IO_THREADS 4
+// First size of the mapping of a file written with IO_BACKEND_MMAP, which then doubles as needed
+#define IO_MAP_INITIAL (1 << 20)
+
+#ifdef WIN32
+#define io_fseek _fseeki64
+#define io_ftell _ftelli64
+#else
+#define io_fseek fseeko
+#define io_ftell ftello
+#endif
+
+///Returns the name of the backend, for the statistics
+const char *io_backend_name(io_backend_t backend)
+{
+	switch (backend)
+	{
+	case IO_BACKEND_MMAP:
+		return "mmap";
+	case IO_BACKEND_PREAD:
+		return "parallel pread";
+	case IO_BACKEND_DIRECT:
+		return "O_DIRECT";
+	default:
+		return "stdio";
+	}
+}
+
+/// Opens the stdio stream of the file, with a large buffer
+static int open_stream(io_file_t *file, const char *name)
+{
+	if ((file->stream = fopen(name, file->mode == IO_READ ? "rb" : "w+b")) == NULL)
+		return -1;
+	setvbuf(file->stream, NULL, _IOFBF, IO_STREAM_BUFFER);
+	if (file->mode == IO_READ)
+	{
+		long long size = 0;
+		if (io_fseek(file->stream, 0, SEEK_END) != 0 || (size = io_ftell(file->stream)) < 0 || io_fseek(file->stream, 0, SEEK_SET) != 0)
+		{
+			fclose(file->stream);
+			return -1;
+		}
+		file->size = (unsigned long long)size;
+	}
+	return 0;
+}
+
+/// Moves the stdio stream to offset, if it is not already there; the stream is moved anyway when the
+/// direction of the transfers changes, as stdio requires
+static int seek_stream(io_file_t *file, unsigned long long offset, int writing)
+{
+	if (offset == file->position && writing == file->writing)
+		return 0;
+	if (io_fseek(file->stream, (long long)offset, SEEK_SET) != 0)
+		return -1;
+	file->position = offset;
+	file->writing = writing;
+	return 0;
+}
+
+#ifndef WIN32
+
+/// Range of a transfer of IO_BACKEND_PREAD, moved by one thread
+typedef struct io_range
+{
+	int fd;
+	unsigned char *buffer;
+	unsigned long long offset;
+	size_t bytes;
+	int writing;
+	int result;
+} io_range_t;
+
+/// Reads or writes all the bytes of a range, retrying the partial transfers
+static void *transfer_range(void *argument)
+{
+	io_range_t *range = (io_range_t *)argument;
+	size_t done = 0;
+
+	range->result = 0;
+	while (done < range->bytes)
+	{
+		ssize_t moved = range->writing != 0 ? pwrite(range->fd, range->buffer + done, range->bytes - done, (off_t)(range->offset + done)) :
+				pread(range->fd, range->buffer + done, range->bytes - done, (off_t)(range->offset + done));
+		if (moved < 0 && errno == EINTR)
+			continue;
+		if (moved <= 0)
+		{
+			range->result = -1;
+			break;
+		}
+		done += (size_t)moved;
+	}
+	return NULL;
+}
+
+/// Transfers bytes bytes at offset, splitting the big transfers in contiguous ranges moved by several
+/// threads at once (the first one by the calling thread)
+static int transfer_parallel(int fd, unsigned long long offset, unsigned char *buffer, size_t bytes, int writing)
+{
+	io_range_t ranges[IO_THREADS];
+	pthread_t threads[IO_THREADS];
+	int started[IO_THREADS];
+	unsigned int num_ranges = 1, i = 0;
+	size_t range_bytes = bytes;
+	int result = 0;
+
+	if (bytes >= IO_PARALLEL_THRESHOLD)
+	{
+		num_ranges = bytes / IO_MIN_RANGE < IO_THREADS ? (unsigned int)(bytes / IO_MIN_RANGE) : IO_THREADS;
+		range_bytes = (bytes + num_ranges - 1) / num_ranges;
+	}
+	for (i = 0; i < num_ranges; i++)
+	{
+		size_t first = (size_t)i * range_bytes;
+		ranges[i].fd = fd;
+		ranges[i].buffer = buffer + first;
+		ranges[i].offset = offset + first;
+		ranges[i].bytes = first + range_bytes < bytes ? range_bytes : bytes - first;
+		ranges[i].writing = writing;
+		// when a thread cannot be started, its range is moved by the calling thread
+		started[i] = i > 0 && pthread_create(&threads[i], NULL, transfer_range, &ranges[i]) == 0;
+	}
+	for (i = 0; i < num_ranges; i++)
+	{
+		if (i == 0 || started[i] == 0)
+			transfer_range(&ranges[i]);
+		else
+			pthread_join(threads[i], NULL);
+		if (ranges[i].result != 0)
+			result = -1;
+	}
+	return result;
+}
+
+/// Reads the aligned block of the file starting at offset into block, with zeros past the end of the file
+static int read_block(io_file_t *file, unsigned long long offset, unsigned char *block)
+{
+	ssize_t got = 0;
+
+	do
+		got = pread(file->fd, block, IO_ALIGNMENT, (off_t)offset);
+	while (got < 0 && errno == EINTR);
+	if (got < 0)
+		return -1;
+	memset(block + got, 0, IO_ALIGNMENT - (size_t)got);
+	return 0;
+}
+
+/// IO_BACKEND_DIRECT: writes the bytes held by the aligned buffer, completing the blocks they partially
+/// cover with the content of the file (the first block was completed when the first byte was buffered)
+static int flush_direct(io_file_t *file)
+{
+	const unsigned long long start = file->pending_offset / IO_ALIGNMENT * IO_ALIGNMENT;
+	const size_t end = (size_t)(file->pending_offset - start) + file->pending_bytes;
+	const size_t aligned_end = (end + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT;
+	io_range_t range;
+
+	if (file->pending_bytes == 0)
+		return 0;
+	if (aligned_end != end)
+	{
+		unsigned char *scratch = file->buffer + IO_DIRECT_BUFFER;
+		if (read_block(file, start + aligned_end - IO_ALIGNMENT, scratch) != 0)
+			return -1;
+		memcpy(file->buffer + end, scratch + end % IO_ALIGNMENT, aligned_end - end);
+	}
+	range.fd = file->fd;
+	range.buffer = file->buffer;
+	range.offset = start;
+	range.bytes = aligned_end;
+	range.writing = 1;
+	transfer_range(&range);
+	if (range.result != 0)
+		return -1;
+	if (file->pending_offset + file->pending_bytes > file->size)
+		file->size = file->pending_offset + file->pending_bytes;
+	file->pending_bytes = 0;
+	return 0;
+}
+
+/// IO_BACKEND_DIRECT: buffers the bytes to be written, so that they reach the file in big aligned blocks
+static int write_direct(io_file_t *file, unsigned long long offset, const unsigned char *buffer, size_t bytes)
+{
+	while (bytes > 0)
+	{
+		size_t head = 0, room = 0;
+		if (file->pending_bytes > 0 && offset != file->pending_offset + file->pending_bytes && flush_direct(file) != 0)
+			return -1;
+		head = (size_t)(file->pending_offset % IO_ALIGNMENT);
+		if (file->pending_bytes == 0)
+		{
+			// a new run of contiguous bytes starts: its first block is completed with the file content
+			file->pending_offset = offset;
+			head = (size_t)(offset % IO_ALIGNMENT);
+			if (head > 0 && read_block(file, offset - head, file->buffer) != 0)
+				return -1;
+		}
+		room = IO_DIRECT_BUFFER - head - file->pending_bytes;
+		if (room > bytes)
+			room = bytes;
+		memcpy(file->buffer + head + file->pending_bytes, buffer, room);
+		file->pending_bytes += room;
+		offset += room;
+		buffer += room;
+		bytes -= room;
+		if (head + file->pending_bytes == IO_DIRECT_BUFFER && flush_direct(file) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+/// IO_BACKEND_DIRECT: reads through the aligned buffer, a block range at a time
+static long long read_direct(io_file_t *file, unsigned long long offset, unsigned char *buffer, size_t bytes)
+{
+	size_t done = 0;
+
+	while (done < bytes)
+	{
+		const unsigned long long start = offset / IO_ALIGNMENT * IO_ALIGNMENT;
+		const size_t head = (size_t)(offset - start);
+		size_t length = (head + bytes - done + IO_ALIGNMENT - 1) / IO_ALIGNMENT * IO_ALIGNMENT;
+		ssize_t got = 0;
+
+		if (length > IO_DIRECT_BUFFER)
+			length = IO_DIRECT_BUFFER;
+		do
+			got = pread(file->fd, file->buffer, length, (off_t)start);
+		while (got < 0 && errno == EINTR);
+		if (got < 0)
+			return -1;
+		if ((size_t)got <= head)
+			break;
+		got -= head;
+		if ((size_t)got > bytes - done)
+			got = bytes - done;
+		memcpy(buffer + done, file->buffer + head, (size_t)got);
+		done += (size_t)got;
+		offset += (size_t)got;
+		if ((size_t)got + head < length)
+			break;
+	}
+	return (long long)done;
+}
+
+/// IO_BACKEND_MMAP: maps the first map_size bytes of the file, hinting a sequential access
+static int map_file(io_file_t *file, size_t map_size)
+{
+	void *map = mmap(NULL, map_size, file->mode == IO_READ ? PROT_READ : PROT_READ | PROT_WRITE, MAP_SHARED, file->fd, 0);
+
+	if (map == MAP_FAILED)
+		return -1;
+	madvise(map, map_size, MADV_SEQUENTIAL);
+	file->map = (unsigned char *)map;
+	file->map_size = map_size;
+	return 0;
+}
+
+/// IO_BACKEND_MMAP: grows the file and its mapping so that they hold at least size bytes
+static int grow_map(io_file_t *file, unsigned long long size)
+{
+	size_t map_size = file->map_size > 0 ? file->map_size : IO_MAP_INITIAL;
+
+	while (map_size < size)
+		map_size *= 2;
+	if (file->map != NULL)
+	{
+		munmap(file->map, file->map_size);
+		file->map = NULL;
+		file->map_size = 0;
+	}
+	if (ftruncate(file->fd, (off_t)map_size) != 0)
+		return -1;
+	return map_file(file, map_size);
+}
+
+/// Opens the file descriptor of the file and, for IO_BACKEND_MMAP and IO_BACKEND_DIRECT, maps it or
+/// allocates the aligned buffer
+static int open_descriptor(io_file_t *file, const char *name)
+{
+	int flags = file->mode == IO_READ ? O_RDONLY : O_RDWR | O_CREAT | O_TRUNC;
+	struct stat status;
+
+#ifdef O_DIRECT
+	if (file->backend == IO_BACKEND_DIRECT)
+	{
+		file->fd = open(name, flags | O_DIRECT, 0666);
+		// the file systems not supporting O_DIRECT (e.g. tmpfs) refuse it when the file is opened
+		if (file->fd < 0 && errno == EINVAL)
+			file->fd = open(name, flags, 0666);
+	}
+	else
+#endif
+		file->fd = open(name, flags, 0666);
+	if (file->fd < 0)
+		return -1;
+	if (fstat(file->fd, &status) != 0)
+	{
+		close(file->fd);
+		return -1;
+	}
+	file->size = (unsigned long long)status.st_size;
+	if (file->backend == IO_BACKEND_MMAP && file->mode == IO_READ && file->size > 0 && map_file(file, (size_t)file->size) != 0)
+	{
+		close(file->fd);
+		return -1;
+	}
+	if (file->backend == IO_BACKEND_DIRECT && posix_memalign((void **)&file->buffer, IO_ALIGNMENT, IO_DIRECT_BUFFER + IO_ALIGNMENT) != 0)
+	{
+		file->buffer = NULL;
+		close(file->fd);
+		return -1;
+	}
+	return 0;
+}
+
+#endif
+
+///Opens the file name through the given backend
+///@return 0 if the file was opened, a negative value otherwise
+int io_open(io_file_t *file, io_backend_t backend, const char *name, io_mode_t mode)
+{
+	int result = 0;
+
+	memset(file, 0, sizeof(io_file_t));
+#ifdef WIN32
+	backend = IO_BACKEND_STDIO;
+#endif
+	file->backend = backend;
+	file->mode = mode;
+	file->fd = -1;
+	if (backend == IO_BACKEND_STDIO)
+		result = open_stream(file, name);
+#ifndef WIN32
+	else
+		result = open_descriptor(file, name);
+#endif
+	if (result != 0)
+		log_error(CCSDS_ERROR_IO, "Error in opening file %s with the %s backend\n\n", name, io_backend_name(backend));
+	return result;
+}
+
+///Returns the number of bytes of the file
+unsigned long long io_size(const io_file_t *file)
+{
+	return file->size;
+}
+
+///Reads up to bytes bytes of the file, starting at offset, into buffer
+///@return the number of bytes read, smaller than bytes only when the end of the file is reached,
+///a negative value in case of error
+long long io_read(io_file_t *file, unsigned long long offset, void *buffer, size_t bytes)
+{
+	long long result = 0;
+
+#ifndef WIN32
+	// the bytes still buffered by IO_BACKEND_DIRECT are written first, so that they can be read back
+	if (file->backend == IO_BACKEND_DIRECT && flush_direct(file) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in writing %zu bytes at offset %llu with the %s backend\n\n", file->pending_bytes, file->pending_offset, io_backend_name(file->backend));
+		return -1;
+	}
+#endif
+	if (offset >= file->size)
+		return 0;
+	if (bytes > file->size - offset)
+		bytes = (size_t)(file->size - offset);
+	if (file->backend == IO_BACKEND_STDIO)
+	{
+		size_t got = 0;
+		if (seek_stream(file, offset, 0) == 0)
+		{
+			got = fread(buffer, 1, bytes, file->stream);
+			file->position += got;
+		}
+		result = got == bytes ? (long long)got : -1;
+	}
+#ifndef WIN32
+	else if (file->backend == IO_BACKEND_MMAP)
+	{
+		memcpy(buffer, file->map + offset, bytes);
+		result = (long long)bytes;
+	}
+	else if (file->backend == IO_BACKEND_PREAD)
+	{
+		result = transfer_parallel(file->fd, offset, (unsigned char *)buffer, bytes, 0) == 0 ? (long long)bytes : -1;
+	}
+	else
+	{
+		result = read_direct(file, offset, (unsigned char *)buffer, bytes);
+	}
+#endif
+	if (result < 0)
+		log_error(CCSDS_ERROR_IO, "Error in reading %zu bytes at offset %llu with the %s backend\n\n", bytes, offset, io_backend_name(file->backend));
+	return result;
+}
+
+///Writes bytes bytes of buffer in the file, starting at offset (which can be past the end of the file)
+///@return 0 if the operation succesfully completes, a negative value otherwise
+int io_write(io_file_t *file, unsigned long long offset, const void *buffer, size_t bytes)
+{
+	int result = 0;
+
+	if (file->backend == IO_BACKEND_STDIO)
+	{
+		result = seek_stream(file, offset, 1) == 0 && fwrite(buffer, 1, bytes, file->stream) == bytes ? 0 : -1;
+		file->position += bytes;
+	}
+#ifndef WIN32
+	else if (file->backend == IO_BACKEND_MMAP)
+	{
+		result = offset + bytes <= file->map_size || grow_map(file, offset + bytes) == 0 ? 0 : -1;
+		if (result == 0)
+			memcpy(file->map + offset, buffer, bytes);
+	}
+	else if (file->backend == IO_BACKEND_PREAD)
+	{
+		result = transfer_parallel(file->fd, offset, (unsigned char *)buffer, bytes, 1);
+	}
+	else
+	{
+		// the size is updated when the buffered bytes reach the file
+		result = write_direct(file, offset, (const unsigned char *)buffer, bytes);
+	}
+#endif
+	if (result != 0)
+		log_error(CCSDS_ERROR_IO, "Error in writing %zu bytes at offset %llu with the %s backend\n\n", bytes, offset, io_backend_name(file->backend));
+	else if (file->backend != IO_BACKEND_DIRECT && offset + bytes > file->size)
+		file->size = offset + bytes;
+	return result;
+}
+
+///Writes bytes bytes of buffer at the end of the file
+///@return 0 if the operation succesfully completes, a negative value otherwise
+int io_append(io_file_t *file, const void *buffer, size_t bytes)
+{
+	unsigned long long end = file->size;
+
+	// with IO_BACKEND_DIRECT the end of the file can still be in the aligned buffer
+	if (file->pending_bytes > 0 && file->pending_offset + file->pending_bytes > end)
+		end = file->pending_offset + file->pending_bytes;
+	return io_write(file, end, buffer, bytes);
+}
+
+///Closes the file, completing the writes still pending
+///@return 0 if the operation succesfully completes, a negative value otherwise
+int io_close(io_file_t *file)
+{
+	int result = 0;
+
+	if (file->backend == IO_BACKEND_STDIO)
+	{
+		if (file->stream != NULL && fclose(file->stream) != 0)
+			result = -1;
+		file->stream = NULL;
+	}
+#ifndef WIN32
+	else if (file->fd >= 0)
+	{
+		if (file->backend == IO_BACKEND_DIRECT && file->mode == IO_WRITE && flush_direct(file) != 0)
+			result = -1;
+		if (file->map != NULL)
+			munmap(file->map, file->map_size);
+		// the mapping and the aligned blocks can go past the end of the file
+		if (file->mode == IO_WRITE && ftruncate(file->fd, (off_t)file->size) != 0)
+			result = -1;
+		if (close(file->fd) != 0)
+			result = -1;
+		file->fd = -1;
+		file->map = NULL;
+	}
+#endif
+	free(file->buffer);
+	free(file->contents);
+	file->buffer = NULL;
+	file->contents = NULL;
+	if (result != 0)
+		log_error(CCSDS_ERROR_IO, "Error in completing the writes of a file with the %s backend\n\n", io_backend_name(file->backend));
+	return result;
+}
+
+///Opens the file name for reading as a stdio stream, for the parsers consuming it a few bits at a time
+///(e.g. the entropy decoder): with IO_BACKEND_STDIO the file is opened with a large buffer; with the
+///other backends the whole file is read through the backend (or mapped, for IO_BACKEND_MMAP) and the
+///stream reads from memory. file must be passed to io_close_stream when the stream is not needed anymore.
+///@return the stream, NULL in case of error
+FILE *io_open_stream(io_file_t *file, io_backend_t backend, const char *name)
+{
+	FILE *stream = NULL;
+	unsigned char *contents = NULL;
+
+	if (io_open(file, backend, name, IO_READ) != 0)
+		return NULL;
+	if (file->backend == IO_BACKEND_STDIO)
+		return file->stream;
+#ifndef WIN32
+	if (file->size == 0)
+	{
+		// fmemopen refuses empty buffers; the parser finds the stream truncated anyway
+		stream = fopen(name, "rb");
+	}
+	else if (file->backend == IO_BACKEND_MMAP)
+	{
+		stream = fmemopen(file->map, (size_t)file->size, "rb");
+	}
+	else if ((contents = (unsigned char *)malloc((size_t)file->size)) != NULL)
+	{
+		file->contents = contents;
+		if (io_read(file, 0, contents, (size_t)file->size) == (long long)file->size)
+			stream = fmemopen(contents, (size_t)file->size, "rb");
+	}
+#endif
+	if (stream == NULL)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in opening file %s as a stream with the %s backend\n\n", name, io_backend_name(file->backend));
+		io_close(file);
+	}
+	return stream;
+}
+
+///Closes a stream opened with io_open_stream
+void io_close_stream(io_file_t *file, FILE *stream)
+{
+	if (file->backend != IO_BACKEND_STDIO)
+		fclose(stream);
+	io_close(file);
+}
+
+///Moves the stdio stream to the byte offset from its start, with 64 bits offsets
+int io_seek_stream(FILE *stream, unsigned long long offset)
+{
+	return io_fseek(stream, (long long)offset, SEEK_SET) == 0 ? 0 : -1;
+}
@@ -0,0 +1,102 @@
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "log.h"
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+// Longest message passed to the callbacks; longer ones are truncated
+#define MAX_MESSAGE_LENGTH 512
+
+// Log context of the call being executed by this thread, NULL outside the library
+static THREAD_LOCAL log_context_t *current_context = NULL;
+
+/// Formats the message and passes it to the callback of the current context, dropping the new
+/// lines which surround it
+static void report(log_level_t level, const char *format, va_list args)
+{
+	char message[MAX_MESSAGE_LENGTH];
+	char *start = message;
+	size_t length = 0;
+
+	vsnprintf(message, MAX_MESSAGE_LENGTH, format, args);
+	while (*start == '\n')
+		start++;
+	length = strlen(start);
+	while (length > 0 && start[length - 1] == '\n')
+		start[--length] = '\0';
+	current_context->callback(level, start, current_context->user_data);
+}
+
+///Callback printing the errors to stderr and the other messages to stdout
+void log_to_stdio(log_level_t level, const char *message, void *user_data)
+{
+	(void)user_data;
+	if (level == LOG_ERROR)
+		fprintf(stderr, "%s\n", message);
+	else
+		printf("%s\n", message);
+}
+
+///Installs context as the log context of the calling thread, reporting to callback (which can be NULL)
+void log_begin(log_context_t *context, log_callback_t callback, void *user_data)
+{
+	context->callback = callback;
+	context->user_data = user_data;
+	context->status = CCSDS_OK;
+	context->previous = current_context;
+	current_context = context;
+}
+
+///Restores the log context active before context was installed, given the result of the call (0 or
+///a negative value in case of error)
+///@return CCSDS_OK if result is 0, otherwise the status of the first error reported while context was
+///installed (CCSDS_ERROR_INTERNAL if none was)
+ccsds_status_t log_end(log_context_t *context, int result)
+{
+	current_context = context->previous;
+	if (result == 0)
+		return CCSDS_OK;
+	return context->status != CCSDS_OK ? context->status : CCSDS_ERROR_INTERNAL;
+}
+
+///Returns the callback and the user data of the log context of the calling thread (NULL outside of the
+///library), so that the threads started by a call can report to the same callback
+void log_current_callback(log_callback_t *callback, void **user_data)
+{
+	*callback = current_context != NULL ? current_context->callback : NULL;
+	*user_data = current_context != NULL ? current_context->user_data : NULL;
+}
+
+///Reports an error with the given status, formatting the message as printf
+void log_error(ccsds_status_t status, const char *format, ...)
+{
+	va_list args;
+
+	if (current_context == NULL)
+		return;
+	if (current_context->status == CCSDS_OK)
+		current_context->status = status;
+	if (current_context->callback == NULL)
+		return;
+	va_start(args, format);
+	report(LOG_ERROR, format, args);
+	va_end(args);
+}
+
+///Reports an information message (e.g. statistics), formatting it as printf
+void log_info(const char *format, ...)
+{
+	va_list args;
+
+	if (current_context == NULL || current_context->callback == NULL)
+		return;
+	va_start(args, format);
+	report(LOG_INFO, format, args);
+	va_end(args);
+}
@@ -0,0 +1,971 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "out_of_core.h"
+#include "ring_buffer.h"
+#include "checkpoint.h"
+
+// Number of chunks (lines or bands) a stage of the pipelined compression can run ahead of the next one
+#define PIPELINE_DEPTH 4
+
+// Largest block of the block adaptive encoder (J <= 64)
+#define MAX_BLOCK_SAMPLES 64
+
+/// Compressed stream being produced: it is written to the output file (or, when file is NULL, copied
+/// to the destination buffer of capacity bytes) every time a chunk of residuals (a line or a row) has
+/// been encoded, so only the last chunk is kept in memory
+typedef struct out_stream
+{
+	io_file_t *file;
+	unsigned char *destination;
+	size_t capacity;
+	unsigned char *buffer;
+	size_t written_bytes;
+	unsigned int written_bits;
+	size_t flushed_bytes;
+} out_stream_t;
+
+/// Number of bytes of the stream buffer given the residuals encoded between two flushes: the sample
+/// adaptive encoder produces at most u_max + D <= 48 bits per residual; room is also left for the header
+/// (whose optional weight and accumulator tables use less than 3 bytes per weight and 1 per band)
+/// and for a whole block of the block adaptive encoder, which is only output when it is complete (so
+/// that the chunk of a narrow image may complete a block started before it, or the last block of the
+/// image, padded with zeros)
+static size_t stream_capacity(input_feature_t input_params, predictor_config_t predictor_params, size_t chunk_samples)
+{
+	return 6 * (chunk_samples + MAX_BLOCK_SAMPLES) + header_size_bound(input_params, predictor_params);
+}
+
+/// Writes out the bytes of the stream completed so far
+static int flush_stream(out_stream_t *stream)
+{
+	size_t written_bytes = stream->written_bytes;
+	if (stream->file == NULL)
+	{
+		if (written_bytes > stream->capacity - stream->flushed_bytes)
+		{
+			log_error(CCSDS_ERROR_BUFFER, "Error, the compressed stream does not fit in the %zu bytes of the output buffer\n\n", stream->capacity);
+			return -1;
+		}
+		memcpy(stream->destination + stream->flushed_bytes, stream->buffer, written_bytes);
+		stream->buffer[0] = stream->buffer[written_bytes];
+		memset(stream->buffer + 1, 0, written_bytes);
+		stream->written_bytes = 0;
+	}
+	else if (bitStream_flush(stream->file, stream->buffer, &stream->written_bytes) != 0)
+		return -1;
+	stream->flushed_bytes += written_bytes;
+	return 0;
+}
+
+/// Copies count samples of the image loaded in memory (in BSQ order), starting from the one with
+/// index first, widening them to 16 bits when the narrow storage is used
+static void copy_samples(input_feature_t input_params, const void *samples, size_t first, size_t count, unsigned short int *destination)
+{
+	if (SAMPLE_BYTES(input_params) == 1)
+		widen_row((const unsigned char *)samples + first, destination, (unsigned int)count);
+	else
+		memcpy(destination, (const unsigned short int *)samples + first, count * sizeof(unsigned short int));
+}
+
+/// Reads the row y of all the bands into line (row y of band z at line + z * x_size), either from the
+/// image loaded in samples or, when samples is NULL, from the input file; with BI input the line is
+/// contiguous in the file and it is read into raw_line and then de-interleaved
+static int read_line(input_feature_t input_params, io_file_t *inFile, const void *samples, unsigned int y, unsigned short int *line,
+		unsigned short int *raw_line)
+{
+	const size_t x_size = input_params.x_size;
+	unsigned int z = 0;
+
+	if (samples != NULL)
+	{
+		for (z = 0; z < input_params.z_size; z++)
+		{
+			copy_samples(input_params, samples, BSQ_OFFSET(input_params, 0, y, z), x_size, line + z * x_size);
+		}
+		return 0;
+	}
+	if (input_params.in_interleaving == BSQ)
+	{
+		for (z = 0; z < input_params.z_size; z++)
+		{
+			if (read_regular_samples(input_params, inFile, BSQ_OFFSET(input_params, 0, y, z), x_size, line + z * x_size) != 0)
+				return -1;
+		}
+		return 0;
+	}
+	if (read_regular_samples(input_params, inFile, (size_t)y * x_size * input_params.z_size, x_size * input_params.z_size, raw_line) != 0)
+		return -1;
+	deinterleave_line(raw_line, line, input_params.x_size, input_params.z_size, input_params.in_interleaving_depth);
+	return 0;
+}
+
+/// Reads the whole band z, either from the image loaded in samples or, when samples is NULL, from
+/// the input file; with BI input the band is scattered over the file and every row y is extracted
+/// from the row y of its interleaving group, read into raw_row
+static int read_band(input_feature_t input_params, io_file_t *inFile, const void *samples, unsigned int z, unsigned short int *band,
+		unsigned short int *raw_row)
+{
+	const size_t x_size = input_params.x_size;
+	unsigned int first_band = 0, width = 0;
+	unsigned int x = 0, y = 0;
+
+	if (samples != NULL)
+	{
+		copy_samples(input_params, samples, BSQ_OFFSET(input_params, 0, 0, z), x_size * input_params.y_size, band);
+		return 0;
+	}
+	if (input_params.in_interleaving == BSQ)
+		return read_regular_samples(input_params, inFile, BSQ_OFFSET(input_params, 0, 0, z), x_size * input_params.y_size, band);
+	first_band = z - z % input_params.in_interleaving_depth;
+	width = MIN(input_params.in_interleaving_depth, input_params.z_size - first_band);
+	for (y = 0; y < input_params.y_size; y++)
+	{
+		if (read_regular_samples(input_params, inFile, ((size_t)y * input_params.z_size + first_band) * x_size, x_size * width, raw_row) != 0)
+			return -1;
+		for (x = 0; x < x_size; x++)
+		{
+			band[y * x_size + x] = raw_row[x * width + z - first_band];
+		}
+	}
+	return 0;
+}
+
+/// Saves the checkpoint of line y, whose first codeword starts at the current end of the stream; the
+/// previous line, the weights and the statistics are the ones the decoder has once line y - 1 is done
+static int save_checkpoint(encoder_config_t encoder_params, const out_stream_t *stream, unsigned long long stream_start,
+		const encoder_state_t *state, unsigned int y, const unsigned short int *origins, const int *weights, const unsigned short int *prev_line)
+{
+	line_checkpoint_t checkpoint;
+
+	checkpoint.y = y;
+	checkpoint.bit_offset = (stream->flushed_bytes + stream->written_bytes) * 8ULL + stream->written_bits - stream_start;
+	checkpoint.counter = state->counter;
+	checkpoint.accumulator = state->accumulator;
+	checkpoint.origins = (unsigned short int *)origins;
+	checkpoint.weights = (int *)weights;
+	checkpoint.prev_line = (unsigned short int *)prev_line;
+	return checkpoint_write(encoder_params.checkpoints, &checkpoint);
+}
+
+/// BI output: the image is processed one line (row y of all the bands) at a time, keeping the
+/// previous line for the local sums and the weights of all the bands
+static int compress_lines(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params,
+		io_file_t *inFile, const void *samples, out_stream_t *stream, encoder_state_t *state, arena_t *arena)
+{
+	const size_t x_size = input_params.x_size;
+	const size_t line_samples = x_size * input_params.z_size;
+	int weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+	unsigned int window = predictor_params.pred_bands + 1;
+	unsigned int arrays_per_row = predictor_params.full != 0 ? 5 : 2;
+	unsigned int num_groups = (input_params.z_size + encoder_params.out_interleaving_depth - 1) / encoder_params.out_interleaving_depth;
+	unsigned short int *lines = NULL;
+	unsigned short int *raw_line = NULL;
+	unsigned short int *residual_line = NULL;
+	unsigned short int *origins = NULL;
+	int *weights = NULL;
+	int *differences_buffer = NULL;
+	int *predicted_row = NULL;
+	row_differences_t *window_differences = NULL;
+	row_differences_t **band_differences = NULL;
+	unsigned int x = 0, y = 0, z = 0, i = 0;
+	// position of the first codeword, the one the checkpoints are relative to
+	unsigned long long stream_start = (stream->flushed_bytes + stream->written_bytes) * 8ULL + stream->written_bits;
+	int result = 0;
+	arena_mark_t mark = arena_get_mark(arena);
+
+	lines = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * 2 * line_samples);
+	residual_line = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * line_samples);
+	if (samples == NULL && input_params.in_interleaving == BI)
+		raw_line = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * line_samples);
+	origins = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * input_params.z_size);
+	weights = (int *)arena_alloc(arena, sizeof(int) * (weights_len > 0 ? weights_len : 1) * input_params.z_size);
+	differences_buffer = (int *)arena_alloc(arena, sizeof(int) * x_size * (window * arrays_per_row + 1));
+	window_differences = (row_differences_t *)arena_alloc(arena, sizeof(row_differences_t) * window);
+	band_differences = (row_differences_t **)arena_alloc(arena, sizeof(row_differences_t *) * window);
+	if (lines == NULL || residual_line == NULL || (samples == NULL && input_params.in_interleaving == BI && raw_line == NULL) || origins == NULL ||
+			weights == NULL || differences_buffer == NULL || window_differences == NULL || band_differences == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the lines buffers of the out of core compression\n\n");
+		result = -1;
+	}
+	else
+	{
+		init_differences_window(predictor_params, x_size, window, differences_buffer, window_differences);
+		predicted_row = differences_buffer + (size_t)window * arrays_per_row * x_size;
+	}
+
+	for (y = 0; y < input_params.y_size && result == 0; y++)
+	{
+		unsigned short int *line = lines + (y & 0x1) * line_samples;
+		unsigned short int *prev_line = lines + ((y + 1) & 0x1) * line_samples;
+		if (encoder_params.checkpoints != NULL && y > 0 && y % encoder_params.checkpoints->interval == 0 &&
+				save_checkpoint(encoder_params, stream, stream_start, state, y, origins, weights, prev_line) != 0)
+		{
+			result = -1;
+			break;
+		}
+		if (read_line(input_params, inFile, samples, y, line, raw_line) != 0)
+		{
+			result = -1;
+			break;
+		}
+		for (z = 0; z < input_params.z_size; z++)
+		{
+			const unsigned short int *cur_row = line + z * x_size;
+			unsigned int cur_pred_bands = z < predictor_params.pred_bands ? z : predictor_params.pred_bands;
+			if (y == 0)
+				origins[z] = cur_row[0];
+			compute_row_differences(input_params, predictor_params, y, cur_row,
+					y > 0 ? prev_line + z * x_size : NULL, &window_differences[z % window]);
+			for (i = 0; i <= cur_pred_bands; i++)
+			{
+				band_differences[i] = &window_differences[(z - i) % window];
+			}
+			predict_row(input_params, predictor_params, y, z, cur_row, z > 0 ? origins[z - 1] : 0, band_differences,
+					weights + z * weights_len, predicted_row, residual_line + z * x_size);
+		}
+		// The line is complete: its residuals are encoded in the BI order and written out
+		for (i = 0; i < num_groups && result == 0; i++)
+		{
+			unsigned int first_band = i * encoder_params.out_interleaving_depth;
+			unsigned int last_band = MIN(first_band + encoder_params.out_interleaving_depth, input_params.z_size);
+			for (x = 0; x < x_size && result == 0; x++)
+			{
+				for (z = first_band; z < last_band && result == 0; z++)
+				{
+					result = encode_residual(input_params, encoder_params, state, x, y, z, residual_line[z * x_size + x],
+							stream->buffer, &stream->written_bytes, &stream->written_bits);
+				}
+			}
+		}
+		if (result == 0)
+			result = flush_stream(stream);
+	}
+
+	arena_rewind(arena, mark);
+	return result;
+}
+
+/// BSQ output: the image is processed one band at a time, keeping the P-band window (the band
+/// being compressed and the pred_bands previous ones); the local differences of the previous
+/// bands are computed again for every row instead of being stored for the whole band
+static int compress_bands(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params,
+		io_file_t *inFile, const void *samples, out_stream_t *stream, encoder_state_t *state, arena_t *arena)
+{
+	const size_t x_size = input_params.x_size;
+	const size_t band_samples = x_size * input_params.y_size;
+	int weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+	unsigned int window = predictor_params.pred_bands + 1;
+	unsigned int arrays_per_row = predictor_params.full != 0 ? 5 : 2;
+	unsigned short int *bands = NULL;
+	unsigned short int *raw_row = NULL;
+	unsigned short int *residual_row = NULL;
+	unsigned short int prev_band_origin = 0;
+	int *weights = NULL;
+	int *differences_buffer = NULL;
+	int *predicted_row = NULL;
+	row_differences_t *window_differences = NULL;
+	row_differences_t **band_differences = NULL;
+	unsigned int x = 0, y = 0, z = 0, i = 0;
+	int result = 0;
+	arena_mark_t mark = arena_get_mark(arena);
+
+	bands = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * window * band_samples);
+	residual_row = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * x_size);
+	if (samples == NULL && input_params.in_interleaving == BI)
+		raw_row = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * x_size * input_params.in_interleaving_depth);
+	weights = (int *)arena_alloc(arena, sizeof(int) * (weights_len > 0 ? weights_len : 1));
+	differences_buffer = (int *)arena_alloc(arena, sizeof(int) * x_size * (window * arrays_per_row + 1));
+	window_differences = (row_differences_t *)arena_alloc(arena, sizeof(row_differences_t) * window);
+	band_differences = (row_differences_t **)arena_alloc(arena, sizeof(row_differences_t *) * window);
+	if (bands == NULL || residual_row == NULL || (samples == NULL && input_params.in_interleaving == BI && raw_row == NULL) ||
+			weights == NULL || differences_buffer == NULL || window_differences == NULL || band_differences == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the bands buffers of the out of core compression\n\n");
+		result = -1;
+	}
+	else
+	{
+		init_differences_window(predictor_params, x_size, window, differences_buffer, window_differences);
+		predicted_row = differences_buffer + (size_t)window * arrays_per_row * x_size;
+	}
+
+	for (z = 0; z < input_params.z_size && result == 0; z++)
+	{
+		unsigned short int *band = bands + (z % window) * band_samples;
+		unsigned int cur_pred_bands = z < predictor_params.pred_bands ? z : predictor_params.pred_bands;
+		if (read_band(input_params, inFile, samples, z, band, raw_row) != 0)
+		{
+			result = -1;
+			break;
+		}
+		for (y = 0; y < input_params.y_size && result == 0; y++)
+		{
+			for (i = 0; i <= cur_pred_bands; i++)
+			{
+				const unsigned short int *row = bands + ((z - i) % window) * band_samples + y * x_size;
+				compute_row_differences(input_params, predictor_params, y, row, y > 0 ? row - x_size : NULL, &window_differences[i]);
+				band_differences[i] = &window_differences[i];
+			}
+			predict_row(input_params, predictor_params, y, z, band + y * x_size, prev_band_origin, band_differences,
+					weights, predicted_row, residual_row);
+			for (x = 0; x < x_size && result == 0; x++)
+			{
+				result = encode_residual(input_params, encoder_params, state, x, y, z, residual_row[x],
+						stream->buffer, &stream->written_bytes, &stream->written_bits);
+			}
+			if (result == 0)
+				result = flush_stream(stream);
+		}
+		prev_band_origin = band[0];
+	}
+
+	arena_rewind(arena, mark);
+	return result;
+}
+
+/// Number of bytes of memory used by compress_streaming, apart from the image when it is loaded in memory;
+/// from_file tells whether the samples are read from the input file
+static size_t streaming_working_set(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params,
+		int from_file)
+{
+	const size_t x_size = input_params.x_size;
+	size_t weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+	size_t window = predictor_params.pred_bands + 1;
+	size_t arrays_per_row = predictor_params.full != 0 ? 5 : 2;
+	// local differences of the window and predicted row
+	size_t bytes = sizeof(int) * x_size * (window * arrays_per_row + 1) + (sizeof(row_differences_t) + sizeof(row_differences_t *)) * window;
+
+	if (weights_len == 0)
+		weights_len = 1;
+	if (encoder_params.out_interleaving == BI)
+	{
+		// two lines, the residuals line, the (0, 0) samples and the weights of every band
+		bytes += sizeof(unsigned short int) * 3 * x_size * input_params.z_size;
+		bytes += (sizeof(unsigned short int) + sizeof(int) * weights_len) * input_params.z_size;
+		if (from_file != 0 && input_params.in_interleaving == BI)
+			bytes += sizeof(unsigned short int) * x_size * input_params.z_size;
+		bytes += stream_capacity(input_params, predictor_params, x_size * input_params.z_size);
+	}
+	else
+	{
+		// the bands of the window, the residuals row and the weights of one band
+		bytes += sizeof(unsigned short int) * window * x_size * input_params.y_size;
+		bytes += sizeof(unsigned short int) * x_size + sizeof(int) * weights_len;
+		if (from_file != 0 && input_params.in_interleaving == BI)
+			bytes += sizeof(unsigned short int) * x_size * input_params.in_interleaving_depth;
+		bytes += stream_capacity(input_params, predictor_params, x_size);
+	}
+	return bytes + encoder_state_size(input_params, encoder_params);
+}
+
+/// Compresses the image, whose samples are either already loaded in samples or, when samples is NULL,
+/// read from inFile, writing the compressed stream to the destination of stream as it is produced
+/// @return the number of bytes of the compressed stream, a negative value in case of error
+static long long compress_streaming(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params,
+		io_file_t *inFile, const void *samples, out_stream_t *stream, arena_t *arena)
+{
+	size_t capacity = 0;
+	encoder_state_t state;
+	int result = 0;
+	arena_mark_t mark = arena_get_mark(arena);
+
+	if (encoder_params.out_interleaving == BI)
+		capacity = stream_capacity(input_params, predictor_params, (size_t)input_params.x_size * input_params.z_size);
+	else
+		capacity = stream_capacity(input_params, predictor_params, input_params.x_size);
+	if ((stream->buffer = (unsigned char *)arena_calloc(arena, capacity, 1)) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in the allocation of the compressed stream\n\n");
+		return -1;
+	}
+	if (init_encoder_state(input_params, encoder_params, &state, arena) != 0)
+	{
+		arena_rewind(arena, mark);
+		return -1;
+	}
+
+	create_header(&stream->written_bytes, &stream->written_bits, stream->buffer, input_params, predictor_params, encoder_params);
+	result = flush_stream(stream);
+	if (result == 0)
+	{
+		// The image is traversed in the order of the output stream, so that every residual can be
+		// encoded as soon as it has been computed
+		if (encoder_params.out_interleaving == BI)
+			result = compress_lines(input_params, predictor_params, encoder_params, inFile, samples, stream, &state, arena);
+		else
+			result = compress_bands(input_params, predictor_params, encoder_params, inFile, samples, stream, &state, arena);
+	}
+	if (result == 0)
+	{
+		finish_encoding(input_params, encoder_params, &state, stream->buffer, &stream->written_bytes, &stream->written_bits);
+		pad_to_word(encoder_params, stream->buffer, &stream->written_bytes, &stream->written_bits, stream->flushed_bytes);
+		result = flush_stream(stream);
+	}
+	arena_rewind(arena, mark);
+	stream->buffer = NULL;
+	if (result != 0)
+		return -1;
+	return (long long)stream->flushed_bytes;
+}
+
+/// Compresses the image as compress_streaming does, writing the compressed stream to outputFile through
+/// the given I/O backend
+static long long compress_to_file(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params,
+		io_file_t *inFile, const void *samples, char outputFile[128], io_backend_t backend, arena_t *arena)
+{
+	out_stream_t stream;
+	io_file_t outFile;
+	long long compressed_bytes = 0;
+
+	memset(&stream, 0, sizeof(out_stream_t));
+	if (io_open(&outFile, backend, outputFile, IO_WRITE) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in creating file %s for writing the compression result\n\n", outputFile);
+		return -1;
+	}
+	stream.file = &outFile;
+	compressed_bytes = compress_streaming(input_params, predictor_params, encoder_params, inFile, samples, &stream, arena);
+	if (io_close(&outFile) != 0 && compressed_bytes >= 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in writing the compressed stream to %s\n\n", outputFile);
+		return -1;
+	}
+	return compressed_bytes;
+}
+
+/// Pipelined compression: the samples are read by the reader thread, predicted by the calling thread
+/// and encoded and written by the encoder thread; the chunks (lines with BI output, bands with BSQ output)
+/// are passed from a stage to the next one through bounded single producer, single consumer queues
+typedef struct pipeline
+{
+	input_feature_t input_params;
+	predictor_config_t predictor_params;
+	encoder_config_t encoder_params;
+	io_file_t inFile;
+	// scratch of the reader for the BI input
+	unsigned short int *raw_chunk;
+	// chunks of samples, from the reader to the predictor, and of residuals, from the predictor to the encoder
+	ring_buffer_t samples;
+	ring_buffer_t residuals;
+	out_stream_t *stream;
+	encoder_state_t state;
+	log_callback_t log_callback;
+	void *log_user_data;
+	ccsds_status_t reader_status;
+	ccsds_status_t encoder_status;
+} pipeline_t;
+
+/// Number of chunks the image is split into
+static unsigned int pipeline_chunks(const pipeline_t *pipeline)
+{
+	return pipeline->encoder_params.out_interleaving == BI ? pipeline->input_params.y_size : pipeline->input_params.z_size;
+}
+
+/// Stops all the stages, after an error in one of them
+static void cancel_pipeline(pipeline_t *pipeline)
+{
+	ring_cancel(&pipeline->samples);
+	ring_cancel(&pipeline->residuals);
+}
+
+/// Reader stage: reads the lines or the bands of the image in order
+static void *pipeline_reader(void *argument)
+{
+	pipeline_t *pipeline = (pipeline_t *)argument;
+	log_context_t log_context;
+	unsigned int chunk = 0;
+	int result = 0;
+
+	log_begin(&log_context, pipeline->log_callback, pipeline->log_user_data);
+	for (chunk = 0; chunk < pipeline_chunks(pipeline) && result == 0; chunk++)
+	{
+		unsigned short int *samples = (unsigned short int *)ring_acquire_write(&pipeline->samples);
+		// a NULL slot means that another stage failed
+		if (samples == NULL)
+			break;
+		if (pipeline->encoder_params.out_interleaving == BI)
+			result = read_line(pipeline->input_params, &pipeline->inFile, NULL, chunk, samples, pipeline->raw_chunk);
+		else
+			result = read_band(pipeline->input_params, &pipeline->inFile, NULL, chunk, samples, pipeline->raw_chunk);
+		if (result == 0)
+			ring_commit_write(&pipeline->samples);
+	}
+	if (result != 0)
+		cancel_pipeline(pipeline);
+	pipeline->reader_status = log_end(&log_context, result);
+	return NULL;
+}
+
+/// Encoder stage: encodes the residuals of every chunk in the order of the output stream and writes them
+/// out; the header has already been written
+static void *pipeline_encoder(void *argument)
+{
+	pipeline_t *pipeline = (pipeline_t *)argument;
+	const input_feature_t input_params = pipeline->input_params;
+	const encoder_config_t encoder_params = pipeline->encoder_params;
+	const size_t x_size = input_params.x_size;
+	out_stream_t *stream = pipeline->stream;
+	log_context_t log_context;
+	unsigned int chunk = 0, x = 0, y = 0, z = 0, i = 0;
+	int result = 0;
+
+	log_begin(&log_context, pipeline->log_callback, pipeline->log_user_data);
+	for (chunk = 0; chunk < pipeline_chunks(pipeline) && result == 0; chunk++)
+	{
+		const unsigned short int *residuals = (const unsigned short int *)ring_acquire_read(&pipeline->residuals);
+		if (residuals == NULL)
+			break;
+		if (encoder_params.out_interleaving == BI)
+		{
+			// line y: the bands are interleaved by groups of out_interleaving_depth
+			unsigned int num_groups = (input_params.z_size + encoder_params.out_interleaving_depth - 1) / encoder_params.out_interleaving_depth;
+			y = chunk;
+			for (i = 0; i < num_groups && result == 0; i++)
+			{
+				unsigned int first_band = i * encoder_params.out_interleaving_depth;
+				unsigned int last_band = MIN(first_band + encoder_params.out_interleaving_depth, input_params.z_size);
+				for (x = 0; x < x_size && result == 0; x++)
+				{
+					for (z = first_band; z < last_band && result == 0; z++)
+					{
+						result = encode_residual(input_params, encoder_params, &pipeline->state, x, y, z, residuals[z * x_size + x],
+								stream->buffer, &stream->written_bytes, &stream->written_bits);
+					}
+				}
+			}
+			if (result == 0)
+				result = flush_stream(stream);
+		}
+		else
+		{
+			// band z, flushed row by row
+			z = chunk;
+			for (y = 0; y < input_params.y_size && result == 0; y++)
+			{
+				for (x = 0; x < x_size && result == 0; x++)
+				{
+					result = encode_residual(input_params, encoder_params, &pipeline->state, x, y, z, residuals[y * x_size + x],
+							stream->buffer, &stream->written_bytes, &stream->written_bits);
+				}
+				if (result == 0)
+					result = flush_stream(stream);
+			}
+		}
+		ring_release_read(&pipeline->residuals);
+	}
+	if (result == 0 && chunk == pipeline_chunks(pipeline))
+	{
+		finish_encoding(input_params, encoder_params, &pipeline->state, stream->buffer, &stream->written_bytes, &stream->written_bits);
+		pad_to_word(encoder_params, stream->buffer, &stream->written_bytes, &stream->written_bits, stream->flushed_bytes);
+		result = flush_stream(stream);
+	}
+	if (result != 0)
+		cancel_pipeline(pipeline);
+	pipeline->encoder_status = log_end(&log_context, result);
+	return NULL;
+}
+
+/// Predictor stage, BI output: every line is predicted from the previous one, which is held until the
+/// next line has been predicted
+/// @return 0 when all the lines have been predicted or when another stage failed, a negative value
+/// in case of error
+static int pipeline_predict_lines(pipeline_t *pipeline, arena_t *arena)
+{
+	const input_feature_t input_params = pipeline->input_params;
+	const predictor_config_t predictor_params = pipeline->predictor_params;
+	const size_t x_size = input_params.x_size;
+	int weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+	unsigned int window = predictor_params.pred_bands + 1;
+	unsigned int arrays_per_row = predictor_params.full != 0 ? 5 : 2;
+	const unsigned short int *prev_line = NULL;
+	unsigned short int *origins = NULL;
+	int *weights = NULL;
+	int *differences_buffer = NULL;
+	int *predicted_row = NULL;
+	row_differences_t *window_differences = NULL;
+	row_differences_t **band_differences = NULL;
+	unsigned int y = 0, z = 0, i = 0;
+
+	origins = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * input_params.z_size);
+	weights = (int *)arena_alloc(arena, sizeof(int) * (weights_len > 0 ? weights_len : 1) * input_params.z_size);
+	differences_buffer = (int *)arena_alloc(arena, sizeof(int) * x_size * (window * arrays_per_row + 1));
+	window_differences = (row_differences_t *)arena_alloc(arena, sizeof(row_differences_t) * window);
+	band_differences = (row_differences_t **)arena_alloc(arena, sizeof(row_differences_t *) * window);
+	if (origins == NULL || weights == NULL || differences_buffer == NULL || window_differences == NULL || band_differences == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the lines buffers of the pipelined compression\n\n");
+		return -1;
+	}
+	init_differences_window(predictor_params, x_size, window, differences_buffer, window_differences);
+	predicted_row = differences_buffer + (size_t)window * arrays_per_row * x_size;
+
+	for (y = 0; y < input_params.y_size; y++)
+	{
+		const unsigned short int *line = (const unsigned short int *)ring_acquire_read(&pipeline->samples);
+		unsigned short int *residual_line = (unsigned short int *)ring_acquire_write(&pipeline->residuals);
+		if (line == NULL || residual_line == NULL)
+			return 0;
+		for (z = 0; z < input_params.z_size; z++)
+		{
+			const unsigned short int *cur_row = line + z * x_size;
+			unsigned int cur_pred_bands = z < predictor_params.pred_bands ? z : predictor_params.pred_bands;
+			if (y == 0)
+				origins[z] = cur_row[0];
+			compute_row_differences(input_params, predictor_params, y, cur_row,
+					y > 0 ? prev_line + z * x_size : NULL, &window_differences[z % window]);
+			for (i = 0; i <= cur_pred_bands; i++)
+			{
+				band_differences[i] = &window_differences[(z - i) % window];
+			}
+			predict_row(input_params, predictor_params, y, z, cur_row, z > 0 ? origins[z - 1] : 0, band_differences,
+					weights + z * weights_len, predicted_row, residual_line + z * x_size);
+		}
+		ring_commit_write(&pipeline->residuals);
+		// the previous line is not needed anymore
+		if (y > 0)
+			ring_release_read(&pipeline->samples);
+		prev_line = line;
+	}
+	ring_release_read(&pipeline->samples);
+	return 0;
+}
+
+/// Predictor stage, BSQ output: every band is predicted holding the P-band window (the band and the
+/// pred_bands previous ones); the local differences of the previous bands are computed again for every row
+/// @return 0 when all the bands have been predicted or when another stage failed, a negative value
+/// in case of error
+static int pipeline_predict_bands(pipeline_t *pipeline, arena_t *arena)
+{
+	const input_feature_t input_params = pipeline->input_params;
+	const predictor_config_t predictor_params = pipeline->predictor_params;
+	const size_t x_size = input_params.x_size;
+	int weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+	unsigned int window = predictor_params.pred_bands + 1;
+	unsigned int arrays_per_row = predictor_params.full != 0 ? 5 : 2;
+	const unsigned short int **bands = NULL;
+	unsigned short int prev_band_origin = 0;
+	int *weights = NULL;
+	int *differences_buffer = NULL;
+	int *predicted_row = NULL;
+	row_differences_t *window_differences = NULL;
+	row_differences_t **band_differences = NULL;
+	unsigned int y = 0, z = 0, i = 0;
+
+	bands = (const unsigned short int **)arena_alloc(arena, sizeof(unsigned short int *) * window);
+	weights = (int *)arena_alloc(arena, sizeof(int) * (weights_len > 0 ? weights_len : 1));
+	differences_buffer = (int *)arena_alloc(arena, sizeof(int) * x_size * (window * arrays_per_row + 1));
+	window_differences = (row_differences_t *)arena_alloc(arena, sizeof(row_differences_t) * window);
+	band_differences = (row_differences_t **)arena_alloc(arena, sizeof(row_differences_t *) * window);
+	if (bands == NULL || weights == NULL || differences_buffer == NULL || window_differences == NULL || band_differences == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the bands buffers of the pipelined compression\n\n");
+		return -1;
+	}
+	init_differences_window(predictor_params, x_size, window, differences_buffer, window_differences);
+	predicted_row = differences_buffer + (size_t)window * arrays_per_row * x_size;
+
+	for (z = 0; z < input_params.z_size; z++)
+	{
+		unsigned int cur_pred_bands = z < predictor_params.pred_bands ? z : predictor_params.pred_bands;
+		unsigned short int *residual_band = NULL;
+		bands[z % window] = (const unsigned short int *)ring_acquire_read(&pipeline->samples);
+		residual_band = (unsigned short int *)ring_acquire_write(&pipeline->residuals);
+		if (bands[z % window] == NULL || residual_band == NULL)
+			return 0;
+		for (y = 0; y < input_params.y_size; y++)
+		{
+			for (i = 0; i <= cur_pred_bands; i++)
+			{
+				const unsigned short int *row = bands[(z - i) % window] + y * x_size;
+				compute_row_differences(input_params, predictor_params, y, row, y > 0 ? row - x_size : NULL, &window_differences[i]);
+				band_differences[i] = &window_differences[i];
+			}
+			predict_row(input_params, predictor_params, y, z, bands[z % window] + y * x_size, prev_band_origin, band_differences,
+					weights, predicted_row, residual_band + y * x_size);
+		}
+		ring_commit_write(&pipeline->residuals);
+		prev_band_origin = bands[z % window][0];
+		// the oldest band of the window is not needed by the next band
+		if (z >= predictor_params.pred_bands)
+			ring_release_read(&pipeline->samples);
+	}
+	for (i = 0; i < MIN(predictor_params.pred_bands, input_params.z_size); i++)
+		ring_release_read(&pipeline->samples);
+	return 0;
+}
+
+/// Number of slots of the queue of the samples: the chunks held by the predictor and the ones read ahead
+static size_t pipeline_sample_slots(predictor_config_t predictor_params, encoder_config_t encoder_params)
+{
+	if (encoder_params.out_interleaving == BI)
+		return 2 + PIPELINE_DEPTH;
+	return (size_t)predictor_params.pred_bands + 1 + PIPELINE_DEPTH;
+}
+
+/// Number of samples of a chunk: a line with BI output, a band with BSQ output
+static size_t pipeline_chunk_samples(input_feature_t input_params, encoder_config_t encoder_params)
+{
+	if (encoder_params.out_interleaving == BI)
+		return (size_t)input_params.x_size * input_params.z_size;
+	return (size_t)input_params.x_size * input_params.y_size;
+}
+
+/// Returns the number of bytes of memory used by compress_out_of_core for the given image
+/// and configuration.
+size_t out_of_core_working_set(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params)
+{
+	return streaming_working_set(input_params, predictor_params, encoder_params, 1);
+}
+
+/// Returns the number of bytes of memory used by compress_fused for the given image and
+/// configuration, including the image itself.
+size_t fused_working_set(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params)
+{
+	return SAMPLE_BYTES(input_params) * IMAGE_SAMPLES(input_params) + streaming_working_set(input_params, predictor_params, encoder_params, 0);
+}
+
+/// Compresses the image in inputFile into outputFile, streaming both of them. The produced
+/// stream is identical to the one of the in-memory compression (predict followed by encode).
+/// When memory_budget is not 0 and the working set is bigger than memory_budget bytes
+/// nothing is done and an error is returned.
+/// @return the number of bytes of the compressed stream, a negative value in case of error
+long long compress_out_of_core(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params,
+		char inputFile[128], char outputFile[128], io_backend_t backend, size_t memory_budget, arena_t *arena)
+{
+	size_t working_set = out_of_core_working_set(input_params, predictor_params, encoder_params);
+	io_file_t inFile;
+	long long compressed_bytes = 0;
+
+	// The samples are read at arbitrary positions of the file, so each of them must have the same size
+	if (input_params.regular_input == 0)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "Error, the out of core compression requires the input samples to be stored with 16 bits each\n\n");
+		return -1;
+	}
+	if (memory_budget != 0 && working_set > memory_budget)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error, the out of core compression needs %zu bytes of memory, more than the budget of %zu bytes\n\n", working_set, memory_budget);
+		return -1;
+	}
+	if (io_open(&inFile, backend, inputFile, IO_READ) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in opening input file %s\n\n", inputFile);
+		return -1;
+	}
+	compressed_bytes = compress_to_file(input_params, predictor_params, encoder_params, &inFile, NULL, outputFile, backend, arena);
+	io_close(&inFile);
+	return compressed_bytes;
+}
+
+/// Compresses the image in inputFile into outputFile: the image is loaded in memory, but its
+/// residuals are encoded and written to outputFile as soon as they are computed, so that neither
+/// the residuals nor the whole compressed stream are kept in memory.
+/// @return the number of bytes of the compressed stream, a negative value in case of error
+long long compress_fused(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params,
+		char inputFile[128], char outputFile[128], io_backend_t backend, arena_t *arena)
+{
+	void *samples = NULL;
+	long long compressed_bytes = 0;
+	arena_mark_t mark = arena_get_mark(arena);
+
+	samples = arena_alloc(arena, SAMPLE_BYTES(input_params) * IMAGE_SAMPLES(input_params));
+	if (samples == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating %lf kBytes for the input image buffer\n\n", ((double)SAMPLE_BYTES(input_params) * IMAGE_SAMPLES(input_params)) / 1024.0);
+		return -1;
+	}
+	if (read_samples(input_params, backend, inputFile, samples) != 0)
+	{
+		arena_rewind(arena, mark);
+		return -1;
+	}
+	compressed_bytes = compress_to_file(input_params, predictor_params, encoder_params, NULL, samples, outputFile, backend, arena);
+	arena_rewind(arena, mark);
+	return compressed_bytes;
+}
+
+/// Returns the maximum number of bytes of the compressed stream of an image with the given
+/// configuration: the sample adaptive encoder produces at most u_max + D bits per residual, the
+/// block adaptive one less than D + 3 (identifiers, reference samples and zero blocks included)
+size_t compress_bound(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params)
+{
+	size_t bits_per_sample = input_params.dyn_range + 3;
+	if (encoder_params.encoding_method == SAMPLE)
+		bits_per_sample = encoder_params.u_max + input_params.dyn_range;
+	return (IMAGE_SAMPLES(input_params) * bits_per_sample + 7) / 8 + stream_capacity(input_params, predictor_params, 0);
+}
+
+/// Compresses the image whose samples are loaded in samples (in BSQ order, as by read_samples) into
+/// the destination buffer of capacity bytes; the compressed stream is identical to the one of the
+/// other engines. The buffers are allocated from arena and released before returning.
+/// @return the number of bytes of the compressed stream, a negative value in case of error (including
+/// a compressed stream not fitting in destination)
+long long compress_fused_to_buffer(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params,
+		const void *samples, unsigned char *destination, size_t capacity, arena_t *arena)
+{
+	out_stream_t stream;
+
+	memset(&stream, 0, sizeof(out_stream_t));
+	stream.destination = destination;
+	stream.capacity = capacity;
+	return compress_streaming(input_params, predictor_params, encoder_params, NULL, samples, &stream, arena);
+}
+
+/// Returns the number of bytes of memory used by compress_pipelined for the given image and
+/// configuration.
+size_t pipelined_working_set(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params)
+{
+	const size_t x_size = input_params.x_size;
+	size_t chunk_bytes = sizeof(unsigned short int) * pipeline_chunk_samples(input_params, encoder_params);
+	size_t weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+	size_t window = predictor_params.pred_bands + 1;
+	size_t arrays_per_row = predictor_params.full != 0 ? 5 : 2;
+	size_t bytes = ring_size(chunk_bytes, pipeline_sample_slots(predictor_params, encoder_params)) + ring_size(chunk_bytes, PIPELINE_DEPTH);
+
+	if (weights_len == 0)
+		weights_len = 1;
+	// local differences of the window and predicted row
+	bytes += sizeof(int) * x_size * (window * arrays_per_row + 1) + (sizeof(row_differences_t) + sizeof(row_differences_t *)) * window;
+	if (encoder_params.out_interleaving == BI)
+	{
+		// the (0, 0) samples and the weights of every band
+		bytes += (sizeof(unsigned short int) + sizeof(int) * weights_len) * input_params.z_size;
+		if (input_params.in_interleaving == BI)
+			bytes += chunk_bytes;
+		bytes += stream_capacity(input_params, predictor_params, x_size * input_params.z_size);
+	}
+	else
+	{
+		bytes += sizeof(unsigned short int *) * window + sizeof(int) * weights_len;
+		if (input_params.in_interleaving == BI)
+			bytes += sizeof(unsigned short int) * x_size * input_params.in_interleaving_depth;
+		bytes += stream_capacity(input_params, predictor_params, x_size);
+	}
+	return bytes + encoder_state_size(input_params, encoder_params);
+}
+
+/// Compresses the image in inputFile into outputFile with three threads: the reader, the predictor (the
+/// calling thread) and the encoder, which also writes the stream out.
+long long compress_pipelined(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params,
+		char inputFile[128], char outputFile[128], io_backend_t backend, arena_t *arena)
+{
+	const size_t chunk_bytes = sizeof(unsigned short int) * pipeline_chunk_samples(input_params, encoder_params);
+	pipeline_t pipeline;
+	out_stream_t stream;
+	io_file_t outFile;
+	pthread_t reader, encoder;
+	int reader_started = 0, encoder_started = 0;
+	int result = 0;
+	ccsds_status_t status = CCSDS_OK;
+	arena_mark_t mark = arena_get_mark(arena);
+
+	// The samples are read at arbitrary positions of the file, so each of them must have the same size
+	if (input_params.regular_input == 0)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "Error, the pipelined compression requires the input samples to be stored with 16 bits each\n\n");
+		return -1;
+	}
+	memset(&pipeline, 0, sizeof(pipeline_t));
+	memset(&stream, 0, sizeof(out_stream_t));
+	pipeline.input_params = input_params;
+	pipeline.predictor_params = predictor_params;
+	pipeline.encoder_params = encoder_params;
+	pipeline.stream = &stream;
+	log_current_callback(&pipeline.log_callback, &pipeline.log_user_data);
+
+	// Everything used by the threads is allocated up front, as the arena is not shared among them
+	if (ring_init(&pipeline.samples, chunk_bytes, pipeline_sample_slots(predictor_params, encoder_params), arena) != 0 ||
+			ring_init(&pipeline.residuals, chunk_bytes, PIPELINE_DEPTH, arena) != 0)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the queues of the pipelined compression\n\n");
+		arena_rewind(arena, mark);
+		return -1;
+	}
+	if (input_params.in_interleaving == BI)
+	{
+		size_t raw_samples = encoder_params.out_interleaving == BI ? pipeline_chunk_samples(input_params, encoder_params) :
+				(size_t)input_params.x_size * input_params.in_interleaving_depth;
+		pipeline.raw_chunk = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * raw_samples);
+	}
+	if (encoder_params.out_interleaving == BI)
+		stream.buffer = (unsigned char *)arena_calloc(arena, stream_capacity(input_params, predictor_params, (size_t)input_params.x_size * input_params.z_size), 1);
+	else
+		stream.buffer = (unsigned char *)arena_calloc(arena, stream_capacity(input_params, predictor_params, input_params.x_size), 1);
+	if ((input_params.in_interleaving == BI && pipeline.raw_chunk == NULL) || stream.buffer == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the buffers of the pipelined compression\n\n");
+		arena_rewind(arena, mark);
+		return -1;
+	}
+	if (init_encoder_state(input_params, encoder_params, &pipeline.state, arena) != 0)
+	{
+		arena_rewind(arena, mark);
+		return -1;
+	}
+
+	if (io_open(&pipeline.inFile, backend, inputFile, IO_READ) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in opening input file %s\n\n", inputFile);
+		arena_rewind(arena, mark);
+		return -1;
+	}
+	if (io_open(&outFile, backend, outputFile, IO_WRITE) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in creating file %s for writing the compression result\n\n", outputFile);
+		io_close(&pipeline.inFile);
+		arena_rewind(arena, mark);
+		return -1;
+	}
+	stream.file = &outFile;
+	create_header(&stream.written_bytes, &stream.written_bits, stream.buffer, input_params, predictor_params, encoder_params);
+	result = flush_stream(&stream);
+
+	if (result == 0)
+	{
+		reader_started = pthread_create(&reader, NULL, pipeline_reader, &pipeline) == 0;
+		encoder_started = reader_started && pthread_create(&encoder, NULL, pipeline_encoder, &pipeline) == 0;
+		if (encoder_started)
+		{
+			if (encoder_params.out_interleaving == BI)
+				result = pipeline_predict_lines(&pipeline, arena);
+			else
+				result = pipeline_predict_bands(&pipeline, arena);
+		}
+		else
+		{
+			log_error(CCSDS_ERROR_INTERNAL, "Error in starting the threads of the pipelined compression\n\n");
+			result = -1;
+		}
+		if (result != 0)
+			cancel_pipeline(&pipeline);
+		if (reader_started)
+			pthread_join(reader, NULL);
+		if (encoder_started)
+			pthread_join(encoder, NULL);
+	}
+
+	// The errors of the other threads have been reported to the log callback already
+	if (result == 0)
+	{
+		status = pipeline.reader_status != CCSDS_OK ? pipeline.reader_status : pipeline.encoder_status;
+		if (status != CCSDS_OK)
+		{
+			log_error(status, "Error in the %s thread of the pipelined compression\n\n", pipeline.reader_status != CCSDS_OK ? "reader" : "encoder");
+			result = -1;
+		}
+	}
+	io_close(&pipeline.inFile);
+	if (io_close(&outFile) != 0 && result == 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in writing the compressed stream to %s\n\n", outputFile);
+		result = -1;
+	}
+	arena_rewind(arena, mark);
+	if (result != 0)
+		return -1;
+	return (long long)stream.flushed_bytes;
+}
@@ -0,0 +1,539 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "pipelined_decoder.h"
+#include "ring_buffer.h"
+#include "decoder.h"
+#include "unpredict.h"
+
+// Number of chunks (lines or bands) a stage of the pipelined decompression can run ahead of the next one
+#define PIPELINE_DEPTH 4
+
+/// Pipelined decompression: the residuals are decoded by the decoder thread, unpredicted by the calling
+/// thread and the samples written by the writer thread; the chunks (lines with BI streams, bands with
+/// BSQ streams) are passed from a stage to the next one through bounded single producer, single consumer
+/// queues
+typedef struct decoding_pipeline
+{
+	// the image being decompressed, the first bands of the one of the stream when only some are requested
+	input_feature_t input_params;
+	input_feature_t stream_params;
+	predictor_config_t predictor_params;
+	encoder_config_t encoder_params;
+	FILE *inFile;
+	io_file_t inStream;
+	decoder_state_t state;
+	// scratch of the decoder for the BI stream
+	unsigned short int *raw_chunk;
+	// chunks of residuals, from the decoder to the unpredictor, and of samples, from the unpredictor to
+	// the writer; the unpredictor also reads back the samples of the previous chunks it wrote
+	ring_buffer_t residuals;
+	ring_buffer_t samples;
+	io_file_t outFile;
+	// scratch of the writer: the line in the order of the BI output file and the formatted samples
+	unsigned short int *raw_line;
+	unsigned char *formatted;
+	unsigned char *formatted_group;
+	log_callback_t log_callback;
+	void *log_user_data;
+	ccsds_status_t decoder_status;
+	ccsds_status_t writer_status;
+} decoding_pipeline_t;
+
+/// Number of chunks the image is split into
+static unsigned int pipeline_chunks(const decoding_pipeline_t *pipeline)
+{
+	return pipeline->encoder_params.out_interleaving == BI ? pipeline->input_params.y_size : pipeline->input_params.z_size;
+}
+
+/// Number of samples of a chunk: a line with BI streams, a band with BSQ streams
+static size_t pipeline_chunk_samples(input_feature_t input_params, encoder_config_t encoder_params)
+{
+	if (encoder_params.out_interleaving == BI)
+		return (size_t)input_params.x_size * input_params.z_size;
+	return (size_t)input_params.x_size * input_params.y_size;
+}
+
+/// Number of slots of the queue of the samples: the chunks read back by the unpredictor and the ones
+/// waiting to be written
+static size_t pipeline_sample_slots(predictor_config_t predictor_params, encoder_config_t encoder_params)
+{
+	if (encoder_params.out_interleaving == BI)
+		return 2 + PIPELINE_DEPTH;
+	return (size_t)predictor_params.pred_bands + 1 + PIPELINE_DEPTH;
+}
+
+/// Number of bands of the interleaving group of the output file band z belongs to, with a band chunk
+static unsigned int output_group_width(input_feature_t input_params, unsigned int z)
+{
+	unsigned int first_band = z - z % input_params.in_interleaving_depth;
+	return MIN(input_params.in_interleaving_depth, input_params.z_size - first_band);
+}
+
+/// Stops all the stages, after an error in one of them
+static void cancel_pipeline(decoding_pipeline_t *pipeline)
+{
+	ring_cancel(&pipeline->residuals);
+	ring_cancel(&pipeline->samples);
+}
+
+/// Returns the number of bytes of memory used by the pipeline for the given image and configuration
+static size_t pipeline_working_set(input_feature_t input_params, predictor_config_t predictor_params, encoder_config_t encoder_params)
+{
+	const size_t x_size = input_params.x_size;
+	size_t chunk_samples = pipeline_chunk_samples(input_params, encoder_params);
+	size_t chunk_bytes = sizeof(unsigned short int) * chunk_samples;
+	size_t weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+	size_t window = predictor_params.pred_bands + 1;
+	size_t arrays_per_row = predictor_params.full != 0 ? 5 : 2;
+	size_t bytes = ring_size(chunk_bytes, PIPELINE_DEPTH) + ring_size(chunk_bytes, pipeline_sample_slots(predictor_params, encoder_params));
+
+	if (weights_len == 0)
+		weights_len = 1;
+	bytes += decoder_state_size(input_params);
+	// local differences of the window
+	bytes += sizeof(int) * x_size * window * arrays_per_row + (sizeof(row_differences_t) + sizeof(row_differences_t *)) * window;
+	bytes += OUTPUT_SAMPLE_BYTES(input_params) * chunk_samples;
+	if (encoder_params.out_interleaving == BI)
+	{
+		// the (0, 0) samples and the weights of every band
+		bytes += (sizeof(unsigned short int) + sizeof(int) * weights_len) * input_params.z_size;
+		bytes += chunk_bytes;
+		if (input_params.in_interleaving == BI)
+			bytes += chunk_bytes;
+	}
+	else
+	{
+		bytes += sizeof(unsigned short int *) * window + sizeof(int) * weights_len;
+		if (input_params.in_interleaving == BI)
+			bytes += OUTPUT_SAMPLE_BYTES(input_params) * x_size * MIN(input_params.in_interleaving_depth, input_params.z_size);
+	}
+	return bytes;
+}
+
+/// Decoder stage: decodes the residuals of the lines or of the bands in the order of the stream
+static void *pipeline_decoder(void *argument)
+{
+	decoding_pipeline_t *pipeline = (decoding_pipeline_t *)argument;
+	const input_feature_t input_params = pipeline->input_params;
+	const encoder_config_t encoder_params = pipeline->encoder_params;
+	const size_t chunk_samples = pipeline_chunk_samples(input_params, encoder_params);
+	const input_feature_t stream_params = pipeline->stream_params;
+	log_context_t log_context;
+	unsigned int chunk = 0;
+	int result = 0;
+
+	log_begin(&log_context, pipeline->log_callback, pipeline->log_user_data);
+	for (chunk = 0; chunk < pipeline_chunks(pipeline) && result == 0; chunk++)
+	{
+		unsigned short int *residuals = (unsigned short int *)ring_acquire_write(&pipeline->residuals);
+		// a NULL slot means that another stage failed
+		if (residuals == NULL)
+			break;
+		if (encoder_params.out_interleaving == BI)
+		{
+			result = decode_residuals(pipeline->inFile, stream_params, encoder_params, &pipeline->state, pipeline->raw_chunk, chunk_samples);
+			if (result == 0)
+				deinterleave_line(pipeline->raw_chunk, residuals, input_params.x_size, input_params.z_size, encoder_params.out_interleaving_depth);
+		}
+		else
+		{
+			result = decode_residuals(pipeline->inFile, stream_params, encoder_params, &pipeline->state, residuals, chunk_samples);
+		}
+		if (result == 0)
+			ring_commit_write(&pipeline->residuals);
+	}
+	if (result != 0)
+		cancel_pipeline(pipeline);
+	pipeline->decoder_status = log_end(&log_context, result);
+	return NULL;
+}
+
+/// Writes count formatted samples in the output file, starting from the sample with the given index (in
+/// the order of the file)
+static int write_output_samples(decoding_pipeline_t *pipeline, size_t index, const unsigned char *formatted, size_t count)
+{
+	const unsigned int sample_bytes = OUTPUT_SAMPLE_BYTES(pipeline->input_params);
+
+	if (io_write(&pipeline->outFile, (unsigned long long)index * sample_bytes, formatted, count * sample_bytes) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in writing the uncompressed samples to the output file\n");
+		return -1;
+	}
+	return 0;
+}
+
+/// Writes the line y (row y of band z at line + z * x_size): it is contiguous in a BI file, while in a BSQ
+/// file each of its rows is written to its band
+static int write_line(decoding_pipeline_t *pipeline, unsigned int y, const unsigned short int *line)
+{
+	const input_feature_t input_params = pipeline->input_params;
+	const size_t line_samples = (size_t)input_params.x_size * input_params.z_size;
+	const unsigned int sample_bytes = OUTPUT_SAMPLE_BYTES(input_params);
+	unsigned int s_mid = 0x1 << (input_params.dyn_range - 1);
+	unsigned int z = 0;
+
+	if (input_params.in_interleaving == BI)
+	{
+		// the lines are written in the order of the file
+		interleave_line(line, pipeline->raw_line, input_params.x_size, input_params.z_size, input_params.in_interleaving_depth);
+		format_samples(input_params, pipeline->raw_line, line_samples, s_mid, pipeline->formatted);
+		return write_output_samples(pipeline, (size_t)y * line_samples, pipeline->formatted, line_samples);
+	}
+	format_samples(input_params, line, line_samples, s_mid, pipeline->formatted);
+	for (z = 0; z < input_params.z_size; z++)
+	{
+		if (write_output_samples(pipeline, BSQ_OFFSET(input_params, 0, y, z), pipeline->formatted + (size_t)z * input_params.x_size * sample_bytes,
+				input_params.x_size) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+/// Writes the band z: it is contiguous in a BSQ file, while in a BI file every row is interleaved with the
+/// ones of the other bands of its group; the row y of the group is read back, unless the band is the first
+/// one of the group, and written again with the row of the band
+static int write_band(decoding_pipeline_t *pipeline, unsigned int z, const unsigned short int *band)
+{
+	const input_feature_t input_params = pipeline->input_params;
+	const size_t x_size = input_params.x_size;
+	const unsigned int sample_bytes = OUTPUT_SAMPLE_BYTES(input_params);
+	unsigned int s_mid = 0x1 << (input_params.dyn_range - 1);
+	unsigned int first_band = 0, width = 0;
+	unsigned int x = 0, y = 0;
+
+	format_samples(input_params, band, x_size * input_params.y_size, s_mid, pipeline->formatted);
+	if (input_params.in_interleaving == BSQ)
+		return write_output_samples(pipeline, BSQ_OFFSET(input_params, 0, 0, z), pipeline->formatted, x_size * input_params.y_size);
+	first_band = z - z % input_params.in_interleaving_depth;
+	width = output_group_width(input_params, z);
+	for (y = 0; y < input_params.y_size; y++)
+	{
+		const unsigned char *row = pipeline->formatted + y * x_size * sample_bytes;
+		size_t group_start = ((size_t)y * input_params.z_size + first_band) * x_size;
+		if (z == first_band)
+		{
+			memset(pipeline->formatted_group, 0, x_size * width * sample_bytes);
+		}
+		else if (io_read(&pipeline->outFile, (unsigned long long)group_start * sample_bytes, pipeline->formatted_group, x_size * width * sample_bytes) !=
+				(long long)(x_size * width * sample_bytes))
+		{
+			log_error(CCSDS_ERROR_IO, "Error in reading back the output file\n");
+			return -1;
+		}
+		for (x = 0; x < x_size; x++)
+		{
+			memcpy(pipeline->formatted_group + (x * width + z - first_band) * sample_bytes, row + x * sample_bytes, sample_bytes);
+		}
+		if (write_output_samples(pipeline, group_start, pipeline->formatted_group, x_size * width) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+/// Writer stage: formats the samples of every chunk and writes them to the output file
+static void *pipeline_writer(void *argument)
+{
+	decoding_pipeline_t *pipeline = (decoding_pipeline_t *)argument;
+	log_context_t log_context;
+	unsigned int chunk = 0;
+	int result = 0;
+
+	log_begin(&log_context, pipeline->log_callback, pipeline->log_user_data);
+	for (chunk = 0; chunk < pipeline_chunks(pipeline) && result == 0; chunk++)
+	{
+		const unsigned short int *samples = (const unsigned short int *)ring_acquire_read(&pipeline->samples);
+		if (samples == NULL)
+			break;
+		if (pipeline->encoder_params.out_interleaving == BI)
+			result = write_line(pipeline, chunk, samples);
+		else
+			result = write_band(pipeline, chunk, samples);
+		ring_release_read(&pipeline->samples);
+	}
+	if (result != 0)
+		cancel_pipeline(pipeline);
+	pipeline->writer_status = log_end(&log_context, result);
+	return NULL;
+}
+
+/// Unpredictor stage, BI stream: every line is reconstructed from the previous one, which is read back
+/// from the queue of the samples
+/// @return 0 when all the lines have been reconstructed or when another stage failed, a negative value
+/// in case of error
+static int pipeline_unpredict_lines(decoding_pipeline_t *pipeline, arena_t *arena)
+{
+	const input_feature_t input_params = pipeline->input_params;
+	const predictor_config_t predictor_params = pipeline->predictor_params;
+	const size_t x_size = input_params.x_size;
+	int weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+	unsigned int window = predictor_params.pred_bands + 1;
+	unsigned int arrays_per_row = predictor_params.full != 0 ? 5 : 2;
+	const unsigned short int *prev_line = NULL;
+	unsigned short int *origins = NULL;
+	int *weights = NULL;
+	int *differences_buffer = NULL;
+	row_differences_t *window_differences = NULL;
+	row_differences_t **band_differences = NULL;
+	unsigned int y = 0, z = 0, i = 0;
+
+	origins = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * input_params.z_size);
+	weights = (int *)arena_alloc(arena, sizeof(int) * (weights_len > 0 ? weights_len : 1) * input_params.z_size);
+	differences_buffer = (int *)arena_alloc(arena, sizeof(int) * x_size * window * arrays_per_row);
+	window_differences = (row_differences_t *)arena_alloc(arena, sizeof(row_differences_t) * window);
+	band_differences = (row_differences_t **)arena_alloc(arena, sizeof(row_differences_t *) * window);
+	if (origins == NULL || weights == NULL || differences_buffer == NULL || window_differences == NULL || band_differences == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the lines buffers of the pipelined decompression\n\n");
+		return -1;
+	}
+	init_differences_window(predictor_params, input_params.x_size, window, differences_buffer, window_differences);
+
+	for (y = 0; y < input_params.y_size; y++)
+	{
+		const unsigned short int *residual_line = (const unsigned short int *)ring_acquire_read(&pipeline->residuals);
+		unsigned short int *line = (unsigned short int *)ring_acquire_write(&pipeline->samples);
+		if (residual_line == NULL || line == NULL)
+			return 0;
+		for (z = 0; z < input_params.z_size; z++)
+		{
+			unsigned int cur_pred_bands = z < predictor_params.pred_bands ? z : predictor_params.pred_bands;
+			for (i = 0; i <= cur_pred_bands; i++)
+			{
+				band_differences[i] = &window_differences[(z - i) % window];
+			}
+			unpredict_row(input_params, predictor_params, y, z, line + z * x_size, y > 0 ? prev_line + z * x_size : NULL,
+					z > 0 ? origins[z - 1] : 0, band_differences, weights + z * weights_len, residual_line + z * x_size);
+			if (y == 0)
+				origins[z] = line[z * x_size];
+		}
+		ring_commit_write(&pipeline->samples);
+		ring_release_read(&pipeline->residuals);
+		// the slot of the line is not written again before the next line has been reconstructed
+		prev_line = line;
+	}
+	return 0;
+}
+
+/// Unpredictor stage, BSQ stream: every band is reconstructed from the P-band window, whose bands are read
+/// back from the queue of the samples; the local differences of the previous bands are computed again for
+/// every row
+/// @return 0 when all the bands have been reconstructed or when another stage failed, a negative value
+/// in case of error
+static int pipeline_unpredict_bands(decoding_pipeline_t *pipeline, arena_t *arena)
+{
+	const input_feature_t input_params = pipeline->input_params;
+	const predictor_config_t predictor_params = pipeline->predictor_params;
+	const size_t x_size = input_params.x_size;
+	int weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+	unsigned int window = predictor_params.pred_bands + 1;
+	unsigned int arrays_per_row = predictor_params.full != 0 ? 5 : 2;
+	unsigned short int **bands = NULL;
+	unsigned short int prev_band_origin = 0;
+	int *weights = NULL;
+	int *differences_buffer = NULL;
+	row_differences_t *window_differences = NULL;
+	row_differences_t **band_differences = NULL;
+	unsigned int y = 0, z = 0, i = 0;
+
+	bands = (unsigned short int **)arena_alloc(arena, sizeof(unsigned short int *) * window);
+	weights = (int *)arena_alloc(arena, sizeof(int) * (weights_len > 0 ? weights_len : 1));
+	differences_buffer = (int *)arena_alloc(arena, sizeof(int) * x_size * window * arrays_per_row);
+	window_differences = (row_differences_t *)arena_alloc(arena, sizeof(row_differences_t) * window);
+	band_differences = (row_differences_t **)arena_alloc(arena, sizeof(row_differences_t *) * window);
+	if (bands == NULL || weights == NULL || differences_buffer == NULL || window_differences == NULL || band_differences == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the bands buffers of the pipelined decompression\n\n");
+		return -1;
+	}
+	init_differences_window(predictor_params, input_params.x_size, window, differences_buffer, window_differences);
+
+	for (z = 0; z < input_params.z_size; z++)
+	{
+		unsigned int cur_pred_bands = z < predictor_params.pred_bands ? z : predictor_params.pred_bands;
+		const unsigned short int *residual_band = (const unsigned short int *)ring_acquire_read(&pipeline->residuals);
+		unsigned short int *band = (unsigned short int *)ring_acquire_write(&pipeline->samples);
+		if (residual_band == NULL || band == NULL)
+			return 0;
+		bands[z % window] = band;
+		for (y = 0; y < input_params.y_size; y++)
+		{
+			band_differences[0] = &window_differences[0];
+			for (i = 1; i <= cur_pred_bands; i++)
+			{
+				const unsigned short int *row = bands[(z - i) % window] + y * x_size;
+				compute_row_differences(input_params, predictor_params, y, row, y > 0 ? row - x_size : NULL, &window_differences[i]);
+				band_differences[i] = &window_differences[i];
+			}
+			unpredict_row(input_params, predictor_params, y, z, band + y * x_size, y > 0 ? band + (y - 1) * x_size : NULL,
+					prev_band_origin, band_differences, weights, residual_band + y * x_size);
+		}
+		ring_commit_write(&pipeline->samples);
+		ring_release_read(&pipeline->residuals);
+		prev_band_origin = band[0];
+	}
+	return 0;
+}
+
+/// Decompresses the stream in inputFile into outputFile with three threads: the decoder, the unpredictor
+/// (the calling thread) and the writer; with num_bands only the first num_bands bands of a BSQ stream are
+/// decoded and written.
+int decompress_pipelined(char inputFile[128], char outputFile[128], input_feature_t *input_params,
+		predictor_config_t *predictor_params, unsigned int num_bands, io_backend_t backend, size_t memory_budget, arena_t *arena)
+{
+	decoding_pipeline_t pipeline;
+	encoder_config_t encoder_params;
+	input_feature_t output_params;
+	size_t chunk_bytes = 0;
+	size_t working_set = 0;
+	pthread_t decoder, writer;
+	int decoder_started = 0, writer_started = 0;
+	int result = 0;
+	ccsds_status_t status = CCSDS_OK;
+	arena_mark_t mark = arena_get_mark(arena);
+	arena_mark_t buffers_mark;
+
+	memset(&pipeline, 0, sizeof(decoding_pipeline_t));
+	memset(&encoder_params, 0, sizeof(encoder_config_t));
+	if ((pipeline.inFile = io_open_stream(&pipeline.inStream, backend, inputFile)) == NULL)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in opening file %s containing the compressed stream\n", inputFile);
+		return -1;
+	}
+	// the tables of the header are kept until the end of the decompression
+	predictor_params->weight_init_table = NULL;
+	if (read_header(pipeline.inFile, input_params, &encoder_params, predictor_params, arena) != 0 || check_image_size(*input_params) != 0)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error in reading the header of the compressed stream\n");
+		io_close_stream(&pipeline.inStream, pipeline.inFile);
+		arena_rewind(arena, mark);
+		return -1;
+	}
+	if (num_bands != 0 && (encoder_params.out_interleaving != BSQ || num_bands > input_params->z_size))
+	{
+		log_error(CCSDS_ERROR_CONFIG, "Error, the first %u bands cannot be decoded alone from a %s stream of %u bands\n", num_bands,
+				encoder_params.out_interleaving == BSQ ? "BSQ" : "BI", input_params->z_size);
+		io_close_stream(&pipeline.inStream, pipeline.inFile);
+		arena_rewind(arena, mark);
+		return -1;
+	}
+	// the bands of a BSQ stream follow each other, so the decoder stops after the last requested one; it
+	// still keeps the statistics of all the bands of the stream
+	output_params = *input_params;
+	if (num_bands != 0)
+		output_params.z_size = num_bands;
+	working_set = pipeline_working_set(output_params, *predictor_params, encoder_params) + decoder_state_size(*input_params) -
+			decoder_state_size(output_params);
+	if (memory_budget != 0 && working_set > memory_budget)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "\nError, the decompression needs %zu bytes of memory, more than the budget of %zu bytes\n\n", working_set, memory_budget);
+		io_close_stream(&pipeline.inStream, pipeline.inFile);
+		arena_rewind(arena, mark);
+		return -1;
+	}
+	log_info("Decompression engine: pipelined, estimated peak memory %zu bytes (%.2lf kb)\n", working_set, ((double)working_set) / 1024.0);
+	pipeline.input_params = output_params;
+	pipeline.stream_params = *input_params;
+	pipeline.predictor_params = *predictor_params;
+	pipeline.encoder_params = encoder_params;
+	log_current_callback(&pipeline.log_callback, &pipeline.log_user_data);
+	buffers_mark = arena_get_mark(arena);
+
+	// Everything used by the threads is allocated up front, as the arena is not shared among them; the
+	// slots of the samples are zeroed as the central difference of a sample is computed (and then corrected)
+	// before the sample is extracted
+	chunk_bytes = sizeof(unsigned short int) * pipeline_chunk_samples(output_params, encoder_params);
+	if (ring_init(&pipeline.residuals, chunk_bytes, PIPELINE_DEPTH, arena) != 0 ||
+			ring_init(&pipeline.samples, chunk_bytes, pipeline_sample_slots(*predictor_params, encoder_params), arena) != 0)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the queues of the pipelined decompression\n\n");
+		io_close_stream(&pipeline.inStream, pipeline.inFile);
+		arena_rewind(arena, mark);
+		return -1;
+	}
+	memset(pipeline.samples.slots, 0, ring_size(chunk_bytes, pipeline_sample_slots(*predictor_params, encoder_params)));
+	pipeline.formatted = (unsigned char *)arena_alloc(arena, OUTPUT_SAMPLE_BYTES(output_params) * pipeline_chunk_samples(output_params, encoder_params));
+	if (encoder_params.out_interleaving == BI)
+	{
+		pipeline.raw_chunk = (unsigned short int *)arena_alloc(arena, chunk_bytes);
+		if (output_params.in_interleaving == BI)
+			pipeline.raw_line = (unsigned short int *)arena_alloc(arena, chunk_bytes);
+	}
+	else if (output_params.in_interleaving == BI)
+	{
+		pipeline.formatted_group = (unsigned char *)arena_alloc(arena, OUTPUT_SAMPLE_BYTES(output_params) * output_params.x_size *
+				MIN(output_params.in_interleaving_depth, output_params.z_size));
+	}
+	if (pipeline.formatted == NULL || (encoder_params.out_interleaving == BI && pipeline.raw_chunk == NULL) ||
+			(encoder_params.out_interleaving == BI && output_params.in_interleaving == BI && pipeline.raw_line == NULL) ||
+			(encoder_params.out_interleaving == BSQ && output_params.in_interleaving == BI && pipeline.formatted_group == NULL))
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the buffers of the pipelined decompression\n\n");
+		io_close_stream(&pipeline.inStream, pipeline.inFile);
+		arena_rewind(arena, mark);
+		return -1;
+	}
+	if (init_decoder_state(*input_params, encoder_params, &pipeline.state, arena) != 0)
+	{
+		io_close_stream(&pipeline.inStream, pipeline.inFile);
+		arena_rewind(arena, mark);
+		return -1;
+	}
+	// the bands of a BI file are read back while they are written
+	if (io_open(&pipeline.outFile, backend, outputFile, IO_WRITE) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in opening output file %s\n\n", outputFile);
+		io_close_stream(&pipeline.inStream, pipeline.inFile);
+		arena_rewind(arena, mark);
+		return -1;
+	}
+
+	decoder_started = pthread_create(&decoder, NULL, pipeline_decoder, &pipeline) == 0;
+	writer_started = decoder_started && pthread_create(&writer, NULL, pipeline_writer, &pipeline) == 0;
+	if (writer_started)
+	{
+		if (encoder_params.out_interleaving == BI)
+			result = pipeline_unpredict_lines(&pipeline, arena);
+		else
+			result = pipeline_unpredict_bands(&pipeline, arena);
+	}
+	else
+	{
+		log_error(CCSDS_ERROR_INTERNAL, "Error in starting the threads of the pipelined decompression\n\n");
+		result = -1;
+	}
+	if (result != 0)
+		cancel_pipeline(&pipeline);
+	if (decoder_started)
+		pthread_join(decoder, NULL);
+	if (writer_started)
+		pthread_join(writer, NULL);
+
+	// The errors of the other threads have been reported to the log callback already
+	if (result == 0)
+	{
+		status = pipeline.decoder_status != CCSDS_OK ? pipeline.decoder_status : pipeline.writer_status;
+		if (status != CCSDS_OK)
+		{
+			log_error(status, "Error in the %s thread of the pipelined decompression\n\n", pipeline.decoder_status != CCSDS_OK ? "decoder" : "writer");
+			result = -1;
+		}
+	}
+	io_close_stream(&pipeline.inStream, pipeline.inFile);
+	if (io_close(&pipeline.outFile) != 0 && result == 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in writing the uncompressed samples to %s\n\n", outputFile);
+		result = -1;
+	}
+	if (result != 0)
+	{
+		arena_rewind(arena, mark);
+		predictor_params->weight_init_table = NULL;
+		return -1;
+	}
+	// only the tables of the header are kept
+	arena_rewind(arena, buffers_mark);
+	return 0;
+}
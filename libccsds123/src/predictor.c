@@ -41,639 +41,606 @@
 
 #include "utils.h"
 #include "predictor.h"
+#include "simd.h"
 
-/// Computes the local sum for the given sample index
-int local_sum(input_feature_t input_params, predictor_config_t predictor_params,
-		unsigned int x, unsigned int y, unsigned int z, unsigned short int *samples)
+/// Computes the local sum and the local differences of the sample in column x of the
+/// row; used for the row borders, when no SIMD support is present and by the
+/// decompressor, which reconstructs the row one sample at a time.
+void compute_sample_differences(input_feature_t input_params, predictor_config_t predictor_params, unsigned int y, unsigned int x,
+		const unsigned short int *cur_row, const unsigned short int *prev_row, row_differences_t *differences)
 {
-	unsigned int sum = 0;
+	int sum = 0;
 
-#ifndef NDEBUG
 	if (x == 0 && y == 0)
 	{
-		fprintf(stderr, "Error, called local_sum for band %d with x=0, y=0\n\n", z);
-		return 0x80000000;
+		differences->local_sum[0] = 0;
+		differences->central[0] = 0;
+		if (predictor_params.full != 0)
+		{
+			differences->north[0] = 0;
+			differences->west[0] = 0;
+			differences->north_west[0] = 0;
+		}
+		return;
 	}
-#endif
 
-	if (predictor_params.neighbour_sum != 0)
+	if (y == 0)
+	{
+		sum = 4 * cur_row[x - 1];
+	}
+	else if (predictor_params.neighbour_sum == 0)
+	{
+		sum = 4 * prev_row[x];
+	}
+	else if (x > 0)
+	{
+		sum = cur_row[x - 1] + prev_row[x] + prev_row[x - 1];
+		if (x < (input_params.x_size - 1))
+			sum += prev_row[x + 1];
+		else
+			sum += prev_row[x];
+	}
+	else if (input_params.x_size > 1)
+	{
+		sum = 2 * prev_row[x] + 2 * prev_row[x + 1];
+	}
+	else
+	{
+		sum = 4 * prev_row[x];
+	}
+	differences->local_sum[x] = sum;
+	differences->central[x] = 4 * cur_row[x] - sum;
+
+	if (predictor_params.full != 0)
 	{
 		if (y > 0)
 		{
+			differences->north[x] = 4 * prev_row[x] - sum;
 			if (x > 0)
 			{
-				sum += MATRIX_BSQ_INDEX(samples, input_params, x - 1, y, z) +
-					MATRIX_BSQ_INDEX(samples, input_params, x, y - 1, z) + MATRIX_BSQ_INDEX(samples, input_params, x - 1, y - 1, z);
-				if (x < (input_params.x_size - 1))
-					sum += MATRIX_BSQ_INDEX(samples, input_params, x + 1, y - 1, z);
-				else
-					sum += MATRIX_BSQ_INDEX(samples, input_params, x, y - 1, z);
+				differences->west[x] = 4 * cur_row[x - 1] - sum;
+				differences->north_west[x] = 4 * prev_row[x - 1] - sum;
 			}
 			else
 			{
-				sum += 2 * MATRIX_BSQ_INDEX(samples, input_params, x, y - 1, z) + 2 * MATRIX_BSQ_INDEX(samples, input_params, x + 1, y - 1, z);
+				differences->west[x] = differences->north[x];
+				differences->north_west[x] = differences->north[x];
 			}
 		}
 		else
 		{
-			sum += 4 * MATRIX_BSQ_INDEX(samples, input_params, x - 1, y, z);
+			differences->north[x] = 0;
+			differences->west[x] = 0;
+			differences->north_west[x] = 0;
 		}
 	}
-	else
+}
+
+/// Sets up the rows of local sums and differences of the P-band window over buffer, which has to hold
+/// window * (2 or 5) rows of x_size elements
+void init_differences_window(predictor_config_t predictor_params, unsigned int x_size, unsigned int window,
+		int *buffer, row_differences_t *window_differences)
+{
+	unsigned int arrays_per_row = predictor_params.full != 0 ? 5 : 2;
+	unsigned int i = 0;
+	for (i = 0; i < window; i++)
 	{
-		if (y > 0)
-			sum = 4 * MATRIX_BSQ_INDEX(samples, input_params, x, y - 1, z);
-		else
-			sum = 4 * MATRIX_BSQ_INDEX(samples, input_params, x - 1, y, z);
+		int *row_base = buffer + (size_t)i * arrays_per_row * x_size;
+		window_differences[i].local_sum = row_base;
+		window_differences[i].central = row_base + x_size;
+		window_differences[i].north = NULL;
+		window_differences[i].west = NULL;
+		window_differences[i].north_west = NULL;
+		if (predictor_params.full != 0)
+		{
+			window_differences[i].north = row_base + 2 * x_size;
+			window_differences[i].west = row_base + 3 * x_size;
+			window_differences[i].north_west = row_base + 4 * x_size;
+		}
 	}
-
-	return sum;
 }
 
-#ifdef NO_COMPUTE_LOCAL
-int get_central_difference(input_feature_t input_params, predictor_config_t predictor_params,
-		int *central_difference, unsigned short int *samples, unsigned int x, unsigned int y, unsigned int z)
+/// Computes the local sums and the local differences of the whole row y of a band at once;
+/// cur_row points to row y of the band and prev_row to row y - 1 (ignored when y == 0).
+/// The interior of the row is processed with SIMD instructions when available
+void compute_row_differences(input_feature_t input_params, predictor_config_t predictor_params, unsigned int y,
+		const unsigned short int *cur_row, const unsigned short int *prev_row, row_differences_t *differences)
 {
+	unsigned int x = 0;
+	// The first column and, with the neighbour oriented sum, the last one use a different
+	// set of neighbours: they are left to the scalar code
+	unsigned int interior_end = (y > 0 && predictor_params.neighbour_sum != 0) ? input_params.x_size - 1 : input_params.x_size;
 
-	// Central difference computed: it is common both to reduced and
-	// full prediction mode
-	if (y == 0 && x == 0)
-	{
-		*central_difference = 0;
-	}
-	else
+	compute_sample_differences(input_params, predictor_params, y, 0, cur_row, prev_row, differences);
+	x = 1;
+
+#ifdef ROW_LANES
+	for (; x + ROW_LANES <= interior_end; x += ROW_LANES)
 	{
-		int local_sum_temp = local_sum(input_params, predictor_params, x, y, z, samples);
-#ifndef NDEBUG
-		if (local_sum_temp == 0x80000000)
+		row_vector_t current = row_load_samples(cur_row + x);
+		row_vector_t west = row_load_samples(cur_row + x - 1);
+		row_vector_t sum;
+		if (y == 0)
 		{
-			return -1;
+			sum = row_times4(west);
+			row_store(differences->local_sum + x, sum);
+			row_store(differences->central + x, row_sub(row_times4(current), sum));
+			if (predictor_params.full != 0)
+			{
+				row_store(differences->north + x, row_zero());
+				row_store(differences->west + x, row_zero());
+				row_store(differences->north_west + x, row_zero());
+			}
+		}
+		else
+		{
+			row_vector_t north = row_load_samples(prev_row + x);
+			row_vector_t north_west = row_load_samples(prev_row + x - 1);
+			if (predictor_params.neighbour_sum != 0)
+				sum = row_add(row_add(west, north), row_add(north_west, row_load_samples(prev_row + x + 1)));
+			else
+				sum = row_times4(north);
+			row_store(differences->local_sum + x, sum);
+			row_store(differences->central + x, row_sub(row_times4(current), sum));
+			if (predictor_params.full != 0)
+			{
+				row_store(differences->north + x, row_sub(row_times4(north), sum));
+				row_store(differences->west + x, row_sub(row_times4(west), sum));
+				row_store(differences->north_west + x, row_sub(row_times4(north_west), sum));
+			}
 		}
-#endif
-		*central_difference = 4 * MATRIX_BSQ_INDEX(samples, input_params, x, y, z) - local_sum_temp;
 	}
+#endif
 
-	return 0;
+	for (; x < input_params.x_size; x++)
+	{
+		compute_sample_differences(input_params, predictor_params, y, x, cur_row, prev_row, differences);
+	}
 }
 
-int get_directional_difference(input_feature_t input_params, predictor_config_t predictor_params,
-		int directional_difference[3], unsigned short int *samples, unsigned int x, unsigned int y, unsigned int z)
+/// Given the sample and its scaled predicted value it maps the prediction residual
+/// to an unsigned value enabling it to be represented with D bits
+unsigned short int compute_mapped_residual(unsigned short int sample, int scaled_predicted, unsigned int s_min, unsigned int s_max)
 {
-	int local_sum_temp = local_sum(input_params, predictor_params, x, y, z, samples);
+	unsigned short int mapped = 0;
+	int delta = ((int)sample) - scaled_predicted / 2;
+	unsigned int omega = scaled_predicted / 2 - s_min;
+	unsigned int abs_delta = delta < 0 ? (-1 * delta) : delta;
+	int sign_scaled = (scaled_predicted & 0x1) != 0 ? -1 : 1;
 
-#ifndef NDEBUG
-	if (local_sum_temp == 0x80000000)
+	if (omega > s_max - scaled_predicted / 2)
 	{
-		return -1;
+		omega = s_max - scaled_predicted / 2;
 	}
-	if (predictor_params.full == 0)
+
+	if (abs_delta > omega)
 	{
-		fprintf(stderr, "Error: directional differences asked, but full prediction mode disabled.\n");
-		return -1;
+		mapped = abs_delta + omega;
 	}
-#endif
-
-	//full prediction mode, the differences in the directional_difference vector are
-	//in this order: central, north, west, north-west
-	if (y > 0)
+	else if ((sign_scaled * delta) <= omega && (sign_scaled * delta) >= 0)
 	{
-		directional_difference[0] = 4 * MATRIX_BSQ_INDEX(samples, input_params, x, y - 1, z) - local_sum_temp;
-		if (x > 0)
-		{
-			directional_difference[1] = 4 * MATRIX_BSQ_INDEX(samples, input_params, x - 1, y, z) - local_sum_temp;
-			directional_difference[2] = 4 * MATRIX_BSQ_INDEX(samples, input_params, x - 1, y - 1, z) - local_sum_temp;
-		}
-		else
-		{
-			directional_difference[1] = directional_difference[0];
-			directional_difference[2] = directional_difference[0];
-		}
+		mapped = 2 * abs_delta;
 	}
 	else
 	{
-		directional_difference[0] = 0;
-		directional_difference[1] = 0;
-		directional_difference[2] = 0;
+		mapped = 2 * abs_delta - 1;
 	}
 
-	return 0;
+	return mapped;
 }
 
-#endif
-
-#ifndef NO_COMPUTE_LOCAL
-/// Computes the local differences for the whole image and saves them in the local_differences
-/// array; note that the image input to this procedure is assumed to be in BSQ format
-int compute_local_differences(input_feature_t input_params, predictor_config_t predictor_params,
-		int ***local_differences, unsigned short int *samples)
+/// Maps a whole row of samples given their scaled predicted values, as compute_mapped_residual
+/// does for a single sample; the omega clamp and the three-way mapping are computed
+/// with blends instead of branches, on ROW_LANES samples at a time when SIMD is available
+void compute_mapped_residual_row(const unsigned short int *samples, const int *scaled_predicted, unsigned short int *residuals,
+		unsigned int length, unsigned int s_min, unsigned int s_max)
 {
-	unsigned int x = 0, y = 0, z = 0;
-
-	// First I have to allocate the memory to hold the result
-	if (predictor_params.full != 0)
-		*local_differences = (int **)malloc(sizeof(int) * 4);
-	else
-		*local_differences = (int **)malloc(sizeof(int));
-	if (*local_differences == NULL)
+	unsigned int x = 0;
+#ifdef ROW_LANES
+	row_vector_t zero = row_zero();
+	row_vector_t one = row_set(1);
+	row_vector_t min_value = row_set(s_min);
+	row_vector_t max_value = row_set(s_max);
+
+	for (; x + ROW_LANES <= length; x += ROW_LANES)
 	{
-		fprintf(stderr, "Error in allocating memory for building the local differences matrices\n");
-		return -1;
+		row_vector_t scaled = row_load(scaled_predicted + x);
+		row_vector_t predicted = row_half(scaled);
+		row_vector_t delta = row_sub(row_load_samples(samples + x), predicted);
+		row_vector_t omega_low = row_sub(predicted, min_value);
+		row_vector_t omega_high = row_sub(max_value, predicted);
+		row_vector_t omega = row_blend(row_greater(omega_low, omega_high), omega_high, omega_low);
+		row_vector_t abs_delta = row_abs(delta);
+		// sign of the scaled prediction applied to delta: negative when the prediction is odd
+		row_vector_t signed_delta = row_negate_where(row_sub(zero, row_and(scaled, one)), delta);
+		row_vector_t mapped_outside = row_add(abs_delta, omega);
+		row_vector_t mapped_inside = row_add(row_add(abs_delta, abs_delta), row_sign_mask(signed_delta));
+		row_store_samples(residuals + x, row_blend(row_greater(abs_delta, omega), mapped_outside, mapped_inside));
 	}
-	if (((*local_differences)[0] = (int *)malloc(sizeof(int) * input_params.x_size * input_params.y_size * input_params.z_size)) == NULL)
+#endif
+	for (; x < length; x++)
 	{
-		fprintf(stderr, "Error in allocating %d bytes for holding the local differences matrix\n", sizeof(int) * input_params.x_size * input_params.y_size * input_params.z_size);
-		return -1;
+		residuals[x] = compute_mapped_residual(samples[x], scaled_predicted[x], s_min, s_max);
 	}
-	if (predictor_params.full != 0)
+}
+
+void init_weights(int *weights, predictor_config_t predictor_params, unsigned int z)
+{
+	int i = 0;
+
+	if (predictor_params.weight_init_table == NULL)
 	{
-		int i = 0;
-		for (i = 1; i < 4; i++)
+		// default weights initialization
+		if (predictor_params.pred_bands > 0)
 		{
-			if (((*local_differences)[i] = (int *)malloc(sizeof(int) * input_params.x_size * input_params.y_size * input_params.z_size)) == NULL)
+			weights[0] = 7 << (predictor_params.weight_resolution - 3);
+			for (i = 1; i < predictor_params.pred_bands; i++)
 			{
-				fprintf(stderr, "Error in allocating %d bytes for holding the local differences matrix %d\n", sizeof(int) * input_params.x_size * input_params.y_size * input_params.z_size, i);
-				return -1;
+				weights[i] = weights[i - 1] >> 3;
 			}
 		}
-	}
-
-	// Ok, now I can actually start the computation
-	// Central difference computed: it is common both to reduced and
-	// full prediction mode
-	for (z = 0; z < input_params.z_size; z++)
-	{
-		for (y = 0, x = 1; y < input_params.y_size; y++, x = 0)
+		if (predictor_params.full != 0)
 		{
-			for (; x < input_params.x_size; x++)
+			for (i = 0; i < 3; i++)
 			{
-				int local_sum_temp = local_sum(input_params, predictor_params, x, y, z, samples);
-#ifndef NDEBUG
-				if (local_sum_temp == 0x80000000)
-				{
-					return -1;
-				}
-#endif
-				MATRIX_BSQ_INDEX((*local_differences)[0], input_params, x, y, z) = 4 * MATRIX_BSQ_INDEX(samples, input_params, x, y, z) - local_sum_temp;
+				weights[predictor_params.pred_bands + i] = 0;
 			}
 		}
 	}
-	if (predictor_params.full != 0)
+	else
 	{
-		//full prediction mode, the differences in the local_differences vector are
-		//in this order: central, north, west, north-west
-		for (z = 0; z < input_params.z_size; z++)
+		// custom weights initialization: the table holds the weights on weight_init_resolution bits,
+		// which are scaled back to the weight resolution as 2^shift * table + floor(2^(shift - 1)) - 1
+		// (the - 1 is there even when the two resolutions are the same)
+		const int shift = predictor_params.weight_resolution + 3 - predictor_params.weight_init_resolution;
+		const int offset = (shift > 0 ? 0x1 << (shift - 1) : 0) - 1;
+		if (predictor_params.full != 0)
 		{
-			for (y = 0; y < input_params.y_size; y++)
+			for (i = 0; i < 3; i++)
 			{
-				for (x = 0; x < input_params.x_size; x++)
-				{
-					if (y > 0)
-					{
-						int local_sum_temp = local_sum(input_params, predictor_params, x, y, z, samples);
-#ifndef NDEBUG
-						if (local_sum_temp == 0x80000000)
-						{
-							return -1;
-						}
-#endif
-						MATRIX_BSQ_INDEX((*local_differences)[1], input_params, x, y, z) = 4 * MATRIX_BSQ_INDEX(samples, input_params, x, y - 1, z) - local_sum_temp;
-						if (x > 0)
-						{
-							MATRIX_BSQ_INDEX((*local_differences)[2], input_params, x, y, z) = 4 * MATRIX_BSQ_INDEX(samples, input_params, x - 1, y, z) - local_sum_temp;
-							MATRIX_BSQ_INDEX((*local_differences)[3], input_params, x, y, z) = 4 * MATRIX_BSQ_INDEX(samples, input_params, x - 1, y - 1, z) - local_sum_temp;
-						}
-						else
-						{
-							MATRIX_BSQ_INDEX((*local_differences)[2], input_params, 0, y, z) = MATRIX_BSQ_INDEX((*local_differences)[1], input_params, 0, y, z);
-							MATRIX_BSQ_INDEX((*local_differences)[3], input_params, 0, y, z) = MATRIX_BSQ_INDEX((*local_differences)[1], input_params, 0, y, z);
-						}
-					}
-					else
-					{
-						MATRIX_BSQ_INDEX((*local_differences)[1], input_params, x, 0, z) = 0;
-						MATRIX_BSQ_INDEX((*local_differences)[2], input_params, x, 0, z) = 0;
-						MATRIX_BSQ_INDEX((*local_differences)[3], input_params, x, 0, z) = 0;
-					}
-				}
+				weights[predictor_params.pred_bands + i] = (predictor_params.weight_init_table[z][i] << shift) + offset;
 			}
-		}
-	}
-	return 0;
-}
-#endif
-
-/// Given the prediction error, it updates the weight matrix (local and
-/// prediction weights per band).
-#ifndef NO_COMPUTE_LOCAL
-void update_weights(int *weights, input_feature_t input_params, predictor_config_t predictor_params,
-		unsigned int x, unsigned int y, unsigned int z, int error, int **local_differences, unsigned short int *samples)
-{
-#else
-	void update_weights(int *weights, input_feature_t input_params, predictor_config_t predictor_params,
-			unsigned int x, unsigned int y, unsigned int z, int error, unsigned short int *samples)
-	{
-#endif
-		int i = 0;
-		int weight_limit = 0x1 << (predictor_params.weight_resolution + 2);
-		int sign_error = error < 0 ? -1 : 1;
-		int scaling_exp = predictor_params.weight_initial + ((int)(y * input_params.x_size + x - input_params.x_size)) / predictor_params.weight_interval;
-		if (scaling_exp < predictor_params.weight_initial)
-			scaling_exp = predictor_params.weight_initial;
-		if (scaling_exp > predictor_params.weight_final)
-			scaling_exp = predictor_params.weight_final;
-		scaling_exp += input_params.dyn_range - predictor_params.weight_resolution;
-
-		// Now I can update the weights; they are saved in the weights matrix such as
-		// the first index of the matrix is the spectral band and the other elements are
-		// the various weights: pred_1, pred_2, pred_p, N, W, NW.
-		if (z > 0)
-		{
-			int cur_pred_bands = z < predictor_params.pred_bands ? z : predictor_params.pred_bands;
-			for (i = 0; i < cur_pred_bands; i++)
+			for (i = 3; i < predictor_params.pred_bands + 3; i++)
 			{
-#ifdef NO_COMPUTE_LOCAL
-				int central_difference = 0;
-				if (get_central_difference(input_params, predictor_params, &central_difference, samples, x, y, z - i - 1) < 0)
-				{
-					fprintf(stderr, "Error in getting the central differences for band %d", z - i);
-				}
-#endif
-
-				if (scaling_exp > 0)
-				{
-#ifndef NO_COMPUTE_LOCAL
-					weights[i] = weights[i] + ((((sign_error * (MATRIX_BSQ_INDEX(local_differences[0], input_params, x, y, z - i - 1))) >> scaling_exp) + 1) >> 1);
-#else
-					weights[i] = weights[i] + ((((sign_error * central_difference) >> scaling_exp) + 1) >> 1);
-#endif
-				}
-				else
-				{
-#ifndef NO_COMPUTE_LOCAL
-					weights[i] = weights[i] + ((((sign_error * (MATRIX_BSQ_INDEX(local_differences[0], input_params, x, y, z - i - 1))) << -1 * scaling_exp) + 1) >> 1);
-#else
-					weights[i] = weights[i] + ((((sign_error * central_difference) << -1 * scaling_exp) + 1) >> 1);
-#endif
-				}
-				if (weights[i] < (-1 * weight_limit))
-				{
-					weights[i] = -1 * weight_limit;
-				}
-				if (weights[i] > (weight_limit - 1))
-				{
-					weights[i] = weight_limit - 1;
-				}
+				weights[i - 3] = (predictor_params.weight_init_table[z][i] << shift) + offset;
 			}
 		}
-		if (predictor_params.full != 0)
+		else
 		{
-#ifdef NO_COMPUTE_LOCAL
-			int directional_difference[3];
-			if (get_directional_difference(input_params, predictor_params, directional_difference, samples, x, y, z) < 0)
-			{
-				fprintf(stderr, "Error in getting the directional differences");
-			}
-#endif
-
-			for (i = 0; i < 3; i++)
+			for (i = 0; i < predictor_params.pred_bands; i++)
 			{
-				if (scaling_exp > 0)
-				{
-#ifndef NO_COMPUTE_LOCAL
-					weights[predictor_params.pred_bands + i] = weights[predictor_params.pred_bands + i] + ((((sign_error * (MATRIX_BSQ_INDEX(local_differences[i + 1], input_params, x, y, z))) >> scaling_exp) + 1) >> 1);
-#else
-					weights[predictor_params.pred_bands + i] = weights[predictor_params.pred_bands + i] + ((((sign_error * directional_difference[i]) >> scaling_exp) + 1) >> 1);
-#endif
-				}
-				else
-				{
-#ifndef NO_COMPUTE_LOCAL
-					weights[predictor_params.pred_bands + i] = weights[predictor_params.pred_bands + i] + ((((sign_error * (MATRIX_BSQ_INDEX(local_differences[i + 1], input_params, x, y, z))) << -1 * scaling_exp) + 1) >> 1);
-#else
-					weights[predictor_params.pred_bands + i] = weights[predictor_params.pred_bands + i] + ((((sign_error * directional_difference[i]) << -1 * scaling_exp) + 1) >> 1);
-#endif
-				}
-				if (weights[predictor_params.pred_bands + i] < (-1 * weight_limit))
-				{
-					weights[predictor_params.pred_bands + i] = -1 * weight_limit;
-				}
-				if (weights[predictor_params.pred_bands + i] > (weight_limit - 1))
-				{
-					weights[predictor_params.pred_bands + i] = weight_limit - 1;
-				}
+				weights[i] = (predictor_params.weight_init_table[z][i] << shift) + offset;
 			}
 		}
 	}
+}
 
-#ifndef NO_COMPUTE_LOCAL
-	/// given the local differences and the samples, it computes the scaled predicted
-	/// sample value
-	int compute_predicted_sample(input_feature_t input_params, predictor_config_t predictor_params,
-			unsigned int x, unsigned int y, unsigned int z, unsigned int s_min, unsigned int s_mid, unsigned int s_max,
-			int **local_differences, unsigned short int *samples, int *weights)
+int write_weights_table(char fileName[128], input_feature_t input_params, predictor_config_t predictor_params, const int *weights,
+		unsigned int resolution)
+{
+	// inverse of the scaling of init_weights: each weight is written as the value giving back the
+	// closest one, the weight itself plus one when the resolutions are the same
+	const int shift = predictor_params.weight_resolution + 3 - resolution;
+	const int max_value = (0x1 << (resolution - 1)) - 1;
+	const int min_value = -1 * (0x1 << (resolution - 1));
+	const unsigned int directional = predictor_params.full != 0 ? 3 : 0;
+	const unsigned int weights_len = predictor_params.pred_bands + directional;
+	FILE *weightsFile = NULL;
+	unsigned int z = 0, i = 0;
+	int result = 0;
+
+	if ((weightsFile = fopen(fileName, "w")) == NULL)
 	{
-#else
-		/// given the local differences and the samples, it computes the scaled predicted
-		/// sample value
-		int compute_predicted_sample(input_feature_t input_params, predictor_config_t predictor_params,
-				unsigned int x, unsigned int y, unsigned int z, unsigned int s_min, unsigned int s_mid, unsigned int s_max,
-				unsigned short int *samples, int *weights)
+		log_error(CCSDS_ERROR_IO, "Error in creating the weights file %s\n\n", fileName);
+		return -1;
+	}
+	for (z = 0; z < input_params.z_size && result == 0; z++)
+	{
+		const int *band_weights = weights + (size_t)z * weights_len;
+		// an empty line separates the bands; the directional weights come first in the table
+		if (z > 0 && fprintf(weightsFile, "\n") < 0)
+			result = -1;
+		for (i = 0; i < weights_len && result == 0; i++)
 		{
-#endif
-			long long scaled_predicted = 0;
-			long long diff_predicted = 0;
-			int i = 0;
+			int value = (band_weights[i < directional ? predictor_params.pred_bands + i : i - directional] + 1) >> shift;
+			if (value > max_value)
+				value = max_value;
+			if (value < min_value)
+				value = min_value;
+			if (fprintf(weightsFile, "%d\n", value) < 0)
+				result = -1;
+		}
+	}
+	if (fclose(weightsFile) != 0)
+		result = -1;
+	if (result != 0)
+		log_error(CCSDS_ERROR_IO, "Error in writing the weights file %s\n\n", fileName);
+	return result;
+}
 
-			//     fprintf(stderr, "compute_predicted_sample=%d, %d, %d - pred_bands = %d\n", x, y, z, predictor_params.pred_bands);
+/// Computes the scaled predicted value of the sample in column x of the row y of band z,
+/// given the local sums and differences of the row (differences[0]) and the central
+/// differences of the previous bands (differences[i] for band z - i)
+int predict_sample(input_feature_t input_params, predictor_config_t predictor_params, unsigned int x, unsigned int y, unsigned int z,
+		unsigned short int prev_band_origin, row_differences_t **differences, const int *weights)
+{
+	unsigned int s_min = 0;
+	unsigned int s_max = (0x1 << input_params.dyn_range) - 1;
+	unsigned int s_mid = 0x1 << (input_params.dyn_range - 1);
+	int cur_pred_bands = z < predictor_params.pred_bands ? z : predictor_params.pred_bands;
+	long long scaled_predicted = 0;
+	long long diff_predicted = 0;
+	int i = 0;
 
-			if (x > 0 || y > 0)
-			{
-				long long local_sum_temp = 0;
-
-				// predicted local difference
-				if (z > 0)
-				{
-					int cur_pred_bands = z < predictor_params.pred_bands ? z : predictor_params.pred_bands;
-					for (i = 0; i < cur_pred_bands; i++)
-					{
-#ifdef NO_COMPUTE_LOCAL
-						int central_difference = 0;
-						if (get_central_difference(input_params, predictor_params, &central_difference, samples, x, y, z - i - 1) < 0)
-						{
-							fprintf(stderr, "Error in getting the central differences for band %d", z - i);
-						}
-						//                 fprintf(stderr, "central_difference=%d\n", central_difference);
-#endif
+	if (x == 0 && y == 0)
+	{
+		if (z == 0 || predictor_params.pred_bands == 0)
+			return 2 * s_mid;
+		return 2 * prev_band_origin;
+	}
 
-#ifndef NO_COMPUTE_LOCAL
-						diff_predicted += ((long long)weights[i]) * (long long)(MATRIX_BSQ_INDEX(local_differences[0], input_params, x, y, z - i - 1));
-#else
-						diff_predicted += ((long long)weights[i]) * (long long)central_difference;
-#endif
-					}
-				}
-				if (predictor_params.full != 0)
-				{
-#ifdef NO_COMPUTE_LOCAL
-					int directional_difference[3];
-					if (get_directional_difference(input_params, predictor_params, directional_difference, samples, x, y, z) < 0)
-					{
-						fprintf(stderr, "Error in getting the directional differences");
-					}
-					//             fprintf(stderr, "directional_difference[0]=%d, directional_difference[1]=%d, directional_difference[2]=%d\n", directional_difference[0], directional_difference[1], directional_difference[2]);
-#endif
+	// predicted local difference
+	for (i = 0; i < cur_pred_bands; i++)
+	{
+		diff_predicted += ((long long)weights[i]) * (long long)differences[i + 1]->central[x];
+	}
+	if (predictor_params.full != 0)
+	{
+		diff_predicted += ((long long)weights[predictor_params.pred_bands]) * (long long)differences[0]->north[x];
+		diff_predicted += ((long long)weights[predictor_params.pred_bands + 1]) * (long long)differences[0]->west[x];
+		diff_predicted += ((long long)weights[predictor_params.pred_bands + 2]) * (long long)differences[0]->north_west[x];
+	}
 
-					for (i = 0; i < 3; i++)
-					{
-#ifndef NO_COMPUTE_LOCAL
-						diff_predicted += ((long long)weights[predictor_params.pred_bands + i]) * (long long)(MATRIX_BSQ_INDEX(local_differences[i + 1], input_params, x, y, z));
-#else
-						diff_predicted += ((long long)weights[predictor_params.pred_bands + i]) * (long long)directional_difference[i];
-#endif
-					}
-				}
-
-				// scaled predicted sample
-				local_sum_temp = local_sum(input_params, predictor_params, x, y, z, samples);
-				scaled_predicted = mod_star(diff_predicted + ((local_sum_temp - 4 * s_mid) << predictor_params.weight_resolution), predictor_params.register_size, x == 1 && y == 0 && z == 0);
-				scaled_predicted = scaled_predicted >> (predictor_params.weight_resolution + 1);
-				scaled_predicted = scaled_predicted + 1 + 2 * s_mid;
-				if (scaled_predicted < 2 * s_min)
-					scaled_predicted = 2 * s_min;
-				if (scaled_predicted > (2 * s_max + 1))
-					scaled_predicted = (2 * s_max + 1);
-			}
-			else
-			{
-				if (z == 0 || predictor_params.pred_bands == 0)
-				{
-					//             fprintf(stderr, "smid\n");
-					scaled_predicted = 2 * s_mid;
-				}
-				else
-				{
-					//             fprintf(stderr, "sample\n");
-					scaled_predicted = 2 * (MATRIX_BSQ_INDEX(samples, input_params, 0, 0, z - 1));
-				}
-			}
+	// scaled predicted sample
+	scaled_predicted = mod_star(diff_predicted + ((differences[0]->local_sum[x] - 4 * (long long)s_mid) << predictor_params.weight_resolution), predictor_params.register_size, 0);
+	scaled_predicted = scaled_predicted >> (predictor_params.weight_resolution + 1);
+	scaled_predicted = scaled_predicted + 1 + 2 * s_mid;
+	if (scaled_predicted < 2 * s_min)
+		scaled_predicted = 2 * s_min;
+	if (scaled_predicted > (2 * s_max + 1))
+		scaled_predicted = (2 * s_max + 1);
+
+	return (int)scaled_predicted;
+}
 
-			return (int)scaled_predicted;
+/// Given the prediction error of the sample in column x of the row y of band z (not the
+/// first sample of the band), it updates the weights of the band as update_weights does,
+/// reading the differences from the rows prepared for predict_sample
+void update_sample_weights(input_feature_t input_params, predictor_config_t predictor_params, unsigned int x, unsigned int y, unsigned int z,
+		int error, row_differences_t **differences, int *weights)
+{
+	int weight_limit = 0x1 << (predictor_params.weight_resolution + 2);
+	int cur_pred_bands = z < predictor_params.pred_bands ? z : predictor_params.pred_bands;
+	int sign_error = error < 0 ? -1 : 1;
+	// the sample index t = y * x_size + x can exceed the int range in very large images
+	long long sample_exp = predictor_params.weight_initial + ((long long)y * input_params.x_size + x - input_params.x_size) / predictor_params.weight_interval;
+	int scaling_exp = 0;
+	int i = 0;
+
+	if (sample_exp < predictor_params.weight_initial)
+		sample_exp = predictor_params.weight_initial;
+	if (sample_exp > predictor_params.weight_final)
+		sample_exp = predictor_params.weight_final;
+	scaling_exp = (int)sample_exp + input_params.dyn_range - predictor_params.weight_resolution;
+
+	for (i = 0; i < cur_pred_bands + (predictor_params.full != 0 ? 3 : 0); i++)
+	{
+		int *weight = NULL;
+		int difference = 0;
+		if (i < cur_pred_bands)
+		{
+			weight = &weights[i];
+			difference = differences[i + 1]->central[x];
 		}
+		else
+		{
+			int *directional[3] = {differences[0]->north, differences[0]->west, differences[0]->north_west};
+			weight = &weights[predictor_params.pred_bands + i - cur_pred_bands];
+			difference = directional[i - cur_pred_bands][x];
+		}
+		if (scaling_exp > 0)
+			*weight = *weight + ((((sign_error * difference) >> scaling_exp) + 1) >> 1);
+		else
+			*weight = *weight + ((((sign_error * difference) << -1 * scaling_exp) + 1) >> 1);
+		if (*weight < (-1 * weight_limit))
+			*weight = -1 * weight_limit;
+		if (*weight > (weight_limit - 1))
+			*weight = weight_limit - 1;
+	}
+}
 
-		/// Given the scaled predicted sample value it maps it to an unsigned value
-		/// enabling it to be represented with D bits
-		unsigned short int compute_mapped_residual(input_feature_t input_params,
-				unsigned int x, unsigned int y, unsigned int z, unsigned int s_min, unsigned int s_mid, unsigned int s_max,
-				unsigned short int *samples, int scaled_predicted)
+/// Predicts the row y of band z from its precomputed local sums and differences
+/// (differences[0]) and the central differences of the previous bands at the same
+/// row (differences[i] for band z - i), updating the band weights sample by sample.
+/// The scaled predictions are saved in predicted_row and the mapped residuals in residual_row;
+/// prev_band_origin is the sample (0, 0, z - 1), only used when z > 0
+void predict_row(input_feature_t input_params, predictor_config_t predictor_params, unsigned int y, unsigned int z,
+		const unsigned short int *cur_row, unsigned short int prev_band_origin, row_differences_t **differences,
+		int *weights, int *predicted_row, unsigned short int *residual_row)
+{
+	unsigned int s_max = (0x1 << input_params.dyn_range) - 1;
+	unsigned int x = 0;
+
+	// The weight update is a sequential recurrence along the row: each prediction depends on the
+	// weights updated with the previous sample, so only the differences are precomputed
+	for (x = 0; x < input_params.x_size; x++)
+	{
+		predicted_row[x] = predict_sample(input_params, predictor_params, x, y, z, prev_band_origin, differences, weights);
+		if (x > 0 || y > 0)
+		{
+			// finally I can update the weights, preparing for the prediction of the next sample
+			update_sample_weights(input_params, predictor_params, x, y, z, 2 * cur_row[x] - predicted_row[x], differences, weights);
+		}
+		else
 		{
-			unsigned short int mapped = 0;
-			int delta = ((int)MATRIX_BSQ_INDEX(samples, input_params, x, y, z)) - scaled_predicted / 2;
-			unsigned int omega = scaled_predicted / 2 - s_min;
-			unsigned int abs_delta = delta < 0 ? (-1 * delta) : delta;
-			int sign_scaled = (scaled_predicted & 0x1) != 0 ? -1 : 1;
+			//  weights initialization
+			init_weights(weights, predictor_params, z);
+		}
+	}
 
-			if (omega > s_max - scaled_predicted / 2)
-			{
-				omega = s_max - scaled_predicted / 2;
-			}
+	// Now that the whole row has been predicted, the residuals can be mapped
+	compute_mapped_residual_row(cur_row, predicted_row, residual_row, input_params.x_size, 0, s_max);
+	if (predictor_params.adapted_weights != NULL && y == input_params.y_size - 1)
+	{
+		size_t weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+		memcpy(predictor_params.adapted_weights + z * weights_len, weights, sizeof(int) * weights_len);
+	}
+}
 
-			if (abs_delta > omega)
-			{
-				mapped = abs_delta + omega;
-			}
-			else if ((sign_scaled * delta) <= omega && (sign_scaled * delta) >= 0)
-			{
-				mapped = 2 * abs_delta;
-			}
-			else
-			{
-				mapped = 2 * abs_delta - 1;
-			}
+/// Returns the number of bytes of memory allocated by predict_bands for the given band range
+size_t predict_bands_working_set(input_feature_t input_params, predictor_config_t predictor_params,
+		unsigned int first_band, unsigned int end_band)
+{
+	size_t weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+	size_t window = predictor_params.pred_bands + 1;
+	size_t arrays_per_row = predictor_params.full != 0 ? 5 : 2;
+	size_t warm_up = first_band < predictor_params.pred_bands ? first_band : predictor_params.pred_bands;
+	size_t bytes = 0;
+
+	bytes += sizeof(int) * (weights_len > 0 ? weights_len : 1) * (end_band - first_band);
+	bytes += sizeof(int) * input_params.x_size * (window * arrays_per_row + 1);
+	bytes += (sizeof(row_differences_t) + sizeof(row_differences_t *)) * window;
+	if (SAMPLE_BYTES(input_params) == 1)
+		bytes += sizeof(unsigned short int) * input_params.x_size * (2 * (end_band - first_band + warm_up) + 1);
+	return bytes;
+}
 
-			return mapped;
-		}
+/// Returns the number of bytes of memory allocated by predict: the image samples and the rows of
+/// the row engine (the residuals are allocated by the caller)
+size_t predict_working_set(input_feature_t input_params, predictor_config_t predictor_params)
+{
+	return SAMPLE_BYTES(input_params) * IMAGE_SAMPLES(input_params) +
+			predict_bands_working_set(input_params, predictor_params, 0, input_params.z_size);
+}
+
+/// Predicts the bands [first_band, end_band) of the image loaded in samples, saving their
+/// residuals in the same positions of the residuals cube.
+int predict_bands(input_feature_t input_params, predictor_config_t predictor_params, const void *samples, void *residuals,
+		unsigned int first_band, unsigned int end_band, arena_t *arena)
+{
+	// For each row, the local sums and differences of the row of every band are computed with
+	// the row kernels, keeping those of the last pred_bands bands in a sliding window; then, for
+	// each pixel in the row, the predicted sample is computed, the weights of its band updated and
+	// the mapped residual added to the residuals matrix.
+	// The prediction of a band only depends on the samples of the pred_bands previous ones, so
+	// the differences of those bands are computed too (warm-up), without predicting them.
+	// When the dynamic range fits in 8 bits the samples and the residuals are stored with one
+	// byte each: the rows are then widened to 16 bits into a small scratch area before being
+	// processed and the residuals narrowed back to 8 bits.
+	const unsigned int sample_bytes = SAMPLE_BYTES(input_params);
+	unsigned int y = 0, z = 0;
+	unsigned int warm_start = first_band < predictor_params.pred_bands ? 0 : first_band - predictor_params.pred_bands;
+	unsigned int bands = end_band - warm_start;
+	int *weights = NULL;
+	int weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+	// Number of rows of differences kept: the current band and the previous pred_bands ones
+	unsigned int window = predictor_params.pred_bands + 1;
+	unsigned int arrays_per_row = predictor_params.full != 0 ? 5 : 2;
+	int *differences_buffer = NULL;
+	int *predicted_row = NULL;
+	row_differences_t *window_differences = NULL;
+	row_differences_t **band_differences = NULL;
+	// 16 bits copies of the last two rows of every band and of the residual row, only used
+	// with the narrow storage
+	unsigned short int *wide_rows = NULL;
+	unsigned int i = 0;
+	// everything allocated here is released when the prediction ends
+	arena_mark_t mark = arena_get_mark(arena);
+
+	// Weights are kept separately for every band, as the bands are interleaved row by row
+	weights = (int *)arena_alloc(arena, sizeof(int) * (weights_len > 0 ? weights_len : 1) * (end_band - first_band));
+	differences_buffer = (int *)arena_alloc(arena, sizeof(int) * input_params.x_size * (window * arrays_per_row + 1));
+	window_differences = (row_differences_t *)arena_alloc(arena, sizeof(row_differences_t) * window);
+	band_differences = (row_differences_t **)arena_alloc(arena, sizeof(row_differences_t *) * window);
+	if (sample_bytes == 1)
+		wide_rows = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * input_params.x_size * (2 * bands + 1));
+	if (weights == NULL || differences_buffer == NULL || window_differences == NULL || band_differences == NULL ||
+			(sample_bytes == 1 && wide_rows == NULL))
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the weights vector and the local differences rows\n\n");
+		arena_rewind(arena, mark);
+		return -1;
+	}
+	init_differences_window(predictor_params, input_params.x_size, window, differences_buffer, window_differences);
+	predicted_row = differences_buffer + window * arrays_per_row * input_params.x_size;
 
-		void init_weights(int *weights, predictor_config_t predictor_params, unsigned int z)
+	// Now actually it goes over the various rows and it computes the prediction
+	// residual for each of their samples
+	// Note that, for each band, the element in position (0, 0) is not predicted
+	for (y = 0; y < input_params.y_size; y++)
+	{
+		for (z = warm_start; z < end_band; z++)
 		{
-			int i = 0;
+			const unsigned short int *cur_row = NULL;
+			const unsigned short int *prev_row = NULL;
+			unsigned short int *residual_row = NULL;
+			unsigned int cur_pred_bands = z < predictor_params.pred_bands ? z : predictor_params.pred_bands;
 
-			if (predictor_params.weight_init_table == NULL)
+			if (sample_bytes == 1)
 			{
-				// default weights initialization
-				if (predictor_params.pred_bands > 0)
-				{
-					weights[0] = 7 << (predictor_params.weight_resolution - 3);
-					for (i = 1; i < predictor_params.pred_bands; i++)
-					{
-						weights[i] = weights[i - 1] >> 3;
-					}
-				}
-				if (predictor_params.full != 0)
-				{
-					for (i = 0; i < 3; i++)
-					{
-						weights[predictor_params.pred_bands + i] = 0;
-					}
-				}
+				unsigned short int *wide_row = wide_rows + (size_t)(2 * (z - warm_start) + (y & 0x1)) * input_params.x_size;
+				widen_row((const unsigned char *)samples + BSQ_OFFSET(input_params, 0, y, z), wide_row, input_params.x_size);
+				cur_row = wide_row;
+				prev_row = wide_rows + (size_t)(2 * (z - warm_start) + ((y + 1) & 0x1)) * input_params.x_size;
+				residual_row = wide_rows + (size_t)2 * bands * input_params.x_size;
 			}
 			else
 			{
-				// custom weights initialization
-				if (predictor_params.full != 0)
-				{
-					for (i = 0; i < 3; i++)
-					{
-						weights[predictor_params.pred_bands + i] = predictor_params.weight_init_table[z][i] << (predictor_params.weight_resolution + 3 - predictor_params.weight_init_resolution);
-						weights[predictor_params.pred_bands + i] += 0x1 << (predictor_params.weight_resolution + 2 - predictor_params.weight_init_resolution);
-						weights[predictor_params.pred_bands + i] -= 1;
-					}
-					for (i = 3; i < predictor_params.pred_bands + 3; i++)
-					{
-						weights[i - 3] = predictor_params.weight_init_table[z][i] << (predictor_params.weight_resolution + 3 - predictor_params.weight_init_resolution);
-						weights[i - 3] += 0x1 << (predictor_params.weight_resolution + 2 - predictor_params.weight_init_resolution);
-						weights[i - 3] -= 1;
-					}
-				}
-				else
-				{
-					for (i = 0; i < predictor_params.pred_bands; i++)
-					{
-						weights[i] = predictor_params.weight_init_table[z][i] << (predictor_params.weight_resolution + 3 - predictor_params.weight_init_resolution);
-						weights[i] += 0x1 << (predictor_params.weight_resolution + 2 - predictor_params.weight_init_resolution);
-						weights[i] -= 1;
-					}
-				}
+				cur_row = (const unsigned short int *)samples + BSQ_OFFSET(input_params, 0, y, z);
+				prev_row = cur_row - input_params.x_size;
+				residual_row = (unsigned short int *)residuals + BSQ_OFFSET(input_params, 0, y, z);
 			}
-		}
 
-		/// High-level routine which actually performs the prediction, by calling the
-		/// in the right order the other sub-routines.
-		/// A value different from 0 is returned in case of error
-		int predict(input_feature_t input_params, predictor_config_t predictor_params, char inputFile[128], unsigned short int *residuals)
-		{
-			// Calls the various routines to parse the input file and
-			// to compute the mapped residuals. The steps are:
-			// - parse input file (with signed/unsigned conversion and converting to BSQ)
-			// - create local differences matrix
-			// - now, for each pixel in the image, I compute_predicted_sample,
-			//   update the weights and compute the mapped residual which is added to the residuals matrix
-			unsigned int s_min = 0;
-			unsigned int s_max = (0x1 << input_params.dyn_range) - 1;
-			unsigned int s_mid = 0x1 << (input_params.dyn_range - 1);
-			unsigned short int *samples = NULL;
-#ifndef NO_COMPUTE_LOCAL
-			int **local_differences = NULL;
-#endif
-			unsigned int x = 0, y = 0, z = 0;
-			int *weights = NULL;
-			int weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
-
-			// Parse the input image, loading it into memory and appropriately converting it
-			samples = (unsigned short int *)malloc(sizeof(unsigned short int) * input_params.x_size * input_params.y_size * input_params.z_size);
-			if (samples == NULL)
-			{
-				fprintf(stderr, "Error in allocating %lf kBytes for the input image buffer\n\n", ((double)sizeof(unsigned short int) * input_params.x_size * input_params.y_size * input_params.z_size) / 1024.0);
-				return -1;
-			}
-			if (read_samples(input_params, inputFile, samples) != 0)
+			compute_row_differences(input_params, predictor_params, y, cur_row,
+					y > 0 ? prev_row : NULL, &window_differences[z % window]);
+			// the bands before first_band only provide their central differences
+			if (z < first_band)
+				continue;
+			for (i = 0; i <= cur_pred_bands; i++)
 			{
-				return -1;
+				band_differences[i] = &window_differences[(z - i) % window];
 			}
+			predict_row(input_params, predictor_params, y, z, cur_row,
+					z > 0 ? GET_ELEMENT(samples, sample_bytes, BSQ_OFFSET(input_params, 0, 0, z - 1)) : 0, band_differences,
+					weights + (z - first_band) * weights_len, predicted_row, residual_row);
+			if (sample_bytes == 1)
+				narrow_row(residual_row, (unsigned char *)residuals + BSQ_OFFSET(input_params, 0, y, z), input_params.x_size);
+		}
+	}
 
-#ifndef NO_COMPUTE_LOCAL
-			// Computes the local differences to be used in the prediction process; local_differences is a matrix
-			// as if contains the local differences (central, north, west, north-west) for every sample in the image
-			// (with samples expressed with a linear array)
-			if (compute_local_differences(input_params, predictor_params, &local_differences, samples) < 0)
-			{
-				return -1;
-			}
-#endif
+	// Freeing allocated memory
+	arena_rewind(arena, mark);
 
-			weights = (int *)malloc(sizeof(int) * weights_len);
-			if (weights == NULL)
-			{
-				fprintf(stderr, "Error in allocating the weights vector\n\n");
-				return -1;
-			}
-			// Now actually it goes over the various samples and it computes the prediction
-			// residual for each of them
-			// Note that, for each band, the element in position (0, 0) is not predicted
-			for (z = 0; z < input_params.z_size; z++)
-			{
-				for (y = 0; y < input_params.y_size; y++)
-				{
-					for (x = 0; x < input_params.x_size; x++)
-					{
-						int predicted_sample = 0;
-						unsigned short int mapped_residual = 0;
-						int error = 0;
-
-						// prediction of the current sample and saving the residual
-#ifndef NO_COMPUTE_LOCAL
-						predicted_sample = compute_predicted_sample(input_params, predictor_params,
-								x, y, z, s_min, s_mid, s_max, local_differences, samples, weights);
-#else
-						predicted_sample = compute_predicted_sample(input_params, predictor_params,
-								x, y, z, s_min, s_mid, s_max, samples, weights);
-#endif
-						//                 fprintf(stderr, "(%d, %d, %d) = predicted_sample=%d\n", x, y, z, predicted_sample);
-						//                 fprintf(stderr, "sample=%d\n", MATRIX_BSQ_INDEX(samples, input_params, x, y, z));
-						mapped_residual = compute_mapped_residual(input_params, x, y, z,
-								s_min, s_mid, s_max, samples, predicted_sample);
-						MATRIX_BSQ_INDEX(residuals, input_params, x, y, z) = mapped_residual;
-						if (x == 0 && y == 0)
-						{
-							//  weights initialization
-							init_weights(weights, predictor_params, z);
-						}
-						else
-						{
-							// finally I can update the weights, preparing for the prediction of the next sample
-							error = 2 * (MATRIX_BSQ_INDEX(samples, input_params, x, y, z)) - predicted_sample;
-#ifndef NO_COMPUTE_LOCAL
-							update_weights(weights, input_params, predictor_params, x, y, z, error, local_differences, samples);
-#else
-							update_weights(weights, input_params, predictor_params, x, y, z, error, samples);
-#endif
-						}
-					}
-				}
-			}
-			// Freeing allocated memory
-			if (samples != NULL)
-			{
-				free(samples);
-			}
-			if (weights != NULL)
-			{
-				free(weights);
-			}
+	return 0;
+}
 
-#ifndef NO_COMPUTE_LOCAL
-			if (local_differences != NULL)
-			{
-				if (predictor_params.full != 0)
-				{
-					int i = 0;
-					for (i = 0; i < 4; i++)
-					{
-						if (local_differences[i] != NULL)
-						{
-							free(local_differences[i]);
-						}
-					}
-				}
-				else
-				{
-					if (local_differences[0] != NULL)
-					{
-						free(local_differences[0]);
-					}
-				}
-				free(local_differences);
-			}
-#endif
+/// High-level routine which actually performs the prediction, by calling the
+/// in the right order the other sub-routines.
+/// A value different from 0 is returned in case of error
+int predict(input_feature_t input_params, predictor_config_t predictor_params, char inputFile[128], io_backend_t backend, void *residuals, arena_t *arena)
+{
+	// Parses the input file (with signed/unsigned conversion and converting to BSQ) and
+	// predicts all the bands of the image
+	void *samples = NULL;
+	const unsigned int sample_bytes = SAMPLE_BYTES(input_params);
+	int result = 0;
+	// everything allocated here is released when the prediction ends
+	arena_mark_t mark = arena_get_mark(arena);
+
+	// Parse the input image, loading it into memory and appropriately converting it
+	samples = arena_alloc(arena, sample_bytes * IMAGE_SAMPLES(input_params));
+	if (samples == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating %lf kBytes for the input image buffer\n\n", ((double)sample_bytes * IMAGE_SAMPLES(input_params)) / 1024.0);
+		return -1;
+	}
+	if (read_samples(input_params, backend, inputFile, samples) == 0)
+		result = predict_bands(input_params, predictor_params, samples, residuals, 0, input_params.z_size, arena);
+	else
+		result = -1;
 
-			return 0;
-		}
+	// Freeing allocated memory
+	arena_rewind(arena, mark);
+
+	return result;
+}
\ No newline at end of file
@@ -0,0 +1,349 @@
+#include <string.h>
+#include <time.h>
+
+#include "reinterleave.h"
+#include "decoder.h"
+#include "io_backend.h"
+
+/// Returns the num_bits (at most 32) bits of stream starting at bit position, most significant first
+static unsigned int peek_bits(const unsigned char *stream, unsigned long long position, unsigned int num_bits)
+{
+	unsigned int value = 0;
+	unsigned int i = 0;
+
+	for (i = 0; i < num_bits; i++, position++)
+		value = (value << 1) | ((stream[position / 8] >> (7 - position % 8)) & 0x1);
+	return value;
+}
+
+/// Copies num_bits bits of source, starting at bit source_position, into the zeroed target starting at
+/// bit target_position
+static void copy_bits(unsigned char *target, unsigned long long target_position, const unsigned char *source, unsigned long long source_position,
+		unsigned int num_bits)
+{
+	size_t written_bytes = target_position / 8;
+	unsigned int written_bits = target_position % 8;
+
+	while (num_bits > 0)
+	{
+		unsigned int chunk = MIN(num_bits, 16);
+		bitStream_store(target, &written_bytes, &written_bits, chunk, peek_bits(source, source_position, chunk));
+		source_position += chunk;
+		num_bits -= chunk;
+	}
+}
+
+/// Returns the length of the codeword of the residual starting at bit position of stream (stream_bits bits
+/// long), in band z, updating the statistics of the band; first tells whether it is the first residual of
+/// the band, which is stored uncompressed
+/// @return the length of the codeword, 0 if it does not end within the stream
+static unsigned int codeword_length(const unsigned char *stream, unsigned long long stream_bits, unsigned long long position,
+		input_feature_t input_params, encoder_config_t encoder_params, decoder_state_t *state, unsigned int z, int first)
+{
+	unsigned int k = 0;
+	unsigned int zeros = 0;
+	unsigned int residual = 0;
+
+	if (first != 0)
+		return position + input_params.dyn_range <= stream_bits ? input_params.dyn_range : 0;
+	k = sample_codeword_k(input_params, state->counter[z], state->accumulator[z]);
+	while (zeros < encoder_params.u_max && position + zeros < stream_bits && peek_bits(stream, position + zeros, 1) == 0)
+		zeros++;
+	if (zeros == encoder_params.u_max)
+	{
+		// the residual is saved uncompressed after u_max zeros
+		if (position + zeros + input_params.dyn_range > stream_bits)
+			return 0;
+		residual = peek_bits(stream, position + zeros, input_params.dyn_range);
+		update_sample_statistics(encoder_params, &state->counter[z], &state->accumulator[z], residual);
+		return zeros + input_params.dyn_range;
+	}
+	if (position + zeros + 1 + k > stream_bits)
+		return 0;
+	residual = (zeros << k) | peek_bits(stream, position + zeros + 1, k);
+	update_sample_statistics(encoder_params, &state->counter[z], &state->accumulator[z], residual);
+	return zeros + 1 + k;
+}
+
+/// Walks the codewords of source, starting at bit first_bit, in the order of its interleaving (given in
+/// encoder_params), moving band_cursor[z] after every codeword of band z; when target is not NULL the
+/// codeword is copied there at band_cursor[z], building the BSQ stream
+static int scatter_codewords(const unsigned char *source, unsigned long long source_bits, unsigned long long first_bit, input_feature_t input_params,
+		encoder_config_t encoder_params, decoder_state_t *state, unsigned long long *band_cursor, unsigned char *target)
+{
+	const size_t band_size = (size_t)input_params.x_size * input_params.y_size;
+	const size_t samplesNum = IMAGE_SAMPLES(input_params);
+	unsigned long long position = first_bit;
+	size_t i = 0;
+
+	for (i = 0; i < samplesNum; i++)
+	{
+		size_t BSQidx = indexToBSQ(encoder_params.out_interleaving, encoder_params.out_interleaving_depth, input_params.x_size, input_params.y_size,
+				input_params.z_size, i);
+		unsigned int z = BSQidx / band_size;
+		unsigned int length = codeword_length(source, source_bits, position, input_params, encoder_params, state, z, (BSQidx % band_size) == 0);
+		if (length == 0)
+		{
+			log_error(CCSDS_ERROR_DATA, "Error, the compressed stream ended before residual %zu\n", i);
+			return -1;
+		}
+		if (target != NULL)
+			copy_bits(target, band_cursor[z], source, position, length);
+		band_cursor[z] += length;
+		position += length;
+	}
+	return 0;
+}
+
+/// Walks the codewords of the BSQ stream bsq in the order of the interleaving given in encoder_params, the
+/// codewords of band z being read at band_cursor[z], and copies them one after the other into target
+/// starting at bit first_bit
+static int gather_codewords(const unsigned char *bsq, unsigned long long bsq_bits, unsigned long long first_bit, input_feature_t input_params,
+		encoder_config_t encoder_params, decoder_state_t *state, unsigned long long *band_cursor, unsigned char *target)
+{
+	const size_t band_size = (size_t)input_params.x_size * input_params.y_size;
+	const size_t samplesNum = IMAGE_SAMPLES(input_params);
+	unsigned long long position = first_bit;
+	size_t i = 0;
+
+	for (i = 0; i < samplesNum; i++)
+	{
+		size_t BSQidx = indexToBSQ(encoder_params.out_interleaving, encoder_params.out_interleaving_depth, input_params.x_size, input_params.y_size,
+				input_params.z_size, i);
+		unsigned int z = BSQidx / band_size;
+		unsigned int length = codeword_length(bsq, bsq_bits, band_cursor[z], input_params, encoder_params, state, z, (BSQidx % band_size) == 0);
+		if (length == 0)
+		{
+			log_error(CCSDS_ERROR_DATA, "Error, the codewords of band %u end past the compressed stream\n", z);
+			return -1;
+		}
+		copy_bits(target, position, bsq, band_cursor[z], length);
+		band_cursor[z] += length;
+		position += length;
+	}
+	return 0;
+}
+
+/// Sets the sample order and the interleaving depth of the header of stream
+static void patch_header(unsigned char *stream, interleaving_t out_interleaving, unsigned int out_interleaving_depth)
+{
+	// the order is the least significant bit of byte 7, followed by the depth on 16 bits
+	if (out_interleaving == BSQ)
+	{
+		stream[7] |= 0x1;
+		out_interleaving_depth = 0;
+	}
+	else
+	{
+		stream[7] &= 0xFE;
+	}
+	stream[8] = (unsigned char)(out_interleaving_depth >> 8);
+	stream[9] = (unsigned char)out_interleaving_depth;
+}
+
+/// Re-interleaves the stream described by config, allocating all the buffers from arena
+static int reinterleave_stream(decompressConfig_t *config, interleaving_t out_interleaving, unsigned int out_interleaving_depth, arena_t *arena)
+{
+	double startTime = ((double)clock()) / CLOCKS_PER_SEC;
+	io_file_t inStream;
+	io_file_t outFile;
+	FILE *inFile = NULL;
+	encoder_config_t encoder_params;
+	encoder_config_t target_params;
+	decoder_state_t state;
+	unsigned char *source = NULL;
+	unsigned char *bsq = NULL;
+	unsigned char *target = NULL;
+	unsigned long long *band_start = NULL;
+	unsigned long long *band_cursor = NULL;
+	unsigned long long first_bit = 0;
+	unsigned long long stream_bits = 0;
+	size_t header_bytes = 0;
+	size_t stream_bytes = 0;
+	size_t needed_memory = 0;
+	long position = 0;
+	unsigned int z = 0;
+
+	if (config->in_file[0] == '\x0')
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the file containing the compressed stream\n\n");
+		return -1;
+	}
+	if (config->out_file[0] == '\x0')
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the file where the re-interleaved stream will be saved\n\n");
+		return -1;
+	}
+	if (config->io_backend > IO_BACKEND_DIRECT)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, unknown I/O backend %d\n\n", (int)config->io_backend);
+		return -1;
+	}
+	if (out_interleaving != BSQ && out_interleaving != BI)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, unknown output interleaving %d\n\n", (int)out_interleaving);
+		return -1;
+	}
+
+	// The whole source is kept in memory, the header being parsed from its beginning.
+	memset(&encoder_params, 0, sizeof(encoder_config_t));
+	if ((inFile = io_open_stream(&inStream, config->io_backend, config->in_file)) == NULL)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in opening the compressed stream %s\n", config->in_file);
+		return -1;
+	}
+	if (read_header(inFile, &config->input_params, &encoder_params, &config->predictor_params, arena) != 0 || (position = ftell(inFile)) < 0 ||
+			check_image_size(config->input_params) != 0)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error in reading the header of the compressed stream %s\n", config->in_file);
+		io_close_stream(&inStream, inFile);
+		return -1;
+	}
+	header_bytes = (size_t)position;
+	if (fseek(inFile, 0, SEEK_END) != 0 || (position = ftell(inFile)) < 0 || (size_t)position < header_bytes || fseek(inFile, 0, SEEK_SET) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in reading the compressed stream %s\n", config->in_file);
+		io_close_stream(&inStream, inFile);
+		return -1;
+	}
+	stream_bytes = (size_t)position;
+	if (encoder_params.encoding_method != SAMPLE)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, only the streams compressed with the sample adaptive encoder can be re-interleaved\n\n");
+		io_close_stream(&inStream, inFile);
+		return -1;
+	}
+	if (out_interleaving == BI && (out_interleaving_depth < 1 || out_interleaving_depth > config->input_params.z_size))
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the interleaving depth must be between 1 and the number of bands (%u)\n\n", config->input_params.z_size);
+		io_close_stream(&inStream, inFile);
+		return -1;
+	}
+	// the source, the BSQ stream when the source is BI, and the target when it is BI
+	needed_memory = stream_bytes * (1 + (encoder_params.out_interleaving == BI) + (out_interleaving == BI)) +
+			2 * sizeof(unsigned long long) * config->input_params.z_size + decoder_state_size(config->input_params);
+	if (config->memory_budget != 0 && needed_memory > config->memory_budget)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "\nError, the re-interleaving needs %zu bytes of memory, more than the budget of %zu bytes\n\n", needed_memory,
+				config->memory_budget);
+		io_close_stream(&inStream, inFile);
+		return -1;
+	}
+	if ((source = (unsigned char *)arena_alloc(arena, stream_bytes)) == NULL ||
+			(band_start = (unsigned long long *)arena_calloc(arena, config->input_params.z_size, sizeof(unsigned long long))) == NULL ||
+			(band_cursor = (unsigned long long *)arena_alloc(arena, sizeof(unsigned long long) * config->input_params.z_size)) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the compressed stream\n");
+		io_close_stream(&inStream, inFile);
+		return -1;
+	}
+	if (fread(source, 1, stream_bytes, inFile) != stream_bytes)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in reading the compressed stream %s\n", config->in_file);
+		io_close_stream(&inStream, inFile);
+		return -1;
+	}
+	io_close_stream(&inStream, inFile);
+	if (init_decoder_state(config->input_params, encoder_params, &state, arena) != 0)
+		return -1;
+	first_bit = 8 * (unsigned long long)header_bytes;
+	stream_bits = 8 * (unsigned long long)stream_bytes;
+
+	// The length of the codewords of every band gives where the band starts in the BSQ stream ...
+	if (scatter_codewords(source, stream_bits, first_bit, config->input_params, encoder_params, &state, band_start, NULL) != 0)
+		return -1;
+	for (z = 0; z < config->input_params.z_size; z++)
+	{
+		unsigned long long band_bits = band_start[z];
+		band_start[z] = first_bit;
+		first_bit += band_bits;
+	}
+	first_bit = 8 * (unsigned long long)header_bytes;
+
+	// ... which is then built, unless the source is already in BSQ order ...
+	bsq = source;
+	if (encoder_params.out_interleaving == BI)
+	{
+		if ((bsq = (unsigned char *)arena_calloc(arena, stream_bytes, 1)) == NULL)
+		{
+			log_error(CCSDS_ERROR_MEMORY, "Error in allocating the BSQ stream\n");
+			return -1;
+		}
+		memcpy(bsq, source, header_bytes);
+		memcpy(band_cursor, band_start, sizeof(unsigned long long) * config->input_params.z_size);
+		reset_decoder_state(config->input_params, encoder_params, &state);
+		if (scatter_codewords(source, stream_bits, first_bit, config->input_params, encoder_params, &state, band_cursor, bsq) != 0)
+			return -1;
+	}
+
+	// ... and read back band by band in the order of the requested interleaving.
+	target = bsq;
+	if (out_interleaving == BI)
+	{
+		if ((target = (unsigned char *)arena_calloc(arena, stream_bytes, 1)) == NULL)
+		{
+			log_error(CCSDS_ERROR_MEMORY, "Error in allocating the re-interleaved stream\n");
+			return -1;
+		}
+		memcpy(target, source, header_bytes);
+		target_params = encoder_params;
+		target_params.out_interleaving = BI;
+		target_params.out_interleaving_depth = out_interleaving_depth;
+		memcpy(band_cursor, band_start, sizeof(unsigned long long) * config->input_params.z_size);
+		reset_decoder_state(config->input_params, encoder_params, &state);
+		if (gather_codewords(bsq, stream_bits, first_bit, config->input_params, target_params, &state, band_cursor, target) != 0)
+			return -1;
+	}
+	// the codewords take the same bits in every order, so the padding to the output word is the same
+	patch_header(target, out_interleaving, out_interleaving_depth);
+
+	if (io_open(&outFile, config->io_backend, config->out_file, IO_WRITE) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "\nError in creating the re-interleaved stream %s\n\n", config->out_file);
+		return -1;
+	}
+	if (io_write(&outFile, 0, target, stream_bytes) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "\nError in writing the re-interleaved stream %s\n\n", config->out_file);
+		io_close(&outFile);
+		return -1;
+	}
+	if (io_close(&outFile) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "\nError in closing the re-interleaved stream %s\n\n", config->out_file);
+		return -1;
+	}
+
+	if (out_interleaving == BSQ)
+		log_info("Re-interleaved %zu codewords from %s to BSQ\n", IMAGE_SAMPLES(config->input_params),
+				encoder_params.out_interleaving == BSQ ? "BSQ" : "BI");
+	else
+		log_info("Re-interleaved %zu codewords from %s to BI - interleaving %u\n", IMAGE_SAMPLES(config->input_params),
+				encoder_params.out_interleaving == BSQ ? "BSQ" : "BI", out_interleaving_depth);
+	log_info("Re-interleaving duration %lf (sec)\n", ((double)clock()) / CLOCKS_PER_SEC - startTime);
+	return 0;
+}
+
+int reinterleave_ccsds123(decompressConfig_t *config, interleaving_t out_interleaving, unsigned int out_interleaving_depth)
+{
+	arena_t local_arena;
+	arena_t *arena = config->arena;
+	log_context_t log_context;
+	int result = 0;
+
+	log_begin(&log_context, config->log_callback, config->log_user_data);
+	if (arena == NULL)
+	{
+		arena = &local_arena;
+		arena_init(arena, 0, 0);
+	}
+	result = reinterleave_stream(config, out_interleaving, out_interleaving_depth, arena);
+
+	// All the memory used by the conversion is given back at once; the table points to it.
+	config->predictor_params.weight_init_table = NULL;
+	if (arena == config->arena)
+		arena_reset(arena);
+	else
+		arena_release(arena);
+	return log_end(&log_context, result);
+}
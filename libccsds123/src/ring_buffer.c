@@ -0,0 +1,103 @@
+#include <sched.h>
+#include <time.h>
+
+#include "ring_buffer.h"
+
+// Number of times the state of the queue is checked before yielding the processor, and of the yields
+// before sleeping
+#define SPIN_COUNT 64
+#define YIELD_COUNT 1024
+
+/// Waits a bit more at each call, given the number of times the state of the queue has already been checked
+static void backoff(unsigned int attempt)
+{
+	if (attempt < SPIN_COUNT)
+	{
+		return;
+	}
+	else if (attempt < SPIN_COUNT + YIELD_COUNT)
+	{
+		sched_yield();
+	}
+	else
+	{
+		struct timespec pause = {0, 50000};
+		nanosleep(&pause, NULL);
+	}
+}
+
+///Initializes the queue, allocating from arena num_slots slots of slot_size bytes each
+///@return a negative number if the memory could not be allocated
+int ring_init(ring_buffer_t *ring, size_t slot_size, size_t num_slots, arena_t *arena)
+{
+	// every slot starts on its own cache line
+	ring->slot_size = (slot_size + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT;
+	ring->num_slots = num_slots;
+	ring->head = 0;
+	ring->tail = 0;
+	ring->acquired = 0;
+	ring->cancelled = 0;
+	ring->slots = (unsigned char *)arena_alloc(arena, ring->slot_size * num_slots);
+	return ring->slots == NULL ? -1 : 0;
+}
+
+///Returns the number of bytes allocated by ring_init
+size_t ring_size(size_t slot_size, size_t num_slots)
+{
+	return (slot_size + ARENA_ALIGNMENT - 1) / ARENA_ALIGNMENT * ARENA_ALIGNMENT * num_slots;
+}
+
+///Producer: waits for a free slot and returns it, NULL if the queue has been cancelled
+void *ring_acquire_write(ring_buffer_t *ring)
+{
+	unsigned int attempt = 0;
+
+	// the slot of head is free once the consumer has released the one num_slots before it
+	while (ring->head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) == ring->num_slots)
+	{
+		if (__atomic_load_n(&ring->cancelled, __ATOMIC_RELAXED) != 0)
+			return NULL;
+		backoff(attempt++);
+	}
+	if (__atomic_load_n(&ring->cancelled, __ATOMIC_RELAXED) != 0)
+		return NULL;
+	return ring->slots + (ring->head % ring->num_slots) * ring->slot_size;
+}
+
+///Producer: hands the slot returned by the last ring_acquire_write to the consumer
+void ring_commit_write(ring_buffer_t *ring)
+{
+	__atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+}
+
+///Consumer: waits for the next committed slot and returns it, NULL if the queue has been cancelled;
+///the slot stays valid until it is released
+void *ring_acquire_read(ring_buffer_t *ring)
+{
+	unsigned int attempt = 0;
+	void *slot = NULL;
+
+	while (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->acquired)
+	{
+		if (__atomic_load_n(&ring->cancelled, __ATOMIC_RELAXED) != 0)
+			return NULL;
+		backoff(attempt++);
+	}
+	if (__atomic_load_n(&ring->cancelled, __ATOMIC_RELAXED) != 0)
+		return NULL;
+	slot = ring->slots + (ring->acquired % ring->num_slots) * ring->slot_size;
+	ring->acquired++;
+	return slot;
+}
+
+///Consumer: gives back to the producer the oldest slot it holds
+void ring_release_read(ring_buffer_t *ring)
+{
+	__atomic_store_n(&ring->tail, ring->tail + 1, __ATOMIC_RELEASE);
+}
+
+///Stops the queue: the pending and future waits of both threads return NULL
+void ring_cancel(ring_buffer_t *ring)
+{
+	__atomic_store_n(&ring->cancelled, 1, __ATOMIC_RELAXED);
+}
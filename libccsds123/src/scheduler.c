@@ -0,0 +1,760 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "scheduler.h"
+#include "predictor.h"
+#include "entropy_encoder.h"
+#include "utils.h"
+#include "band_index.h"
+
+// Initial number of tasks held by the queue of a worker; it grows when needed
+#define INITIAL_DEQUE_CAPACITY 64
+
+struct worker;
+
+/// Unit of work of a job; first_band and end_band delimit the bands it works on
+typedef struct task
+{
+	void (*run)(scheduler_t *scheduler, struct worker *worker, struct task *task);
+	compress_job_t *job;
+	unsigned int first_band;
+	unsigned int end_band;
+} task_t;
+
+/// Double ended queue of tasks, implemented as a ring buffer whose capacity is a power of two:
+/// the tasks are pushed and popped at the bottom and stolen from the top
+typedef struct task_deque
+{
+	pthread_mutex_t lock;
+	task_t **tasks;
+	size_t capacity;
+	size_t top;
+	size_t bottom;
+} task_deque_t;
+
+/// Compressed stream of a band encoded on its own
+typedef struct band_stream
+{
+	unsigned char *stream;
+	size_t written_bytes;
+	unsigned int written_bits;
+} band_stream_t;
+
+struct compress_job
+{
+	compressConfig_t config;
+	// holds the tables and the buffers of the image, released when the compression ends
+	arena_t arena;
+	void *samples;
+	void *residuals;
+	// per band streams and encoder statistics, only used when the bands are encoded separately
+	band_stream_t *band_streams;
+	encoder_state_t encoder_state;
+	task_t ingest;
+	// the prediction tasks, followed by the encoding ones and by the write one
+	task_t *tasks;
+	unsigned int num_predictions;
+	unsigned int num_encodings;
+	unsigned int pending_predictions;
+	unsigned int pending_encodings;
+	// the following fields are protected by the lock of the scheduler
+	ccsds_status_t status;
+	long long compressed_bytes;
+	int done;
+	struct compress_job *next_waiting;
+	struct compress_job *next_job;
+};
+
+/// Worker thread, with its queue of tasks and the scratch memory used by the tasks it runs
+typedef struct worker
+{
+	scheduler_t *scheduler;
+	unsigned int index;
+	pthread_t thread;
+	task_deque_t deque;
+	arena_t scratch;
+} worker_t;
+
+struct scheduler
+{
+	pthread_mutex_t lock;
+	pthread_cond_t work_available;
+	pthread_cond_t job_done;
+	worker_t *workers;
+	unsigned int num_workers;
+	// ingest tasks of the images started by scheduler_submit, stolen by the workers
+	task_deque_t injected;
+	// number of tasks in the queues not yet claimed by a worker
+	size_t queued_tasks;
+	unsigned int max_in_flight;
+	unsigned int in_flight;
+	// images waiting to be started, in submission order
+	compress_job_t *waiting_head;
+	compress_job_t *waiting_tail;
+	// all the jobs not yet waited for
+	compress_job_t *jobs;
+	unsigned int running_jobs;
+	int stopping;
+};
+
+/******************************************************
+ * Queues of tasks
+ *******************************************************/
+
+static int deque_init(task_deque_t *deque, size_t capacity)
+{
+	deque->capacity = INITIAL_DEQUE_CAPACITY;
+	while (deque->capacity < capacity)
+		deque->capacity *= 2;
+	deque->top = 0;
+	deque->bottom = 0;
+	if ((deque->tasks = (task_t **)malloc(sizeof(task_t *) * deque->capacity)) == NULL)
+		return -1;
+	pthread_mutex_init(&deque->lock, NULL);
+	return 0;
+}
+
+static void deque_destroy(task_deque_t *deque)
+{
+	pthread_mutex_destroy(&deque->lock);
+	free(deque->tasks);
+}
+
+/// Adds a task at the bottom of the queue, doubling its capacity when it is full
+/// @return a negative value if the queue could not grow
+static int deque_push(task_deque_t *deque, task_t *task)
+{
+	pthread_mutex_lock(&deque->lock);
+	if (deque->bottom - deque->top == deque->capacity)
+	{
+		size_t i = 0;
+		task_t **tasks = (task_t **)malloc(sizeof(task_t *) * deque->capacity * 2);
+		if (tasks == NULL)
+		{
+			pthread_mutex_unlock(&deque->lock);
+			return -1;
+		}
+		for (i = deque->top; i < deque->bottom; i++)
+			tasks[i & (deque->capacity * 2 - 1)] = deque->tasks[i & (deque->capacity - 1)];
+		free(deque->tasks);
+		deque->tasks = tasks;
+		deque->capacity *= 2;
+	}
+	deque->tasks[deque->bottom & (deque->capacity - 1)] = task;
+	deque->bottom++;
+	pthread_mutex_unlock(&deque->lock);
+	return 0;
+}
+
+/// Removes the task at the bottom of the queue (the last pushed one), NULL if the queue is empty
+static task_t *deque_pop(task_deque_t *deque)
+{
+	task_t *task = NULL;
+	pthread_mutex_lock(&deque->lock);
+	if (deque->bottom != deque->top)
+	{
+		deque->bottom--;
+		task = deque->tasks[deque->bottom & (deque->capacity - 1)];
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return task;
+}
+
+/// Removes the task at the top of the queue (the oldest one), NULL if the queue is empty
+static task_t *deque_steal(task_deque_t *deque)
+{
+	task_t *task = NULL;
+	pthread_mutex_lock(&deque->lock);
+	if (deque->bottom != deque->top)
+	{
+		task = deque->tasks[deque->top & (deque->capacity - 1)];
+		deque->top++;
+	}
+	pthread_mutex_unlock(&deque->lock);
+	return task;
+}
+
+/// Queues a task spawned by worker (or by the submitting thread when worker is NULL) and wakes up an
+/// idle worker; when the queue cannot grow the task is run right away
+static void push_task(scheduler_t *scheduler, worker_t *worker, task_t *task)
+{
+	if (deque_push(worker != NULL ? &worker->deque : &scheduler->injected, task) != 0)
+	{
+		task->run(scheduler, worker, task);
+		return;
+	}
+	pthread_mutex_lock(&scheduler->lock);
+	scheduler->queued_tasks++;
+	pthread_cond_signal(&scheduler->work_available);
+	pthread_mutex_unlock(&scheduler->lock);
+}
+
+/// Takes a task claimed by worker: first from its own queue, then from the injected tasks, then
+/// stealing from the other workers
+static task_t *take_task(scheduler_t *scheduler, worker_t *worker)
+{
+	task_t *task = NULL;
+	unsigned int i = 0;
+
+	for (;;)
+	{
+		if ((task = deque_pop(&worker->deque)) != NULL)
+			return task;
+		if ((task = deque_steal(&scheduler->injected)) != NULL)
+			return task;
+		for (i = 1; i < scheduler->num_workers; i++)
+		{
+			if ((task = deque_steal(&scheduler->workers[(worker->index + i) % scheduler->num_workers].deque)) != NULL)
+				return task;
+		}
+		// the claimed task is being moved by a push; try again
+		sched_yield();
+	}
+}
+
+static void *worker_main(void *argument)
+{
+	worker_t *worker = (worker_t *)argument;
+	scheduler_t *scheduler = worker->scheduler;
+	task_t *task = NULL;
+
+	for (;;)
+	{
+		// A task is claimed before being taken, so that the workers only look for tasks which are
+		// there and sleep otherwise
+		pthread_mutex_lock(&scheduler->lock);
+		while (scheduler->queued_tasks == 0 && scheduler->stopping == 0)
+			pthread_cond_wait(&scheduler->work_available, &scheduler->lock);
+		if (scheduler->queued_tasks == 0)
+		{
+			pthread_mutex_unlock(&scheduler->lock);
+			break;
+		}
+		scheduler->queued_tasks--;
+		pthread_mutex_unlock(&scheduler->lock);
+
+		task = take_task(scheduler, worker);
+		task->run(scheduler, worker, task);
+	}
+	return NULL;
+}
+
+/******************************************************
+ * Tasks of the compression of an image
+ *******************************************************/
+
+static void predict_task(scheduler_t *scheduler, worker_t *worker, task_t *task);
+static void encode_band_task(scheduler_t *scheduler, worker_t *worker, task_t *task);
+static void encode_task(scheduler_t *scheduler, worker_t *worker, task_t *task);
+static void write_task(scheduler_t *scheduler, worker_t *worker, task_t *task);
+
+/// The bands are encoded separately when the output stream holds them one after the other and the
+/// encoder keeps no state shared among them
+static int encode_bands_separately(const compressConfig_t *config)
+{
+	return config->encoder_params.encoding_method == SAMPLE && config->encoder_params.out_interleaving == BSQ;
+}
+
+/// Maximum number of bytes of the stream of a band, each residual taking at most u_max + D bits
+static size_t band_stream_capacity(const compressConfig_t *config)
+{
+	size_t band_samples = (size_t)config->input_params.x_size * config->input_params.y_size;
+	return (band_samples * (config->encoder_params.u_max + config->input_params.dyn_range) + 7) / 8 + 1;
+}
+
+/// Number of bands predicted by each prediction task: the pred_bands bands preceding each range
+/// have to be processed again, so ranges are kept at least twice as wide
+static unsigned int bands_per_task(const scheduler_t *scheduler, const compressConfig_t *config)
+{
+	unsigned int min_bands = 2 * (config->predictor_params.pred_bands + 1);
+	unsigned int bands = (config->input_params.z_size + 2 * scheduler->num_workers - 1) / (2 * scheduler->num_workers);
+	return bands > min_bands ? bands : min_bands;
+}
+
+/// Records the first error of the job
+static void fail_job(scheduler_t *scheduler, compress_job_t *job, ccsds_status_t status)
+{
+	pthread_mutex_lock(&scheduler->lock);
+	if (job->status == CCSDS_OK)
+		job->status = status;
+	pthread_mutex_unlock(&scheduler->lock);
+}
+
+static int job_failed(scheduler_t *scheduler, compress_job_t *job)
+{
+	int failed = 0;
+	pthread_mutex_lock(&scheduler->lock);
+	failed = job->status != CCSDS_OK;
+	pthread_mutex_unlock(&scheduler->lock);
+	return failed;
+}
+
+/// Ends the job, releasing its memory, and starts the first image waiting for its turn
+static void finish_job(scheduler_t *scheduler, worker_t *worker, compress_job_t *job, ccsds_status_t status)
+{
+	compress_job_t *next = NULL;
+
+	arena_release(&job->arena);
+	pthread_mutex_lock(&scheduler->lock);
+	if (job->status == CCSDS_OK)
+		job->status = status;
+	job->done = 1;
+	scheduler->running_jobs--;
+	if (scheduler->waiting_head != NULL)
+	{
+		next = scheduler->waiting_head;
+		scheduler->waiting_head = next->next_waiting;
+		if (scheduler->waiting_head == NULL)
+			scheduler->waiting_tail = NULL;
+	}
+	else
+	{
+		scheduler->in_flight--;
+	}
+	pthread_cond_broadcast(&scheduler->job_done);
+	pthread_mutex_unlock(&scheduler->lock);
+	if (next != NULL)
+		push_task(scheduler, worker, &next->ingest);
+}
+
+/// Allocates the buffers of the image and its tasks, and reads its samples
+static int load_job(scheduler_t *scheduler, compress_job_t *job)
+{
+	compressConfig_t *config = &job->config;
+	size_t image_bytes = SAMPLE_BYTES(config->input_params) * IMAGE_SAMPLES(config->input_params);
+	unsigned int band_range = bands_per_task(scheduler, config);
+	unsigned int num_predictions = (config->input_params.z_size + band_range - 1) / band_range;
+	unsigned int num_encodings = encode_bands_separately(config) ? config->input_params.z_size : 1;
+	size_t peak_memory = 2 * image_bytes + sizeof(task_t) * (num_predictions + num_encodings + 1);
+	unsigned int i = 0, z = 0;
+
+	if (encode_bands_separately(config))
+	{
+		// the band streams, and the whole stream when they are concatenated
+		peak_memory += 2 * band_stream_capacity(config) * config->input_params.z_size + sizeof(band_stream_t) * config->input_params.z_size +
+				encoder_state_size(config->input_params, config->encoder_params) + header_size_bound(config->input_params, config->predictor_params);
+	}
+	else
+	{
+		peak_memory += encode_working_set(config->input_params, config->encoder_params);
+	}
+	if (config->memory_budget != 0 && peak_memory > config->memory_budget)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "\nError, the compression of %s needs %zu bytes of memory, more than the budget of %zu bytes\n\n",
+				config->samples_file, peak_memory, config->memory_budget);
+		return -1;
+	}
+
+	job->samples = arena_alloc(&job->arena, image_bytes);
+	job->residuals = arena_alloc(&job->arena, image_bytes);
+	job->tasks = (task_t *)arena_alloc(&job->arena, sizeof(task_t) * (num_predictions + num_encodings + 1));
+	if (job->samples == NULL || job->residuals == NULL || job->tasks == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating %lf kBytes for the image and residuals buffers\n\n", ((double)2 * image_bytes) / 1024.0);
+		return -1;
+	}
+	if (encode_bands_separately(config))
+	{
+		job->band_streams = (band_stream_t *)arena_alloc(&job->arena, sizeof(band_stream_t) * config->input_params.z_size);
+		if (job->band_streams == NULL || init_encoder_state(config->input_params, config->encoder_params, &job->encoder_state, &job->arena) != 0)
+		{
+			log_error(CCSDS_ERROR_MEMORY, "Error in allocating the streams of the bands\n\n");
+			return -1;
+		}
+		for (z = 0; z < config->input_params.z_size; z++)
+		{
+			job->band_streams[z].written_bytes = 0;
+			job->band_streams[z].written_bits = 0;
+			if ((job->band_streams[z].stream = (unsigned char *)arena_calloc(&job->arena, band_stream_capacity(config), 1)) == NULL)
+			{
+				log_error(CCSDS_ERROR_MEMORY, "Error in allocating the streams of the bands\n\n");
+				return -1;
+			}
+		}
+	}
+	if (read_samples(config->input_params, config->io_backend, config->samples_file, job->samples) != 0)
+		return -1;
+
+	for (i = 0; i < num_predictions + num_encodings + 1; i++)
+	{
+		job->tasks[i].job = job;
+		if (i < num_predictions)
+		{
+			job->tasks[i].run = predict_task;
+			job->tasks[i].first_band = i * band_range;
+			job->tasks[i].end_band = MIN((i + 1) * band_range, config->input_params.z_size);
+		}
+		else if (i < num_predictions + num_encodings)
+		{
+			job->tasks[i].run = encode_bands_separately(config) ? encode_band_task : encode_task;
+			job->tasks[i].first_band = i - num_predictions;
+			job->tasks[i].end_band = job->tasks[i].first_band + 1;
+		}
+		else
+		{
+			job->tasks[i].run = write_task;
+		}
+	}
+	job->num_predictions = num_predictions;
+	job->num_encodings = num_encodings;
+	job->pending_predictions = num_predictions;
+	job->pending_encodings = num_encodings;
+	log_info("Compression of %s: %u prediction and %u encoding tasks, estimated peak memory %zu bytes (%.2lf kb)\n",
+			config->samples_file, num_predictions, num_encodings, peak_memory, ((double)peak_memory) / 1024.0);
+	return 0;
+}
+
+/// Checks the configuration and loads the image, then spawns its prediction tasks
+static void ingest_task(scheduler_t *scheduler, worker_t *worker, task_t *task)
+{
+	compress_job_t *job = task->job;
+	log_context_t log_context;
+	ccsds_status_t status = CCSDS_OK;
+	task_t *predictions = NULL;
+	unsigned int num_predictions = 0;
+	unsigned int i = 0;
+
+	arena_init(&job->arena, 0, 0);
+	status = (ccsds_status_t)compress_prepare(&job->config, &job->arena);
+	if (status == CCSDS_OK)
+	{
+		log_begin(&log_context, job->config.log_callback, job->config.log_user_data);
+		status = log_end(&log_context, load_job(scheduler, job));
+	}
+	if (status != CCSDS_OK)
+	{
+		finish_job(scheduler, worker, job, status);
+		return;
+	}
+	// the job can end as soon as its last prediction is queued
+	predictions = job->tasks;
+	num_predictions = job->num_predictions;
+	for (i = 0; i < num_predictions; i++)
+		push_task(scheduler, worker, &predictions[i]);
+}
+
+/// Predicts a range of bands, then spawns the encoding tasks which can start
+static void predict_task(scheduler_t *scheduler, worker_t *worker, task_t *task)
+{
+	compress_job_t *job = task->job;
+	log_context_t log_context;
+	ccsds_status_t status = CCSDS_OK;
+	unsigned int remaining = 0;
+	unsigned int z = 0;
+
+	if (job_failed(scheduler, job) == 0)
+	{
+		log_begin(&log_context, job->config.log_callback, job->config.log_user_data);
+		status = log_end(&log_context, predict_bands(job->config.input_params, job->config.predictor_params, job->samples, job->residuals,
+					task->first_band, task->end_band, &worker->scratch));
+		if (status != CCSDS_OK)
+			fail_job(scheduler, job, status);
+	}
+
+	pthread_mutex_lock(&scheduler->lock);
+	remaining = --job->pending_predictions;
+	pthread_mutex_unlock(&scheduler->lock);
+	if (encode_bands_separately(&job->config))
+	{
+		// the bands just predicted can be encoded right away; as the job (and the task) can end as
+		// soon as the last band is queued, nothing is read from them after that
+		task_t *encodings = job->tasks + job->num_predictions;
+		unsigned int end_band = task->end_band;
+		for (z = task->first_band; z < end_band; z++)
+			push_task(scheduler, worker, &encodings[z]);
+	}
+	else if (remaining == 0)
+	{
+		push_task(scheduler, worker, &job->tasks[job->num_predictions]);
+	}
+}
+
+/// Encodes a band into its own stream, spawning the write task after the last band
+static void encode_band_task(scheduler_t *scheduler, worker_t *worker, task_t *task)
+{
+	compress_job_t *job = task->job;
+	const input_feature_t input_params = job->config.input_params;
+	const unsigned int sample_bytes = SAMPLE_BYTES(input_params);
+	band_stream_t *band = &job->band_streams[task->first_band];
+	log_context_t log_context;
+	ccsds_status_t status = CCSDS_OK;
+	unsigned int remaining = 0;
+	unsigned int x = 0, y = 0, z = task->first_band;
+	int result = 0;
+
+	if (job_failed(scheduler, job) == 0)
+	{
+		log_begin(&log_context, job->config.log_callback, job->config.log_user_data);
+		for (y = 0; y < input_params.y_size && result == 0; y++)
+		{
+			for (x = 0; x < input_params.x_size && result == 0; x++)
+			{
+				result = encode_residual(input_params, job->config.encoder_params, &job->encoder_state, x, y, z,
+						GET_ELEMENT(job->residuals, sample_bytes, BSQ_OFFSET(input_params, x, y, z)), band->stream, &band->written_bytes, &band->written_bits);
+			}
+		}
+		status = log_end(&log_context, result);
+		if (status != CCSDS_OK)
+			fail_job(scheduler, job, status);
+	}
+
+	pthread_mutex_lock(&scheduler->lock);
+	remaining = --job->pending_encodings;
+	pthread_mutex_unlock(&scheduler->lock);
+	if (remaining == 0)
+		push_task(scheduler, worker, &job->tasks[job->num_predictions + job->num_encodings]);
+}
+
+/// Encodes the whole image and writes it to the output file, once all its bands have been predicted
+static void encode_task(scheduler_t *scheduler, worker_t *worker, task_t *task)
+{
+	compress_job_t *job = task->job;
+	log_context_t log_context;
+	ccsds_status_t status = CCSDS_OK;
+	long long compressed_bytes = 0;
+
+	if (job_failed(scheduler, job) == 0)
+	{
+		log_begin(&log_context, job->config.log_callback, job->config.log_user_data);
+		compressed_bytes = encode(job->config.input_params, job->config.encoder_params, job->config.predictor_params,
+				job->residuals, job->config.out_file, job->config.io_backend, &job->arena);
+		if (compressed_bytes >= 0)
+			log_info("%lld bytes (%.2lf kb) in the compressed image %s\n", compressed_bytes, ((double)compressed_bytes) / 1024.0, job->config.out_file);
+		status = log_end(&log_context, compressed_bytes < 0 ? -1 : 0);
+		job->compressed_bytes = compressed_bytes;
+	}
+	finish_job(scheduler, worker, job, status);
+}
+
+/// Concatenates the streams of the bands after the header and writes the result to the output file
+static int write_bands(compress_job_t *job)
+{
+	compressConfig_t *config = &job->config;
+	size_t capacity = header_size_bound(config->input_params, config->predictor_params) + config->encoder_params.out_wordsize;
+	unsigned char *compressed_stream = NULL;
+	size_t written_bytes = 0;
+	unsigned int written_bits = 0;
+	io_file_t outFile;
+	int result = 0;
+	unsigned int z = 0;
+
+	for (z = 0; z < config->input_params.z_size; z++)
+		capacity += job->band_streams[z].written_bytes + 1;
+	if ((compressed_stream = (unsigned char *)arena_calloc(&job->arena, capacity, 1)) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in the allocation of the compressed stream\n\n");
+		return -1;
+	}
+	create_header(&written_bytes, &written_bits, compressed_stream, config->input_params, config->predictor_params, config->encoder_params);
+	for (z = 0; z < config->input_params.z_size; z++)
+	{
+		bitStream_append(compressed_stream, &written_bytes, &written_bits, job->band_streams[z].stream,
+				job->band_streams[z].written_bytes, job->band_streams[z].written_bits);
+	}
+	pad_to_word(config->encoder_params, compressed_stream, &written_bytes, &written_bits, 0);
+
+	if (io_open(&outFile, config->io_backend, config->out_file, IO_WRITE) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in creating file %s for writing the compression result\n\n", config->out_file);
+		return -1;
+	}
+	result = io_append(&outFile, compressed_stream, written_bytes);
+	if (io_close(&outFile) != 0 || result != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in writing the %zu bytes of the compressed stream to %s\n\n", written_bytes, config->out_file);
+		return -1;
+	}
+	if (config->band_index_file[0] != '\x0')
+	{
+		// the streams of the bands are the ones of the band index
+		unsigned long long *band_bits = (unsigned long long *)arena_alloc(&job->arena, sizeof(unsigned long long) * config->input_params.z_size);
+		if (band_bits == NULL)
+		{
+			log_error(CCSDS_ERROR_MEMORY, "Error in the allocation of the band index\n\n");
+			return -1;
+		}
+		for (z = 0; z < config->input_params.z_size; z++)
+			band_bits[z] = job->band_streams[z].written_bytes * 8ULL + job->band_streams[z].written_bits;
+		if (write_band_index(config->band_index_file, config->input_params, band_bits) != 0)
+			return -1;
+	}
+	job->compressed_bytes = (long long)written_bytes;
+	log_info("%lld bytes (%.2lf kb) in the compressed image %s\n", job->compressed_bytes, ((double)job->compressed_bytes) / 1024.0, config->out_file);
+	return 0;
+}
+
+static void write_task(scheduler_t *scheduler, worker_t *worker, task_t *task)
+{
+	compress_job_t *job = task->job;
+	log_context_t log_context;
+	ccsds_status_t status = CCSDS_OK;
+
+	if (job_failed(scheduler, job) == 0)
+	{
+		log_begin(&log_context, job->config.log_callback, job->config.log_user_data);
+		status = log_end(&log_context, write_bands(job));
+	}
+	finish_job(scheduler, worker, job, status);
+}
+
+/******************************************************
+ * Public functions
+ *******************************************************/
+
+/// Stops the first num_workers workers and frees the scheduler
+static void stop_workers(scheduler_t *scheduler, unsigned int num_workers)
+{
+	unsigned int i = 0;
+
+	pthread_mutex_lock(&scheduler->lock);
+	scheduler->stopping = 1;
+	pthread_cond_broadcast(&scheduler->work_available);
+	pthread_mutex_unlock(&scheduler->lock);
+	for (i = 0; i < num_workers; i++)
+		pthread_join(scheduler->workers[i].thread, NULL);
+	for (i = 0; i < scheduler->num_workers; i++)
+	{
+		deque_destroy(&scheduler->workers[i].deque);
+		arena_release(&scheduler->workers[i].scratch);
+	}
+	deque_destroy(&scheduler->injected);
+	pthread_cond_destroy(&scheduler->job_done);
+	pthread_cond_destroy(&scheduler->work_available);
+	pthread_mutex_destroy(&scheduler->lock);
+	free(scheduler->workers);
+	free(scheduler);
+}
+
+int scheduler_create(unsigned int num_threads, unsigned int max_in_flight, scheduler_t **scheduler)
+{
+	unsigned int i = 0;
+
+	*scheduler = NULL;
+	if (num_threads == 0)
+	{
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		num_threads = online > 0 ? (unsigned int)online : 1;
+	}
+	if (max_in_flight == 0)
+		max_in_flight = num_threads;
+	if ((*scheduler = (scheduler_t *)calloc(1, sizeof(scheduler_t))) == NULL)
+		return CCSDS_ERROR_MEMORY;
+	if (((*scheduler)->workers = (worker_t *)calloc(num_threads, sizeof(worker_t))) == NULL ||
+			deque_init(&(*scheduler)->injected, max_in_flight) != 0)
+	{
+		free((*scheduler)->workers);
+		free(*scheduler);
+		*scheduler = NULL;
+		return CCSDS_ERROR_MEMORY;
+	}
+	pthread_mutex_init(&(*scheduler)->lock, NULL);
+	pthread_cond_init(&(*scheduler)->work_available, NULL);
+	pthread_cond_init(&(*scheduler)->job_done, NULL);
+	(*scheduler)->max_in_flight = max_in_flight;
+	for (i = 0; i < num_threads; i++)
+	{
+		worker_t *worker = &(*scheduler)->workers[i];
+		worker->scheduler = *scheduler;
+		worker->index = i;
+		arena_init(&worker->scratch, 0, 0);
+		if (deque_init(&worker->deque, 0) != 0)
+			break;
+		(*scheduler)->num_workers++;
+	}
+	if ((*scheduler)->num_workers < num_threads)
+	{
+		stop_workers(*scheduler, 0);
+		*scheduler = NULL;
+		return CCSDS_ERROR_MEMORY;
+	}
+	for (i = 0; i < num_threads; i++)
+	{
+		if (pthread_create(&(*scheduler)->workers[i].thread, NULL, worker_main, &(*scheduler)->workers[i]) != 0)
+		{
+			stop_workers(*scheduler, i);
+			*scheduler = NULL;
+			return CCSDS_ERROR_INTERNAL;
+		}
+	}
+	return CCSDS_OK;
+}
+
+int scheduler_submit(scheduler_t *scheduler, const compressConfig_t *config, compress_job_t **job)
+{
+	log_context_t log_context;
+	int start = 0;
+
+	log_begin(&log_context, config->log_callback, config->log_user_data);
+	if ((*job = (compress_job_t *)calloc(1, sizeof(compress_job_t))) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "\nError, in allocating the compression job\n\n");
+		return log_end(&log_context, -1);
+	}
+	(*job)->config = *config;
+	(*job)->config.arena = NULL;
+	(*job)->ingest.run = ingest_task;
+	(*job)->ingest.job = *job;
+
+	pthread_mutex_lock(&scheduler->lock);
+	(*job)->next_job = scheduler->jobs;
+	scheduler->jobs = *job;
+	scheduler->running_jobs++;
+	if (scheduler->in_flight < scheduler->max_in_flight)
+	{
+		scheduler->in_flight++;
+		start = 1;
+	}
+	else if (scheduler->waiting_tail != NULL)
+	{
+		scheduler->waiting_tail->next_waiting = *job;
+		scheduler->waiting_tail = *job;
+	}
+	else
+	{
+		scheduler->waiting_head = *job;
+		scheduler->waiting_tail = *job;
+	}
+	pthread_mutex_unlock(&scheduler->lock);
+	if (start != 0)
+		push_task(scheduler, NULL, &(*job)->ingest);
+	return log_end(&log_context, 0);
+}
+
+long long scheduler_wait(scheduler_t *scheduler, compress_job_t *job)
+{
+	compress_job_t **link = NULL;
+	long long result = 0;
+
+	pthread_mutex_lock(&scheduler->lock);
+	while (job->done == 0)
+		pthread_cond_wait(&scheduler->job_done, &scheduler->lock);
+	for (link = &scheduler->jobs; *link != job; link = &(*link)->next_job)
+		;
+	*link = job->next_job;
+	pthread_mutex_unlock(&scheduler->lock);
+	result = job->status == CCSDS_OK ? job->compressed_bytes : job->status;
+	free(job);
+	return result;
+}
+
+void scheduler_destroy(scheduler_t *scheduler)
+{
+	compress_job_t *job = NULL;
+
+	if (scheduler == NULL)
+		return;
+	pthread_mutex_lock(&scheduler->lock);
+	while (scheduler->running_jobs > 0)
+		pthread_cond_wait(&scheduler->job_done, &scheduler->lock);
+	pthread_mutex_unlock(&scheduler->lock);
+	while ((job = scheduler->jobs) != NULL)
+	{
+		scheduler->jobs = job->next_job;
+		free(job);
+	}
+	stop_workers(scheduler, scheduler->num_workers);
+}
@@ -0,0 +1,499 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "segment_decoder.h"
+#include "checkpoint.h"
+#include "decoder.h"
+#include "unpredict.h"
+
+/// Decompression of a range of lines split in segments, shared by the threads taking part in it; segment 0
+/// starts at the first line of the range, the other ones at the checkpoints inside it
+typedef struct
+{
+	const char *inputFile;
+	io_backend_t backend;
+	input_feature_t input_params;
+	// the image written to the output file: the lines of the range
+	input_feature_t output_params;
+	predictor_config_t predictor_params;
+	encoder_config_t encoder_params;
+	unsigned long long header_bits;
+	unsigned int first_line;
+	unsigned int last_line;
+	// lines between two checkpoints, 0 without checkpoints
+	unsigned int interval;
+	unsigned int num_segments;
+	io_file_t outFile;
+	log_callback_t log_callback;
+	void *log_user_data;
+	// next segment to be decoded, accessed atomically
+	unsigned int next_segment;
+	// number of segments written to the output file and whether a thread failed, updated under lock
+	pthread_mutex_t lock;
+	pthread_cond_t written;
+	unsigned int written_segments;
+	int failed;
+} segment_decoding_t;
+
+/// Thread decoding segments until none is left, with its own stream and buffers; stream is the one of the
+/// calling thread, NULL for the other threads, which open their own
+typedef struct
+{
+	segment_decoding_t *decoding;
+	FILE *stream;
+	checkpoint_file_t checkpoints;
+	line_checkpoint_t checkpoint;
+	decoder_state_t state;
+	// the line being reconstructed and the previous one
+	unsigned short int *lines;
+	unsigned short int *raw_chunk;
+	unsigned short int *residual_line;
+	// the lines of the segment not written yet, as the previous segments are still being decoded
+	unsigned short int *pending;
+	unsigned int pending_lines;
+	// scratch of the writing: the line in the order of the BI output file and the formatted samples
+	unsigned short int *raw_line;
+	unsigned char *formatted;
+	row_differences_t *window_differences;
+	row_differences_t **band_differences;
+	pthread_t thread;
+	ccsds_status_t status;
+} segment_decoder_t;
+
+/// Number of bytes of memory used by every thread: the statistics, the weights and the (0, 0) samples of
+/// every band, the line buffers, the local differences and the lines of a segment, when they are kept
+static size_t segment_thread_working_set(input_feature_t input_params, predictor_config_t predictor_params, unsigned int pending_lines)
+{
+	const size_t line_samples = (size_t)input_params.x_size * input_params.z_size;
+	size_t weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+	size_t window = predictor_params.pred_bands + 1;
+	size_t arrays_per_row = predictor_params.full != 0 ? 5 : 2;
+	size_t bytes = decoder_state_size(input_params);
+
+	if (weights_len == 0)
+		weights_len = 1;
+	bytes += (sizeof(unsigned short int) + sizeof(int) * weights_len) * input_params.z_size;
+	bytes += sizeof(unsigned short int) * line_samples * (4 + (size_t)pending_lines);
+	bytes += OUTPUT_SAMPLE_BYTES(input_params) * line_samples;
+	bytes += sizeof(int) * input_params.x_size * window * arrays_per_row + (sizeof(row_differences_t) + sizeof(row_differences_t *)) * window;
+	return bytes;
+}
+
+/// Allocates the buffers of a thread from arena
+static int alloc_segment_decoder(segment_decoder_t *decoder, segment_decoding_t *decoding, unsigned int pending_lines, arena_t *arena)
+{
+	const input_feature_t input_params = decoding->input_params;
+	const predictor_config_t predictor_params = decoding->predictor_params;
+	const size_t line_samples = (size_t)input_params.x_size * input_params.z_size;
+	unsigned int weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+	unsigned int window = predictor_params.pred_bands + 1;
+	unsigned int arrays_per_row = predictor_params.full != 0 ? 5 : 2;
+	int *differences_buffer = NULL;
+
+	decoder->decoding = decoding;
+	if (init_decoder_state(input_params, decoding->encoder_params, &decoder->state, arena) != 0)
+		return -1;
+	decoder->checkpoint.counter = decoder->state.counter;
+	decoder->checkpoint.accumulator = decoder->state.accumulator;
+	decoder->checkpoint.origins = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * input_params.z_size);
+	decoder->checkpoint.weights = (int *)arena_alloc(arena, sizeof(int) * (weights_len > 0 ? weights_len : 1) * input_params.z_size);
+	// the central differences of the samples are computed (and then corrected) before they are extracted
+	decoder->lines = (unsigned short int *)arena_calloc(arena, 2 * line_samples, sizeof(unsigned short int));
+	decoder->raw_chunk = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * line_samples);
+	decoder->residual_line = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * line_samples);
+	decoder->raw_line = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * line_samples);
+	decoder->formatted = (unsigned char *)arena_alloc(arena, OUTPUT_SAMPLE_BYTES(input_params) * line_samples);
+	differences_buffer = (int *)arena_alloc(arena, sizeof(int) * input_params.x_size * window * arrays_per_row);
+	decoder->window_differences = (row_differences_t *)arena_alloc(arena, sizeof(row_differences_t) * window);
+	decoder->band_differences = (row_differences_t **)arena_alloc(arena, sizeof(row_differences_t *) * window);
+	if (pending_lines > 0)
+		decoder->pending = (unsigned short int *)arena_alloc(arena, sizeof(unsigned short int) * line_samples * pending_lines);
+	if (decoder->checkpoint.origins == NULL || decoder->checkpoint.weights == NULL || decoder->lines == NULL || decoder->raw_chunk == NULL ||
+			decoder->residual_line == NULL || decoder->raw_line == NULL || decoder->formatted == NULL || differences_buffer == NULL ||
+			decoder->window_differences == NULL || decoder->band_differences == NULL || (pending_lines > 0 && decoder->pending == NULL))
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the lines buffers of the segment decompression\n\n");
+		return -1;
+	}
+	init_differences_window(predictor_params, input_params.x_size, window, differences_buffer, decoder->window_differences);
+	return 0;
+}
+
+/// Writes the line y of the image (row y of band z at line + z * x_size) in the output file: it is
+/// contiguous in a BI file, while in a BSQ file each of its rows is written to its band
+static int write_line(segment_decoder_t *decoder, unsigned int y, const unsigned short int *line)
+{
+	segment_decoding_t *decoding = decoder->decoding;
+	const input_feature_t output_params = decoding->output_params;
+	const size_t line_samples = (size_t)output_params.x_size * output_params.z_size;
+	const unsigned int sample_bytes = OUTPUT_SAMPLE_BYTES(output_params);
+	unsigned int s_mid = 0x1 << (output_params.dyn_range - 1);
+	unsigned int out_y = y - decoding->first_line;
+	unsigned int z = 0;
+
+	if (output_params.in_interleaving == BI)
+	{
+		interleave_line(line, decoder->raw_line, output_params.x_size, output_params.z_size, output_params.in_interleaving_depth);
+		format_samples(output_params, decoder->raw_line, line_samples, s_mid, decoder->formatted);
+		if (io_write(&decoding->outFile, (unsigned long long)out_y * line_samples * sample_bytes, decoder->formatted, line_samples * sample_bytes) != 0)
+		{
+			log_error(CCSDS_ERROR_IO, "Error in writing the uncompressed samples to the output file\n");
+			return -1;
+		}
+		return 0;
+	}
+	format_samples(output_params, line, line_samples, s_mid, decoder->formatted);
+	for (z = 0; z < output_params.z_size; z++)
+	{
+		if (io_write(&decoding->outFile, (unsigned long long)BSQ_OFFSET(output_params, 0, out_y, z) * sample_bytes,
+				decoder->formatted + (size_t)z * output_params.x_size * sample_bytes, output_params.x_size * sample_bytes) != 0)
+		{
+			log_error(CCSDS_ERROR_IO, "Error in writing the uncompressed samples to the output file\n");
+			return -1;
+		}
+	}
+	return 0;
+}
+
+/// Writes the lines of the segment kept in memory, which end right before line y
+static int write_pending(segment_decoder_t *decoder, unsigned int y)
+{
+	const size_t line_samples = (size_t)decoder->decoding->input_params.x_size * decoder->decoding->input_params.z_size;
+	unsigned int i = 0;
+
+	for (i = 0; i < decoder->pending_lines; i++)
+	{
+		if (write_line(decoder, y - decoder->pending_lines + i, decoder->pending + i * line_samples) != 0)
+			return -1;
+	}
+	decoder->pending_lines = 0;
+	return 0;
+}
+
+/// Outputs the line y of segment: it is written at once when all the previous segments have been written,
+/// otherwise it is kept until they are
+static int output_line(segment_decoder_t *decoder, unsigned int segment, unsigned int y, const unsigned short int *line)
+{
+	const size_t line_samples = (size_t)decoder->decoding->input_params.x_size * decoder->decoding->input_params.z_size;
+
+	if (__atomic_load_n(&decoder->decoding->written_segments, __ATOMIC_ACQUIRE) == segment)
+	{
+		if (write_pending(decoder, y) != 0)
+			return -1;
+		return write_line(decoder, y, line);
+	}
+	memcpy(decoder->pending + decoder->pending_lines * line_samples, line, sizeof(unsigned short int) * line_samples);
+	decoder->pending_lines++;
+	return 0;
+}
+
+/// Decodes the lines [base, end) of the stream, the state of the decoding at line base being the initial
+/// one or the one of a checkpoint, and outputs the ones from start on
+static int decode_segment(segment_decoder_t *decoder, unsigned int segment, unsigned int base, unsigned int start, unsigned int end)
+{
+	segment_decoding_t *decoding = decoder->decoding;
+	const input_feature_t input_params = decoding->input_params;
+	const predictor_config_t predictor_params = decoding->predictor_params;
+	const encoder_config_t encoder_params = decoding->encoder_params;
+	const size_t x_size = input_params.x_size;
+	const size_t line_samples = x_size * input_params.z_size;
+	unsigned int weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+	unsigned int window = predictor_params.pred_bands + 1;
+	unsigned short int *origins = decoder->checkpoint.origins;
+	unsigned int y = 0, z = 0, i = 0;
+
+	if (base == 0)
+	{
+		reset_decoder_state(input_params, encoder_params, &decoder->state);
+		if (seek_decoder_state(decoder->stream, &decoder->state, 0, decoding->header_bits) != 0)
+			return -1;
+	}
+	else
+	{
+		decoder->checkpoint.prev_line = decoder->lines + ((base + 1) & 0x1) * line_samples;
+		if (checkpoint_read(&decoder->checkpoints, base / decoding->interval - 1, &decoder->checkpoint) != 0 ||
+				seek_decoder_state(decoder->stream, &decoder->state, base * line_samples, decoding->header_bits + decoder->checkpoint.bit_offset) != 0)
+			return -1;
+	}
+
+	for (y = base; y < end; y++)
+	{
+		unsigned short int *line = decoder->lines + (y & 0x1) * line_samples;
+		const unsigned short int *prev_line = decoder->lines + ((y + 1) & 0x1) * line_samples;
+		if (__atomic_load_n(&decoding->failed, __ATOMIC_RELAXED) != 0)
+			return 0;
+		if (decode_residuals(decoder->stream, input_params, encoder_params, &decoder->state, decoder->raw_chunk, line_samples) != 0)
+			return -1;
+		deinterleave_line(decoder->raw_chunk, decoder->residual_line, input_params.x_size, input_params.z_size, encoder_params.out_interleaving_depth);
+		for (z = 0; z < input_params.z_size; z++)
+		{
+			unsigned int cur_pred_bands = z < predictor_params.pred_bands ? z : predictor_params.pred_bands;
+			for (i = 0; i <= cur_pred_bands; i++)
+			{
+				decoder->band_differences[i] = &decoder->window_differences[(z - i) % window];
+			}
+			unpredict_row(input_params, predictor_params, y, z, line + z * x_size, y > 0 ? prev_line + z * x_size : NULL,
+					z > 0 ? origins[z - 1] : 0, decoder->band_differences, decoder->checkpoint.weights + z * weights_len,
+					decoder->residual_line + z * x_size);
+			if (y == 0)
+				origins[z] = line[z * x_size];
+		}
+		if (y >= start && output_line(decoder, segment, y, line) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+/// Marks the decompression as failed, waking up the threads waiting for their turn to write
+static void fail_decoding(segment_decoding_t *decoding)
+{
+	pthread_mutex_lock(&decoding->lock);
+	__atomic_store_n(&decoding->failed, 1, __ATOMIC_RELAXED);
+	pthread_cond_broadcast(&decoding->written);
+	pthread_mutex_unlock(&decoding->lock);
+}
+
+/// Waits until the segments before segment have been written, then writes the lines of segment still in
+/// memory, which end right before line end, and lets the next segment be written
+/// @return 0 if the lines were written or another thread failed, a negative value in case of error
+static int finish_segment(segment_decoder_t *decoder, unsigned int segment, unsigned int end)
+{
+	segment_decoding_t *decoding = decoder->decoding;
+	int failed = 0;
+
+	pthread_mutex_lock(&decoding->lock);
+	while (decoding->written_segments != segment && decoding->failed == 0)
+		pthread_cond_wait(&decoding->written, &decoding->lock);
+	failed = decoding->failed;
+	pthread_mutex_unlock(&decoding->lock);
+	if (failed != 0)
+		return 0;
+	if (write_pending(decoder, end) != 0)
+		return -1;
+	pthread_mutex_lock(&decoding->lock);
+	__atomic_store_n(&decoding->written_segments, segment + 1, __ATOMIC_RELEASE);
+	pthread_cond_broadcast(&decoding->written);
+	pthread_mutex_unlock(&decoding->lock);
+	return 0;
+}
+
+/// Decodes the next segment not taken by another thread, until all of them are decoded or a thread fails
+static void *decode_segments(void *argument)
+{
+	segment_decoder_t *decoder = (segment_decoder_t *)argument;
+	segment_decoding_t *decoding = decoder->decoding;
+	FILE *ownStream = NULL;
+	io_file_t streamFile;
+	log_context_t log_context;
+	int result = 0;
+
+	log_begin(&log_context, decoding->log_callback, decoding->log_user_data);
+	// the threads seek to their segments: the pread and O_DIRECT backends would read the whole stream for
+	// each of them, so they go through stdio
+	if (decoder->stream == NULL)
+	{
+		ownStream = io_open_stream(&streamFile, decoding->backend == IO_BACKEND_MMAP ? IO_BACKEND_MMAP : IO_BACKEND_STDIO, decoding->inputFile);
+		if (ownStream == NULL)
+		{
+			log_error(CCSDS_ERROR_IO, "Error in opening file %s containing the compressed stream\n", decoding->inputFile);
+			result = -1;
+		}
+		decoder->stream = ownStream;
+	}
+	while (result == 0 && __atomic_load_n(&decoding->failed, __ATOMIC_RELAXED) == 0)
+	{
+		unsigned int segment = __atomic_fetch_add(&decoding->next_segment, 1, __ATOMIC_RELAXED);
+		unsigned int start = decoding->first_line, base = 0, end = decoding->last_line;
+		if (segment >= decoding->num_segments)
+			break;
+		if (decoding->interval != 0)
+		{
+			// segment 0 resumes from the checkpoint before the range, the other ones start at a checkpoint
+			base = (decoding->first_line / decoding->interval + segment) * decoding->interval;
+			if (segment > 0)
+				start = base;
+			end = MIN(base + decoding->interval, decoding->last_line);
+		}
+		result = decode_segment(decoder, segment, base, start, end);
+		if (result == 0 && __atomic_load_n(&decoding->failed, __ATOMIC_RELAXED) == 0)
+			result = finish_segment(decoder, segment, end);
+	}
+	if (result != 0)
+		fail_decoding(decoding);
+	if (ownStream != NULL)
+		io_close_stream(&streamFile, ownStream);
+	decoder->status = log_end(&log_context, result);
+	return NULL;
+}
+
+/// Decompresses the lines [first_line, first_line + num_lines) of the stream in inputFile into outputFile,
+/// resuming from the checkpoints of checkpointFile when it is given.
+int decompress_lines(char inputFile[128], char checkpointFile[128], unsigned int first_line, unsigned int num_lines, char outputFile[128],
+		input_feature_t *input_params, predictor_config_t *predictor_params, unsigned int num_threads, io_backend_t backend,
+		size_t memory_budget, arena_t *arena)
+{
+	segment_decoding_t decoding;
+	segment_decoder_t *decoders = NULL;
+	encoder_config_t encoder_params;
+	FILE *inFile = NULL;
+	io_file_t inStream;
+	long header_bytes = 0;
+	unsigned int pending_lines = 0;
+	unsigned int started = 0;
+	unsigned int i = 0;
+	size_t working_set = 0;
+	int result = 0;
+	arena_mark_t mark = arena_get_mark(arena);
+	arena_mark_t buffers_mark;
+
+	memset(&decoding, 0, sizeof(segment_decoding_t));
+	memset(&encoder_params, 0, sizeof(encoder_config_t));
+	if ((inFile = io_open_stream(&inStream, backend, inputFile)) == NULL)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in opening file %s containing the compressed stream\n", inputFile);
+		return -1;
+	}
+	// the tables of the header are kept until the end of the decompression
+	predictor_params->weight_init_table = NULL;
+	if (read_header(inFile, input_params, &encoder_params, predictor_params, arena) != 0 || check_image_size(*input_params) != 0 ||
+			(header_bytes = ftell(inFile)) < 0)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error in reading the header of the compressed stream\n");
+		io_close_stream(&inStream, inFile);
+		arena_rewind(arena, mark);
+		return -1;
+	}
+	buffers_mark = arena_get_mark(arena);
+	if (num_lines == 0 && first_line < input_params->y_size)
+		num_lines = input_params->y_size - first_line;
+	if (encoder_params.out_interleaving != BI || first_line >= input_params->y_size || num_lines > input_params->y_size - first_line)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "Error, the lines [%u, %u) cannot be extracted from the stream: it must be BI and hold them\n",
+				first_line, first_line + num_lines);
+		result = -1;
+	}
+	else if (checkpointFile != NULL && checkpointFile[0] != '\x0' && encoder_params.encoding_method != SAMPLE)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "Error, the checkpoints can only be used with streams compressed with the sample adaptive encoder\n");
+		result = -1;
+	}
+	decoding.inputFile = inputFile;
+	decoding.backend = backend;
+	decoding.input_params = *input_params;
+	decoding.output_params = *input_params;
+	decoding.output_params.y_size = num_lines;
+	decoding.predictor_params = *predictor_params;
+	decoding.encoder_params = encoder_params;
+	decoding.header_bits = (unsigned long long)header_bytes * 8;
+	decoding.first_line = first_line;
+	decoding.last_line = first_line + num_lines;
+	decoding.num_segments = 1;
+	if (result == 0 && checkpointFile != NULL && checkpointFile[0] != '\x0')
+	{
+		checkpoint_file_t checkpoints;
+		// the interval is read from the checkpoint file
+		if (checkpoint_open(&checkpoints, checkpointFile, *input_params, *predictor_params, arena) != 0)
+		{
+			result = -1;
+		}
+		else
+		{
+			decoding.interval = checkpoints.interval;
+			checkpoint_close(&checkpoints);
+			decoding.num_segments = 1 + (decoding.last_line - 1) / decoding.interval - first_line / decoding.interval;
+		}
+	}
+	if (result == 0)
+	{
+		if (num_threads == 0)
+		{
+			long online = sysconf(_SC_NPROCESSORS_ONLN);
+			num_threads = online > 0 ? (unsigned int)online : 1;
+		}
+		if (num_threads > decoding.num_segments)
+			num_threads = decoding.num_segments;
+		// the first segment is never kept in memory, as no segment comes before it
+		pending_lines = decoding.num_segments > 1 ? decoding.interval : 0;
+		working_set = segment_thread_working_set(*input_params, *predictor_params, pending_lines) * num_threads;
+		if (memory_budget != 0 && working_set > memory_budget)
+		{
+			log_error(CCSDS_ERROR_MEMORY, "\nError, the decompression needs %zu bytes of memory, more than the budget of %zu bytes\n\n", working_set, memory_budget);
+			result = -1;
+		}
+	}
+	if (result != 0)
+	{
+		io_close_stream(&inStream, inFile);
+		arena_rewind(arena, mark);
+		predictor_params->weight_init_table = NULL;
+		return -1;
+	}
+	log_info("Decompression engine: %u segments on %u threads, estimated peak memory %zu bytes (%.2lf kb)\n", decoding.num_segments,
+			num_threads, working_set, ((double)working_set) / 1024.0);
+	log_current_callback(&decoding.log_callback, &decoding.log_user_data);
+
+	// Everything used by the threads is allocated up front, as the arena is not shared among them
+	if ((decoders = (segment_decoder_t *)arena_calloc(arena, num_threads, sizeof(segment_decoder_t))) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the threads of the segment decompression\n\n");
+		result = -1;
+	}
+	for (i = 0; i < num_threads && result == 0; i++)
+	{
+		result = alloc_segment_decoder(&decoders[i], &decoding, pending_lines, arena);
+		if (result == 0 && decoding.interval != 0)
+			result = checkpoint_open(&decoders[i].checkpoints, checkpointFile, *input_params, *predictor_params, arena);
+	}
+	if (result == 0 && io_open(&decoding.outFile, backend, outputFile, IO_WRITE) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in opening output file %s\n\n", outputFile);
+		result = -1;
+	}
+	if (result == 0)
+	{
+		pthread_mutex_init(&decoding.lock, NULL);
+		pthread_cond_init(&decoding.written, NULL);
+		// The calling thread decodes segments too, with the stream the header was read from
+		decoders[0].stream = inFile;
+		for (started = 1; started < num_threads; started++)
+		{
+			if (pthread_create(&decoders[started].thread, NULL, decode_segments, &decoders[started]) != 0)
+				break;
+		}
+		decode_segments(&decoders[0]);
+		for (i = 1; i < started; i++)
+			pthread_join(decoders[i].thread, NULL);
+		pthread_cond_destroy(&decoding.written);
+		pthread_mutex_destroy(&decoding.lock);
+
+		// The errors of the other threads have been reported to the log callback already
+		for (i = 0; i < started && result == 0; i++)
+		{
+			if (decoders[i].status != CCSDS_OK)
+			{
+				log_error(decoders[i].status, "Error in decoding the segments of the stream\n");
+				result = -1;
+			}
+		}
+		if (io_close(&decoding.outFile) != 0 && result == 0)
+		{
+			log_error(CCSDS_ERROR_IO, "Error in writing the uncompressed samples to %s\n\n", outputFile);
+			result = -1;
+		}
+	}
+	for (i = 0; decoders != NULL && i < num_threads; i++)
+		checkpoint_close(&decoders[i].checkpoints);
+	io_close_stream(&inStream, inFile);
+	if (result != 0)
+	{
+		arena_rewind(arena, mark);
+		predictor_params->weight_init_table = NULL;
+		return -1;
+	}
+	// only the tables of the header are kept
+	arena_rewind(arena, buffers_mark);
+	return 0;
+}
@@ -0,0 +1,542 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "compress_ccsds123.h"
+#include "tile_container.h"
+
+// Number of shapes of the tiles: the regular one, the ones of the last column and of the last row and
+// the one of the last tile
+#define TILE_SHAPES 4
+
+/// Compression of the tiles of a scene, shared by the threads taking part in it
+typedef struct
+{
+	const compressConfig_t *config;
+	tile_grid_t grid;
+	// offsets of the streams of the tiles in the container, set as they are written
+	unsigned long long *offsets;
+	io_file_t outFile;
+	log_callback_t log_callback;
+	void *log_user_data;
+	// next tile to be compressed, accessed atomically
+	unsigned int next_tile;
+	// number of tiles written to the container and whether a thread failed, updated under lock
+	pthread_mutex_t lock;
+	pthread_cond_t written;
+	unsigned int written_tiles;
+	int failed;
+} tiled_compression_t;
+
+/// Thread compressing tiles until none is left, with its own input file and a compression session for every
+/// shape of the tiles it meets
+typedef struct
+{
+	tiled_compression_t *compression;
+	compress_session_t *sessions[TILE_SHAPES];
+	io_file_t inFile;
+	int inOpen;
+	// holds the samples and the stream of the tile being compressed; it is reset after every tile
+	arena_t arena;
+	pthread_t thread;
+	ccsds_status_t status;
+} tile_compressor_t;
+
+/// Reads count samples of the regular input file starting from the first-th one, only converting their byte
+/// ordering: the compression session converts them as read_samples does
+static int read_raw_samples(io_file_t *inputFile, input_feature_t input_params, size_t first, size_t count, unsigned short int *samples)
+{
+	int swap = (is_little_endian() != 0 && input_params.byte_ordering == BIG) || (is_little_endian() == 0 && input_params.byte_ordering == LITTLE);
+	long long got = io_read(inputFile, (unsigned long long)first * 2, samples, count * 2);
+	size_t i = 0;
+
+	if (got < 0 || (size_t)got != count * 2)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error, not enough elements in the input file\n\n");
+		return -1;
+	}
+	for (i = 0; swap != 0 && i < count; i++)
+		samples[i] = ((samples[i] >> 8) & 0x00FF) | ((samples[i] << 8) & 0xFF00);
+	return 0;
+}
+
+/// Reads the samples of the tile at (x0, y0) into tile, in BSQ order: the rows of a BSQ file are read
+/// directly, while the lines of a BI file are read whole and the rows of the tile extracted from them
+static int read_tile(tile_compressor_t *compressor, unsigned int x0, unsigned int y0, unsigned int width, unsigned int height,
+		unsigned short int *tile)
+{
+	const input_feature_t input_params = compressor->compression->config->input_params;
+	const size_t line_samples = (size_t)input_params.x_size * input_params.z_size;
+	unsigned short int *raw_line = NULL, *line = NULL;
+	unsigned int y = 0, z = 0;
+
+	if (input_params.in_interleaving == BSQ)
+	{
+		for (z = 0; z < input_params.z_size; z++)
+		{
+			for (y = 0; y < height; y++)
+			{
+				if (read_raw_samples(&compressor->inFile, input_params, BSQ_OFFSET(input_params, x0, y0 + y, z), width,
+						tile + ((size_t)z * height + y) * width) != 0)
+					return -1;
+			}
+		}
+		return 0;
+	}
+	raw_line = (unsigned short int *)arena_alloc(&compressor->arena, sizeof(unsigned short int) * line_samples);
+	line = (unsigned short int *)arena_alloc(&compressor->arena, sizeof(unsigned short int) * line_samples);
+	if (raw_line == NULL || line == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the lines of the input file\n\n");
+		return -1;
+	}
+	for (y = 0; y < height; y++)
+	{
+		if (read_raw_samples(&compressor->inFile, input_params, (size_t)(y0 + y) * line_samples, line_samples, raw_line) != 0)
+			return -1;
+		deinterleave_line(raw_line, line, input_params.x_size, input_params.z_size, input_params.in_interleaving_depth);
+		for (z = 0; z < input_params.z_size; z++)
+			memcpy(tile + ((size_t)z * height + y) * width, line + (size_t)z * input_params.x_size + x0, sizeof(unsigned short int) * width);
+	}
+	return 0;
+}
+
+/// Returns the session compressing the tiles of the given size, creating it when the thread meets the
+/// first of them
+static compress_session_t *tile_session(tile_compressor_t *compressor, unsigned int width, unsigned int height)
+{
+	const tile_grid_t *grid = &compressor->compression->grid;
+	unsigned int shape = (width != grid->tile_width ? 1 : 0) + (height != grid->tile_height ? 2 : 0);
+	compressConfig_t tile_config;
+
+	if (compressor->sessions[shape] != NULL)
+		return compressor->sessions[shape];
+	tile_config = *compressor->compression->config;
+	tile_config.input_params.x_size = width;
+	tile_config.input_params.y_size = height;
+	// the tiles are gathered in BSQ order by read_tile
+	tile_config.input_params.in_interleaving = BSQ;
+	if (compress_session_create(&tile_config, &compressor->sessions[shape]) != 0)
+		compressor->sessions[shape] = NULL;
+	return compressor->sessions[shape];
+}
+
+/// Marks the compression as failed, waking up the threads waiting for their turn to write
+static void fail_compression(tiled_compression_t *compression)
+{
+	pthread_mutex_lock(&compression->lock);
+	__atomic_store_n(&compression->failed, 1, __ATOMIC_RELAXED);
+	pthread_cond_broadcast(&compression->written);
+	pthread_mutex_unlock(&compression->lock);
+}
+
+/// Waits until the tiles before tile have been written, then appends its stream to the container and lets
+/// the next tile be written
+/// @return 0 if the stream was written or another thread failed, a negative value in case of error
+static int write_tile_stream(tiled_compression_t *compression, unsigned int tile, const unsigned char *stream, size_t bytes)
+{
+	int failed = 0;
+
+	pthread_mutex_lock(&compression->lock);
+	while (compression->written_tiles != tile && compression->failed == 0)
+		pthread_cond_wait(&compression->written, &compression->lock);
+	failed = compression->failed;
+	pthread_mutex_unlock(&compression->lock);
+	if (failed != 0)
+		return 0;
+	if (io_write(&compression->outFile, compression->offsets[tile], stream, bytes) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in writing the stream of tile %u to the container\n", tile);
+		return -1;
+	}
+	pthread_mutex_lock(&compression->lock);
+	compression->offsets[tile + 1] = compression->offsets[tile] + bytes;
+	compression->written_tiles = tile + 1;
+	pthread_cond_broadcast(&compression->written);
+	pthread_mutex_unlock(&compression->lock);
+	return 0;
+}
+
+/// Reads and compresses tile into a stream allocated from the arena of the thread
+/// @return the number of bytes of the stream, a negative value in case of error
+static long long compress_tile(tile_compressor_t *compressor, unsigned int tile, unsigned char **stream)
+{
+	const compressConfig_t *config = compressor->compression->config;
+	unsigned int x0 = 0, y0 = 0, width = 0, height = 0;
+	compress_session_t *session = NULL;
+	unsigned short int *samples = NULL;
+	size_t capacity = 0;
+	long long bytes = 0;
+
+	tile_rectangle(&compressor->compression->grid, tile, &x0, &y0, &width, &height);
+	if ((session = tile_session(compressor, width, height)) == NULL)
+		return -1;
+	capacity = compress_session_bound(session);
+	samples = (unsigned short int *)arena_alloc(&compressor->arena, sizeof(unsigned short int) * width * height * config->input_params.z_size);
+	*stream = (unsigned char *)arena_alloc(&compressor->arena, capacity);
+	if (samples == NULL || *stream == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the buffers of tile %u\n\n", tile);
+		return -1;
+	}
+	if (read_tile(compressor, x0, y0, width, height, samples) != 0 || (bytes = compress_session_compress(session, samples, *stream, capacity)) < 0)
+		return -1;
+	return bytes;
+}
+
+/// Compresses the next tile not taken by another thread, until all of them are compressed or a thread fails
+static void *compress_tiles(void *argument)
+{
+	tile_compressor_t *compressor = (tile_compressor_t *)argument;
+	tiled_compression_t *compression = compressor->compression;
+	const compressConfig_t *config = compression->config;
+	log_context_t log_context;
+	int result = 0;
+
+	log_begin(&log_context, compression->log_callback, compression->log_user_data);
+	if (io_open(&compressor->inFile, config->io_backend, config->samples_file, IO_READ) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in opening the input file %s\n", config->samples_file);
+		result = -1;
+	}
+	compressor->inOpen = result == 0;
+	while (result == 0 && __atomic_load_n(&compression->failed, __ATOMIC_RELAXED) == 0)
+	{
+		unsigned int tile = __atomic_fetch_add(&compression->next_tile, 1, __ATOMIC_RELAXED);
+		unsigned char *stream = NULL;
+		long long bytes = 0;
+		if (tile >= tile_grid_tiles(&compression->grid))
+			break;
+		if ((bytes = compress_tile(compressor, tile, &stream)) < 0)
+			result = -1;
+		else
+			result = write_tile_stream(compression, tile, stream, (size_t)bytes);
+		arena_reset(&compressor->arena);
+	}
+	if (result != 0)
+		fail_compression(compression);
+	compressor->status = log_end(&log_context, result);
+	return NULL;
+}
+
+/// Returns the number of bytes of the file fileName, 0 when it cannot be read
+static unsigned long long file_size(const char *fileName)
+{
+	FILE *file = fopen(fileName, "rb");
+	long size = 0;
+
+	if (file == NULL)
+		return 0;
+	if (fseek(file, 0, SEEK_END) == 0)
+		size = ftell(file);
+	fclose(file);
+	return size > 0 ? (unsigned long long)size : 0;
+}
+
+/// Compresses the tiles of the scene with num_threads threads, the calling one included, writing them to
+/// the container in the order of the tiles
+static int compress_container(compressConfig_t *config, tile_grid_t grid, unsigned int num_threads, unsigned long long *container_bytes)
+{
+	tiled_compression_t compression;
+	tile_compressor_t *compressors = NULL;
+	arena_t arena;
+	unsigned int started = 0;
+	unsigned int i = 0, s = 0;
+	int result = 0;
+
+	arena_init(&arena, 0, 0);
+	memset(&compression, 0, sizeof(tiled_compression_t));
+	compression.config = config;
+	compression.grid = grid;
+	compression.offsets = (unsigned long long *)arena_alloc(&arena, sizeof(unsigned long long) * ((size_t)tile_grid_tiles(&grid) + 1));
+	compressors = (tile_compressor_t *)arena_calloc(&arena, num_threads, sizeof(tile_compressor_t));
+	if (compression.offsets == NULL || compressors == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the threads of the tiled compression\n\n");
+		arena_release(&arena);
+		return -1;
+	}
+	compression.offsets[0] = tile_directory_size(&grid);
+	if (io_open(&compression.outFile, config->io_backend, config->out_file, IO_WRITE) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in creating the container %s\n", config->out_file);
+		arena_release(&arena);
+		return -1;
+	}
+	log_current_callback(&compression.log_callback, &compression.log_user_data);
+	pthread_mutex_init(&compression.lock, NULL);
+	pthread_cond_init(&compression.written, NULL);
+	for (i = 0; i < num_threads; i++)
+	{
+		compressors[i].compression = &compression;
+		arena_init(&compressors[i].arena, 0, 0);
+	}
+	for (started = 1; started < num_threads; started++)
+	{
+		if (pthread_create(&compressors[started].thread, NULL, compress_tiles, &compressors[started]) != 0)
+			break;
+	}
+	compress_tiles(&compressors[0]);
+	for (i = 1; i < started; i++)
+		pthread_join(compressors[i].thread, NULL);
+	pthread_cond_destroy(&compression.written);
+	pthread_mutex_destroy(&compression.lock);
+
+	// The errors of the other threads have been reported to the log callback already
+	for (i = 0; i < started && result == 0; i++)
+	{
+		if (compressors[i].status != CCSDS_OK)
+		{
+			log_error(compressors[i].status, "Error in compressing the tiles of the scene\n");
+			result = -1;
+		}
+	}
+	for (i = 0; i < num_threads; i++)
+	{
+		for (s = 0; s < TILE_SHAPES; s++)
+		{
+			if (compressors[i].sessions[s] != NULL)
+				compress_session_destroy(compressors[i].sessions[s]);
+		}
+		if (compressors[i].inOpen != 0)
+			io_close(&compressors[i].inFile);
+		arena_release(&compressors[i].arena);
+	}
+	if (result == 0)
+		result = tile_directory_write(&compression.outFile, &grid, compression.offsets, &arena);
+	if (io_close(&compression.outFile) != 0 && result == 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in writing the container %s\n", config->out_file);
+		result = -1;
+	}
+	*container_bytes = compression.offsets[tile_grid_tiles(&grid)];
+	arena_release(&arena);
+	return result;
+}
+
+/// Checks the configuration of the compression of the tiles of a scene
+static int check_tiled_config(const compressConfig_t *config, unsigned int tile_width, unsigned int tile_height)
+{
+	if (config->samples_file[0] == '\x0' || config->out_file[0] == '\x0')
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the input file and the container to be written\n\n");
+		return -1;
+	}
+	if (tile_width == 0 || tile_height == 0 || config->input_params.regular_input == 0 || check_image_size(config->input_params) != 0)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the tiled compression requires non empty tiles and the regular input representation\n\n");
+		return -1;
+	}
+	if (config->band_index_file[0] != '\x0' || config->checkpoint_file[0] != '\x0' || config->adapted_weights_file[0] != '\x0')
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the band index, the checkpoints and the adapted weights cannot be written for the tiles of a container\n\n");
+		return -1;
+	}
+	return 0;
+}
+
+int compress_tiled(struct compressConfig *config, unsigned int tile_width, unsigned int tile_height, unsigned int num_threads,
+		char referenceFile[128], tiled_report_t *report)
+{
+	tile_grid_t grid;
+	tiled_report_t result_report;
+	log_context_t log_context;
+	double samples = 0.0;
+
+	log_begin(&log_context, config->log_callback, config->log_user_data);
+	memset(&result_report, 0, sizeof(tiled_report_t));
+	if (check_tiled_config(config, tile_width, tile_height) != 0)
+		return log_end(&log_context, -1);
+	tile_grid_init(&grid, config->input_params.x_size, config->input_params.y_size, config->input_params.z_size, tile_width, tile_height);
+	if (num_threads == 0)
+	{
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		num_threads = online > 0 ? (unsigned int)online : 1;
+	}
+	if (num_threads > tile_grid_tiles(&grid))
+		num_threads = tile_grid_tiles(&grid);
+
+	if (compress_container(config, grid, num_threads, &result_report.container_bytes) != 0)
+		return log_end(&log_context, -1);
+	result_report.num_tiles = tile_grid_tiles(&grid);
+	result_report.directory_bytes = tile_directory_size(&grid);
+	samples = (double)IMAGE_SAMPLES(config->input_params);
+	log_info("Tiled compression: %u tiles of %ux%u on %u threads, %llu bytes (%lf bits per sample)\n", result_report.num_tiles, grid.tile_width,
+			grid.tile_height, num_threads, result_report.container_bytes, 8.0 * result_report.container_bytes / samples);
+
+	if (referenceFile != NULL && referenceFile[0] != '\x0')
+	{
+		compressConfig_t single_config = *config;
+		strcpy(single_config.out_file, referenceFile);
+		if (compress_ccsds123(&single_config) != 0 || (result_report.single_stream_bytes = file_size(referenceFile)) == 0)
+		{
+			log_error(CCSDS_ERROR_INTERNAL, "Error in compressing the scene into a single stream\n");
+			return log_end(&log_context, -1);
+		}
+		result_report.ratio_cost = (double)result_report.container_bytes / result_report.single_stream_bytes - 1.0;
+		log_info("Single stream: %llu bytes (%lf bits per sample), the tiling costs %.2lf%% of the compressed size\n", result_report.single_stream_bytes,
+				8.0 * result_report.single_stream_bytes / samples, 100.0 * result_report.ratio_cost);
+	}
+	if (report != NULL)
+		*report = result_report;
+	return log_end(&log_context, 0);
+}
+
+int compress_tile_shard(struct compressConfig *config, unsigned int tile_width, unsigned int tile_height, unsigned int tile, char shardFile[128])
+{
+	tiled_compression_t compression;
+	tile_compressor_t compressor;
+	io_file_t outFile;
+	unsigned char *stream = NULL;
+	long long bytes = 0;
+	unsigned int s = 0;
+	log_context_t log_context;
+	int result = 0;
+
+	log_begin(&log_context, config->log_callback, config->log_user_data);
+	if (check_tiled_config(config, tile_width, tile_height) != 0)
+		return log_end(&log_context, -1);
+	memset(&compression, 0, sizeof(tiled_compression_t));
+	memset(&compressor, 0, sizeof(tile_compressor_t));
+	compression.config = config;
+	tile_grid_init(&compression.grid, config->input_params.x_size, config->input_params.y_size, config->input_params.z_size, tile_width, tile_height);
+	if (tile >= tile_grid_tiles(&compression.grid))
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the scene only has %u tiles\n\n", tile_grid_tiles(&compression.grid));
+		return log_end(&log_context, -1);
+	}
+	compressor.compression = &compression;
+	arena_init(&compressor.arena, 0, 0);
+	if (io_open(&compressor.inFile, config->io_backend, config->samples_file, IO_READ) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in opening the input file %s\n", config->samples_file);
+		result = -1;
+	}
+	compressor.inOpen = result == 0;
+	if (result == 0 && (bytes = compress_tile(&compressor, tile, &stream)) < 0)
+		result = -1;
+	if (result == 0)
+	{
+		if (io_open(&outFile, config->io_backend, shardFile, IO_WRITE) != 0)
+		{
+			log_error(CCSDS_ERROR_IO, "Error in creating the shard %s\n", shardFile);
+			result = -1;
+		}
+		else if ((io_write(&outFile, 0, stream, (size_t)bytes) != 0) | (io_close(&outFile) != 0))
+		{
+			log_error(CCSDS_ERROR_IO, "Error in writing the shard %s\n", shardFile);
+			result = -1;
+		}
+	}
+	for (s = 0; s < TILE_SHAPES; s++)
+	{
+		if (compressor.sessions[s] != NULL)
+			compress_session_destroy(compressor.sessions[s]);
+	}
+	if (compressor.inOpen != 0)
+		io_close(&compressor.inFile);
+	arena_release(&compressor.arena);
+	return log_end(&log_context, result);
+}
+
+/// Checks that the stream of a shard starts with the header of an image of the size of tile, whose x, y and z
+/// sizes follow the first byte, on 16 bits each
+static int check_shard(const tile_grid_t *grid, unsigned int tile, const unsigned char *stream, size_t bytes, const char *shardFile)
+{
+	unsigned int x0 = 0, y0 = 0, width = 0, height = 0;
+
+	tile_rectangle(grid, tile, &x0, &y0, &width, &height);
+	if (bytes < 7 || ((stream[1] << 8) | stream[2]) != (int)width || ((stream[3] << 8) | stream[4]) != (int)height ||
+			((stream[5] << 8) | stream[6]) != (int)grid->z_size)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error, %s is not the stream of the %ux%ux%u samples of tile %u\n", shardFile, width, height, grid->z_size, tile);
+		return -1;
+	}
+	return 0;
+}
+
+int merge_tile_shards(struct compressConfig *config, unsigned int tile_width, unsigned int tile_height, const char *const *shardFiles,
+		tiled_report_t *report)
+{
+	tile_grid_t grid;
+	tiled_report_t result_report;
+	unsigned long long *offsets = NULL;
+	io_file_t outFile, shard;
+	arena_t arena;
+	arena_mark_t mark;
+	unsigned int tile = 0;
+	log_context_t log_context;
+	int result = 0;
+
+	log_begin(&log_context, config->log_callback, config->log_user_data);
+	memset(&result_report, 0, sizeof(tiled_report_t));
+	if (config->out_file[0] == '\x0' || tile_width == 0 || tile_height == 0 || check_image_size(config->input_params) != 0)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the container to be written and the size of the scene and of its tiles\n\n");
+		return log_end(&log_context, -1);
+	}
+	tile_grid_init(&grid, config->input_params.x_size, config->input_params.y_size, config->input_params.z_size, tile_width, tile_height);
+	arena_init(&arena, 0, 0);
+	if ((offsets = (unsigned long long *)arena_alloc(&arena, sizeof(unsigned long long) * ((size_t)tile_grid_tiles(&grid) + 1))) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the directory of the container\n\n");
+		arena_release(&arena);
+		return log_end(&log_context, -1);
+	}
+	if (io_open(&outFile, config->io_backend, config->out_file, IO_WRITE) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in creating the container %s\n", config->out_file);
+		arena_release(&arena);
+		return log_end(&log_context, -1);
+	}
+	// The streams of the shards are copied after the directory, in the order of the tiles
+	offsets[0] = tile_directory_size(&grid);
+	mark = arena_get_mark(&arena);
+	for (tile = 0; tile < tile_grid_tiles(&grid) && result == 0; tile++)
+	{
+		unsigned char *stream = NULL;
+		long long size = 0;
+		if (io_open(&shard, config->io_backend, shardFiles[tile], IO_READ) != 0)
+		{
+			log_error(CCSDS_ERROR_IO, "Error in opening the shard %s\n", shardFiles[tile]);
+			result = -1;
+			break;
+		}
+		if ((size = io_size(&shard)) <= 0 || (stream = (unsigned char *)arena_alloc(&arena, (size_t)size)) == NULL ||
+				io_read(&shard, 0, stream, (size_t)size) != size)
+		{
+			log_error(CCSDS_ERROR_IO, "Error in reading the shard %s\n", shardFiles[tile]);
+			result = -1;
+		}
+		else if ((result = check_shard(&grid, tile, stream, (size_t)size, shardFiles[tile])) == 0 &&
+				io_write(&outFile, offsets[tile], stream, (size_t)size) != 0)
+		{
+			log_error(CCSDS_ERROR_IO, "Error in writing the stream of tile %u to the container\n", tile);
+			result = -1;
+		}
+		offsets[tile + 1] = offsets[tile] + (unsigned long long)size;
+		io_close(&shard);
+		arena_rewind(&arena, mark);
+	}
+	if (result == 0)
+		result = tile_directory_write(&outFile, &grid, offsets, &arena);
+	if (io_close(&outFile) != 0 && result == 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in writing the container %s\n", config->out_file);
+		result = -1;
+	}
+	if (result == 0)
+	{
+		result_report.num_tiles = tile_grid_tiles(&grid);
+		result_report.directory_bytes = tile_directory_size(&grid);
+		result_report.container_bytes = offsets[tile_grid_tiles(&grid)];
+		log_info("Merged %u shards into %s: %llu bytes (%lf bits per sample)\n", result_report.num_tiles, config->out_file, result_report.container_bytes,
+				8.0 * result_report.container_bytes / (double)IMAGE_SAMPLES(config->input_params));
+		if (report != NULL)
+			*report = result_report;
+	}
+	arena_release(&arena);
+	return log_end(&log_context, result);
+}
@@ -0,0 +1,112 @@
+#include <string.h>
+
+#include "tile_container.h"
+
+///Sets up the grid of tiles covering the scene
+void tile_grid_init(tile_grid_t *grid, unsigned int x_size, unsigned int y_size, unsigned int z_size, unsigned int tile_width,
+		unsigned int tile_height)
+{
+	grid->x_size = x_size;
+	grid->y_size = y_size;
+	grid->z_size = z_size;
+	grid->tile_width = MIN(tile_width, x_size);
+	grid->tile_height = MIN(tile_height, y_size);
+	grid->tiles_x = (x_size + grid->tile_width - 1) / grid->tile_width;
+	grid->tiles_y = (y_size + grid->tile_height - 1) / grid->tile_height;
+}
+
+///Number of tiles of the grid
+unsigned int tile_grid_tiles(const tile_grid_t *grid)
+{
+	return grid->tiles_x * grid->tiles_y;
+}
+
+///Fills in the origin and the size of the rectangle of the scene covered by tile
+void tile_rectangle(const tile_grid_t *grid, unsigned int tile, unsigned int *x0, unsigned int *y0, unsigned int *width, unsigned int *height)
+{
+	*x0 = (tile % grid->tiles_x) * grid->tile_width;
+	*y0 = (tile / grid->tiles_x) * grid->tile_height;
+	*width = MIN(grid->tile_width, grid->x_size - *x0);
+	*height = MIN(grid->tile_height, grid->y_size - *y0);
+}
+
+///Number of bytes of the header and of the directory of the container
+size_t tile_directory_size(const tile_grid_t *grid)
+{
+	return CONTAINER_HEADER_SIZE + 8 * ((size_t)tile_grid_tiles(grid) + 1);
+}
+
+///Writes the header and the directory at the beginning of the container
+int tile_directory_write(io_file_t *container, const tile_grid_t *grid, const unsigned long long *offsets, arena_t *arena)
+{
+	const size_t bytes = tile_directory_size(grid);
+	unsigned char *directory = (unsigned char *)arena_alloc(arena, bytes);
+	unsigned char *field = directory;
+	unsigned int i = 0;
+
+	if (directory == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the directory of the container\n\n");
+		return -1;
+	}
+	memcpy(field, CONTAINER_MAGIC, 4);
+	field = put_big_endian(field + 4, grid->x_size, 4);
+	field = put_big_endian(field, grid->y_size, 4);
+	field = put_big_endian(field, grid->z_size, 4);
+	field = put_big_endian(field, grid->tile_width, 4);
+	field = put_big_endian(field, grid->tile_height, 4);
+	for (i = 0; i <= tile_grid_tiles(grid); i++)
+		field = put_big_endian(field, offsets[i], 8);
+	if (io_write(container, 0, directory, bytes) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in writing the directory of the container\n");
+		return -1;
+	}
+	return 0;
+}
+
+///Reads the header and the directory of the container, allocating the offsets from arena
+int tile_directory_read(FILE *container, const char *fileName, tile_grid_t *grid, unsigned long long **offsets, arena_t *arena)
+{
+	unsigned char header[CONTAINER_HEADER_SIZE];
+	unsigned char entry[8];
+	const unsigned char *field = header + 4;
+	unsigned long long value[5];
+	unsigned int i = 0;
+
+	if (fread(header, 1, CONTAINER_HEADER_SIZE, container) != CONTAINER_HEADER_SIZE || memcmp(header, CONTAINER_MAGIC, 4) != 0)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error, %s is not a tiled container\n", fileName);
+		return -1;
+	}
+	for (i = 0; i < 5; i++)
+		field = get_big_endian(field, &value[i], 4);
+	if (value[0] == 0 || value[1] == 0 || value[2] == 0 || value[3] == 0 || value[4] == 0 || value[0] > MAX_DIMENSION_SIZE ||
+			value[1] > MAX_DIMENSION_SIZE || value[2] > MAX_DIMENSION_SIZE || value[3] > value[0] || value[4] > value[1])
+	{
+		log_error(CCSDS_ERROR_DATA, "Error, the header of the container %s is corrupted\n", fileName);
+		return -1;
+	}
+	tile_grid_init(grid, (unsigned int)value[0], (unsigned int)value[1], (unsigned int)value[2], (unsigned int)value[3], (unsigned int)value[4]);
+	if ((*offsets = (unsigned long long *)arena_alloc(arena, sizeof(unsigned long long) * ((size_t)tile_grid_tiles(grid) + 1))) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the directory of the container\n\n");
+		return -1;
+	}
+	for (i = 0; i <= tile_grid_tiles(grid); i++)
+	{
+		if (fread(entry, 1, 8, container) != 8)
+			break;
+		get_big_endian(entry, &(*offsets)[i], 8);
+		if ((i == 0 && (*offsets)[0] != tile_directory_size(grid)) || (i > 0 && (*offsets)[i] <= (*offsets)[i - 1]))
+			break;
+	}
+	// the last stream must end within the file
+	if (i <= tile_grid_tiles(grid) || fseek(container, 0, SEEK_END) != 0 || ftell(container) < 0 ||
+			(unsigned long long)ftell(container) < (*offsets)[tile_grid_tiles(grid)])
+	{
+		log_error(CCSDS_ERROR_DATA, "Error, the directory of the container %s is truncated or corrupted\n", fileName);
+		return -1;
+	}
+	return 0;
+}
@@ -0,0 +1,429 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "tile_container.h"
+#include "decoder.h"
+#include "unpredict.h"
+
+/// Decompression of the tiles of a container, shared by the threads taking part in it
+typedef struct
+{
+	const char *inputFile;
+	io_backend_t backend;
+	tile_grid_t grid;
+	const unsigned long long *offsets;
+	// the scene, in the interleaving and byte ordering of the output
+	input_feature_t output_params;
+	// the window decompressed and the tiles intersecting it, from (first_tile_x, first_tile_y) on
+	// region_tiles_x tiles per row; every tile is decoded up to band num_bands - 1
+	tile_region_t region;
+	unsigned int first_tile_x;
+	unsigned int first_tile_y;
+	unsigned int region_tiles_x;
+	unsigned int num_tiles;
+	unsigned int num_bands;
+	// when not NULL, the window is cropped here instead of being written to outFile
+	unsigned short int *region_samples;
+	// the writes of the threads to the output file are serialized
+	io_file_t outFile;
+	pthread_mutex_t output_lock;
+	log_callback_t log_callback;
+	void *log_user_data;
+	// next tile (among the ones intersecting the window) to be decompressed and whether a thread failed,
+	// accessed atomically
+	unsigned int next_tile;
+	int failed;
+} tiled_decompression_t;
+
+/// Thread decompressing tiles until none is left; stream is the one of the calling thread, NULL for the
+/// other threads, which open their own
+typedef struct
+{
+	tiled_decompression_t *decompression;
+	FILE *stream;
+	// holds the residuals and the samples of the tile being decompressed; it is reset after every tile
+	arena_t arena;
+	pthread_t thread;
+	ccsds_status_t status;
+} tile_decompressor_t;
+
+/// Writes the samples of the tile at (x0, y0), in BSQ order, to their place in the output file: every row
+/// of the tile is contiguous in a BSQ file, as are the samples of a group of bands of a line of the tile in
+/// a BI one
+static int write_tile(tile_decompressor_t *decompressor, unsigned int x0, unsigned int y0, unsigned int width, unsigned int height,
+		const void *samples)
+{
+	tiled_decompression_t *decompression = decompressor->decompression;
+	const input_feature_t output_params = decompression->output_params;
+	const unsigned int sample_bytes = OUTPUT_SAMPLE_BYTES(output_params);
+	const unsigned int tile_bytes = SAMPLE_BYTES(output_params);
+	const unsigned int depth = output_params.in_interleaving == BI ? MIN(output_params.in_interleaving_depth, output_params.z_size) : 1;
+	unsigned int s_mid = 0x1 << (output_params.dyn_range - 1);
+	unsigned short int *group = (unsigned short int *)arena_alloc(&decompressor->arena, sizeof(unsigned short int) * width * depth);
+	unsigned char *formatted = (unsigned char *)arena_alloc(&decompressor->arena, sample_bytes * width * depth);
+	unsigned int x = 0, y = 0, z = 0, i = 0;
+	int result = 0;
+
+	if (group == NULL || formatted == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the rows of the tile\n\n");
+		return -1;
+	}
+	pthread_mutex_lock(&decompression->output_lock);
+	for (y = 0; y < height && result == 0; y++)
+	{
+		for (z = 0; z < output_params.z_size && result == 0; z += depth)
+		{
+			unsigned int bands = output_params.in_interleaving == BI ? MIN(depth, output_params.z_size - z) : 1;
+			size_t offset = output_params.in_interleaving == BI ?
+				((size_t)(y0 + y) * output_params.z_size + z) * output_params.x_size + (size_t)x0 * bands : BSQ_OFFSET(output_params, x0, y0 + y, z);
+			for (x = 0; x < width; x++)
+			{
+				for (i = 0; i < bands; i++)
+					group[x * bands + i] = GET_ELEMENT(samples, tile_bytes, ((size_t)(z + i) * height + y) * width + x);
+			}
+			format_samples(output_params, group, (size_t)width * bands, s_mid, formatted);
+			if (io_write(&decompression->outFile, (unsigned long long)offset * sample_bytes, formatted, (size_t)width * bands * sample_bytes) != 0)
+			{
+				log_error(CCSDS_ERROR_IO, "Error in writing the uncompressed samples to the output file\n");
+				result = -1;
+			}
+		}
+	}
+	pthread_mutex_unlock(&decompression->output_lock);
+	return result;
+}
+
+/// Copies the samples of the tile at (x0, y0), in BSQ order, falling in the window to their place in the
+/// buffer of the window, converted as format_samples does but kept on 16 bits in the host byte ordering;
+/// the tiles do not overlap, so the threads do not need to be serialized
+static void crop_tile(tiled_decompression_t *decompression, unsigned int x0, unsigned int y0, unsigned int width, unsigned int height,
+		const void *samples)
+{
+	const input_feature_t output_params = decompression->output_params;
+	const tile_region_t region = decompression->region;
+	const unsigned int tile_bytes = SAMPLE_BYTES(output_params);
+	const unsigned int region_width = region.x1 - region.x0, region_height = region.y1 - region.y0, region_bands = region.z1 - region.z0;
+	const unsigned int depth = output_params.in_interleaving == BI ? MIN(output_params.in_interleaving_depth, region_bands) : 1;
+	const unsigned int first_x = x0 > region.x0 ? x0 : region.x0, last_x = MIN(x0 + width, region.x1);
+	const unsigned int first_y = y0 > region.y0 ? y0 : region.y0, last_y = MIN(y0 + height, region.y1);
+	const unsigned short int mask = 0xFFFF >> (16 - output_params.dyn_range);
+	const unsigned int s_mid = 0x1 << (output_params.dyn_range - 1);
+	unsigned int x = 0, y = 0, z = 0;
+
+	for (z = region.z0; z < region.z1; z++)
+	{
+		// with BI order the band is in a group of bands of the window, whose samples alternate in each line
+		unsigned int band = z - region.z0;
+		unsigned int group = output_params.in_interleaving == BI ? band - band % depth : band;
+		unsigned int stride = output_params.in_interleaving == BI ? MIN(depth, region_bands - group) : 1;
+		for (y = first_y; y < last_y; y++)
+		{
+			const size_t tile_row = ((size_t)z * height + (y - y0)) * width;
+			unsigned short int *row = decompression->region_samples + (output_params.in_interleaving == BI ?
+				((size_t)(y - region.y0) * region_bands + group) * region_width + (band - group) : ((size_t)band * region_height + (y - region.y0)) * region_width);
+			for (x = first_x; x < last_x; x++)
+			{
+				unsigned short int sample = GET_ELEMENT(samples, tile_bytes, tile_row + (x - x0));
+				if (output_params.signed_samples != 0)
+					sample = (unsigned short int)((int)sample - (int)s_mid) & mask;
+				row[(size_t)(x - region.x0) * stride] = sample;
+			}
+		}
+	}
+}
+
+/// Decodes and reconstructs the tile from its stream, up to band num_bands - 1, then writes it to the output
+/// file or crops it into the buffer of the window
+static int decompress_tile(tile_decompressor_t *decompressor, unsigned int tile)
+{
+	tiled_decompression_t *decompression = decompressor->decompression;
+	input_feature_t tile_params;
+	predictor_config_t predictor_params;
+	void *residuals = NULL;
+	void *samples = NULL;
+	unsigned int x0 = 0, y0 = 0, width = 0, height = 0;
+
+	memset(&tile_params, 0, sizeof(input_feature_t));
+	memset(&predictor_params, 0, sizeof(predictor_config_t));
+	tile_rectangle(&decompression->grid, tile, &x0, &y0, &width, &height);
+	if (fseek(decompressor->stream, (long)decompression->offsets[tile], SEEK_SET) != 0 ||
+			decode_stream(decompressor->stream, &tile_params, &predictor_params, &residuals,
+				decompression->num_bands < decompression->grid.z_size ? decompression->num_bands : 0, &decompressor->arena) != 0)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error in decoding the stream of tile %u\n", tile);
+		return -1;
+	}
+	if (tile_params.x_size != width || tile_params.y_size != height || tile_params.z_size != decompression->grid.z_size ||
+			tile_params.dyn_range != decompression->output_params.dyn_range || tile_params.signed_samples != decompression->output_params.signed_samples)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error, the stream of tile %u does not hold the %ux%ux%u samples of the tile\n", tile, width, height,
+				decompression->grid.z_size);
+		return -1;
+	}
+	tile_params.z_size = decompression->num_bands;
+	// the samples are zeroed as the central difference of a sample is computed (and then corrected) before
+	// the sample is extracted
+	if ((samples = arena_calloc(&decompressor->arena, IMAGE_SAMPLES(tile_params), SAMPLE_BYTES(tile_params))) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the samples of tile %u\n\n", tile);
+		return -1;
+	}
+	if (unpredict_samples(tile_params, predictor_params, residuals, samples, &decompressor->arena) != 0)
+		return -1;
+	if (decompression->region_samples == NULL)
+		return write_tile(decompressor, x0, y0, width, height, samples);
+	crop_tile(decompression, x0, y0, width, height, samples);
+	return 0;
+}
+
+/// Decompresses the next tile not taken by another thread, until all of them are decompressed or a thread fails
+static void *decompress_tiles(void *argument)
+{
+	tile_decompressor_t *decompressor = (tile_decompressor_t *)argument;
+	tiled_decompression_t *decompression = decompressor->decompression;
+	FILE *ownStream = NULL;
+	io_file_t streamFile;
+	log_context_t log_context;
+	int result = 0;
+
+	log_begin(&log_context, decompression->log_callback, decompression->log_user_data);
+	// the threads seek to their tiles: the pread and O_DIRECT backends would read the whole container for
+	// each of them, so they go through stdio
+	if (decompressor->stream == NULL)
+	{
+		ownStream = io_open_stream(&streamFile, decompression->backend == IO_BACKEND_MMAP ? IO_BACKEND_MMAP : IO_BACKEND_STDIO, decompression->inputFile);
+		if (ownStream == NULL)
+		{
+			log_error(CCSDS_ERROR_IO, "Error in opening the container %s\n", decompression->inputFile);
+			result = -1;
+		}
+		decompressor->stream = ownStream;
+	}
+	while (result == 0 && __atomic_load_n(&decompression->failed, __ATOMIC_RELAXED) == 0)
+	{
+		unsigned int index = __atomic_fetch_add(&decompression->next_tile, 1, __ATOMIC_RELAXED);
+		if (index >= decompression->num_tiles)
+			break;
+		result = decompress_tile(decompressor, (decompression->first_tile_y + index / decompression->region_tiles_x) * decompression->grid.tiles_x +
+				decompression->first_tile_x + index % decompression->region_tiles_x);
+		arena_reset(&decompressor->arena);
+	}
+	if (result != 0)
+		__atomic_store_n(&decompression->failed, 1, __ATOMIC_RELAXED);
+	if (ownStream != NULL)
+		io_close_stream(&streamFile, ownStream);
+	decompressor->status = log_end(&log_context, result);
+	return NULL;
+}
+
+/// Checks that the window lies in the scene and that the buffer can hold it
+static int check_region(const tile_grid_t *grid, const tile_region_t *region, size_t capacity)
+{
+	if (region->x0 >= region->x1 || region->y0 >= region->y1 || region->z0 >= region->z1 || region->x1 > grid->x_size ||
+			region->y1 > grid->y_size || region->z1 > grid->z_size)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, the window [%u, %u) x [%u, %u) x [%u, %u) is empty or outside of the %ux%ux%u scene\n\n", region->x0,
+				region->x1, region->y0, region->y1, region->z0, region->z1, grid->x_size, grid->y_size, grid->z_size);
+		return -1;
+	}
+	if (capacity < (size_t)(region->x1 - region->x0) * (region->y1 - region->y0) * (region->z1 - region->z0))
+	{
+		log_error(CCSDS_ERROR_BUFFER, "\nError, the window does not fit in the %zu samples of the buffer\n\n", capacity);
+		return -1;
+	}
+	return 0;
+}
+
+/// Decompresses the window of the container described by config (the whole scene when region is NULL),
+/// allocating the directory from arena: the window is cropped into samples or, when samples is NULL, the
+/// whole scene is written to the output file
+static int decompress_container(decompressConfig_t *config, const tile_region_t *region, unsigned short int *samples, size_t capacity,
+		arena_t *arena)
+{
+	tiled_decompression_t decompression;
+	tile_decompressor_t *decompressors = NULL;
+	encoder_config_t encoder_params;
+	input_feature_t tile_params;
+	unsigned long long *offsets = NULL;
+	unsigned int num_threads = config->num_threads;
+	unsigned int started = 0;
+	unsigned int i = 0;
+	FILE *inFile = NULL;
+	io_file_t inStream;
+	size_t working_set = 0;
+	int result = 0;
+
+	if (config->in_file[0] == '\x0' || (samples == NULL && config->out_file[0] == '\x0'))
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the container and the file where the decompressed scene will be saved\n\n");
+		return -1;
+	}
+	if (config->input_params.in_interleaving == BI && config->input_params.in_interleaving_depth == 0)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the depth of the BI interleaving of the output\n\n");
+		return -1;
+	}
+	memset(&decompression, 0, sizeof(tiled_decompression_t));
+	memset(&encoder_params, 0, sizeof(encoder_config_t));
+	if ((inFile = io_open_stream(&inStream, config->io_backend, config->in_file)) == NULL)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in opening the container %s\n", config->in_file);
+		return -1;
+	}
+	// The parameters of the scene are the ones of its first tile, with the size of the scene
+	tile_params = config->input_params;
+	if (tile_directory_read(inFile, config->in_file, &decompression.grid, &offsets, arena) != 0 || fseek(inFile, (long)offsets[0], SEEK_SET) != 0 ||
+			read_header(inFile, &tile_params, &encoder_params, &config->predictor_params, arena) != 0)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error in reading the container %s\n", config->in_file);
+		io_close_stream(&inStream, inFile);
+		return -1;
+	}
+	config->predictor_params.weight_init_table = NULL;
+	config->input_params = tile_params;
+	config->input_params.x_size = decompression.grid.x_size;
+	config->input_params.y_size = decompression.grid.y_size;
+	config->input_params.z_size = decompression.grid.z_size;
+	if (region != NULL)
+		decompression.region = *region;
+	else
+	{
+		decompression.region.x1 = decompression.grid.x_size;
+		decompression.region.y1 = decompression.grid.y_size;
+		decompression.region.z1 = decompression.grid.z_size;
+	}
+	if (samples != NULL && check_region(&decompression.grid, &decompression.region, capacity) != 0)
+	{
+		io_close_stream(&inStream, inFile);
+		return -1;
+	}
+	decompression.first_tile_x = decompression.region.x0 / decompression.grid.tile_width;
+	decompression.first_tile_y = decompression.region.y0 / decompression.grid.tile_height;
+	decompression.region_tiles_x = (decompression.region.x1 - 1) / decompression.grid.tile_width + 1 - decompression.first_tile_x;
+	decompression.num_tiles = ((decompression.region.y1 - 1) / decompression.grid.tile_height + 1 - decompression.first_tile_y) * decompression.region_tiles_x;
+	// The bands after the window are not decoded when they follow it in the streams of the tiles
+	decompression.num_bands = encoder_params.out_interleaving == BSQ ? decompression.region.z1 : decompression.grid.z_size;
+
+	if (num_threads == 0)
+	{
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		num_threads = online > 0 ? (unsigned int)online : 1;
+	}
+	if (num_threads > decompression.num_tiles)
+		num_threads = decompression.num_tiles;
+	tile_params.x_size = decompression.grid.tile_width;
+	tile_params.y_size = decompression.grid.tile_height;
+	tile_params.z_size = decompression.num_bands;
+	working_set = (decode_working_set(tile_params) + unpredict_working_set(tile_params, config->predictor_params) +
+			3 * sizeof(unsigned short int) * tile_params.x_size * tile_params.z_size) * num_threads;
+	if (config->memory_budget != 0 && working_set > config->memory_budget)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "\nError, the decompression needs %zu bytes of memory, more than the budget of %zu bytes\n\n", working_set,
+				config->memory_budget);
+		io_close_stream(&inStream, inFile);
+		return -1;
+	}
+	log_info("Decompression engine: %u of %u tiles on %u threads, estimated peak memory %zu bytes (%.2lf kb)\n", decompression.num_tiles,
+			tile_grid_tiles(&decompression.grid), num_threads, working_set, ((double)working_set) / 1024.0);
+
+	decompression.inputFile = config->in_file;
+	decompression.backend = config->io_backend;
+	decompression.offsets = offsets;
+	decompression.output_params = config->input_params;
+	decompression.region_samples = samples;
+	log_current_callback(&decompression.log_callback, &decompression.log_user_data);
+	if ((decompressors = (tile_decompressor_t *)arena_calloc(arena, num_threads, sizeof(tile_decompressor_t))) == NULL)
+	{
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the threads of the tiled decompression\n\n");
+		io_close_stream(&inStream, inFile);
+		return -1;
+	}
+	if (samples == NULL && io_open(&decompression.outFile, config->io_backend, config->out_file, IO_WRITE) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in opening output file %s\n\n", config->out_file);
+		io_close_stream(&inStream, inFile);
+		return -1;
+	}
+	pthread_mutex_init(&decompression.output_lock, NULL);
+	for (i = 0; i < num_threads; i++)
+	{
+		decompressors[i].decompression = &decompression;
+		arena_init(&decompressors[i].arena, 0, 0);
+	}
+	// The calling thread decompresses tiles too, with the stream the directory was read from
+	decompressors[0].stream = inFile;
+	for (started = 1; started < num_threads; started++)
+	{
+		if (pthread_create(&decompressors[started].thread, NULL, decompress_tiles, &decompressors[started]) != 0)
+			break;
+	}
+	decompress_tiles(&decompressors[0]);
+	for (i = 1; i < started; i++)
+		pthread_join(decompressors[i].thread, NULL);
+	pthread_mutex_destroy(&decompression.output_lock);
+
+	// The errors of the other threads have been reported to the log callback already
+	for (i = 0; i < started && result == 0; i++)
+	{
+		if (decompressors[i].status != CCSDS_OK)
+		{
+			log_error(decompressors[i].status, "Error in decompressing the tiles of the container\n");
+			result = -1;
+		}
+	}
+	for (i = 0; i < num_threads; i++)
+		arena_release(&decompressors[i].arena);
+	if (samples == NULL && io_close(&decompression.outFile) != 0 && result == 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in writing the uncompressed samples to %s\n\n", config->out_file);
+		result = -1;
+	}
+	io_close_stream(&inStream, inFile);
+	return result;
+}
+
+/// Runs decompress_container with the arena of config or, when it has none, a local one
+static int decompress_with_arena(decompressConfig_t *config, const tile_region_t *region, unsigned short int *samples, size_t capacity)
+{
+	arena_t local_arena;
+	arena_t *arena = config->arena;
+	log_context_t log_context;
+	int result = 0;
+
+	log_begin(&log_context, config->log_callback, config->log_user_data);
+	if (arena == NULL)
+	{
+		arena = &local_arena;
+		arena_init(arena, 0, 0);
+	}
+	result = decompress_container(config, region, samples, capacity, arena);
+
+	// The directory and the tables of the header of the first tile are given back at once.
+	config->predictor_params.weight_init_table = NULL;
+	if (arena == config->arena)
+		arena_reset(arena);
+	else
+		arena_release(arena);
+	return log_end(&log_context, result);
+}
+
+int decompress_tiled(decompressConfig_t *config)
+{
+	return decompress_with_arena(config, NULL, NULL, 0);
+}
+
+int decompress_tiled_region(decompressConfig_t *config, const tile_region_t *region, unsigned short int *samples, size_t capacity)
+{
+	if (samples == NULL)
+	{
+		log_context_t log_context;
+		log_begin(&log_context, config->log_callback, config->log_user_data);
+		log_error(CCSDS_ERROR_CONFIG, "\nError, please indicate the buffer where the window will be saved\n\n");
+		return log_end(&log_context, -1);
+	}
+	return decompress_with_arena(config, region, samples, capacity);
+}
@@ -40,118 +40,190 @@
 #include "predictor.h"
 
 /// Given the mapped residual and the prediction it extracts the original sample
+/// The three-way inverse mapping is computed with masks instead of branches, as the taken case
+/// changes almost randomly from one sample to the next
 unsigned short int get_sample(unsigned short int residual, int scaled_predicted, unsigned int s_min, unsigned int s_max)
 {
 	int predicted_sample = scaled_predicted / 2;
-	unsigned int omega = predicted_sample - s_min;
-	unsigned int selected_omega = 0;
-	unsigned short int sample = 0;
-	int delta = 0;
+	int omega_low = predicted_sample - (int)s_min;
+	int omega_high = (int)s_max - predicted_sample;
+	// all ones when omega is the distance from s_max, i.e. when the residual sign is inverted
+	int selected_omega = -(omega_low > omega_high);
+	int omega = (selected_omega & omega_high) | (~selected_omega & omega_low);
+	int outside = -((int)residual > 2 * omega);
+	int delta_outside = (((int)residual - omega) ^ selected_omega) - selected_omega;
+	// even residuals carry the sign of the scaled prediction, odd ones the opposite sign
+	int flip = -(scaled_predicted & 0x1) ^ -(residual & 0x1);
+	int delta_inside = ((((int)residual + (residual & 0x1)) >> 1) ^ flip) - flip;
+	int delta = (outside & delta_outside) | (~outside & delta_inside);
+
+	return (unsigned short int)(delta + predicted_sample);
+}
 
-	if (omega > s_max - predicted_sample)
-	{
-		omega = s_max - predicted_sample;
-		selected_omega = 1;
-	}
+/// Reconstructs the row y of band z from its mapped residuals: as the local sums and differences
+/// of a sample depend on the previous samples of the same row, they are computed one sample at a
+/// time, just before the sample itself is predicted and extracted. differences[0] receives the
+/// differences of the row, differences[i] holds the ones of band z - i
+void unpredict_row(input_feature_t input_params, predictor_config_t predictor_params, unsigned int y, unsigned int z,
+		unsigned short int *cur_row, const unsigned short int *prev_row, unsigned short int prev_band_origin,
+		row_differences_t **differences, int *weights, const unsigned short int *residual_row)
+{
+	unsigned int s_max = (0x1 << input_params.dyn_range) - 1;
+	unsigned int x = 0;
 
-	if (residual > 2 * omega)
-	{
-		if (selected_omega == 0)
-			delta = residual - omega;
-		else
-			delta = omega - residual;
-	}
-	else
+	for (x = 0; x < input_params.x_size; x++)
 	{
-		if ((residual & 0x1) == 0)
+		int predicted_sample = 0;
+		compute_sample_differences(input_params, predictor_params, y, x, cur_row, prev_row, differences[0]);
+		predicted_sample = predict_sample(input_params, predictor_params, x, y, z, prev_band_origin, differences, weights);
+		cur_row[x] = get_sample(residual_row[x], predicted_sample, 0, s_max);
+		if (x == 0 && y == 0)
 		{
-			int sign_scaled = (scaled_predicted & 0x1) != 0 ? -1 : 1;
-			delta = sign_scaled * (residual / 2);
+			//  weights initialization
+			init_weights(weights, predictor_params, z);
 		}
 		else
 		{
-			int sign_scaled = (scaled_predicted & 0x1) != 0 ? 1 : -1;
-			delta = sign_scaled * ((residual + 1) / 2);
+			// the central difference could only be computed now that the sample is known
+			differences[0]->central[x] = 4 * cur_row[x] - differences[0]->local_sum[x];
+			// finally I can update the weights, preparing for the prediction of the next sample
+			update_sample_weights(input_params, predictor_params, x, y, z, 2 * cur_row[x] - predicted_sample, differences, weights);
 		}
 	}
+}
 
-	sample = delta + predicted_sample;
-
-	return sample;
+/// Returns the number of bytes of memory allocated by unpredict: the image samples and the rows of
+/// the row engine (the residuals are allocated by the caller)
+size_t unpredict_working_set(input_feature_t input_params, predictor_config_t predictor_params)
+{
+	size_t weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
+	size_t window = predictor_params.pred_bands + 1;
+	size_t arrays_per_row = predictor_params.full != 0 ? 5 : 2;
+	size_t bytes = SAMPLE_BYTES(input_params) * IMAGE_SAMPLES(input_params);
+
+	bytes += sizeof(int) * (weights_len > 0 ? weights_len : 1) * input_params.z_size;
+	bytes += sizeof(int) * input_params.x_size * window * arrays_per_row;
+	bytes += (sizeof(row_differences_t) + sizeof(row_differences_t *)) * window;
+	if (SAMPLE_BYTES(input_params) == 1)
+		bytes += sizeof(unsigned short int) * input_params.x_size * (2 * (size_t)input_params.z_size + 1);
+	return bytes;
 }
 
 /// Given the mapped residuals saved in BSQ format it iterates over them, computing
-/// the prediction and, then extracting the original sample.
-int unpredict(input_feature_t input_params, predictor_config_t predictor_params, unsigned short int *residuals, char outputFile[128])
+/// the prediction and, then extracting the original sample into samples (BSQ, zeroed by the caller).
+/// The image is reconstructed row by row (all the bands of row y before row y + 1), mirroring
+/// the order used by predict.
+int unpredict_samples(input_feature_t input_params, predictor_config_t predictor_params, void *residuals, void *samples, arena_t *arena)
 {
-	unsigned short int *samples = NULL;
-	unsigned int s_min = 0;
-	unsigned int s_max = (0x1 << input_params.dyn_range) - 1;
-	unsigned int s_mid = 0x1 << (input_params.dyn_range - 1);
-	unsigned int x = 0, y = 0, z = 0;
+	const unsigned int sample_bytes = SAMPLE_BYTES(input_params);
+	unsigned int y = 0, z = 0;
 	int *weights = NULL;
 	int weights_len = predictor_params.pred_bands + (predictor_params.full != 0 ? 3 : 0);
-
-	samples = (unsigned short int *)malloc(sizeof(unsigned short int) * input_params.x_size * input_params.y_size * input_params.z_size);
-	if (samples == NULL)
-	{
-		fprintf(stderr, "Error in allocating %lf kBytes for the output image buffer\n\n", ((double)sizeof(unsigned short int) * input_params.x_size * input_params.y_size * input_params.z_size) / 1024.0);
-		return -1;
-	}
-	weights = (int *)malloc(sizeof(int) * weights_len);
-	if (weights == NULL)
+	// Number of rows of differences kept: the current band and the previous pred_bands ones
+	unsigned int window = predictor_params.pred_bands + 1;
+	unsigned int arrays_per_row = predictor_params.full != 0 ? 5 : 2;
+	int *differences_buffer = NULL;
+	row_differences_t *window_differences = NULL;
+	row_differences_t **band_differences = NULL;
+	// 16 bits copies of the last two rows of every band and of the residual row, only used
+	// with the narrow storage
+	unsigned short int *wide_rows = NULL;
+	unsigned int i = 0;
+	// everything allocated here is released when the unprediction ends
+	arena_mark_t mark = arena_get_mark(arena);
+
+	weights = (int *)arena_alloc(arena, sizeof(int) * (weights_len > 0 ? weights_len : 1) * input_params.z_size);
+	differences_buffer = (int *)arena_alloc(arena, sizeof(int) * input_params.x_size * window * arrays_per_row);
+	window_differences = (row_differences_t *)arena_alloc(arena, sizeof(row_differences_t) * window);
+	band_differences = (row_differences_t **)arena_alloc(arena, sizeof(row_differences_t *) * window);
+	if (sample_bytes == 1)
+		wide_rows = (unsigned short int *)arena_calloc(arena, (size_t)input_params.x_size * (2 * input_params.z_size + 1), sizeof(unsigned short int));
+	if (weights == NULL || differences_buffer == NULL || window_differences == NULL || band_differences == NULL ||
+			(sample_bytes == 1 && wide_rows == NULL))
 	{
-		fprintf(stderr, "Error in allocating the weights vector\n\n");
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating the weights vector and the local differences rows\n\n");
+		arena_rewind(arena, mark);
 		return -1;
 	}
+	init_differences_window(predictor_params, input_params.x_size, window, differences_buffer, window_differences);
+
 	// Now actually it goes over the various samples and it computes the prediction
 	// residual for each of them; with that and the residual the original sample
 	// can be reconstructed.
-	for (z = 0; z < input_params.z_size; z++)
+	for (y = 0; y < input_params.y_size; y++)
 	{
-		for (y = 0; y < input_params.y_size; y++)
+		for (z = 0; z < input_params.z_size; z++)
 		{
-			for (x = 0; x < input_params.x_size; x++)
+			unsigned short int *cur_row = NULL;
+			const unsigned short int *prev_row = NULL;
+			const unsigned short int *residual_row = NULL;
+			unsigned int cur_pred_bands = z < predictor_params.pred_bands ? z : predictor_params.pred_bands;
+
+			if (sample_bytes == 1)
 			{
-				int error = 0;
-				int predicted_sample = 0;
-				unsigned short int cur_sample = 0;
-				predicted_sample = compute_predicted_sample(input_params, predictor_params,
-						x, y, z, s_min, s_mid, s_max, samples, weights);
-				cur_sample = get_sample(MATRIX_BSQ_INDEX(residuals, input_params, x, y, z), predicted_sample, s_min, s_max);
-				MATRIX_BSQ_INDEX(samples, input_params, x, y, z) = cur_sample;
-				if (x == 0 && y == 0)
-				{
-					//  weights initialization
-					init_weights(weights, predictor_params, z);
-				}
-				else
-				{
-					// finally I can update the weights, preparing for the prediction of the next sample
-					error = 2 * cur_sample - predicted_sample;
-					update_weights(weights, input_params, predictor_params, x, y, z, error, samples);
-				}
+				unsigned short int *wide_residuals = wide_rows + (size_t)2 * input_params.z_size * input_params.x_size;
+				cur_row = wide_rows + (size_t)(2 * z + (y & 0x1)) * input_params.x_size;
+				prev_row = wide_rows + (size_t)(2 * z + ((y + 1) & 0x1)) * input_params.x_size;
+				widen_row((unsigned char *)residuals + BSQ_OFFSET(input_params, 0, y, z), wide_residuals, input_params.x_size);
+				residual_row = wide_residuals;
 			}
+			else
+			{
+				cur_row = (unsigned short int *)samples + BSQ_OFFSET(input_params, 0, y, z);
+				prev_row = cur_row - input_params.x_size;
+				residual_row = (unsigned short int *)residuals + BSQ_OFFSET(input_params, 0, y, z);
+			}
+
+			for (i = 0; i <= cur_pred_bands; i++)
+			{
+				band_differences[i] = &window_differences[(z - i) % window];
+			}
+			unpredict_row(input_params, predictor_params, y, z, cur_row, y > 0 ? prev_row : NULL,
+					z > 0 ? GET_ELEMENT(samples, sample_bytes, BSQ_OFFSET(input_params, 0, 0, z - 1)) : 0, band_differences,
+					weights + z * weights_len, residual_row);
+			if (sample_bytes == 1)
+				narrow_row(cur_row, (unsigned char *)samples + BSQ_OFFSET(input_params, 0, y, z), input_params.x_size);
 		}
 	}
 
-	// Now I simply have to save the samples to the output file and in the correct format (BSQ or BI)
-	// remember that in the samples array they are saved in BSQ format
-	if (write_samples(input_params, outputFile, samples, s_mid) != 0)
+	// Freeing allocated memory
+	arena_rewind(arena, mark);
+
+	return 0;
+}
+
+/// Reconstructs the image from its mapped residuals (see unpredict_samples) and saves it to outputFile.
+int unpredict(input_feature_t input_params, predictor_config_t predictor_params, void *residuals, char outputFile[128], io_backend_t backend, arena_t *arena)
+{
+	void *samples = NULL;
+	unsigned int s_mid = 0x1 << (input_params.dyn_range - 1);
+	arena_mark_t mark = arena_get_mark(arena);
+
+	// the samples are zeroed as the central difference of a sample is computed (and then
+	// corrected) before the sample is extracted
+	samples = arena_calloc(arena, IMAGE_SAMPLES(input_params), SAMPLE_BYTES(input_params));
+	if (samples == NULL)
 	{
-		fprintf(stderr, "Error in writing the uncompressed samples to the output file\n");
+		log_error(CCSDS_ERROR_MEMORY, "Error in allocating %lf kBytes for the output image buffer\n\n", ((double)SAMPLE_BYTES(input_params) * IMAGE_SAMPLES(input_params)) / 1024.0);
 		return -1;
 	}
-
-	// Freeing allocated memory
-	if (samples != NULL)
+	if (unpredict_samples(input_params, predictor_params, residuals, samples, arena) != 0)
 	{
-		free(samples);
+		arena_rewind(arena, mark);
+		return -1;
 	}
-	if (weights != NULL)
+
+	// Now I simply have to save the samples to the output file and in the correct format (BSQ or BI)
+	// remember that in the samples array they are saved in BSQ format
+	if (write_samples(input_params, backend, outputFile, samples, s_mid) != 0)
 	{
-		free(weights);
+		log_error(CCSDS_ERROR_IO, "Error in writing the uncompressed samples to the output file\n");
+		arena_rewind(arena, mark);
+		return -1;
 	}
 
+	// Freeing allocated memory
+	arena_rewind(arena, mark);
+
 	return 0;
 }
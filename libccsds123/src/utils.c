@@ -30,6 +30,9 @@
 
 #ifdef WIN32
 #define _CRT_SECURE_NO_WARNINGS
+#else
+// 64 bits file offsets, needed to seek into input files bigger than 2 GB
+#define _FILE_OFFSET_BITS 64
 #endif
 
 #include <stdlib.h>
@@ -39,6 +42,13 @@
 
 #include "utils.h"
 
+// Number of samples read (by read_samples) and written (by write_samples) at a time
+#define IO_CHUNK_SAMPLES 32768
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 /// Returns 0 if the host machine byte ordering is big endian, a value different from 0 if it is
 /// little endian
 static long _TestEndian = 0x1;
@@ -59,20 +69,20 @@ int parse_acc_table(char fileName[128], unsigned int *table, unsigned int max_va
 	acc_tableFile = fopen(fileName, "r+t");
 	if (acc_tableFile == NULL)
 	{
-		fprintf(stderr, "Error in opening the accumulator table file %s\n\n", fileName);
+		log_error(CCSDS_ERROR_IO, "Error in opening the accumulator table file %s\n\n", fileName);
 		return -1;
 	}
 	for (i = 0; i < num_toRead; i++)
 	{
 		if (fscanf(acc_tableFile, "%d\n", &(table[i])) == EOF)
 		{
-			fprintf(stderr, "Error in reading the accumulator table: EOF while read only %d values\n\n", i);
+			log_error(CCSDS_ERROR_CONFIG, "Error in reading the accumulator table: EOF while read only %d values\n\n", i);
 			fclose(acc_tableFile);
 			return -1;
 		}
 		if ((table[i]) > max_value)
 		{
-			fprintf(stderr, "Error in reading the accumulator table: value %d greater than %d\n\n", i, max_value);
+			log_error(CCSDS_ERROR_CONFIG, "Error in reading the accumulator table: value %d greater than %d\n\n", i, max_value);
 			fclose(acc_tableFile);
 			return -1;
 		}
@@ -94,7 +104,7 @@ int parse_weights_table(char fileName[128], int **table, int max_value, int min_
 	constantFile = fopen(fileName, "r+t");
 	if (constantFile == NULL)
 	{
-		fprintf(stderr, "Error in opening the weights file %s\n\n", fileName);
+		log_error(CCSDS_ERROR_IO, "Error in opening the weights file %s\n\n", fileName);
 		return -1;
 	}
 	for (i = 0; i < num_toRead; i++)
@@ -103,26 +113,26 @@ int parse_weights_table(char fileName[128], int **table, int max_value, int min_
 		{
 			if (fscanf(constantFile, "\n") == EOF)
 			{
-				fprintf(stderr, "Error in reading the weights file: EOF while read only %d values - blank line read\n\n", i);
+				log_error(CCSDS_ERROR_CONFIG, "Error in reading the weights file: EOF while read only %d values - blank line read\n\n", i);
 				fclose(constantFile);
 				return -1;
 			}
 		}
 		if (fscanf(constantFile, "%d\n", &readValue) == EOF)
 		{
-			fprintf(stderr, "Error in reading the weights file: EOF while read only %d values\n\n", i);
+			log_error(CCSDS_ERROR_CONFIG, "Error in reading the weights file: EOF while read only %d values\n\n", i);
 			fclose(constantFile);
 			return -1;
 		}
 		if (readValue > max_value)
 		{
-			fprintf(stderr, "Error in reading the weights file: value %d (%d) greater than %d\n\n", i, readValue, max_value);
+			log_error(CCSDS_ERROR_CONFIG, "Error in reading the weights file: value %d (%d) greater than %d\n\n", i, readValue, max_value);
 			fclose(constantFile);
 			return -1;
 		}
 		if (readValue < min_value)
 		{
-			fprintf(stderr, "Error in reading the weights file: value %d (%d) smaller than %d\n\n", i, readValue, min_value);
+			log_error(CCSDS_ERROR_CONFIG, "Error in reading the weights file: value %d (%d) smaller than %d\n\n", i, readValue, min_value);
 			fclose(constantFile);
 			return -1;
 		}
@@ -150,10 +160,18 @@ long long mod_star(long long arg, long long op, int debug)
 ///@param num_bits_to_write number of least significant bits of the bits_to_write word which we have to
 ///write into the stream
 ///@param bits_to_write word containing the bits to be written to the stream
-void bitStream_store(unsigned char *compressed_stream, unsigned int *written_bytes,
+void bitStream_store(unsigned char *compressed_stream, size_t *written_bytes,
 		unsigned int *written_bits, unsigned int num_bits_to_write, unsigned int bits_to_write)
 {
 	int i = 0;
+	if (compressed_stream == NULL)
+	{
+		// the bits are only counted (see estimate_encoding)
+		*written_bits += num_bits_to_write;
+		*written_bytes += *written_bits / 8;
+		*written_bits %= 8;
+		return;
+	}
 	//fprintf(stderr, "bits_to_write %#x, num_bits_to_write %d\n", bits_to_write, num_bits_to_write);
 	for (i = num_bits_to_write - 1; i >= 0; i--)
 	{
@@ -176,10 +194,17 @@ void bitStream_store(unsigned char *compressed_stream, unsigned int *written_byt
 ///@param num_bits_to_write number of times the bit in the least significant position of bit_to_repeat
 ///has to be added to the stream
 ///@param bit_to_repeat byte whose least significant bit is to be added to the stream num_bits_to_write times
-void bitStream_store_constant(unsigned char *compressed_stream, unsigned int *written_bytes,
+void bitStream_store_constant(unsigned char *compressed_stream, size_t *written_bytes,
 		unsigned int *written_bits, unsigned int num_bits_to_write, unsigned char bit_to_repeat)
 {
 	unsigned int i = 0;
+	if (compressed_stream == NULL)
+	{
+		*written_bits += num_bits_to_write;
+		*written_bytes += *written_bits / 8;
+		*written_bits %= 8;
+		return;
+	}
 	bit_to_repeat = 0x1 & bit_to_repeat;
 	for (i = 0; i < num_bits_to_write; i++)
 	{
@@ -193,21 +218,62 @@ void bitStream_store_constant(unsigned char *compressed_stream, unsigned int *wr
 	}
 }
 
+///Appends to compressedStream, starting at byte writtenBytes and in that byte at bit writtenBits,
+///the first source_bytes bytes and source_bits bits of the source stream (e.g. a stream produced
+///separately). It also updates writtenBytes and writtenBits according to the number of bits written
+void bitStream_append(unsigned char *compressed_stream, size_t *written_bytes, unsigned int *written_bits,
+		const unsigned char *source, size_t source_bytes, unsigned int source_bits)
+{
+	size_t i = 0;
+	if (*written_bits == 0)
+	{
+		// byte aligned: the complete bytes are simply copied
+		memcpy(compressed_stream + *written_bytes, source, source_bytes);
+		*written_bytes += source_bytes;
+	}
+	else
+	{
+		// every byte of the source is split between the partial byte of the stream and the next one
+		for (i = 0; i < source_bytes; i++)
+		{
+			compressed_stream[*written_bytes] |= source[i] >> *written_bits;
+			(*written_bytes)++;
+			compressed_stream[*written_bytes] |= (unsigned char)(source[i] << (8 - *written_bits));
+		}
+	}
+	if (source_bits > 0)
+		bitStream_store(compressed_stream, written_bytes, written_bits, source_bits, source[source_bytes] >> (8 - source_bits));
+}
+
+///Writes to file the complete bytes of the compressed stream, moving the partially written
+///byte to the beginning of compressed_stream so that the writing can continue; written_bytes is
+///reset accordingly
+///@return 0 if the operation succesfully completes, a negative value otherwise
+int bitStream_flush(io_file_t *outFile, unsigned char *compressed_stream, size_t *written_bytes)
+{
+	if (*written_bytes == 0)
+		return 0;
+	if (io_append(outFile, compressed_stream, *written_bytes) != 0)
+	{
+		log_error(CCSDS_ERROR_IO, "Error in writing %zu bytes of the compressed stream\n\n", *written_bytes);
+		return -1;
+	}
+	compressed_stream[0] = compressed_stream[*written_bytes];
+	memset(compressed_stream + 1, 0, *written_bytes);
+	*written_bytes = 0;
+	return 0;
+}
+
 ///Given the index of an element in an array where pixels are stored according to
 ///the specified ordering, it returns the index of the same image element
 ///in an array specified using BSQ ordering.
-unsigned int indexToBSQ(interleaving_t interleaving, unsigned int interleaving_depth,
-		unsigned int x_size, unsigned int y_size, unsigned int z_size, unsigned int index)
+///The index must be smaller than the number of samples of the image.
+size_t indexToBSQ(interleaving_t interleaving, unsigned int interleaving_depth,
+		unsigned int x_size, unsigned int y_size, unsigned int z_size, size_t index)
 {
-	unsigned int x = 0, y = 0, z = 0, reminder = 0, i = 0;
-#ifndef NDEBUG
-	// Consistency check: I should never go out of the allocated boundaries
-	if (index >= x_size * y_size * z_size)
-	{
-		fprintf(stderr, "indexToBSQ - Error requested index %d out of boundaries %d\n\n", index, x_size * y_size * z_size);
-		exit(-1);
-	}
-#endif
+	size_t reminder = 0;
+	unsigned int x = 0, y = 0, z = 0, i = 0;
+	const size_t frame_size = (size_t)x_size * z_size;
 	//Of course if the ordering is already BSQ there is nothing to do
 	if (interleaving == BSQ)
 		return index;
@@ -215,11 +281,11 @@ unsigned int indexToBSQ(interleaving_t interleaving, unsigned int interleaving_d
 	//the quickest way is to extract the pixel coordinates (x, y, z)
 	//and then convert them back to sequential numbering according to
 	//BSQ ordering
-	y = index / (x_size * z_size);
-	reminder = index % (x_size * z_size);
+	y = index / frame_size;
+	reminder = index % frame_size;
 
-	i = reminder / (x_size * interleaving_depth);
-	reminder = reminder % (x_size * interleaving_depth);
+	i = reminder / ((size_t)x_size * interleaving_depth);
+	reminder = reminder % ((size_t)x_size * interleaving_depth);
 
 	if (i == z_size / interleaving_depth)
 	{
@@ -236,32 +302,27 @@ unsigned int indexToBSQ(interleaving_t interleaving, unsigned int interleaving_d
 	if (z >= z_size)
 		z = z_size - 1;
 
-	return x + y * x_size + z * x_size * y_size;
+	return x + (size_t)y * x_size + (size_t)z * x_size * y_size;
 }
 
 ///Given the index of an element in an array where pixels are stored according
 ///to the BSQ ordering, it returns the index of the same image element
 ///in an array ordered using the specified ordering
-unsigned int BSQToIndex(interleaving_t interleaving, unsigned int interleaving_depth,
-		unsigned int x_size, unsigned int y_size, unsigned int z_size, unsigned int index)
+///The index must be smaller than the number of samples of the image.
+size_t BSQToIndex(interleaving_t interleaving, unsigned int interleaving_depth,
+		unsigned int x_size, unsigned int y_size, unsigned int z_size, size_t index)
 {
-	unsigned int x = 0, y = 0, z = 0, reminder = 0, i = 0;
-#ifndef NDEBUG
-	// Consistency check: I should never go out of the allocated boundaries
-	if (index >= x_size * y_size * z_size)
-	{
-		fprintf(stderr, "BSQToIndex - Error requested index %d out of boundaries %d\n\n", index, x_size * y_size * z_size);
-		exit(-1);
-	}
-#endif
+	size_t reminder = 0;
+	unsigned int x = 0, y = 0, z = 0, i = 0;
+	const size_t band_size = (size_t)x_size * y_size;
 	//Of course if the target ordering is BSQ there is nothing to do
 	if (interleaving == BSQ)
 		return index;
 
 	//As usual, I extract the pixel coordinates and then reconstruct the
 	//target numbering
-	z = index / (x_size * y_size);
-	reminder = index % (x_size * y_size);
+	z = index / band_size;
+	reminder = index % band_size;
 
 	y = reminder / x_size;
 	reminder = index % x_size;
@@ -274,141 +335,109 @@ unsigned int BSQToIndex(interleaving_t interleaving, unsigned int interleaving_d
 	//left to use the whole interleaving depth
 	if (z == z_size - 1)
 	{
-		return y * x_size * z_size + i * interleaving_depth * x_size + x * (z_size - i * interleaving_depth) + z % interleaving_depth;
+		return (size_t)y * x_size * z_size + (size_t)i * interleaving_depth * x_size + (size_t)x * (z_size - i * interleaving_depth) + z % interleaving_depth;
 	}
 	else
 	{
-		return y * x_size * z_size + i * interleaving_depth * x_size + x * interleaving_depth + z % interleaving_depth;
+		return (size_t)y * x_size * z_size + (size_t)i * interleaving_depth * x_size + (size_t)x * interleaving_depth + z % interleaving_depth;
+	}
+}
+
+///Checks that every dimension of the image is between 1 and MAX_DIMENSION_SIZE and that
+///the memory buffers holding the whole image (samples, residuals and compressed stream) can be
+///addressed on this machine
+///@return 0 if the image size is supported, a negative value otherwise
+int check_image_size(input_feature_t input_params)
+{
+	if (input_params.x_size < 1 || input_params.x_size > MAX_DIMENSION_SIZE ||
+			input_params.y_size < 1 || input_params.y_size > MAX_DIMENSION_SIZE ||
+			input_params.z_size < 1 || input_params.z_size > MAX_DIMENSION_SIZE)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "Error, the image dimensions %u x %u x %u are out of range: each of them must be between 1 and %d\n\n",
+				input_params.x_size, input_params.y_size, input_params.z_size, MAX_DIMENSION_SIZE);
+		return -1;
+	}
+	// The biggest buffer is the one of the samples (or of the compressed stream) with 2 bytes per element
+	if ((size_t)-1 / 2 / input_params.x_size / input_params.y_size < input_params.z_size)
+	{
+		log_error(CCSDS_ERROR_CONFIG, "Error, the image with %llu samples is too big to be addressed on this machine\n\n",
+				(unsigned long long)input_params.x_size * input_params.y_size * input_params.z_size);
+		return -1;
 	}
+	return 0;
 }
 
 ///Given the file samples to be written to files (stored in memory in BSQ order) they
-///are saved to file.
+///are saved to file through the given I/O backend, a chunk at a time.
 ///While the samples are provided as unsigned integers, if needed they are converted
 ///to signed integers. Note also that, disrespective of the actual width of the samples,
 ///they are always saved on 16 bits (in case they are negative and they use less than 16 bits
 ///the most significant bits will be stored as 0s, i.e. no sign extension is done)
-int write_samples(input_feature_t input_params, char fileName[128], unsigned short int *samples, unsigned int s_mid)
+int write_samples(input_feature_t input_params, io_backend_t backend, char fileName[128], void *samples, unsigned int s_mid)
 {
-	FILE *outputFile = NULL;
-
-	outputFile = fopen(fileName, "w+b");
-	if (outputFile == NULL)
-	{
-		fprintf(stderr, "Error in opening output file %s\n\n", fileName);
+	io_file_t outputFile;
+	unsigned short int chunk[IO_CHUNK_SAMPLES];
+	unsigned char formatted[2 * IO_CHUNK_SAMPLES];
+	const unsigned int sample_bytes = SAMPLE_BYTES(input_params);
+	const size_t samplesNum = IMAGE_SAMPLES(input_params);
+	size_t written = 0;
+
+	if (io_open(&outputFile, backend, fileName, IO_WRITE) != 0)
 		return -1;
-	}
 
-	if (input_params.in_interleaving == BSQ)
+	// the samples are gathered in the order of the file (e.g. BI) and then converted to its representation
+	while (written < samplesNum)
 	{
-		unsigned int x = 0, y = 0, z = 0;
-		for (z = 0; z < input_params.z_size; z++)
+		const size_t count = MIN(IO_CHUNK_SAMPLES, samplesNum - written);
+		size_t i = 0;
+		for (i = 0; i < count; i++)
+			chunk[i] = GET_ELEMENT(samples, sample_bytes, indexToBSQ(input_params.in_interleaving, input_params.in_interleaving_depth, input_params.x_size, input_params.y_size, input_params.z_size, written + i));
+		format_samples(input_params, chunk, count, s_mid, formatted);
+		if (io_append(&outputFile, formatted, count * OUTPUT_SAMPLE_BYTES(input_params)) != 0)
 		{
-			for (y = 0; y < input_params.y_size; y++)
-			{
-				for (x = 0; x < input_params.x_size; x++)
-				{
-					if (input_params.signed_samples != 0)
-					{
-						unsigned short int mask = 0xFFFF >> (16 - input_params.dyn_range);
-						short int sample_buffer = ((int)MATRIX_BSQ_INDEX(samples, input_params, x, y, z)) - s_mid;
-						sample_buffer = sample_buffer & mask;
-						if (input_params.dyn_range > 8)
-						{
-							if ((is_little_endian() != 0 && input_params.byte_ordering == BIG) ||
-									(is_little_endian() == 0 && input_params.byte_ordering == LITTLE))
-							{
-								short int temp_endianess = sample_buffer & 0xFF;
-								sample_buffer = ((unsigned short int)sample_buffer) >> 8;
-								sample_buffer |= temp_endianess << 8;
-							}
-							fwrite(&sample_buffer, 2, 1, outputFile);
-						}
-						else
-							fwrite(&sample_buffer, 1, 1, outputFile);
-					}
-					else
-					{
-						unsigned short int sample_buffer = MATRIX_BSQ_INDEX(samples, input_params, x, y, z);
-						if (input_params.dyn_range > 8)
-						{
-							if ((is_little_endian() != 0 && input_params.byte_ordering == BIG) ||
-									(is_little_endian() == 0 && input_params.byte_ordering == LITTLE))
-							{
-								unsigned short int temp_endianess = sample_buffer & 0xFF;
-								sample_buffer = sample_buffer >> 8;
-								sample_buffer |= temp_endianess << 8;
-							}
-							fwrite(&sample_buffer, 2, 1, outputFile);
-						}
-						else
-							fwrite(&sample_buffer, 1, 1, outputFile);
-					}
-				}
-			}
+			io_close(&outputFile);
+			return -1;
 		}
+		written += count;
 	}
-	else
+
+	return io_close(&outputFile);
+}
+
+/// Input file of read_samples, read a chunk at a time
+typedef struct sample_reader
+{
+	io_file_t file;
+	unsigned long long offset;
+	size_t length;
+	size_t position;
+	int error;
+	unsigned short int chunk[IO_CHUNK_SAMPLES];
+} sample_reader_t;
+
+/// Copies the next bytes of the input file (up to bytes) into destination, as fread does
+/// @return the number of copied bytes, smaller than bytes at the end of the file or in case of error
+static size_t read_bytes(sample_reader_t *reader, void *destination, size_t bytes)
+{
+	size_t copied = 0;
+
+	while (copied < bytes)
 	{
-		unsigned int x = 0, y = 0, z = 0, i = 0;
-		unsigned int interleaving_counter = input_params.z_size / input_params.in_interleaving_depth;
-		if ((input_params.z_size % input_params.in_interleaving_depth) != 0)
+		if (reader->position == reader->length)
 		{
-			interleaving_counter++;
-		}
-		for (y = 0; y < input_params.y_size; y++)
-		{
-			for (i = 0; i < interleaving_counter; i++)
+			long long got = io_read(&reader->file, reader->offset, reader->chunk, sizeof(reader->chunk));
+			if (got <= 0)
 			{
-				for (x = 0; x < input_params.x_size; x++)
-				{
-					for (z = i * input_params.in_interleaving_depth; z < MIN((i + 1) * input_params.in_interleaving_depth, input_params.z_size); z++)
-					{
-						if (input_params.signed_samples != 0)
-						{
-							unsigned short int mask = 0xFFFF >> (16 - input_params.dyn_range);
-							short int sample_buffer = ((int)MATRIX_BSQ_INDEX(samples, input_params, x, y, z)) - s_mid;
-							sample_buffer = sample_buffer & mask;
-							if (input_params.dyn_range > 8)
-							{
-								if ((is_little_endian() != 0 && input_params.byte_ordering == BIG) ||
-										(is_little_endian() == 0 && input_params.byte_ordering == LITTLE))
-								{
-									short int temp_endianess = sample_buffer & 0xFF;
-									sample_buffer = ((unsigned short int)sample_buffer) >> 8;
-									sample_buffer |= temp_endianess << 8;
-								}
-								fwrite(&sample_buffer, 2, 1, outputFile);
-							}
-							else
-								fwrite(&sample_buffer, 1, 1, outputFile);
-						}
-						else
-						{
-							short unsigned int sample_buffer = MATRIX_BSQ_INDEX(samples, input_params, x, y, z);
-							if (input_params.dyn_range > 8)
-							{
-								if ((is_little_endian() != 0 && input_params.byte_ordering == BIG) ||
-										(is_little_endian() == 0 && input_params.byte_ordering == LITTLE))
-								{
-									unsigned short int temp_endianess = sample_buffer & 0xFF;
-									sample_buffer = sample_buffer >> 8;
-									sample_buffer |= temp_endianess << 8;
-								}
-								fwrite(&sample_buffer, 2, 1, outputFile);
-							}
-							else
-								fwrite(&sample_buffer, 1, 1, outputFile);
-						}
-					}
-				}
+				reader->error = got < 0;
+				break;
 			}
+			reader->offset += (unsigned long long)got;
+			reader->length = (size_t)got;
+			reader->position = 0;
 		}
+		((unsigned char *)destination)[copied++] = ((unsigned char *)reader->chunk)[reader->position++];
 	}
-
-	fclose(outputFile);
-
-	return 0;
+	return copied;
 }
 
 ///Given the file encoding the input samples, it reads them into the pre-allocated samples
@@ -421,23 +450,25 @@ int write_samples(input_feature_t input_params, char fileName[128], unsigned sho
 ///Also, the input elements could be either signed or unsigned values, I will transform it to unsigned
 ///by adding the quantity 2^(D-1) so that the rest of the compressor only has to deal with
 ///unsigned images
-int read_samples(input_feature_t input_params, char fileName[128], unsigned short int *samples)
+int read_samples(input_feature_t input_params, io_backend_t backend, char fileName[128], void *samples)
 {
 	//I simply have to read chunk of input_params.residual_width at a time,
 	//saving them in a short int (even if each sample is smaller).
 	unsigned short int buffer = 0;
-	unsigned int readElements = 0;
-	FILE *inputFile = NULL;
+	size_t readElements = 0;
+	const size_t samplesNum = IMAGE_SAMPLES(input_params);
+	sample_reader_t inputFile;
 	unsigned int num_inBuffer = 0;
 	unsigned short int prevBuffer = 0x0;
 	int availableBytes = 0;
+	const unsigned int sample_bytes = SAMPLE_BYTES(input_params);
 
-	inputFile = fopen(fileName, "r+b");
-	if (inputFile == NULL)
-	{
-		fprintf(stderr, "Error in opening input file %s\n\n", fileName);
+	if (io_open(&inputFile.file, backend, fileName, IO_READ) != 0)
 		return -1;
-	}
+	inputFile.offset = 0;
+	inputFile.length = 0;
+	inputFile.position = 0;
+	inputFile.error = 0;
 
 	if (input_params.regular_input != 0)
 	{
@@ -445,27 +476,46 @@ int read_samples(input_feature_t input_params, char fileName[128], unsigned shor
 		//which means 16 bits for every value even if the actual size is smaller.
 		//Note that in this case it might be necessary to perform a byte swap if
 		//the endianness is different
-		while (fread(&buffer, 1, 2, inputFile) == 2 && readElements < input_params.x_size * input_params.y_size * input_params.z_size)
+		//The file is read a chunk at a time; when it holds the samples exactly as they are
+		//stored in memory (BSQ order, 16 bits), it is read in place with a single, big, read
+		const int in_place = input_params.in_interleaving == BSQ && sample_bytes == 2;
+		while (readElements < samplesNum)
 		{
-			//I compose convert the endianness of the current element, if necessary,
-			//and store it
-			if ((is_little_endian() != 0 && input_params.byte_ordering == BIG) || (is_little_endian() == 0 && input_params.byte_ordering == LITTLE))
+			unsigned short int *words = in_place != 0 ? (unsigned short int *)samples + readElements : inputFile.chunk;
+			const size_t bytes = in_place != 0 ? 2 * (samplesNum - readElements) : 2 * MIN(IO_CHUNK_SAMPLES, samplesNum - readElements);
+			long long got = io_read(&inputFile.file, 2 * (unsigned long long)readElements, words, bytes);
+			size_t count = 0, i = 0;
+			if (got < 0)
 			{
-				buffer = ((buffer >> 8) & 0x00FF) | ((buffer << 8) & 0xFF00);
+				io_close(&inputFile.file);
+				return -1;
 			}
-			//Consistency check: let's check that, indeed, the element does not use more than
-			//the specified number of bits
-			if ((input_params.signed_samples == 0) || ((buffer & 0x8000) == 0))
+			count = (size_t)got / 2;
+			if (count == 0)
+				break;
+			for (i = 0; i < count; i++)
 			{
-				if ((((unsigned short int)buffer) >> input_params.dyn_range) != 0)
+				buffer = words[i];
+				//I compose convert the endianness of the current element, if necessary,
+				//and store it
+				if ((is_little_endian() != 0 && input_params.byte_ordering == BIG) || (is_little_endian() == 0 && input_params.byte_ordering == LITTLE))
+				{
+					buffer = ((buffer >> 8) & 0x00FF) | ((buffer << 8) & 0xFF00);
+				}
+				//Consistency check: let's check that, indeed, the element does not use more than
+				//the specified number of bits
+				if ((input_params.signed_samples == 0) || ((buffer & 0x8000) == 0))
 				{
-					fprintf(stderr, "Error the %dth sample %#x is using more than %d bits\n\n", readElements, buffer, input_params.dyn_range);
-					fclose(inputFile);
-					return -1;
+					if ((((unsigned short int)buffer) >> input_params.dyn_range) != 0)
+					{
+						log_error(CCSDS_ERROR_DATA, "Error the %zuth sample %#x is using more than %d bits\n\n", readElements, buffer, input_params.dyn_range);
+						io_close(&inputFile.file);
+						return -1;
+					}
 				}
+				SET_ELEMENT(samples, sample_bytes, indexToBSQ(input_params.in_interleaving, input_params.in_interleaving_depth, input_params.x_size, input_params.y_size, input_params.z_size, readElements), buffer);
+				readElements++;
 			}
-			samples[indexToBSQ(input_params.in_interleaving, input_params.in_interleaving_depth, input_params.x_size, input_params.y_size, input_params.z_size, readElements)] = buffer;
-			readElements++;
 		}
 	}
 	else
@@ -476,49 +526,51 @@ int read_samples(input_feature_t input_params, char fileName[128], unsigned shor
 		//signicant bits, in case the length of the residuals is smaller than 16 bits,
 		//keeping the remaining bits for the next residual
 		//I repeat until the input file is empty
-		availableBytes = fread(&buffer, 1, 2, inputFile);
-		while (availableBytes == 2 && readElements < (input_params.x_size * input_params.y_size * input_params.z_size))
+		availableBytes = (int)read_bytes(&inputFile, &buffer, 2);
+		while (availableBytes == 2 && readElements < samplesNum)
 		{
 			//I compose the current element
-			samples[indexToBSQ(input_params.in_interleaving, input_params.in_interleaving_depth, input_params.x_size, input_params.y_size, input_params.z_size, readElements)] = ((buffer << num_inBuffer) | prevBuffer) & (((unsigned short int)0xFFFF) >> (16 - input_params.dyn_range));
+			SET_ELEMENT(samples, sample_bytes, indexToBSQ(input_params.in_interleaving, input_params.in_interleaving_depth, input_params.x_size, input_params.y_size, input_params.z_size, readElements), ((buffer << num_inBuffer) | prevBuffer) & (((unsigned short int)0xFFFF) >> (16 - input_params.dyn_range)));
 			readElements++;
 			prevBuffer = buffer >> (input_params.dyn_range - num_inBuffer);
 			num_inBuffer = 16 - (input_params.dyn_range - num_inBuffer);
 			//Now it might be the case that num_inBuffer >= input_params.residual_width: in this
 			//case it is not necessary anymore to read another element, but I can directly use the buffer
-			while (num_inBuffer >= input_params.dyn_range && readElements < input_params.x_size * input_params.y_size * input_params.z_size)
+			while (num_inBuffer >= input_params.dyn_range && readElements < samplesNum)
 			{
-				samples[indexToBSQ(input_params.in_interleaving, input_params.in_interleaving_depth, input_params.x_size, input_params.y_size, input_params.z_size, readElements)] = prevBuffer & (((unsigned short int)0xFFFF) >> (16 - input_params.dyn_range));
+				SET_ELEMENT(samples, sample_bytes, indexToBSQ(input_params.in_interleaving, input_params.in_interleaving_depth, input_params.x_size, input_params.y_size, input_params.z_size, readElements), prevBuffer & (((unsigned short int)0xFFFF) >> (16 - input_params.dyn_range)));
 				readElements++;
 				prevBuffer = prevBuffer >> input_params.dyn_range;
 				num_inBuffer -= input_params.dyn_range;
 			}
 			buffer = 0;
-			availableBytes = fread(&buffer, 1, 2, inputFile);
+			availableBytes = (int)read_bytes(&inputFile, &buffer, 2);
 		}
 		// I still have a byte to go
-		if (availableBytes == 1 && readElements < input_params.x_size * input_params.y_size * input_params.z_size)
+		if (availableBytes == 1 && readElements < samplesNum)
 		{
-			samples[indexToBSQ(input_params.in_interleaving, input_params.in_interleaving_depth, input_params.x_size, input_params.y_size, input_params.z_size, readElements)] = ((buffer << num_inBuffer) | prevBuffer) & (((unsigned short int)0xFFFF) >> (8 - input_params.dyn_range));
+			SET_ELEMENT(samples, sample_bytes, indexToBSQ(input_params.in_interleaving, input_params.in_interleaving_depth, input_params.x_size, input_params.y_size, input_params.z_size, readElements), ((buffer << num_inBuffer) | prevBuffer) & (((unsigned short int)0xFFFF) >> (8 - input_params.dyn_range)));
 			readElements++;
 			prevBuffer = buffer >> (input_params.dyn_range - num_inBuffer);
 			num_inBuffer = 8 - (input_params.dyn_range - num_inBuffer);
 			//Now it might be the case that num_inBuffer >= input_params.residual_width: in this
 			//case it is not necessary anymore to read another element, but I can directly use the buffer
-			while (num_inBuffer >= input_params.dyn_range && readElements < input_params.x_size * input_params.y_size * input_params.z_size)
+			while (num_inBuffer >= input_params.dyn_range && readElements < samplesNum)
 			{
-				samples[indexToBSQ(input_params.in_interleaving, input_params.in_interleaving_depth, input_params.x_size, input_params.y_size, input_params.z_size, readElements)] = prevBuffer & (((unsigned short int)0xFFFF) >> (8 - input_params.dyn_range));
+				SET_ELEMENT(samples, sample_bytes, indexToBSQ(input_params.in_interleaving, input_params.in_interleaving_depth, input_params.x_size, input_params.y_size, input_params.z_size, readElements), prevBuffer & (((unsigned short int)0xFFFF) >> (8 - input_params.dyn_range)));
 				readElements++;
 				prevBuffer = prevBuffer >> input_params.dyn_range;
 				num_inBuffer -= input_params.dyn_range;
 			}
 		}
 	}
-	fclose(inputFile);
+	io_close(&inputFile.file);
+	if (inputFile.error != 0)
+		return -1;
 
-	if (readElements < input_params.x_size * input_params.y_size * input_params.z_size)
+	if (readElements < samplesNum)
 	{
-		fprintf(stderr, "Error, not enough elements in the input file\n\n");
+		log_error(CCSDS_ERROR_DATA, "Error, not enough elements in the input file\n\n");
 		return -1;
 	}
 
@@ -528,25 +580,276 @@ int read_samples(input_feature_t input_params, char fileName[128], unsigned shor
 	if (input_params.signed_samples != 0)
 	{
 		short int mid_range = 0x1 << (input_params.dyn_range - 1);
-		unsigned int i = 0;
+		size_t i = 0;
 		unsigned short sign_extend_mask = 0xFFFF << input_params.dyn_range;
 		unsigned short sign_bit_mask = 0x1 << (input_params.dyn_range - 1);
 
 		for (i = 0; i < readElements; i++)
 		{
-			short int buffer = samples[i];
+			short int buffer = GET_ELEMENT(samples, sample_bytes, i);
 			//Now I make the necessary corrections to sign externd the read value
 			if (input_params.signed_samples != 0 && (buffer & sign_bit_mask) != 0)
 			{
 				buffer |= sign_extend_mask;
 			}
-			samples[i] = (unsigned short int)(buffer + mid_range);
+			SET_ELEMENT(samples, sample_bytes, i, buffer + mid_range);
 		}
 	}
 
 	return 0;
 }
 
+///Checks that the sample with the given index, in the regular representation and in the host byte
+///ordering, does not use more than the specified number of bits and, if signed, makes it unsigned
+///@return 0 if the sample is valid, a negative value otherwise
+static int convert_regular_sample(input_feature_t input_params, size_t index, unsigned short int *sample)
+{
+	unsigned short int sign_bit_mask = 0x1 << (input_params.dyn_range - 1);
+	unsigned short int sign_extend_mask = 0xFFFFU << input_params.dyn_range;
+	unsigned short int buffer = *sample;
+
+	//Consistency check: let's check that, indeed, the element does not use more than
+	//the specified number of bits
+	if ((input_params.signed_samples == 0) || ((buffer & 0x8000) == 0))
+	{
+		if ((buffer >> input_params.dyn_range) != 0)
+		{
+			log_error(CCSDS_ERROR_DATA, "Error the %zuth sample %#x is using more than %d bits\n\n", index, buffer, input_params.dyn_range);
+			return -1;
+		}
+	}
+	if (input_params.signed_samples != 0)
+	{
+		//sign extension of the value, then the mid-range is added to make it unsigned
+		if ((buffer & sign_bit_mask) != 0)
+			buffer |= sign_extend_mask;
+		buffer = (unsigned short int)(buffer + sign_bit_mask);
+	}
+	*sample = buffer;
+	return 0;
+}
+
+///Reads count consecutive samples, starting from the first-th one, from a file using the regular
+///representation (16 bits for every sample), in the same way as read_samples does: the samples are
+///converted to the host byte ordering, checked against the dynamic range and, if signed,
+///made unsigned.
+///@return 0 if the operation succesfully completes, a negative value otherwise
+int read_regular_samples(input_feature_t input_params, io_file_t *inputFile, size_t first, size_t count, unsigned short int *samples)
+{
+	int swap = (is_little_endian() != 0 && input_params.byte_ordering == BIG) || (is_little_endian() == 0 && input_params.byte_ordering == LITTLE);
+	size_t i = 0;
+	long long got = io_read(inputFile, (unsigned long long)first * 2, samples, count * 2);
+
+	if (got < 0)
+		return -1;
+	if ((size_t)got != count * 2)
+	{
+		log_error(CCSDS_ERROR_DATA, "Error, not enough elements in the input file\n\n");
+		return -1;
+	}
+	for (i = 0; i < count; i++)
+	{
+		if (swap != 0)
+		{
+			samples[i] = ((samples[i] >> 8) & 0x00FF) | ((samples[i] << 8) & 0xFF00);
+		}
+		if (convert_regular_sample(input_params, first + i, &samples[i]) != 0)
+			return -1;
+	}
+	return 0;
+}
+
+///Loads the samples of an image held in memory, one unsigned short int per sample in the host byte
+///ordering and in the order given by input_params.in_interleaving, into the samples array (in BSQ
+///order, SAMPLE_BYTES(input_params) bytes per element); the samples are converted as read_samples does
+///(dynamic range check and signed to unsigned conversion)
+///@return 0 if the operation succesfully completes, a negative value otherwise
+int load_samples(input_feature_t input_params, const unsigned short int *buffer, void *samples)
+{
+	const size_t samplesNum = IMAGE_SAMPLES(input_params);
+	const unsigned int sample_bytes = SAMPLE_BYTES(input_params);
+	size_t i = 0;
+
+	for (i = 0; i < samplesNum; i++)
+	{
+		unsigned short int sample = buffer[i];
+		size_t index = i;
+		if (convert_regular_sample(input_params, i, &sample) != 0)
+			return -1;
+		if (input_params.in_interleaving != BSQ)
+			index = indexToBSQ(input_params.in_interleaving, input_params.in_interleaving_depth, input_params.x_size, input_params.y_size, input_params.z_size, i);
+		SET_ELEMENT(samples, sample_bytes, index, sample);
+	}
+	return 0;
+}
+
+unsigned int sampled_lines(unsigned int y_size, unsigned int line_step)
+{
+	unsigned int lines = 0;
+	unsigned int y = 0;
+
+	if (line_step <= 1)
+		return y_size;
+	for (y = 0; y < y_size; y++)
+	{
+		if ((y / SAMPLED_RUN_LINES) % line_step == 0)
+			lines++;
+	}
+	return lines;
+}
+
+void sample_lines(input_feature_t input_params, unsigned int line_step, const void *samples, void *sampled)
+{
+	const unsigned int sample_bytes = SAMPLE_BYTES(input_params);
+	const size_t line_bytes = (size_t)sample_bytes * input_params.x_size;
+	unsigned char *destination = (unsigned char *)sampled;
+	unsigned int y = 0, z = 0;
+
+	if (line_step == 0)
+		line_step = 1;
+	for (z = 0; z < input_params.z_size; z++)
+	{
+		for (y = 0; y < input_params.y_size; y++)
+		{
+			if ((y / SAMPLED_RUN_LINES) % line_step != 0)
+				continue;
+			memcpy(destination, (const unsigned char *)samples + sample_bytes * BSQ_OFFSET(input_params, 0, y, z), line_bytes);
+			destination += line_bytes;
+		}
+	}
+}
+
+///Reorders a line of the image (row y of all the bands) stored band interleaved by groups of
+///interleaving_depth bands, so that row y of band z starts at line + z * x_size
+void deinterleave_line(const unsigned short int *raw_line, unsigned short int *line, unsigned int x_size, unsigned int z_size,
+		unsigned int interleaving_depth)
+{
+	unsigned int x = 0, z = 0, i = 0;
+
+	for (z = 0; z < z_size; z += interleaving_depth)
+	{
+		unsigned int width = MIN(interleaving_depth, z_size - z);
+		const unsigned short int *group = raw_line + (size_t)z * x_size;
+		for (x = 0; x < x_size; x++)
+		{
+			for (i = 0; i < width; i++)
+			{
+				line[(size_t)(z + i) * x_size + x] = group[x * width + i];
+			}
+		}
+	}
+}
+
+///Inverse of deinterleave_line
+void interleave_line(const unsigned short int *line, unsigned short int *raw_line, unsigned int x_size, unsigned int z_size,
+		unsigned int interleaving_depth)
+{
+	unsigned int x = 0, z = 0, i = 0;
+
+	for (z = 0; z < z_size; z += interleaving_depth)
+	{
+		unsigned int width = MIN(interleaving_depth, z_size - z);
+		unsigned short int *group = raw_line + (size_t)z * x_size;
+		for (x = 0; x < x_size; x++)
+		{
+			for (i = 0; i < width; i++)
+			{
+				group[x * width + i] = line[(size_t)(z + i) * x_size + x];
+			}
+		}
+	}
+}
+
+///Converts count decompressed samples into the representation used by write_samples: signed samples
+///are stored in two's complement on dyn_range bits and the samples wider than 8 bits take two bytes,
+///in the byte ordering of the image
+void format_samples(input_feature_t input_params, const unsigned short int *samples, size_t count, unsigned int s_mid,
+		unsigned char *destination)
+{
+	unsigned short int mask = 0xFFFF >> (16 - input_params.dyn_range);
+	size_t i = 0;
+
+	for (i = 0; i < count; i++)
+	{
+		unsigned short int sample = samples[i];
+		if (input_params.signed_samples != 0)
+			sample = (unsigned short int)((int)sample - (int)s_mid) & mask;
+		if (input_params.dyn_range <= 8)
+		{
+			destination[i] = (unsigned char)sample;
+		}
+		else if (input_params.byte_ordering == BIG)
+		{
+			destination[2 * i] = (unsigned char)(sample >> 8);
+			destination[2 * i + 1] = (unsigned char)sample;
+		}
+		else
+		{
+			destination[2 * i] = (unsigned char)sample;
+			destination[2 * i + 1] = (unsigned char)(sample >> 8);
+		}
+	}
+}
+
+///Copies length 8 bits elements into a 16 bits buffer, using SIMD instructions when available
+void widen_row(const unsigned char *source, unsigned short int *destination, unsigned int length)
+{
+	unsigned int i = 0;
+#ifdef __SSE2__
+	__m128i zero = _mm_setzero_si128();
+	for (; i + 16 <= length; i += 16)
+	{
+		__m128i narrow = _mm_loadu_si128((const __m128i *)(source + i));
+		_mm_storeu_si128((__m128i *)(destination + i), _mm_unpacklo_epi8(narrow, zero));
+		_mm_storeu_si128((__m128i *)(destination + i + 8), _mm_unpackhi_epi8(narrow, zero));
+	}
+#endif
+	for (; i < length; i++)
+	{
+		destination[i] = source[i];
+	}
+}
+
+///Copies length 16 bits elements, which must all be smaller than 256, into an 8 bits buffer,
+///using SIMD instructions when available
+void narrow_row(const unsigned short int *source, unsigned char *destination, unsigned int length)
+{
+	unsigned int i = 0;
+#ifdef __SSE2__
+	for (; i + 16 <= length; i += 16)
+	{
+		__m128i low = _mm_loadu_si128((const __m128i *)(source + i));
+		__m128i high = _mm_loadu_si128((const __m128i *)(source + i + 8));
+		_mm_storeu_si128((__m128i *)(destination + i), _mm_packus_epi16(low, high));
+	}
+#endif
+	for (; i < length; i++)
+	{
+		destination[i] = (unsigned char)source[i];
+	}
+}
+
+///Stores value in buffer on bytes bytes, most significant first, returning the first byte after it
+unsigned char *put_big_endian(unsigned char *buffer, unsigned long long value, unsigned int bytes)
+{
+	unsigned int i = 0;
+
+	for (i = 0; i < bytes; i++)
+		buffer[i] = (unsigned char)(value >> (8 * (bytes - 1 - i)));
+	return buffer + bytes;
+}
+
+///Loads from buffer a value stored on bytes bytes, most significant first, returning the first byte after it
+const unsigned char *get_big_endian(const unsigned char *buffer, unsigned long long *value, unsigned int bytes)
+{
+	unsigned int i = 0;
+
+	*value = 0;
+	for (i = 0; i < bytes; i++)
+		*value = (*value << 8) | buffer[i];
+	return buffer + bytes;
+}
+
 ///Reads from file the specified ammount of bits and returns the read value into
 ///as unsigned integer.
 unsigned int read_bits(FILE *compressedStream, unsigned int num_bits, unsigned char *buffer, unsigned int *buffer_len)
@@ -560,7 +863,7 @@ unsigned int read_bits(FILE *compressedStream, unsigned int num_bits, unsigned c
 		to_read -= *buffer_len;
 		if (fread(buffer, 1, 1, compressedStream) < 1)
 		{
-			fprintf(stderr, "feof=%d, to_read=%d, read_value=%#x\n", feof(compressedStream), to_read, read_value);
+			log_error(CCSDS_ERROR_DATA, "Error, the compressed stream ended while %u more bits were expected\n", to_read);
 			return (unsigned int)-1;
 		}
 		*buffer_len = 8;
@@ -1,12 +1,21 @@
 #include <iostream>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
 #include <string.h>
 #include <vector>
+#include <random>
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
 
 #include "compress_ccsds123.h"
 #include "decompress_ccsds123.h"
+#include "scheduler.h"
+#include "tile_container.h"
+#include "reinterleave.h"
+#include "autotune.h"
+#include "unpredict.h"
 
 // Folder where the results of the test will be stored.
 #define RESULTS_FOLDER "./test_results/"
@@ -20,6 +29,61 @@
 #define ORIGINAL "original.arr"
 #define COMPRESSED "compressed.arr"
 #define DECOMPRESSED "decompressed.arr"
+#define OUT_OF_CORE_COMPRESSED "out_of_core_compressed.arr"
+#define SCHEDULED_COMPRESSED "scheduled_compressed.arr"
+#define PIPELINED_COMPRESSED "pipelined_compressed.arr"
+#define PIPELINED_DECOMPRESSED "pipelined_decompressed.arr"
+#define IO_BACKEND_COMPRESSED "io_backend_compressed.arr"
+#define BATCH_COMPRESSED "batch_compressed.arr"
+#define INDEXED_COMPRESSED "indexed_compressed.arr"
+#define INDEXED_DECOMPRESSED "indexed_decompressed.arr"
+#define BAND_INDEX "band_index.bin"
+#define BI_COMPRESSED "bi_compressed.arr"
+#define CHECKPOINTED_COMPRESSED "checkpointed_compressed.arr"
+#define CHECKPOINTS "checkpoints.bin"
+#define LINES_DECOMPRESSED "lines_decompressed.arr"
+#define SEGMENTS_DECOMPRESSED "segments_decompressed.arr"
+#define BANDS_DECOMPRESSED "bands_decompressed.arr"
+#define PIPELINED_BANDS_DECOMPRESSED "pipelined_bands_decompressed.arr"
+#define TILED_COMPRESSED "tiled_compressed.arr"
+#define TILED_DECOMPRESSED "tiled_decompressed.arr"
+#define TILED_REFERENCE "tiled_reference.arr"
+#define TILE_STREAM "tile_stream.arr"
+#define TILE_DECOMPRESSED "tile_decompressed.arr"
+#define TILE_SHARD "tile_shard.arr"
+#define MERGED_SHARDS "merged_shards.arr"
+#define COORDINATOR "./coordinator"
+#define COORDINATOR_WORK_DIR "coordinator_work"
+#define COORDINATOR_LOG "coordinator.log"
+#define COORDINATED_CONTAINER "coordinated_container.arr"
+#define BLOCK_COMPRESSED "block_compressed.arr"
+#define BLOCK_TRANSCODED "block_transcoded.arr"
+#define SAMPLE_TRANSCODED "sample_transcoded.arr"
+#define BI_REFERENCE "bi_reference.arr"
+#define BI_REINTERLEAVED "bi_reinterleaved.arr"
+#define BI_DEPTH_REINTERLEAVED "bi_depth_reinterleaved.arr"
+#define BSQ_REINTERLEAVED "bsq_reinterleaved.arr"
+#define TUNED_PARAMETERS "tuned_parameters.txt"
+#define ADAPTED_COMPRESSED "adapted_compressed.arr"
+#define ADAPTED_WEIGHTS "adapted_weights.txt"
+#define FUSED_ADAPTED_WEIGHTS "fused_adapted_weights.txt"
+#define ROUNDED_ADAPTED_WEIGHTS "rounded_adapted_weights.txt"
+#define WARM_COMPRESSED "warm_compressed.arr"
+#define WARM_DECOMPRESSED "warm_decompressed.arr"
+#define MODE_COMPRESSED "mode_compressed.arr"
+#define MODE_DECOMPRESSED "mode_decompressed.arr"
+#define FUSED_COMPRESSED "fused_compressed.arr"
+
+// One line every ESTIMATE_LINE_STEP is predicted by the approximate rate estimation, whose relative
+// error must stay below ESTIMATE_TOLERANCE.
+#define ESTIMATE_LINE_STEP 4
+#define ESTIMATE_TOLERANCE 0.05
+
+// Number of threads evaluating the candidates of the autotuning test, whose result must not depend on it.
+#define TUNING_THREADS 3
+
+// Number of lines between two checkpoints of the checkpoint test.
+#define CHECKPOINT_INTERVAL 16
 
 // For each of the test images, I actually copy the one band data this number of times.
 #define NUM_BANDS 10
@@ -50,6 +114,211 @@ int readSamplesFromTextFile(Image &image, const std::string filename);
 /// @param filename name of the file where we want to store the samples in binary format.
 int writeSamplesToBinaryFile(const Image &image, const std::string filename);
 
+/// @brief Checks the indexing routines of the library on a synthetic cube holding more than 4G samples,
+/// without allocating it: the BSQ offsets and the conversions between BSQ and BI orderings must be
+/// computed on 64 bits, and the size guard must accept the cube while rejecting out of range dimensions.
+/// @return 0 if all the checks pass, -1 otherwise.
+int testLargeCubeIndexing();
+
+/// @brief Checks the mapping of the prediction residuals for every dynamic range D from 2 to 16 bits: every
+/// pair of sample and scaled prediction up to 8 bits, and random pairs plus the extreme ones above.
+/// @return 0 if compute_mapped_residual_row maps every pair as compute_mapped_residual and as the standard
+/// does, and get_sample gives the sample back from its mapped residual, -1 otherwise.
+int testResidualMapping();
+
+/// @brief Compresses again the image under a memory budget of half the image size, letting the library select
+/// the engine: only the out of core one, which streams the image from disk keeping only a few rows in memory,
+/// fits. The compressed stream must be identical to the one produced by the in memory compression.
+/// @param config configuration used for the in memory compression.
+/// @param compressedFilename name of the file produced by the in memory compression.
+/// @param outOfCoreFilename name of the file where the out of core compression result is written.
+/// @return 0 if the two compressed streams are identical, -1 otherwise.
+int testOutOfCoreCompression(compressConfig_t config, const std::string compressedFilename, const std::string outOfCoreFilename);
+
+/// @brief Compresses the image twice through the same compression session, from the samples held in memory
+/// to a memory buffer: both compressed streams must be identical to the one produced by compress_ccsds123.
+/// @param config configuration used for the compression of the file.
+/// @param originalFilename name of the file holding the samples, loaded in memory before compressing.
+/// @param compressedFilename name of the file produced by compress_ccsds123.
+/// @return 0 if all the compressed streams are identical and sessions asked to write a band index, checkpoints
+/// or adapted weights are rejected, -1 otherwise.
+int testCompressionSession(compressConfig_t config, const std::string originalFilename, const std::string compressedFilename);
+
+/// @brief Compresses several copies of the image file as a batch through a compression session, which reads
+/// the next image and writes the previous stream while compressing the current one, and compares the
+/// produced streams with the one of compress_ccsds123.
+/// @param config the configuration used to compress the image into compressedFilename.
+/// @param compressedFilename file holding the expected compressed stream.
+/// @param batchPrefix prefix of the names of the files compressed by the batch.
+/// @return 0 if all the streams are identical, -1 otherwise.
+int testSessionBatch(compressConfig_t config, const std::string compressedFilename, const std::string batchPrefix);
+
+/// @brief Compresses the image with the pipelined engine and compares the produced stream with the one
+/// of the in memory compression.
+/// @param config the configuration used to compress the image into compressedFilename.
+/// @param compressedFilename file holding the expected compressed stream.
+/// @param pipelinedFilename file where the pipelined compression is written.
+/// @return 0 if the streams are identical, -1 otherwise.
+int testPipelinedCompression(compressConfig_t config, const std::string compressedFilename, const std::string pipelinedFilename);
+
+/// @brief Compresses the image again through each of the other I/O backends (mmap, parallel pread and
+/// O_DIRECT) and compares the produced streams with the one written through stdio.
+/// @param config the configuration used to compress the image into compressedFilename.
+/// @param compressedFilename file holding the expected compressed stream.
+/// @param backendFilename file where the compressions through the other backends are written.
+/// @return 0 if all the streams are identical, -1 otherwise.
+int testIoBackends(compressConfig_t config, const std::string compressedFilename, const std::string backendFilename);
+
+/// @brief Compresses the image several times at once with a scheduler, with less images in flight than
+/// submitted, and compares the produced streams with the one of compress_ccsds123.
+/// @param config the configuration used to compress the image into compressedFilename.
+/// @param compressedFilename file holding the expected compressed stream.
+/// @param scheduledPrefix prefix of the names of the files compressed by the scheduler.
+/// @return 0 if all the streams are identical, -1 otherwise.
+int testScheduler(compressConfig_t config, const std::string compressedFilename, const std::string scheduledPrefix);
+
+/// @brief Compresses with an invalid parameter and with a missing input file: the library must return the
+/// matching status codes and report its error messages to the log callback only.
+/// @param config a valid compression configuration.
+/// @return 0 if the errors are reported as expected, -1 otherwise.
+int testErrorReporting(compressConfig_t config);
+
+/// @brief Decompresses the image again with the pipelined engine and compares the produced file with the one
+/// of the in memory decompression.
+/// @param config the configuration used to decompress the image into decompressedFilename.
+/// @param decompressedFilename file holding the expected decompressed image.
+/// @param pipelinedFilename file where the pipelined decompression is written.
+/// @return 0 if the files are identical, -1 otherwise.
+int testPipelinedDecompression(decompressConfig_t config, const std::string decompressedFilename, const std::string pipelinedFilename);
+
+/// @brief Compresses the image again writing its band index, then decompresses it with several threads
+/// decoding the bands found through the index.
+/// @param config the configuration used to compress the image into compressedFilename.
+/// @param decompressConfig the configuration used to decompress the image into decompressedFilename.
+/// @param compressedFilename file holding the expected compressed stream.
+/// @param decompressedFilename file holding the expected decompressed image.
+/// @param indexedPrefix prefix of the names of the files written by the test.
+/// @return 0 if the compressed streams and the decompressed images are identical, -1 otherwise.
+int testBandIndex(compressConfig_t config, decompressConfig_t decompressConfig, const std::string compressedFilename,
+	const std::string decompressedFilename, const std::string indexedPrefix);
+
+/// @brief Compresses the image with the BI output interleaving, with and without checkpoints, then
+/// decompresses a range of lines resuming from the checkpoints, and the whole image with several threads
+/// decoding the segments between the checkpoints.
+/// @param config the configuration used to compress the image.
+/// @param decompressConfig the configuration used to decompress the image into decompressedFilename.
+/// @param decompressedFilename file holding the expected decompressed image (BSQ).
+/// @param checkpointPrefix prefix of the names of the files written by the test.
+/// @return 0 if the compressed streams are identical and the lines decompressed are the expected ones, -1 otherwise.
+int testCheckpoints(compressConfig_t config, decompressConfig_t decompressConfig, const std::string decompressedFilename,
+	const std::string checkpointPrefix);
+
+/// @brief Decompresses only the first bands of the image, with both engines.
+/// @param config the configuration used to decompress the image into decompressedFilename.
+/// @param decompressedFilename file holding the expected decompressed image (BSQ).
+/// @param bandsPrefix prefix of the names of the files written by the test.
+/// @return 0 if the decompressed bands are the first bands of the expected image, -1 otherwise.
+int testBandRange(decompressConfig_t config, const std::string decompressedFilename, const std::string bandsPrefix);
+
+/// @brief Compresses the image into a container of tiles with several threads, together with the single
+/// stream it is compared with, then decompresses the container with several threads and its last tile on
+/// its own, from the stream extracted from the container.
+/// @param config the configuration used to compress the image into compressedFilename.
+/// @param decompressConfig the configuration used to decompress the image into decompressedFilename.
+/// @param compressedFilename file holding the expected compressed stream.
+/// @param decompressedFilename file holding the expected decompressed image (BSQ).
+/// @param tiledPrefix prefix of the names of the files written by the test.
+/// @return 0 if the single stream and the decompressed scene and tile are the expected ones, -1 otherwise.
+int testTiledContainer(compressConfig_t config, decompressConfig_t decompressConfig, const std::string compressedFilename,
+	const std::string decompressedFilename, const std::string tiledPrefix);
+
+/// @brief Decompresses a window spanning several tiles of the container written by testTiledContainer
+/// into memory, in BSQ and in BI order.
+/// @param config the configuration used to decompress the image into decompressedFilename.
+/// @param decompressedFilename file holding the expected decompressed image (BSQ).
+/// @param tiledPrefix prefix of the names of the files written by testTiledContainer.
+/// @return 0 if the samples of the window are the expected ones, -1 otherwise.
+int testTiledRegion(decompressConfig_t config, const std::string decompressedFilename, const std::string tiledPrefix);
+
+/// @brief Compresses every tile of the container written by testTiledContainer into a shard of its own, the
+/// last tile first, and merges the shards into a container.
+/// @param config the configuration used to compress the image.
+/// @param tiledPrefix prefix of the names of the files written by testTiledContainer.
+/// @return 0 if the merged container is the one written by compress_tiled and shards given in the wrong
+/// order are rejected, -1 otherwise.
+int testTileShards(compressConfig_t config, const std::string tiledPrefix);
+
+/// @brief Runs the coordinator of the sharded compression on the tiles of the container written by
+/// testTiledContainer, resuming the work directory of an interrupted run where a worker of this machine
+/// which died holds a tile and a worker of another machine, finishing later, holds another one.
+/// @param config the configuration used to compress the image.
+/// @param tiledPrefix prefix of the names of the files written by testTiledContainer.
+/// @return 0 if a run without retries fails after waiting for the worker of the other machine, a run with one
+/// retry compresses the tile of the dead worker again and merges the container written by compress_tiled, and
+/// an invalid configuration is rejected before the work directory is created, -1 otherwise.
+int testShardCoordinator(compressConfig_t config, const std::string tiledPrefix);
+
+/// @brief Transcodes the compressed image to the block adaptive encoder, and the result back to the
+/// sample adaptive one, without running the predictor.
+/// @param config the configuration used to compress the image into compressedFilename.
+/// @param compressedFilename file holding the stream compressed with the sample adaptive encoder.
+/// @param transcodedPrefix prefix of the names of the files written by the test.
+/// @return 0 if the transcoded streams are the ones compressing the image with the same encoders gives,
+/// -1 otherwise.
+int testTranscoding(compressConfig_t config, const std::string compressedFilename, const std::string transcodedPrefix);
+
+/// @brief Re-interleaves the compressed image from BSQ to BI, from BI to BI with another depth and back,
+/// and from BI to BSQ, moving the codewords without decoding the stream.
+/// @param config the configuration used to compress the image into compressedFilename.
+/// @param compressedFilename file holding the stream compressed in BSQ order with the sample adaptive encoder.
+/// @param reinterleavedPrefix prefix of the names of the files written by the test.
+/// @return 0 if the re-interleaved streams are the ones compressing the image in the same order gives,
+/// -1 otherwise.
+int testReinterleaving(compressConfig_t config, const std::string compressedFilename, const std::string reinterleavedPrefix);
+
+/// @brief Estimates the size of the streams of the image with the sample and the block adaptive encoders,
+/// exactly and from one line every ESTIMATE_LINE_STEP.
+/// @param config the configuration used to compress the image into compressedFilename.
+/// @param compressedFilename file holding the stream compressed with the sample adaptive encoder.
+/// @param blockCompressedFilename file holding the stream written by testTranscoding with the block adaptive encoder.
+/// @return 0 if the exact estimates are the sizes of the streams, the bits of the bands add up and the
+/// approximate estimate is within ESTIMATE_TOLERANCE of the exact one, -1 otherwise.
+int testRateEstimation(compressConfig_t config, const std::string compressedFilename, const std::string blockCompressedFilename);
+
+/// @brief Tunes the predictor and encoder parameters on one line every ESTIMATE_LINE_STEP, starting from the
+/// configuration used to compress the image, with TUNING_THREADS threads and with one.
+/// @param config the configuration used to compress the image.
+/// @param parametersFilename file receiving the tuned parameters as options of the compressor.
+/// @return 0 if the tuned parameters do not depend on the number of threads, do not give a bigger stream
+/// than the ones given, are the ones the estimation of their stream measures and are saved, -1 otherwise.
+int testAutotuning(compressConfig_t config, const std::string parametersFilename);
+
+/// @brief Compresses the image saving the adapted weights of its bands, with the in memory and the fused
+/// engines at the full weight resolution and with a lower one, and compresses it again starting from them,
+/// as the next image of the same sensor would be.
+/// @param config the configuration used to compress the image into compressedFilename.
+/// @param decompressConfig the configuration used to decompress compressedFilename into decompressedFilename.
+/// @param warmPrefix prefix of the names of the files written by the test.
+/// @return 0 if saving the weights leaves the stream untouched, both engines save the same weights, the lower
+/// resolution table is the full one rounded, init_weights turns both tables into the weights given by the
+/// standard, the streams starting from them decompress to the image (the one at full resolution being smaller)
+/// and invalid resolutions are rejected, -1 otherwise.
+int testWarmStart(compressConfig_t config, decompressConfig_t decompressConfig, const std::string compressedFilename,
+	const std::string decompressedFilename, const std::string warmPrefix);
+
+/// @brief Compresses and decompresses the image with the predictor and input settings the other tests leave
+/// at their defaults: 3 prediction bands with neighbour oriented local sums, then a dynamic range of 8 bits,
+/// whose samples are kept with one byte each, with 2 prediction bands in the reduced mode.
+/// @param config the configuration used by the other tests, whose original image fits in 8 bits.
+/// @param decompressConfig the configuration used by the other tests to decompress the image.
+/// @param originalFilename name of the file holding the original image.
+/// @param modePrefix prefix of the names of the files written by the test.
+/// @return 0 if, for both settings, the fused, out of core and pipelined engines and the scheduler produce
+/// the stream of the in memory engine, and the in memory, pipelined, band range and checkpointed decompressions
+/// give the original image back, -1 otherwise.
+int testPredictionModes(compressConfig_t config, decompressConfig_t decompressConfig, const std::string originalFilename,
+	const std::string modePrefix);
+
 /// This main will load image samples from a text file, write them into an "original" binary
 /// file, perform compression on that file, perform decompression on the outputted file and
 /// return with errors if any of the steps does not happen correctly.
@@ -63,6 +332,14 @@ int main(void) {
 		return -1;
 	}
 	
+	// The same arena holds the buffers of all the compressions and decompressions: after the
+	// first image, only images bigger than the previous ones need new memory.
+	arena_t arena;
+	if (arena_init(&arena, 0, 0) != 0) {
+		std::cout << "ERROR: could not initialize the memory arena" << std::endl;
+		return -1;
+	}
+
 	// Run each of the tests.
 	std::string originalFilename, compressedFilename, decompressedFilename;
 	for (int i = 0; i < numTests; i++) {
@@ -118,6 +395,9 @@ int main(void) {
 		config.predictor_params.weight_initial = 6;
 		config.predictor_params.weight_final = 6;
 
+		config.arena = &arena;
+		config.log_callback = log_to_stdio;
+
 		// Perform the actual compression.
 		std::cout << "\nCompressing..." << std::endl;
 		if (compress_ccsds123(&config) != 0) {
@@ -126,6 +406,62 @@ int main(void) {
 		}
 		std::cout << "SUCCESS: compression went well" << std::endl;
 
+		// OUT OF CORE COMPRESSION
+		std::cout << "\nCompressing out of core..." << std::endl;
+		if (testOutOfCoreCompression(config, compressedFilename, RESULTS_FOLDER + std::to_string(i) + "_" + OUT_OF_CORE_COMPRESSED) != 0) {
+			std::cout << "ERROR: the out of core compression does not match the in memory one" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: out of core compression went well" << std::endl;
+
+		// PIPELINED COMPRESSION
+		std::cout << "\nCompressing with the pipelined engine..." << std::endl;
+		if (testPipelinedCompression(config, compressedFilename, RESULTS_FOLDER + std::to_string(i) + "_" + PIPELINED_COMPRESSED) != 0) {
+			std::cout << "ERROR: the pipelined compression does not match the in memory one" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: pipelined compression went well" << std::endl;
+
+		// I/O BACKENDS
+		std::cout << "\nCompressing through the other I/O backends..." << std::endl;
+		if (testIoBackends(config, compressedFilename, RESULTS_FOLDER + std::to_string(i) + "_" + IO_BACKEND_COMPRESSED) != 0) {
+			std::cout << "ERROR: the compression through an I/O backend does not match the stdio one" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: I/O backends went well" << std::endl;
+
+		// COMPRESSION SESSION
+		std::cout << "\nCompressing from memory through a session..." << std::endl;
+		if (testCompressionSession(config, originalFilename, compressedFilename) != 0) {
+			std::cout << "ERROR: there was a problem with the compression session" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: session compression went well" << std::endl;
+
+		// BATCH OF FILES
+		std::cout << "\nCompressing a batch of files through a session..." << std::endl;
+		if (testSessionBatch(config, compressedFilename, RESULTS_FOLDER + std::to_string(i) + "_") != 0) {
+			std::cout << "ERROR: the batch compressions do not match the file one" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: batch compression went well" << std::endl;
+
+		// SCHEDULER
+		std::cout << "\nCompressing several copies at once with the scheduler..." << std::endl;
+		if (testScheduler(config, compressedFilename, RESULTS_FOLDER + std::to_string(i) + "_") != 0) {
+			std::cout << "ERROR: the scheduled compressions do not match the sequential one" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: scheduled compression went well" << std::endl;
+
+		// ERROR REPORTING
+		std::cout << "\nChecking the error reporting..." << std::endl;
+		if (testErrorReporting(config) != 0) {
+			std::cout << "ERROR: the errors were not reported as expected" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: error reporting went well" << std::endl;
+
 		// DECOMPRESSION
 
 		// Declare and initialize the decompression configuration structure.
@@ -138,6 +474,8 @@ int main(void) {
 		strcpy(decompressConfig.in_file, compressedFilename.c_str());
 		strcpy(decompressConfig.out_file, decompressedFilename.c_str());
 		decompressConfig.input_params.in_interleaving = BSQ;
+		decompressConfig.arena = &arena;
+		decompressConfig.log_callback = log_to_stdio;
 
 		// Perform the decompression algorithm.
 		std::cout << "\nDecompressing..." << std::endl;
@@ -146,7 +484,136 @@ int main(void) {
 			return -1;
 		}
 		std::cout << "SUCCESS: decompression went well" << std::endl;
+
+		// Decompress again, with the pipelined engine.
+		std::cout << "\nDecompressing with the pipelined engine..." << std::endl;
+		if (testPipelinedDecompression(decompressConfig, decompressedFilename, RESULTS_FOLDER + std::to_string(i) + "_" + PIPELINED_DECOMPRESSED) != 0) {
+			std::cout << "ERROR: there was a problem during the pipelined decompression" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: pipelined decompression went well" << std::endl;
+
+		// BAND INDEX
+		std::cout << "\nCompressing with a band index and decoding the bands in parallel..." << std::endl;
+		if (testBandIndex(config, decompressConfig, compressedFilename, decompressedFilename, RESULTS_FOLDER + std::to_string(i) + "_") != 0) {
+			std::cout << "ERROR: there was a problem with the band index" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: band index went well" << std::endl;
+
+		// CHECKPOINTS
+		std::cout << "\nCompressing with checkpoints and decoding lines from them..." << std::endl;
+		if (testCheckpoints(config, decompressConfig, decompressedFilename, RESULTS_FOLDER + std::to_string(i) + "_") != 0) {
+			std::cout << "ERROR: there was a problem with the checkpoints" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: checkpoints went well" << std::endl;
+
+		// BAND RANGE
+		std::cout << "\nDecompressing only the first bands..." << std::endl;
+		if (testBandRange(decompressConfig, decompressedFilename, RESULTS_FOLDER + std::to_string(i) + "_") != 0) {
+			std::cout << "ERROR: there was a problem decompressing the first bands" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: band range went well" << std::endl;
+
+		// TILED CONTAINER
+		std::cout << "\nCompressing and decompressing a container of tiles in parallel..." << std::endl;
+		if (testTiledContainer(config, decompressConfig, compressedFilename, decompressedFilename, RESULTS_FOLDER + std::to_string(i) + "_") != 0) {
+			std::cout << "ERROR: there was a problem with the tiled container" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: tiled container went well" << std::endl;
+
+		// TILED REGION
+		std::cout << "\nDecompressing a window of the container..." << std::endl;
+		if (testTiledRegion(decompressConfig, decompressedFilename, RESULTS_FOLDER + std::to_string(i) + "_") != 0) {
+			std::cout << "ERROR: there was a problem decompressing the window" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: tiled region went well" << std::endl;
+
+		// TILE SHARDS
+		std::cout << "\nCompressing the tiles as separate shards and merging them..." << std::endl;
+		if (testTileShards(config, RESULTS_FOLDER + std::to_string(i) + "_") != 0) {
+			std::cout << "ERROR: the merged shards do not match the tiled container" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: tile shards went well" << std::endl;
+
+		// SHARD COORDINATOR
+		std::cout << "\nResuming the sharded compression of the tiles with the coordinator..." << std::endl;
+		if (testShardCoordinator(config, RESULTS_FOLDER + std::to_string(i) + "_") != 0) {
+			std::cout << "ERROR: the coordinator did not resume the compression of the tiles" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: shard coordinator went well" << std::endl;
+
+		// TRANSCODING
+		std::cout << "\nTranscoding between the sample and the block adaptive encoders..." << std::endl;
+		if (testTranscoding(config, compressedFilename, RESULTS_FOLDER + std::to_string(i) + "_") != 0) {
+			std::cout << "ERROR: the transcoded streams do not match the compressed ones" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: transcoding went well" << std::endl;
+
+		// RE-INTERLEAVING
+		std::cout << "\nRe-interleaving the compressed stream between BSQ and BI..." << std::endl;
+		if (testReinterleaving(config, compressedFilename, RESULTS_FOLDER + std::to_string(i) + "_") != 0) {
+			std::cout << "ERROR: the re-interleaved streams do not match the compressed ones" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: re-interleaving went well" << std::endl;
+
+		// RATE ESTIMATION
+		std::cout << "\nEstimating the size of the compressed streams without writing them..." << std::endl;
+		if (testRateEstimation(config, compressedFilename, RESULTS_FOLDER + std::to_string(i) + "_" + BLOCK_COMPRESSED) != 0) {
+			std::cout << "ERROR: the estimated sizes do not match the compressed streams" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: rate estimation went well" << std::endl;
+
+		// AUTOTUNING
+		std::cout << "\nTuning the predictor and encoder parameters..." << std::endl;
+		if (testAutotuning(config, RESULTS_FOLDER + std::to_string(i) + "_" + TUNED_PARAMETERS) != 0) {
+			std::cout << "ERROR: the tuned parameters are not the best ones of the grid" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: autotuning went well" << std::endl;
+
+		// WARM START
+		std::cout << "\nCompressing again from the weights adapted to the image..." << std::endl;
+		if (testWarmStart(config, decompressConfig, compressedFilename, decompressedFilename, RESULTS_FOLDER + std::to_string(i) + "_") != 0) {
+			std::cout << "ERROR: there was a problem with the adapted weights" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: warm start went well" << std::endl;
+
+		// PREDICTION MODES
+		std::cout << "\nCompressing with several prediction bands and with a dynamic range of 8 bits..." << std::endl;
+		if (testPredictionModes(config, decompressConfig, originalFilename, RESULTS_FOLDER + std::to_string(i) + "_") != 0) {
+			std::cout << "ERROR: there was a problem with the other prediction modes" << std::endl;
+			return -1;
+		}
+		std::cout << "SUCCESS: prediction modes went well" << std::endl;
+	}
+	arena_release(&arena);
+
+	// INDEXING OF VERY LARGE IMAGES
+	std::cout << "\nChecking the indexing of a cube with more than 4G samples..." << std::endl;
+	if (testLargeCubeIndexing() != 0) {
+		std::cout << "ERROR: there was a problem indexing the large cube" << std::endl;
+		return -1;
 	}
+	std::cout << "SUCCESS: large cube indexing went well" << std::endl;
+
+	// RESIDUAL MAPPING
+	std::cout << "\nChecking the mapping of the prediction residuals..." << std::endl;
+	if (testResidualMapping() != 0) {
+		std::cout << "ERROR: there was a problem mapping the residuals" << std::endl;
+		return -1;
+	}
+	std::cout << "SUCCESS: residual mapping went well" << std::endl;
 
 	std::cout << "\nSUCCESS: process finished succesfully" << std::endl;
 	std::cout << "Check the byte sizes of the original and compressed images using" << std::endl;
@@ -247,4 +714,1228 @@ int readSamplesFromTextFile(Image &image, const std::string filename) {
 	image.numCols = width;
 
 	return 0;
-}
\ No newline at end of file
+}
+
+int testLargeCubeIndexing() {
+
+	// 4096 x 4096 x 300 = 5033164800 samples, well above the 32 bits range.
+	input_feature_t params;
+	memset(&params, 0x00, sizeof(params));
+	params.dyn_range = 16;
+	params.x_size = 4096;
+	params.y_size = 4096;
+	params.z_size = 300;
+	const unsigned int depth = 7;
+	const size_t numSamples = 5033164800ULL;
+
+	if (IMAGE_SAMPLES(params) != numSamples) {
+		std::cout << "ERROR: wrong number of samples " << IMAGE_SAMPLES(params) << std::endl;
+		return -1;
+	}
+	if (check_image_size(params) != 0) {
+		std::cout << "ERROR: the large cube was rejected by the size check" << std::endl;
+		return -1;
+	}
+
+	// Samples at the beginning, across the 4G boundary and at the end of the cube; the expected BI
+	// index is computed from the coordinates, with the last group of bands possibly narrower than depth.
+	const unsigned int coordinates[][3] = {{0, 0, 0}, {4095, 4095, 255}, {1, 0, 256}, {17, 3000, 299}, {4095, 4095, 299}};
+	for (size_t i = 0; i < sizeof(coordinates) / sizeof(coordinates[0]); i++) {
+		unsigned int x = coordinates[i][0], y = coordinates[i][1], z = coordinates[i][2];
+		unsigned int group = z / depth;
+		unsigned int groupWidth = std::min(depth, params.z_size - group * depth);
+		size_t expectedBSQ = ((size_t)z * params.y_size + y) * params.x_size + x;
+		size_t expectedBI = (size_t)y * params.x_size * params.z_size + (size_t)group * depth * params.x_size + (size_t)x * groupWidth + z % depth;
+
+		if (BSQ_OFFSET(params, x, y, z) != expectedBSQ) {
+			std::cout << "ERROR: wrong BSQ offset " << BSQ_OFFSET(params, x, y, z) << " instead of " << expectedBSQ << std::endl;
+			return -1;
+		}
+		if (BSQToIndex(BI, depth, params.x_size, params.y_size, params.z_size, expectedBSQ) != expectedBI ||
+			indexToBSQ(BI, depth, params.x_size, params.y_size, params.z_size, expectedBI) != expectedBSQ) {
+			std::cout << "ERROR: wrong BI conversion of sample (" << x << ", " << y << ", " << z << ")" << std::endl;
+			return -1;
+		}
+	}
+	if (BSQ_OFFSET(params, params.x_size - 1, params.y_size - 1, params.z_size - 1) != numSamples - 1) {
+		std::cout << "ERROR: the last sample is not at the end of the cube" << std::endl;
+		return -1;
+	}
+
+	// Dimensions which cannot be represented in the 16 bits fields of the header must be rejected.
+	params.x_size = MAX_DIMENSION_SIZE + 1;
+	if (check_image_size(params) == 0) {
+		std::cout << "ERROR: the size check accepted an out of range dimension" << std::endl;
+		return -1;
+	}
+
+	return 0;
+}
+
+int testResidualMapping() {
+
+	std::mt19937 generator(123);
+	for (unsigned int dynRange = 2; dynRange <= 16; dynRange++) {
+		const unsigned int sMax = (1U << dynRange) - 1;
+		std::vector<unsigned short> samples;
+		std::vector<int> scaledPredicted;
+
+		// The scaled predictions are in [0, 2 * sMax + 1]; the number of pairs is not a multiple of the SIMD
+		// lanes, so that the scalar tail of the row kernel is checked too.
+		if (dynRange <= 8) {
+			for (unsigned int sample = 0; sample <= sMax; sample++) {
+				for (unsigned int scaled = 0; scaled <= 2 * sMax + 1; scaled++) {
+					samples.push_back(sample);
+					scaledPredicted.push_back(scaled);
+				}
+			}
+		} else {
+			const unsigned int extremes[] = {0, 1, sMax / 2, sMax / 2 + 1, sMax - 1, sMax};
+			for (unsigned int sample : extremes) {
+				for (unsigned int scaled : extremes) {
+					for (unsigned int odd = 0; odd < 2; odd++) {
+						samples.push_back(sample);
+						scaledPredicted.push_back(std::min(2 * scaled + odd, 2 * sMax + 1));
+					}
+				}
+			}
+			std::uniform_int_distribution<unsigned int> sampleDistribution(0, sMax), scaledDistribution(0, 2 * sMax + 1);
+			for (int i = 0; i < 100003; i++) {
+				samples.push_back(sampleDistribution(generator));
+				scaledPredicted.push_back(scaledDistribution(generator));
+			}
+		}
+
+		std::vector<unsigned short> residuals(samples.size());
+		compute_mapped_residual_row(samples.data(), scaledPredicted.data(), residuals.data(), samples.size(), 0, sMax);
+		for (size_t i = 0; i < samples.size(); i++) {
+			// the mapping of the standard, with omega the distance of the prediction from the closest bound
+			const int predicted = scaledPredicted[i] / 2;
+			const int delta = (int)samples[i] - predicted;
+			const int omega = std::min(predicted, (int)sMax - predicted);
+			const int signedDelta = (scaledPredicted[i] & 0x1) != 0 ? -delta : delta;
+			const int expected = std::abs(delta) > omega ? std::abs(delta) + omega :
+				(signedDelta >= 0 && signedDelta <= omega ? 2 * std::abs(delta) : 2 * std::abs(delta) - 1);
+			if (residuals[i] != expected || compute_mapped_residual(samples[i], scaledPredicted[i], 0, sMax) != expected ||
+					get_sample(residuals[i], scaledPredicted[i], 0, sMax) != samples[i]) {
+				std::cout << "ERROR: wrong mapping of sample " << samples[i] << " with scaled prediction " << scaledPredicted[i]
+					<< " on " << dynRange << " bits" << std::endl;
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int testOutOfCoreCompression(compressConfig_t config, const std::string compressedFilename, const std::string outOfCoreFilename) {
+
+	// The samples written by writeSamplesToBinaryFile use 16 bits each, as required by the out of core engine.
+	strcpy(config.out_file, outOfCoreFilename.c_str());
+	config.input_params.regular_input = 1;
+	config.engine = ENGINE_AUTO;
+	// Half of the size of the image, which uses 2 bytes per sample.
+	config.memory_budget = IMAGE_SAMPLES(config.input_params);
+	config.encoder_params.k_init = NULL;
+	config.predictor_params.weight_init_table = NULL;
+	if (compress_ccsds123(&config) != 0) {
+		return -1;
+	}
+
+	// Compare the two compressed streams.
+	std::ifstream inMemory(compressedFilename, std::ios::binary);
+	std::ifstream outOfCore(outOfCoreFilename, std::ios::binary);
+	std::vector<char> inMemoryBytes((std::istreambuf_iterator<char>(inMemory)), std::istreambuf_iterator<char>());
+	std::vector<char> outOfCoreBytes((std::istreambuf_iterator<char>(outOfCore)), std::istreambuf_iterator<char>());
+	if (inMemoryBytes.empty() || inMemoryBytes != outOfCoreBytes) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int testPipelinedCompression(compressConfig_t config, const std::string compressedFilename, const std::string pipelinedFilename) {
+
+	strcpy(config.out_file, pipelinedFilename.c_str());
+	config.input_params.regular_input = 1;
+	config.engine = ENGINE_PIPELINED;
+	config.encoder_params.k_init = NULL;
+	config.predictor_params.weight_init_table = NULL;
+	if (compress_ccsds123(&config) != 0) {
+		return -1;
+	}
+
+	// Compare the two compressed streams.
+	std::ifstream inMemory(compressedFilename, std::ios::binary);
+	std::ifstream pipelined(pipelinedFilename, std::ios::binary);
+	std::vector<char> inMemoryBytes((std::istreambuf_iterator<char>(inMemory)), std::istreambuf_iterator<char>());
+	std::vector<char> pipelinedBytes((std::istreambuf_iterator<char>(pipelined)), std::istreambuf_iterator<char>());
+	if (inMemoryBytes.empty() || inMemoryBytes != pipelinedBytes) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int testIoBackends(compressConfig_t config, const std::string compressedFilename, const std::string backendFilename) {
+
+	std::ifstream inMemory(compressedFilename, std::ios::binary);
+	std::vector<char> inMemoryBytes((std::istreambuf_iterator<char>(inMemory)), std::istreambuf_iterator<char>());
+	const io_backend_t backends[] = {IO_BACKEND_MMAP, IO_BACKEND_PREAD, IO_BACKEND_DIRECT};
+
+	strcpy(config.out_file, backendFilename.c_str());
+	config.encoder_params.k_init = NULL;
+	config.predictor_params.weight_init_table = NULL;
+	for (io_backend_t backend : backends) {
+		config.io_backend = backend;
+		if (compress_ccsds123(&config) != 0) {
+			return -1;
+		}
+
+		// Compare the two compressed streams.
+		std::ifstream compressed(backendFilename, std::ios::binary);
+		std::vector<char> backendBytes((std::istreambuf_iterator<char>(compressed)), std::istreambuf_iterator<char>());
+		if (inMemoryBytes.empty() || inMemoryBytes != backendBytes) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int testPipelinedDecompression(decompressConfig_t config, const std::string decompressedFilename, const std::string pipelinedFilename) {
+
+	strcpy(config.out_file, pipelinedFilename.c_str());
+	config.engine = DECOMPRESS_ENGINE_PIPELINED;
+	if (decompress_ccsds123(&config) != 0) {
+		return -1;
+	}
+
+	// Compare the two decompressed images.
+	std::ifstream inMemory(decompressedFilename, std::ios::binary);
+	std::ifstream pipelined(pipelinedFilename, std::ios::binary);
+	std::vector<char> inMemoryBytes((std::istreambuf_iterator<char>(inMemory)), std::istreambuf_iterator<char>());
+	std::vector<char> pipelinedBytes((std::istreambuf_iterator<char>(pipelined)), std::istreambuf_iterator<char>());
+	if (inMemoryBytes.empty() || inMemoryBytes != pipelinedBytes) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int testBandIndex(compressConfig_t config, decompressConfig_t decompressConfig, const std::string compressedFilename,
+	const std::string decompressedFilename, const std::string indexedPrefix) {
+
+	const std::string indexedCompressed = indexedPrefix + INDEXED_COMPRESSED;
+	const std::string indexedDecompressed = indexedPrefix + INDEXED_DECOMPRESSED;
+	const std::string bandIndex = indexedPrefix + BAND_INDEX;
+	strcpy(config.out_file, indexedCompressed.c_str());
+	strcpy(config.band_index_file, bandIndex.c_str());
+	config.log_callback = NULL;
+	if (compress_ccsds123(&config) != 0) {
+		return -1;
+	}
+	strcpy(decompressConfig.in_file, indexedCompressed.c_str());
+	strcpy(decompressConfig.out_file, indexedDecompressed.c_str());
+	strcpy(decompressConfig.band_index_file, bandIndex.c_str());
+	decompressConfig.num_threads = 3;
+	decompressConfig.log_callback = NULL;
+	if (decompress_ccsds123(&decompressConfig) != 0) {
+		return -1;
+	}
+
+	// The index must leave the stream untouched, and the bands decoded through it must be the same.
+	const std::string expectedFiles[2] = {compressedFilename, decompressedFilename};
+	const std::string indexedFiles[2] = {indexedCompressed, indexedDecompressed};
+	for (int i = 0; i < 2; i++) {
+		std::ifstream expected(expectedFiles[i], std::ios::binary);
+		std::ifstream indexed(indexedFiles[i], std::ios::binary);
+		std::vector<char> expectedBytes((std::istreambuf_iterator<char>(expected)), std::istreambuf_iterator<char>());
+		std::vector<char> indexedBytes((std::istreambuf_iterator<char>(indexed)), std::istreambuf_iterator<char>());
+		if (expectedBytes.empty() || expectedBytes != indexedBytes) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int testCheckpoints(compressConfig_t config, decompressConfig_t decompressConfig, const std::string decompressedFilename,
+	const std::string checkpointPrefix) {
+
+	const std::string biCompressed = checkpointPrefix + BI_COMPRESSED;
+	const std::string checkpointedCompressed = checkpointPrefix + CHECKPOINTED_COMPRESSED;
+	const std::string checkpoints = checkpointPrefix + CHECKPOINTS;
+	const std::string linesDecompressed = checkpointPrefix + LINES_DECOMPRESSED;
+	const std::string segmentsDecompressed = checkpointPrefix + SEGMENTS_DECOMPRESSED;
+	config.encoder_params.out_interleaving = BI;
+	config.encoder_params.out_interleaving_depth = config.input_params.z_size;
+	config.log_callback = NULL;
+	strcpy(config.out_file, biCompressed.c_str());
+	if (compress_ccsds123(&config) != 0) {
+		return -1;
+	}
+	strcpy(config.out_file, checkpointedCompressed.c_str());
+	strcpy(config.checkpoint_file, checkpoints.c_str());
+	config.checkpoint_interval = CHECKPOINT_INTERVAL;
+	if (compress_ccsds123(&config) != 0) {
+		return -1;
+	}
+
+	// The checkpoints must leave the stream untouched.
+	std::ifstream bi(biCompressed, std::ios::binary);
+	std::ifstream checkpointed(checkpointedCompressed, std::ios::binary);
+	std::vector<char> biBytes((std::istreambuf_iterator<char>(bi)), std::istreambuf_iterator<char>());
+	std::vector<char> checkpointedBytes((std::istreambuf_iterator<char>(checkpointed)), std::istreambuf_iterator<char>());
+	if (biBytes.empty() || biBytes != checkpointedBytes) {
+		return -1;
+	}
+
+	// A range of lines starting between two checkpoints and spanning a few of them, then the whole image.
+	const size_t xSize = config.input_params.x_size, ySize = config.input_params.y_size, zSize = config.input_params.z_size;
+	const unsigned int firstLine = (unsigned int)ySize / 3 + 1;
+	const unsigned int numLines = (unsigned int)ySize / 2;
+	strcpy(decompressConfig.in_file, checkpointedCompressed.c_str());
+	strcpy(decompressConfig.checkpoint_file, checkpoints.c_str());
+	decompressConfig.num_threads = 3;
+	decompressConfig.log_callback = NULL;
+	strcpy(decompressConfig.out_file, linesDecompressed.c_str());
+	decompressConfig.first_line = firstLine;
+	decompressConfig.num_lines = numLines;
+	if (decompress_ccsds123(&decompressConfig) != 0) {
+		return -1;
+	}
+	strcpy(decompressConfig.out_file, segmentsDecompressed.c_str());
+	decompressConfig.first_line = 0;
+	decompressConfig.num_lines = 0;
+	if (decompress_ccsds123(&decompressConfig) != 0) {
+		return -1;
+	}
+
+	// The images are BSQ with SAMPLE_BYTES bytes per sample: the range holds the rows [firstLine, firstLine + numLines) of every band.
+	const size_t rowBytes = SAMPLE_BYTES(config.input_params) * xSize;
+	std::ifstream expected(decompressedFilename, std::ios::binary);
+	std::ifstream lines(linesDecompressed, std::ios::binary);
+	std::ifstream segments(segmentsDecompressed, std::ios::binary);
+	std::vector<char> expectedBytes((std::istreambuf_iterator<char>(expected)), std::istreambuf_iterator<char>());
+	std::vector<char> linesBytes((std::istreambuf_iterator<char>(lines)), std::istreambuf_iterator<char>());
+	std::vector<char> segmentsBytes((std::istreambuf_iterator<char>(segments)), std::istreambuf_iterator<char>());
+	if (expectedBytes.empty() || expectedBytes != segmentsBytes || linesBytes.size() != rowBytes * numLines * zSize) {
+		return -1;
+	}
+	for (size_t z = 0; z < zSize; z++) {
+		size_t expectedStart = rowBytes * (z * ySize + firstLine);
+		size_t linesStart = rowBytes * z * numLines;
+		if (!std::equal(expectedBytes.begin() + expectedStart, expectedBytes.begin() + expectedStart + rowBytes * numLines, linesBytes.begin() + linesStart)) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int testBandRange(decompressConfig_t config, const std::string decompressedFilename, const std::string bandsPrefix) {
+
+	const std::string bandsFiles[2] = {bandsPrefix + BANDS_DECOMPRESSED, bandsPrefix + PIPELINED_BANDS_DECOMPRESSED};
+	const decompress_engine_t engines[2] = {DECOMPRESS_ENGINE_IN_MEMORY, DECOMPRESS_ENGINE_PIPELINED};
+	std::ifstream expected(decompressedFilename, std::ios::binary);
+	std::vector<char> expectedBytes((std::istreambuf_iterator<char>(expected)), std::istreambuf_iterator<char>());
+	const unsigned int numBands = config.input_params.z_size / 2 + 1;
+	const size_t bandsSize = SAMPLE_BYTES(config.input_params) * (size_t)config.input_params.x_size * config.input_params.y_size * numBands;
+
+	// The images are BSQ: the first bands are at the beginning of the whole image.
+	config.num_bands = numBands;
+	config.log_callback = NULL;
+	for (int i = 0; i < 2; i++) {
+		strcpy(config.out_file, bandsFiles[i].c_str());
+		config.engine = engines[i];
+		if (decompress_ccsds123(&config) != 0) {
+			return -1;
+		}
+		std::ifstream bands(bandsFiles[i], std::ios::binary);
+		std::vector<char> bandsBytes((std::istreambuf_iterator<char>(bands)), std::istreambuf_iterator<char>());
+		if (expectedBytes.size() < bandsSize || bandsBytes.size() != bandsSize || !std::equal(bandsBytes.begin(), bandsBytes.end(), expectedBytes.begin())) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int testTiledContainer(compressConfig_t config, decompressConfig_t decompressConfig, const std::string compressedFilename,
+	const std::string decompressedFilename, const std::string tiledPrefix) {
+
+	const std::string tiledCompressed = tiledPrefix + TILED_COMPRESSED;
+	const std::string tiledDecompressed = tiledPrefix + TILED_DECOMPRESSED;
+	const std::string tiledReference = tiledPrefix + TILED_REFERENCE;
+	const std::string tileStream = tiledPrefix + TILE_STREAM;
+	const std::string tileDecompressed = tiledPrefix + TILE_DECOMPRESSED;
+	const size_t xSize = config.input_params.x_size, ySize = config.input_params.y_size, zSize = config.input_params.z_size;
+	const unsigned int tileWidth = (unsigned int)xSize / 3 + 1, tileHeight = (unsigned int)ySize / 2 + 1;
+	char referenceFile[128];
+
+	// Tiles not dividing the scene, so that the last column and the last row hold smaller ones.
+	tiled_report_t report;
+	strcpy(config.out_file, tiledCompressed.c_str());
+	strcpy(referenceFile, tiledReference.c_str());
+	config.input_params.regular_input = 1;
+	config.log_callback = NULL;
+	if (compress_tiled(&config, tileWidth, tileHeight, 3, referenceFile, &report) != 0 || report.num_tiles != 6) {
+		return -1;
+	}
+	strcpy(decompressConfig.in_file, tiledCompressed.c_str());
+	strcpy(decompressConfig.out_file, tiledDecompressed.c_str());
+	decompressConfig.num_threads = 3;
+	decompressConfig.log_callback = NULL;
+	if (decompress_tiled(&decompressConfig) != 0) {
+		return -1;
+	}
+
+	// The single stream is the usual one, and the container gives the whole scene back.
+	std::ifstream expected(compressedFilename, std::ios::binary);
+	std::ifstream reference(tiledReference, std::ios::binary);
+	std::ifstream container(tiledCompressed, std::ios::binary);
+	std::ifstream decompressed(decompressedFilename, std::ios::binary);
+	std::ifstream tiled(tiledDecompressed, std::ios::binary);
+	std::vector<char> expectedBytes((std::istreambuf_iterator<char>(expected)), std::istreambuf_iterator<char>());
+	std::vector<char> referenceBytes((std::istreambuf_iterator<char>(reference)), std::istreambuf_iterator<char>());
+	std::vector<unsigned char> containerBytes((std::istreambuf_iterator<char>(container)), std::istreambuf_iterator<char>());
+	std::vector<char> decompressedBytes((std::istreambuf_iterator<char>(decompressed)), std::istreambuf_iterator<char>());
+	std::vector<char> tiledBytes((std::istreambuf_iterator<char>(tiled)), std::istreambuf_iterator<char>());
+	if (expectedBytes.empty() || expectedBytes != referenceBytes || report.single_stream_bytes != expectedBytes.size() ||
+			report.container_bytes != containerBytes.size() || decompressedBytes.empty() || decompressedBytes != tiledBytes) {
+		return -1;
+	}
+
+	// The last tile is a standard stream, between the last two offsets of the directory (big endian, after the
+	// 24 bytes of the header).
+	unsigned long long offsets[2] = {0, 0};
+	for (int k = 0; k < 2; k++) {
+		for (int b = 0; b < 8; b++) {
+			offsets[k] = (offsets[k] << 8) | containerBytes[24 + 8 * (report.num_tiles - 1 + k) + b];
+		}
+	}
+	if (offsets[0] >= offsets[1] || offsets[1] != containerBytes.size()) {
+		return -1;
+	}
+	std::ofstream stream(tileStream, std::ios::binary);
+	stream.write(reinterpret_cast<const char *>(containerBytes.data()) + offsets[0], offsets[1] - offsets[0]);
+	stream.close();
+	strcpy(decompressConfig.in_file, tileStream.c_str());
+	strcpy(decompressConfig.out_file, tileDecompressed.c_str());
+	if (decompress_ccsds123(&decompressConfig) != 0) {
+		return -1;
+	}
+
+	// The images are BSQ with 2 bytes per sample: the last tile holds the bottom right corner of every band.
+	const size_t x0 = 2 * tileWidth, y0 = tileHeight;
+	const size_t width = xSize - x0, height = ySize - y0;
+	std::ifstream tile(tileDecompressed, std::ios::binary);
+	std::vector<char> tileBytes((std::istreambuf_iterator<char>(tile)), std::istreambuf_iterator<char>());
+	if (tileBytes.size() != 2 * width * height * zSize) {
+		return -1;
+	}
+	for (size_t z = 0; z < zSize; z++) {
+		for (size_t y = 0; y < height; y++) {
+			size_t expectedStart = 2 * ((z * ySize + y0 + y) * xSize + x0);
+			size_t tileStart = 2 * (z * height + y) * width;
+			if (!std::equal(tileBytes.begin() + tileStart, tileBytes.begin() + tileStart + 2 * width, decompressedBytes.begin() + expectedStart)) {
+				return -1;
+			}
+		}
+	}
+
+	return 0;
+}
+
+int testTiledRegion(decompressConfig_t config, const std::string decompressedFilename, const std::string tiledPrefix) {
+
+	const std::string tiledCompressed = tiledPrefix + TILED_COMPRESSED;
+	const size_t xSize = config.input_params.x_size, ySize = config.input_params.y_size, zSize = config.input_params.z_size;
+	std::ifstream expected(decompressedFilename, std::ios::binary);
+	std::vector<unsigned char> expectedBytes((std::istreambuf_iterator<char>(expected)), std::istreambuf_iterator<char>());
+	if (expectedBytes.size() != 2 * xSize * ySize * zSize) {
+		return -1;
+	}
+
+	// A window crossing the borders between the tiles of testTiledContainer, without the first and the last bands.
+	tile_region_t region;
+	region.x0 = (unsigned int)xSize / 4;
+	region.x1 = (unsigned int)xSize * 3 / 4 + 1;
+	region.y0 = (unsigned int)ySize / 3;
+	region.y1 = (unsigned int)ySize * 3 / 4 + 1;
+	region.z0 = 1;
+	region.z1 = (unsigned int)zSize - 1;
+	const size_t width = region.x1 - region.x0, height = region.y1 - region.y0, bands = region.z1 - region.z0;
+	std::vector<unsigned short> samples(width * height * bands);
+
+	strcpy(config.in_file, tiledCompressed.c_str());
+	config.num_threads = 3;
+	config.log_callback = NULL;
+	for (int order = 0; order < 2; order++) {
+		// BI with groups of 2 bands, the last one possibly narrower
+		const size_t depth = order == 0 ? 1 : 2;
+		config.input_params.in_interleaving = order == 0 ? BSQ : BI;
+		config.input_params.in_interleaving_depth = (unsigned int)depth;
+		if (decompress_tiled_region(&config, &region, samples.data(), samples.size()) != 0) {
+			return -1;
+		}
+		// The expected image is BSQ, little endian with 2 bytes per sample.
+		for (size_t z = 0; z < bands; z++) {
+			const size_t group = z - z % depth, groupBands = std::min(depth, bands - group);
+			for (size_t y = 0; y < height; y++) {
+				for (size_t x = 0; x < width; x++) {
+					const size_t e = 2 * (((z + region.z0) * ySize + y + region.y0) * xSize + x + region.x0);
+					const size_t s = order == 0 ? (z * height + y) * width + x : (y * bands + group) * width + x * groupBands + z - group;
+					if (samples[s] != (expectedBytes[e] | (expectedBytes[e + 1] << 8))) {
+						return -1;
+					}
+				}
+			}
+		}
+	}
+
+	return 0;
+}
+
+int testTileShards(compressConfig_t config, const std::string tiledPrefix) {
+
+	const unsigned int tileWidth = config.input_params.x_size / 3 + 1, tileHeight = config.input_params.y_size / 2 + 1;
+	const unsigned int numTiles = 6;
+	const std::string mergedShards = tiledPrefix + MERGED_SHARDS;
+	std::vector<std::string> shardNames;
+	std::vector<const char *> shardFiles;
+
+	config.input_params.regular_input = 1;
+	config.log_callback = NULL;
+	for (unsigned int tile = 0; tile < numTiles; tile++) {
+		shardNames.push_back(tiledPrefix + std::to_string(tile) + "_" + TILE_SHARD);
+	}
+	// The shards do not depend on each other, nor on the order they are compressed in.
+	for (unsigned int tile = numTiles; tile-- > 0;) {
+		char shardFile[128];
+		strcpy(shardFile, shardNames[tile].c_str());
+		if (compress_tile_shard(&config, tileWidth, tileHeight, tile, shardFile) != 0) {
+			return -1;
+		}
+		shardFiles.insert(shardFiles.begin(), shardNames[tile].c_str());
+	}
+	char missingTile[128];
+	strcpy(missingTile, (tiledPrefix + TILE_SHARD).c_str());
+	if (compress_tile_shard(&config, tileWidth, tileHeight, numTiles, missingTile) == 0) {
+		return -1;
+	}
+
+	tiled_report_t report;
+	strcpy(config.out_file, mergedShards.c_str());
+	if (merge_tile_shards(&config, tileWidth, tileHeight, shardFiles.data(), &report) != 0 || report.num_tiles != numTiles) {
+		return -1;
+	}
+	std::ifstream tiled(tiledPrefix + TILED_COMPRESSED, std::ios::binary);
+	std::ifstream merged(mergedShards, std::ios::binary);
+	std::vector<char> tiledBytes((std::istreambuf_iterator<char>(tiled)), std::istreambuf_iterator<char>());
+	std::vector<char> mergedBytes((std::istreambuf_iterator<char>(merged)), std::istreambuf_iterator<char>());
+	if (tiledBytes.empty() || tiledBytes != mergedBytes || report.container_bytes != mergedBytes.size()) {
+		return -1;
+	}
+
+	// The first and the last tile do not have the same size, so the merge notices they are swapped.
+	std::swap(shardFiles.front(), shardFiles.back());
+	if (merge_tile_shards(&config, tileWidth, tileHeight, shardFiles.data(), NULL) == 0) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int testShardCoordinator(compressConfig_t config, const std::string tiledPrefix) {
+
+	const unsigned int tileWidth = config.input_params.x_size / 3 + 1, tileHeight = config.input_params.y_size / 2 + 1;
+	const std::string workDir = tiledPrefix + COORDINATOR_WORK_DIR;
+	const std::string container = tiledPrefix + COORDINATED_CONTAINER;
+	const std::string logFile = tiledPrefix + COORDINATOR_LOG;
+	struct stat info;
+	char host[65] = {0};
+
+	config.input_params.regular_input = 1;
+	config.log_callback = NULL;
+	gethostname(host, 64);
+	std::ostringstream command;
+	command << COORDINATOR << " --input " << config.samples_file << " --output " << container
+		<< " --rows " << config.input_params.y_size << " --columns " << config.input_params.x_size << " --bands " << config.input_params.z_size
+		<< " --tile_width " << tileWidth << " --tile_height " << tileHeight << " --work_dir " << workDir << " --workers 2"
+		<< " --in_format BSQ --in_byte_ordering little --out_format BSQ --dyn_range " << (int)config.input_params.dyn_range
+		<< " --word_len " << config.encoder_params.out_wordsize << " --sample_adaptive --u_max " << config.encoder_params.u_max
+		<< " --y_star " << config.encoder_params.y_star << " --y_0 " << config.encoder_params.y_0 << " --k " << config.encoder_params.k
+		<< " --pred_bands " << (int)config.predictor_params.pred_bands << (config.predictor_params.full != 0 ? " --full" : "")
+		<< (config.predictor_params.neighbour_sum != 0 ? " --neighbour_sum" : "") << " --reg_size " << (int)config.predictor_params.register_size
+		<< " --w_resolution " << (int)config.predictor_params.weight_resolution << " --w_interval " << config.predictor_params.weight_interval
+		<< " --w_initial " << (int)config.predictor_params.weight_initial << " --w_final " << (int)config.predictor_params.weight_final;
+
+	// An invalid configuration is rejected before anything is written.
+	if (system(("rm -rf " + workDir).c_str()) != 0 || system((command.str() + " --y_0 0 > " + logFile + " 2>&1").c_str()) == 0 ||
+			stat(workDir.c_str(), &info) == 0) {
+		return -1;
+	}
+
+	// The work directory of an interrupted run: a worker of this machine, whose process is over, holds
+	// tile 0, and a worker of another machine holds tile 1.
+	pid_t deadWorker = fork();
+	if (deadWorker == 0) {
+		_exit(0);
+	}
+	if (deadWorker < 0 || waitpid(deadWorker, NULL, 0) != deadWorker) {
+		return -1;
+	}
+	const std::string states[4] = {"", "/queue", "/claimed", "/failed"};
+	for (int s = 0; s < 4; s++) {
+		if (mkdir((workDir + states[s]).c_str(), 0777) != 0) {
+			return -1;
+		}
+	}
+	const std::string deadClaim = workDir + "/claimed/0." + std::to_string(deadWorker) + "." + host;
+	const std::string remoteClaim = workDir + "/claimed/1." + std::to_string(deadWorker) + ".remote-worker";
+	std::ofstream(deadClaim) << "0" << std::endl;
+	std::ofstream(remoteClaim) << "0" << std::endl;
+
+	// The worker of the other machine writes its shard a while later.
+	std::cout.flush();
+	pid_t remoteWorker = fork();
+	if (remoteWorker == 0) {
+		char shardFile[128];
+		sleep(2);
+		strcpy(shardFile, (workDir + "/tile_1.cbs.remote").c_str());
+		_exit(compress_tile_shard(&config, tileWidth, tileHeight, 1, shardFile) == 0 &&
+				rename(shardFile, (workDir + "/tile_1.cbs").c_str()) == 0 && unlink(remoteClaim.c_str()) == 0 ? 0 : 1);
+	}
+	if (remoteWorker < 0) {
+		return -1;
+	}
+
+	// Without retries the tile of the dead worker is not compressed again, and the run fails once the tile of
+	// the other machine, waited for rather than counted as failed, is done.
+	int status = system((command.str() + " --retries 0 >> " + logFile + " 2>&1").c_str());
+	int remoteStatus = 0;
+	pid_t finished = waitpid(remoteWorker, &remoteStatus, WNOHANG);
+	if (finished != remoteWorker) {
+		waitpid(remoteWorker, NULL, 0);
+		return -1;
+	}
+	if (status == 0 || !WIFEXITED(remoteStatus) || WEXITSTATUS(remoteStatus) != 0 || stat(deadClaim.c_str(), &info) != 0) {
+		return -1;
+	}
+
+	// With one retry the resumed run compresses tile 0 again, merges the shards and removes the work directory.
+	if (system((command.str() + " --retries 1 >> " + logFile + " 2>&1").c_str()) != 0 || stat(workDir.c_str(), &info) == 0) {
+		return -1;
+	}
+	std::ifstream tiled(tiledPrefix + TILED_COMPRESSED, std::ios::binary);
+	std::ifstream coordinated(container, std::ios::binary);
+	std::vector<char> tiledBytes((std::istreambuf_iterator<char>(tiled)), std::istreambuf_iterator<char>());
+	std::vector<char> coordinatedBytes((std::istreambuf_iterator<char>(coordinated)), std::istreambuf_iterator<char>());
+	if (tiledBytes.empty() || tiledBytes != coordinatedBytes) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int testTranscoding(compressConfig_t config, const std::string compressedFilename, const std::string transcodedPrefix) {
+
+	const std::string blockCompressed = transcodedPrefix + BLOCK_COMPRESSED;
+	const std::string blockTranscoded = transcodedPrefix + BLOCK_TRANSCODED;
+	const std::string sampleTranscoded = transcodedPrefix + SAMPLE_TRANSCODED;
+	compressConfig_t blockConfig = config;
+	char inputFile[128];
+
+	// The reference: the image compressed with the block adaptive encoder.
+	blockConfig.encoder_params.encoding_method = BLOCK;
+	blockConfig.encoder_params.block_size = 16;
+	blockConfig.encoder_params.ref_interval = 256;
+	blockConfig.log_callback = NULL;
+	strcpy(blockConfig.out_file, blockCompressed.c_str());
+	if (compress_ccsds123(&blockConfig) != 0) {
+		return -1;
+	}
+
+	// The image and the predictor come from the header of the stream, so only the encoder is given.
+	compressConfig_t transcodeConfig = blockConfig;
+	memset(&transcodeConfig.input_params, 0, sizeof(transcodeConfig.input_params));
+	memset(&transcodeConfig.predictor_params, 0, sizeof(transcodeConfig.predictor_params));
+	strcpy(transcodeConfig.samples_file, "");
+	strcpy(transcodeConfig.out_file, blockTranscoded.c_str());
+	strcpy(inputFile, compressedFilename.c_str());
+	if (transcode_ccsds123(&transcodeConfig, inputFile) != 0 || transcodeConfig.input_params.z_size != config.input_params.z_size) {
+		return -1;
+	}
+	transcodeConfig.encoder_params = config.encoder_params;
+	strcpy(transcodeConfig.out_file, sampleTranscoded.c_str());
+	strcpy(inputFile, blockTranscoded.c_str());
+	if (transcode_ccsds123(&transcodeConfig, inputFile) != 0) {
+		return -1;
+	}
+
+	std::ifstream compressed(compressedFilename, std::ios::binary);
+	std::ifstream block(blockCompressed, std::ios::binary);
+	std::ifstream blockTranscodedFile(blockTranscoded, std::ios::binary);
+	std::ifstream sampleTranscodedFile(sampleTranscoded, std::ios::binary);
+	std::vector<char> compressedBytes((std::istreambuf_iterator<char>(compressed)), std::istreambuf_iterator<char>());
+	std::vector<char> blockBytes((std::istreambuf_iterator<char>(block)), std::istreambuf_iterator<char>());
+	std::vector<char> blockTranscodedBytes((std::istreambuf_iterator<char>(blockTranscodedFile)), std::istreambuf_iterator<char>());
+	std::vector<char> sampleTranscodedBytes((std::istreambuf_iterator<char>(sampleTranscodedFile)), std::istreambuf_iterator<char>());
+	if (blockBytes.empty() || blockBytes != blockTranscodedBytes || compressedBytes.empty() || compressedBytes != sampleTranscodedBytes) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int testReinterleaving(compressConfig_t config, const std::string compressedFilename, const std::string reinterleavedPrefix) {
+
+	const std::string biReference = reinterleavedPrefix + BI_REFERENCE;
+	const std::string biReinterleaved = reinterleavedPrefix + BI_REINTERLEAVED;
+	const std::string biDepthReinterleaved = reinterleavedPrefix + BI_DEPTH_REINTERLEAVED;
+	const std::string bsqReinterleaved = reinterleavedPrefix + BSQ_REINTERLEAVED;
+	// a depth which does not divide the number of bands, so that the last group of bands is a shorter one
+	const unsigned int depth = 3;
+
+	// The reference: the image compressed in BI order.
+	compressConfig_t biConfig = config;
+	biConfig.encoder_params.out_interleaving = BI;
+	biConfig.encoder_params.out_interleaving_depth = depth;
+	biConfig.log_callback = NULL;
+	strcpy(biConfig.out_file, biReference.c_str());
+	if (compress_ccsds123(&biConfig) != 0) {
+		return -1;
+	}
+
+	decompressConfig_t reinterleaveConfig;
+	memset(&reinterleaveConfig, 0, sizeof(reinterleaveConfig));
+	reinterleaveConfig.arena = config.arena;
+	strcpy(reinterleaveConfig.in_file, compressedFilename.c_str());
+	strcpy(reinterleaveConfig.out_file, biReinterleaved.c_str());
+	if (reinterleave_ccsds123(&reinterleaveConfig, BI, depth) != 0 || reinterleaveConfig.input_params.z_size != config.input_params.z_size) {
+		return -1;
+	}
+	// BI to BI goes through another depth and back, then BI to BSQ gives the original stream.
+	strcpy(reinterleaveConfig.in_file, biReinterleaved.c_str());
+	strcpy(reinterleaveConfig.out_file, biDepthReinterleaved.c_str());
+	if (reinterleave_ccsds123(&reinterleaveConfig, BI, depth + 2) != 0) {
+		return -1;
+	}
+	strcpy(reinterleaveConfig.in_file, biDepthReinterleaved.c_str());
+	strcpy(reinterleaveConfig.out_file, biReinterleaved.c_str());
+	if (reinterleave_ccsds123(&reinterleaveConfig, BI, depth) != 0) {
+		return -1;
+	}
+	strcpy(reinterleaveConfig.in_file, biReinterleaved.c_str());
+	strcpy(reinterleaveConfig.out_file, bsqReinterleaved.c_str());
+	if (reinterleave_ccsds123(&reinterleaveConfig, BSQ, 0) != 0) {
+		return -1;
+	}
+	// The depth must be one the image allows.
+	strcpy(reinterleaveConfig.out_file, biDepthReinterleaved.c_str());
+	if (reinterleave_ccsds123(&reinterleaveConfig, BI, config.input_params.z_size + 1) != CCSDS_ERROR_CONFIG) {
+		return -1;
+	}
+
+	std::ifstream compressed(compressedFilename, std::ios::binary);
+	std::ifstream reference(biReference, std::ios::binary);
+	std::ifstream biReinterleavedFile(biReinterleaved, std::ios::binary);
+	std::ifstream bsqReinterleavedFile(bsqReinterleaved, std::ios::binary);
+	std::vector<char> compressedBytes((std::istreambuf_iterator<char>(compressed)), std::istreambuf_iterator<char>());
+	std::vector<char> referenceBytes((std::istreambuf_iterator<char>(reference)), std::istreambuf_iterator<char>());
+	std::vector<char> biReinterleavedBytes((std::istreambuf_iterator<char>(biReinterleavedFile)), std::istreambuf_iterator<char>());
+	std::vector<char> bsqReinterleavedBytes((std::istreambuf_iterator<char>(bsqReinterleavedFile)), std::istreambuf_iterator<char>());
+	if (referenceBytes.empty() || referenceBytes != biReinterleavedBytes || compressedBytes.empty() || compressedBytes != bsqReinterleavedBytes) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int testRateEstimation(compressConfig_t config, const std::string compressedFilename, const std::string blockCompressedFilename) {
+
+	std::ifstream compressed(compressedFilename, std::ios::binary | std::ios::ate);
+	std::ifstream blockCompressed(blockCompressedFilename, std::ios::binary | std::ios::ate);
+	const unsigned long long compressedBytes = compressed.tellg();
+	const unsigned long long blockCompressedBytes = blockCompressed.tellg();
+	std::vector<unsigned long long> bandBits(config.input_params.z_size);
+	std::vector<unsigned long long> bandEscapes(config.input_params.z_size);
+	rate_estimate_t estimate;
+
+	// The exact estimate, band by band.
+	config.log_callback = NULL;
+	memset(&estimate, 0, sizeof(estimate));
+	estimate.band_bits = bandBits.data();
+	estimate.band_escapes = bandEscapes.data();
+	if (estimate_ccsds123(&config, 1, &estimate) != 0 || estimate.stream_bytes != compressedBytes) {
+		return -1;
+	}
+	unsigned long long codewordBits = 0, escapes = 0;
+	for (unsigned int z = 0; z < config.input_params.z_size; z++) {
+		codewordBits += bandBits[z];
+		escapes += bandEscapes[z];
+	}
+	if (codewordBits != estimate.codeword_bits || escapes != estimate.escapes ||
+			(estimate.header_bits + estimate.codeword_bits + 7) / 8 > estimate.stream_bytes) {
+		return -1;
+	}
+	const unsigned long long exactBytes = estimate.stream_bytes;
+
+	// The approximate estimate, from a subset of the lines.
+	if (estimate_ccsds123(&config, ESTIMATE_LINE_STEP, &estimate) != 0 ||
+			std::abs((double)estimate.stream_bytes - (double)exactBytes) > ESTIMATE_TOLERANCE * exactBytes) {
+		return -1;
+	}
+
+	// The block adaptive encoder of testTranscoding.
+	config.encoder_params.encoding_method = BLOCK;
+	config.encoder_params.block_size = 16;
+	config.encoder_params.ref_interval = 256;
+	memset(&estimate, 0, sizeof(estimate));
+	if (estimate_ccsds123(&config, 0, &estimate) != 0 || estimate.stream_bytes != blockCompressedBytes) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int testAutotuning(compressConfig_t config, const std::string parametersFilename) {
+
+	// The values of the configuration are in the grid, together with invalid ones (y_star < y_0 + 1).
+	const int predBands[] = {0, 2, 15};
+	const int flags[] = {0, 1};
+	const int weightResolutions[] = {12, 14, 16};
+	const int weightIntervals[] = {16, 32, 64};
+	const int weightLimits[] = {4, 6, 8};
+	const int uMax[] = {16, 18, 20};
+	const int yStar[] = {1, 5, 6, 7};
+	const int k[] = {5, 7, 9};
+	tuning_grid_t grid;
+	memset(&grid, 0, sizeof(grid));
+	tuning_grid_set(&grid, TUNE_PRED_BANDS, predBands, 3);
+	tuning_grid_set(&grid, TUNE_FULL, flags, 2);
+	tuning_grid_set(&grid, TUNE_NEIGHBOUR_SUM, flags, 2);
+	tuning_grid_set(&grid, TUNE_WEIGHT_RESOLUTION, weightResolutions, 3);
+	tuning_grid_set(&grid, TUNE_WEIGHT_INTERVAL, weightIntervals, 3);
+	tuning_grid_set(&grid, TUNE_WEIGHT_INITIAL, weightLimits, 3);
+	tuning_grid_set(&grid, TUNE_WEIGHT_FINAL, weightLimits, 3);
+	tuning_grid_set(&grid, TUNE_U_MAX, uMax, 3);
+	tuning_grid_set(&grid, TUNE_Y_STAR, yStar, 4);
+	tuning_grid_set(&grid, TUNE_K, k, 3);
+
+	char parametersFile[128];
+	strcpy(parametersFile, parametersFilename.c_str());
+	config.log_callback = NULL;
+	compressConfig_t tuned = config, serial = config;
+	tuning_report_t report, serialReport;
+	if (autotune_ccsds123(&tuned, &grid, ESTIMATE_LINE_STEP, TUNING_THREADS, parametersFile, &report) != 0 ||
+			autotune_ccsds123(&serial, &grid, ESTIMATE_LINE_STEP, 1, NULL, &serialReport) != 0) {
+		return -1;
+	}
+	if (report.best_rate > report.baseline_rate || report.best_rate != serialReport.best_rate || report.skipped == 0 ||
+			tuned.predictor_params.pred_bands != serial.predictor_params.pred_bands || tuned.predictor_params.full != serial.predictor_params.full ||
+			tuned.predictor_params.neighbour_sum != serial.predictor_params.neighbour_sum ||
+			tuned.predictor_params.weight_resolution != serial.predictor_params.weight_resolution ||
+			tuned.predictor_params.weight_interval != serial.predictor_params.weight_interval ||
+			tuned.predictor_params.weight_initial != serial.predictor_params.weight_initial ||
+			tuned.predictor_params.weight_final != serial.predictor_params.weight_final || tuned.encoder_params.u_max != serial.encoder_params.u_max ||
+			tuned.encoder_params.y_star != serial.encoder_params.y_star || tuned.encoder_params.k != serial.encoder_params.k) {
+		return -1;
+	}
+
+	// The estimation of the stream of the tuned parameters measures the rate of the search.
+	rate_estimate_t estimate;
+	memset(&estimate, 0, sizeof(estimate));
+	if (estimate_ccsds123(&tuned, ESTIMATE_LINE_STEP, &estimate) != 0 ||
+			std::abs((double)estimate.codeword_bits / IMAGE_SAMPLES(config.input_params) - report.best_rate) > 1e-6) {
+		return -1;
+	}
+
+	// The parameters are saved as options of the compressor.
+	std::ifstream parameters(parametersFilename);
+	std::string options;
+	std::getline(parameters, options);
+	if (options.rfind("--pred_bands " + std::to_string(tuned.predictor_params.pred_bands), 0) != 0 ||
+			options.find("--k " + std::to_string(tuned.encoder_params.k)) == std::string::npos) {
+		return -1;
+	}
+
+	return 0;
+}
+
+// Reads the values of a weight initialization table, one per line, skipping the empty lines between the bands.
+static std::vector<int> readWeightsTable(const std::string filename) {
+	std::ifstream table(filename);
+	std::vector<int> values;
+	std::string line;
+	while (std::getline(table, line)) {
+		if (!line.empty()) {
+			values.push_back(std::stoi(line));
+		}
+	}
+	return values;
+}
+
+int testWarmStart(compressConfig_t config, decompressConfig_t decompressConfig, const std::string compressedFilename,
+	const std::string decompressedFilename, const std::string warmPrefix) {
+
+	const std::string adaptedCompressed = warmPrefix + ADAPTED_COMPRESSED;
+	const std::string weightsFiles[2] = {warmPrefix + ADAPTED_WEIGHTS, warmPrefix + ROUNDED_ADAPTED_WEIGHTS};
+	const std::string fusedAdaptedWeights = warmPrefix + FUSED_ADAPTED_WEIGHTS;
+	const std::string warmCompressed = warmPrefix + WARM_COMPRESSED;
+	const std::string warmDecompressed = warmPrefix + WARM_DECOMPRESSED;
+	// the table at the full weight resolution (no scaling) and at a lower one (scaled by 2^3)
+	const unsigned int resolutions[2] = {(unsigned int)config.predictor_params.weight_resolution + 3,
+		(unsigned int)config.predictor_params.weight_resolution};
+	config.log_callback = NULL;
+	decompressConfig.log_callback = NULL;
+
+	// The weights are saved by the in memory and by the fused engine, then at the lower resolution.
+	compressConfig_t adaptedConfig = config;
+	strcpy(adaptedConfig.out_file, adaptedCompressed.c_str());
+	strcpy(adaptedConfig.adapted_weights_file, weightsFiles[0].c_str());
+	adaptedConfig.adapted_weights_resolution = resolutions[0];
+	adaptedConfig.engine = ENGINE_IN_MEMORY;
+	if (compress_ccsds123(&adaptedConfig) != 0) {
+		return -1;
+	}
+	strcpy(adaptedConfig.adapted_weights_file, fusedAdaptedWeights.c_str());
+	adaptedConfig.engine = ENGINE_FUSED;
+	if (compress_ccsds123(&adaptedConfig) != 0) {
+		return -1;
+	}
+	const std::string expectedFiles[2] = {compressedFilename, weightsFiles[0]};
+	const std::string adaptedFiles[2] = {adaptedCompressed, fusedAdaptedWeights};
+	for (int i = 0; i < 2; i++) {
+		std::ifstream expected(expectedFiles[i], std::ios::binary);
+		std::ifstream adapted(adaptedFiles[i], std::ios::binary);
+		std::vector<char> expectedBytes((std::istreambuf_iterator<char>(expected)), std::istreambuf_iterator<char>());
+		std::vector<char> adaptedBytes((std::istreambuf_iterator<char>(adapted)), std::istreambuf_iterator<char>());
+		if (expectedBytes.empty() || expectedBytes != adaptedBytes) {
+			return -1;
+		}
+	}
+	strcpy(adaptedConfig.adapted_weights_file, weightsFiles[1].c_str());
+	adaptedConfig.adapted_weights_resolution = resolutions[1];
+	if (compress_ccsds123(&adaptedConfig) != 0) {
+		return -1;
+	}
+
+	// The weights init_weights starts a band from are the ones given by the standard for each table,
+	// 2^s * value + floor(2^(s - 1)) - 1 with s = weight_resolution + 3 - resolution, and the table at the
+	// lower resolution holds the weights of the full one rounded as write_weights_table describes.
+	const unsigned int weightsLen = config.predictor_params.pred_bands + (config.predictor_params.full != 0 ? 3 : 0);
+	const unsigned int directional = config.predictor_params.full != 0 ? 3 : 0;
+	std::vector<int> tables[2];
+	std::vector<int> initialWeights[2];
+	for (int t = 0; t < 2; t++) {
+		tables[t] = readWeightsTable(weightsFiles[t]);
+		if (tables[t].size() != (size_t)weightsLen * config.input_params.z_size) {
+			return -1;
+		}
+		predictor_config_t tableParams = config.predictor_params;
+		std::vector<int *> bandTables(config.input_params.z_size);
+		for (unsigned int z = 0; z < config.input_params.z_size; z++) {
+			bandTables[z] = tables[t].data() + (size_t)z * weightsLen;
+		}
+		tableParams.weight_init_table = bandTables.data();
+		tableParams.weight_init_resolution = resolutions[t];
+		const int shift = config.predictor_params.weight_resolution + 3 - resolutions[t];
+		initialWeights[t].resize(tables[t].size());
+		for (unsigned int z = 0; z < config.input_params.z_size; z++) {
+			int *weights = initialWeights[t].data() + (size_t)z * weightsLen;
+			init_weights(weights, tableParams, z);
+			for (unsigned int i = 0; i < weightsLen; i++) {
+				// the directional weights come first in the table, last in the predictor
+				const int value = bandTables[z][i];
+				const int weight = weights[i < directional ? config.predictor_params.pred_bands + i : i - directional];
+				if (weight != value * (1 << shift) + (shift > 0 ? 1 << (shift - 1) : 0) - 1) {
+					return -1;
+				}
+			}
+		}
+	}
+	const int shift = resolutions[0] - resolutions[1];
+	const int maxValue = (1 << (resolutions[1] - 1)) - 1;
+	const int minValue = -(1 << (resolutions[1] - 1));
+	for (unsigned int z = 0; z < config.input_params.z_size; z++) {
+		for (unsigned int i = 0; i < weightsLen; i++) {
+			const int weight = initialWeights[0][(size_t)z * weightsLen + (i < directional ? config.predictor_params.pred_bands + i : i - directional)];
+			const int rounded = std::min(std::max((weight + 1) >> shift, minValue), maxValue);
+			if (tables[1][(size_t)z * weightsLen + i] != rounded) {
+				return -1;
+			}
+		}
+	}
+
+	// The compressions starting from the adapted weights, whose table is saved in the header of the stream.
+	for (int t = 0; t < 2; t++) {
+		compressConfig_t warmConfig = config;
+		strcpy(warmConfig.out_file, warmCompressed.c_str());
+		strcpy(warmConfig.init_weight_file, weightsFiles[t].c_str());
+		warmConfig.predictor_params.weight_init_resolution = resolutions[t];
+		if (compress_ccsds123(&warmConfig) != 0) {
+			return -1;
+		}
+		std::ifstream compressed(compressedFilename, std::ios::binary | std::ios::ate);
+		std::ifstream warm(warmCompressed, std::ios::binary | std::ios::ate);
+		if (t == 0 && warm.tellg() >= compressed.tellg()) {
+			return -1;
+		}
+		strcpy(decompressConfig.in_file, warmCompressed.c_str());
+		strcpy(decompressConfig.out_file, warmDecompressed.c_str());
+		if (decompress_ccsds123(&decompressConfig) != 0) {
+			return -1;
+		}
+		std::ifstream expected(decompressedFilename, std::ios::binary);
+		std::ifstream decompressed(warmDecompressed, std::ios::binary);
+		std::vector<char> expectedBytes((std::istreambuf_iterator<char>(expected)), std::istreambuf_iterator<char>());
+		std::vector<char> decompressedBytes((std::istreambuf_iterator<char>(decompressed)), std::istreambuf_iterator<char>());
+		if (expectedBytes.empty() || expectedBytes != decompressedBytes) {
+			return -1;
+		}
+	}
+
+	// The weights cannot be saved with more bits than the predictor uses.
+	adaptedConfig.adapted_weights_resolution = config.predictor_params.weight_resolution + 4;
+	if (compress_ccsds123(&adaptedConfig) != CCSDS_ERROR_CONFIG) {
+		return -1;
+	}
+
+	return 0;
+}
+
+int testPredictionModes(compressConfig_t config, decompressConfig_t decompressConfig, const std::string originalFilename,
+	const std::string modePrefix) {
+
+	const compress_engine_t engines[3] = {ENGINE_FUSED, ENGINE_OUT_OF_CORE, ENGINE_PIPELINED};
+	const char *engineFiles[3] = {FUSED_COMPRESSED, OUT_OF_CORE_COMPRESSED, PIPELINED_COMPRESSED};
+	std::ifstream original(originalFilename, std::ios::binary);
+	std::vector<char> originalBytes((std::istreambuf_iterator<char>(original)), std::istreambuf_iterator<char>());
+	config.input_params.regular_input = 1;
+	config.encoder_params.k_init = NULL;
+	config.predictor_params.weight_init_table = NULL;
+	config.log_callback = NULL;
+	decompressConfig.log_callback = NULL;
+
+	for (int mode = 0; mode < 2; mode++) {
+		const std::string prefix = modePrefix + std::to_string(mode) + "_";
+		const std::string modeCompressed = prefix + MODE_COMPRESSED;
+		const std::string modeDecompressed = prefix + MODE_DECOMPRESSED;
+		if (mode == 0) {
+			config.predictor_params.pred_bands = 3;
+			config.predictor_params.neighbour_sum = 1;
+		} else {
+			// The samples of the test images are all smaller than 256.
+			config.input_params.dyn_range = 8;
+			config.encoder_params.k = 5;
+			config.predictor_params.pred_bands = 2;
+			config.predictor_params.full = 0;
+			config.predictor_params.neighbour_sum = 0;
+		}
+		config.predictor_params.user_input_pred_bands = config.predictor_params.pred_bands;
+
+		// Every engine must produce the stream of the in memory one.
+		compressConfig_t modeConfig = config;
+		strcpy(modeConfig.out_file, modeCompressed.c_str());
+		modeConfig.engine = ENGINE_IN_MEMORY;
+		if (compress_ccsds123(&modeConfig) != 0) {
+			return -1;
+		}
+		std::ifstream compressed(modeCompressed, std::ios::binary);
+		std::vector<char> expectedBytes((std::istreambuf_iterator<char>(compressed)), std::istreambuf_iterator<char>());
+		for (int i = 0; i < 3; i++) {
+			const std::string engineCompressed = prefix + engineFiles[i];
+			modeConfig = config;
+			strcpy(modeConfig.out_file, engineCompressed.c_str());
+			modeConfig.engine = engines[i];
+			if (compress_ccsds123(&modeConfig) != 0) {
+				return -1;
+			}
+			std::ifstream engine(engineCompressed, std::ios::binary);
+			std::vector<char> engineBytes((std::istreambuf_iterator<char>(engine)), std::istreambuf_iterator<char>());
+			if (expectedBytes.empty() || expectedBytes != engineBytes) {
+				return -1;
+			}
+		}
+		// The scheduler predicts the bands in ranges, each one starting again from the bands before it.
+		if (testScheduler(config, modeCompressed, prefix) != 0) {
+			return -1;
+		}
+
+		// The stream must decompress to the original image, with every decoder.
+		strcpy(decompressConfig.in_file, modeCompressed.c_str());
+		strcpy(decompressConfig.out_file, modeDecompressed.c_str());
+		decompressConfig.engine = DECOMPRESS_ENGINE_IN_MEMORY;
+		if (decompress_ccsds123(&decompressConfig) != 0) {
+			return -1;
+		}
+		std::vector<char> imageBytes = originalBytes;
+		if (SAMPLE_BYTES(config.input_params) == 1) {
+			// The decompressor writes the samples of up to 8 bits with one byte each.
+			const unsigned short *samples = reinterpret_cast<const unsigned short *>(originalBytes.data());
+			imageBytes.assign(samples, samples + originalBytes.size() / 2);
+		}
+		std::ifstream decompressed(modeDecompressed, std::ios::binary);
+		std::vector<char> decompressedBytes((std::istreambuf_iterator<char>(decompressed)), std::istreambuf_iterator<char>());
+		if (imageBytes.empty() || imageBytes != decompressedBytes) {
+			return -1;
+		}
+		if (testPipelinedDecompression(decompressConfig, modeDecompressed, prefix + PIPELINED_DECOMPRESSED) != 0 ||
+			testBandRange(decompressConfig, modeDecompressed, prefix) != 0 ||
+			testCheckpoints(config, decompressConfig, modeDecompressed, prefix) != 0) {
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int testCompressionSession(compressConfig_t config, const std::string originalFilename, const std::string compressedFilename) {
+
+	// The samples were written by writeSamplesToBinaryFile with the host byte ordering, as the session expects.
+	std::ifstream original(originalFilename, std::ios::binary);
+	std::vector<unsigned short> samples(IMAGE_SAMPLES(config.input_params));
+	original.read(reinterpret_cast<char *>(samples.data()), samples.size() * sizeof(unsigned short));
+	if (!original) {
+		return -1;
+	}
+	std::ifstream compressed(compressedFilename, std::ios::binary);
+	std::vector<unsigned char> expected((std::istreambuf_iterator<char>(compressed)), std::istreambuf_iterator<char>());
+
+	compress_session_t *session = NULL;
+	if (compress_session_create(&config, &session) != CCSDS_OK) {
+		return -1;
+	}
+	std::vector<unsigned char> stream(compress_session_bound(session));
+	int result = 0;
+	for (int i = 0; i < 2 && result == 0; i++) {
+		long long compressedBytes = compress_session_compress(session, samples.data(), stream.data(), stream.size());
+		if (compressedBytes < 0 || expected.empty() || std::vector<unsigned char>(stream.begin(), stream.begin() + compressedBytes) != expected) {
+			result = -1;
+		}
+	}
+	compress_session_destroy(session);
+
+	// The sessions do not write the files produced next to the stream by compress_ccsds123.
+	char *sideFiles[3] = {config.band_index_file, config.checkpoint_file, config.adapted_weights_file};
+	config.log_callback = NULL;
+	for (char *sideFile : sideFiles) {
+		strcpy(sideFile, compressedFilename.c_str());
+		if (compress_session_create(&config, &session) != CCSDS_ERROR_CONFIG || session != NULL) {
+			result = -1;
+		}
+		sideFile[0] = '\0';
+	}
+
+	return result;
+}
+
+int testSessionBatch(compressConfig_t config, const std::string compressedFilename, const std::string batchPrefix) {
+
+	const int numImages = 3;
+	std::string batchFilenames[numImages];
+	const char *inputFiles[numImages];
+	const char *outputFiles[numImages];
+	long long compressedBytes[numImages];
+	for (int i = 0; i < numImages; i++) {
+		batchFilenames[i] = batchPrefix + std::to_string(i) + "_" + BATCH_COMPRESSED;
+		inputFiles[i] = config.samples_file;
+		outputFiles[i] = batchFilenames[i].c_str();
+	}
+
+	compress_session_t *session = NULL;
+	if (compress_session_create(&config, &session) != CCSDS_OK) {
+		return -1;
+	}
+	int result = compress_session_compress_files(session, inputFiles, outputFiles, numImages, compressedBytes) == CCSDS_OK ? 0 : -1;
+	compress_session_destroy(session);
+
+	// Compare the streams with the one of compress_ccsds123.
+	std::ifstream compressed(compressedFilename, std::ios::binary);
+	std::vector<char> expected((std::istreambuf_iterator<char>(compressed)), std::istreambuf_iterator<char>());
+	for (int i = 0; i < numImages && result == 0; i++) {
+		std::ifstream batch(batchFilenames[i], std::ios::binary);
+		std::vector<char> batchBytes((std::istreambuf_iterator<char>(batch)), std::istreambuf_iterator<char>());
+		if (expected.empty() || batchBytes != expected || compressedBytes[i] != (long long)expected.size()) {
+			result = -1;
+		}
+	}
+
+	return result;
+}
+
+int testScheduler(compressConfig_t config, const std::string compressedFilename, const std::string scheduledPrefix) {
+
+	const int numJobs = 3;
+	scheduler_t *scheduler = NULL;
+	if (scheduler_create(4, 2, &scheduler) != CCSDS_OK) {
+		return -1;
+	}
+	config.encoder_params.k_init = NULL;
+	config.predictor_params.weight_init_table = NULL;
+	config.log_callback = NULL;
+	compress_job_t *jobs[numJobs];
+	std::string scheduledFilenames[numJobs];
+	int result = 0;
+	for (int i = 0; i < numJobs; i++) {
+		scheduledFilenames[i] = scheduledPrefix + std::to_string(i) + "_" + SCHEDULED_COMPRESSED;
+		strcpy(config.out_file, scheduledFilenames[i].c_str());
+		if (scheduler_submit(scheduler, &config, &jobs[i]) != CCSDS_OK) {
+			jobs[i] = NULL;
+			result = -1;
+		}
+	}
+	for (int i = 0; i < numJobs; i++) {
+		if (jobs[i] != NULL && scheduler_wait(scheduler, jobs[i]) < 0) {
+			result = -1;
+		}
+	}
+	scheduler_destroy(scheduler);
+
+	// Compare the streams with the sequential one.
+	std::ifstream compressed(compressedFilename, std::ios::binary);
+	std::vector<char> expected((std::istreambuf_iterator<char>(compressed)), std::istreambuf_iterator<char>());
+	for (int i = 0; i < numJobs && result == 0; i++) {
+		std::ifstream scheduled(scheduledFilenames[i], std::ios::binary);
+		std::vector<char> scheduledBytes((std::istreambuf_iterator<char>(scheduled)), std::istreambuf_iterator<char>());
+		if (expected.empty() || scheduledBytes != expected) {
+			result = -1;
+		}
+	}
+
+	return result;
+}
+
+/// Log callback collecting the error messages in the std::vector<std::string> passed as user data.
+static void collectErrors(log_level_t level, const char *message, void *userData) {
+	if (level == LOG_ERROR) {
+		static_cast<std::vector<std::string> *>(userData)->push_back(message);
+	}
+}
+
+int testErrorReporting(compressConfig_t config) {
+
+	std::vector<std::string> errors;
+	config.log_callback = collectErrors;
+	config.log_user_data = &errors;
+	config.arena = NULL;
+	config.encoder_params.k_init = NULL;
+	config.predictor_params.weight_init_table = NULL;
+
+	compressConfig_t invalid = config;
+	invalid.predictor_params.weight_resolution = 3;
+	if (compress_ccsds123(&invalid) != CCSDS_ERROR_CONFIG || errors.size() != 1) {
+		return -1;
+	}
+
+	compressConfig_t missing = config;
+	strcpy(missing.samples_file, RESULTS_FOLDER "missing.arr");
+	if (compress_ccsds123(&missing) != CCSDS_ERROR_IO || errors.size() < 2) {
+		return -1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,702 @@
+/*
+ Command line interface sharding the compression of a large scene over several processes: the scene is
+ split into the tiles of a tiled container (see tile_container.h), every tile becomes a job of a queue
+ kept in a work directory, worker processes compress the jobs into shards (the standalone streams of the
+ tiles) and the coordinator merges the shards into the container.
+
+ The queue is a set of directories of work_dir, so that the workers need nothing but the file system,
+ and workers running on other machines sharing it (started with --worker and the same options) can help
+ draining it:
+ - queue/N is the job of tile N, its content being the number of attempts already failed;
+ - a worker claims a job renaming it atomically to claimed/N.pid.host (its process id and the name of its
+   machine), and when done renames the shard it wrote to tile_N.cbs (or the job to failed/N when the
+   compression failed);
+ - when its workers are over, the coordinator queues again the failed jobs and the ones claimed by workers
+   of its machine which died, up to --retries times each, without touching the shards already written, and
+   starts new workers; a work directory left by an interrupted run is resumed in the same way.
+ - the jobs claimed by workers still running, or by workers of other machines (whose processes cannot be
+   checked), are waited for: the claim of a worker of another machine which died has to be removed by hand
+   for its job to be queued again.
+ The work directory is removed once the container is written.
+ */
+
+/*
+   USAGE
+   coordinator --input original_samples --output container --rows num_rows --columns num_col --bands num_bands
+   --tile_width num --tile_height num --work_dir path [--workers num] [--retries num] [--worker]
+   --in_format [BSQ|BI] --in_depth num --in_byte_ordering [LITTLE|big] --dyn_range num --word_len num --out_format [BSQ|bi]
+   --out_depth num --signed_sample --pred_bands num --full --neighbour_sum --reg_size num --w_resolution num --w_interval num
+   --w_initial num --w_final num --w_init_resolution num --weight_init_file file_path --sample_adaptive --u_max num
+   --y_star num --y_0 num --k num --k_init_file file_path --block_size num --restricted_enc --ref_interval num
+
+*/
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <dirent.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "compress_ccsds123.h"
+#include "tile_container.h"
+
+//String specifying the program command line
+#define USAGE_STRING "Usage: %s --input original_samples --output container --rows num_rows --columns num_col --bands num_bands \
+	--tile_width num --tile_height num --work_dir path [--workers num] [--retries num] [--worker] \
+	--in_format [BSQ|BI] --in_depth num --in_byte_ordering [LITTLE|big] --dyn_range num --word_len num --out_format [BSQ|bi] \
+	--out_depth num --signed_sample --pred_bands num --full --neighbour_sum --reg_size num --w_resolution num --w_interval num \
+	--w_initial num --w_final num --w_init_resolution num --weight_init_file file_path --sample_adaptive --u_max num \
+	--y_star num --y_0 num --k num --k_init_file file_path --block_size num --restricted_enc --ref_interval num\n"
+
+//Number of retries of a failed tile when --retries is not given
+#define DEFAULT_RETRIES 2
+
+//Length of the paths of the files of the work directory
+#define PATH_LENGTH 128
+
+//Length of the path of an entry of a directory of the work directory, whose name can take up to 256 characters
+#define ENTRY_PATH_LENGTH (PATH_LENGTH + 258)
+
+//Length of the name of the machine in the claims of the jobs
+#define HOST_LENGTH 64
+
+//Seconds between two scans of the work directory while the jobs left are claimed by other workers
+#define CLAIM_POLL_SECONDS 1
+
+struct option options[] = {
+	{"input", 1, NULL, 1},
+	{"output", 1, NULL, 2},
+	{"rows", 1, NULL, 3},
+	{"columns", 1, NULL, 4},
+	{"bands", 1, NULL, 5},
+	{"in_format", 1, NULL, 6},
+	{"in_depth", 1, NULL, 7},
+	{"in_byte_ordering", 1, NULL, 8},
+	{"out_format", 1, NULL, 9},
+	{"out_depth", 1, NULL, 10},
+	{"u_max", 1, NULL, 12},
+	{"y_star", 1, NULL, 13},
+	{"y_0", 1, NULL, 14},
+	{"k", 1, NULL, 15},
+	{"k_init_file", 1, NULL, 16},
+	{"help", 0, NULL, 17},
+	{"dyn_range", 1, NULL, 18},
+	{"word_len", 1, NULL, 19},
+	{"signed_sample", 0, NULL, 20},
+	{"pred_bands", 1, NULL, 21},
+	{"full", 0, NULL, 22},
+	{"neighbour_sum", 0, NULL, 23},
+	{"reg_size", 1, NULL, 24},
+	{"w_resolution", 1, NULL, 25},
+	{"w_interval", 1, NULL, 26},
+	{"w_initial", 1, NULL, 27},
+	{"w_final", 1, NULL, 28},
+	{"w_init_resolution", 1, NULL, 29},
+	{"weight_init_file", 1, NULL, 30},
+	{"sample_adaptive", 0, NULL, 31},
+	{"block_size", 1, NULL, 32},
+	{"restricted_enc", 0, NULL, 33},
+	{"ref_interval", 1, NULL, 34},
+	{"tile_width", 1, NULL, 40},
+	{"tile_height", 1, NULL, 41},
+	{"workers", 1, NULL, 42},
+	{"retries", 1, NULL, 43},
+	{"work_dir", 1, NULL, 44},
+	{"worker", 0, NULL, 45},
+	{NULL, 0, NULL, 0}};
+
+///Sharded compression of a scene
+typedef struct shard_job
+{
+	compressConfig_t config;
+	unsigned int tile_width;
+	unsigned int tile_height;
+	unsigned int num_tiles;
+	const char *work_dir;
+	// name of the machine, identifying the claims of its workers
+	char host[HOST_LENGTH + 1];
+} shard_job_t;
+
+///Path of the shard of tile
+static void shard_path(const shard_job_t *job, unsigned int tile, char path[PATH_LENGTH])
+{
+	snprintf(path, PATH_LENGTH, "%s/tile_%u.cbs", job->work_dir, tile);
+}
+
+///Path of the claim of tile by the worker process pid of host
+static void claim_path(const shard_job_t *job, unsigned int tile, long pid, const char *host, char path[ENTRY_PATH_LENGTH])
+{
+	snprintf(path, ENTRY_PATH_LENGTH, "%s/claimed/%u.%ld.%s", job->work_dir, tile, pid, host);
+}
+
+///Whether the claim named name (N.pid.host) was left by a worker of this machine which died, and can be
+///queued again; the claims of the other machines are kept, as their workers cannot be checked
+static int dead_claim(const shard_job_t *job, const char *name)
+{
+	unsigned int tile = 0;
+	long pid = 0;
+	int hostStart = -1;
+
+	if (sscanf(name, "%u.%ld.%n", &tile, &pid, &hostStart) != 2 || hostStart < 0)
+		return 1;
+	if (strcmp(name + hostStart, job->host) != 0)
+		return 0;
+	return pid <= 0 || (kill((pid_t)pid, 0) != 0 && errno == ESRCH);
+}
+
+///Whether the file or directory path exists
+static int exists(const char *path)
+{
+	struct stat info;
+	return stat(path, &info) == 0;
+}
+
+///Reads the number of failed attempts held by the job file path (0 when it cannot be read)
+static unsigned int read_attempts(const char *path)
+{
+	unsigned int attempts = 0;
+	FILE *file = fopen(path, "r");
+
+	if (file != NULL)
+	{
+		if (fscanf(file, "%u", &attempts) != 1)
+			attempts = 0;
+		fclose(file);
+	}
+	return attempts;
+}
+
+///Writes the job of tile in the queue, after attempts failed attempts
+static int queue_job(const shard_job_t *job, unsigned int tile, unsigned int attempts)
+{
+	char path[PATH_LENGTH];
+	char temp[PATH_LENGTH];
+	FILE *file = NULL;
+
+	// the job is written aside and then renamed, so that a worker never claims a half written one
+	snprintf(temp, PATH_LENGTH, "%s/job_%u.tmp", job->work_dir, tile);
+	snprintf(path, PATH_LENGTH, "%s/queue/%u", job->work_dir, tile);
+	if ((file = fopen(temp, "w")) == NULL || fprintf(file, "%u\n", attempts) < 0 || fclose(file) != 0 || rename(temp, path) != 0)
+	{
+		fprintf(stderr, "\nError, in queuing the job of tile %u\n\n", tile);
+		return -1;
+	}
+	return 0;
+}
+
+///Compresses the jobs of the queue until it is empty
+///@return the number of jobs which failed
+static unsigned int run_worker(shard_job_t *job)
+{
+	char queueDir[PATH_LENGTH];
+	char claimed[ENTRY_PATH_LENGTH];
+	char path[PATH_LENGTH];
+	char shard[PATH_LENGTH];
+	char temp[PATH_LENGTH];
+	unsigned int failures = 0;
+	int claimedJob = 1;
+
+	snprintf(queueDir, PATH_LENGTH, "%s/queue", job->work_dir);
+	// the directory is scanned again after every job, as the other workers take jobs from it too
+	while (claimedJob != 0)
+	{
+		DIR *queue = opendir(queueDir);
+		struct dirent *entry = NULL;
+		unsigned int tile = 0;
+
+		claimedJob = 0;
+		if (queue == NULL)
+		{
+			fprintf(stderr, "\nError, in opening the queue %s\n\n", queueDir);
+			return failures + 1;
+		}
+		while (claimedJob == 0 && (entry = readdir(queue)) != NULL)
+		{
+			if (sscanf(entry->d_name, "%u", &tile) != 1 || tile >= job->num_tiles)
+				continue;
+			snprintf(path, PATH_LENGTH, "%s/queue/%u", job->work_dir, tile);
+			claim_path(job, tile, (long)getpid(), job->host, claimed);
+			// only one of the workers renaming the job at the same time succeeds
+			claimedJob = rename(path, claimed) == 0;
+		}
+		closedir(queue);
+		if (claimedJob == 0)
+			break;
+		shard_path(job, tile, shard);
+		snprintf(temp, PATH_LENGTH, "%s/tile_%u.cbs.%ld", job->work_dir, tile, (long)getpid());
+		if (compress_tile_shard(&job->config, job->tile_width, job->tile_height, tile, temp) == 0 && rename(temp, shard) == 0)
+		{
+			unlink(claimed);
+			continue;
+		}
+		fprintf(stderr, "\nError, in compressing tile %u\n\n", tile);
+		unlink(temp);
+		snprintf(path, PATH_LENGTH, "%s/failed/%u", job->work_dir, tile);
+		rename(claimed, path);
+		failures++;
+	}
+	return failures;
+}
+
+///Queues the jobs of the tiles whose shard is missing: the new ones and the ones which failed or were lost by
+///a worker of this machine, unless they already failed retries times (exhausted is then set); the jobs claimed
+///by the workers still running, or by the ones of other machines, are counted in running
+///@return the number of jobs in the queue, a negative value in case of error
+static int queue_missing(const shard_job_t *job, unsigned int retries, int *exhausted, unsigned int *running)
+{
+	const char *states[] = {"failed", "claimed"};
+	char path[ENTRY_PATH_LENGTH];
+	char shard[PATH_LENGTH];
+	unsigned int tile = 0, s = 0;
+	unsigned char *pending = NULL;
+	int queued = 0, result = 0;
+
+	if ((pending = (unsigned char *)calloc(job->num_tiles, 1)) == NULL)
+	{
+		fprintf(stderr, "\nError, in allocating the state of the tiles\n\n");
+		return -1;
+	}
+	// the jobs still in the queue are left where they are
+	for (tile = 0; tile < job->num_tiles; tile++)
+	{
+		snprintf(path, PATH_LENGTH, "%s/queue/%u", job->work_dir, tile);
+		pending[tile] = exists(path);
+		queued += pending[tile];
+	}
+	*running = 0;
+	for (s = 0; s < 2; s++)
+	{
+		char stateDir[PATH_LENGTH];
+		DIR *dir = NULL;
+		struct dirent *entry = NULL;
+
+		snprintf(stateDir, PATH_LENGTH, "%s/%s", job->work_dir, states[s]);
+		if ((dir = opendir(stateDir)) == NULL)
+			continue;
+		while ((entry = readdir(dir)) != NULL)
+		{
+			unsigned int attempts = 0;
+			if (sscanf(entry->d_name, "%u", &tile) != 1 || tile >= job->num_tiles)
+				continue;
+			// the job is still being compressed, or may be on another machine
+			if (s == 1 && dead_claim(job, entry->d_name) == 0)
+			{
+				if (pending[tile] == 0)
+					(*running)++;
+				pending[tile] = 1;
+				continue;
+			}
+			snprintf(path, ENTRY_PATH_LENGTH, "%s/%s", stateDir, entry->d_name);
+			attempts = read_attempts(path) + 1;
+			shard_path(job, tile, shard);
+			// the tiles out of retries are left failed, to be retried by a new run with more retries
+			if (attempts > retries && exists(shard) == 0 && pending[tile] == 0)
+			{
+				*exhausted = 1;
+				// nor is it queued as a new job; it is reported by the last scan, once the other jobs are over
+				pending[tile] = 2;
+				continue;
+			}
+			unlink(path);
+			if (exists(shard) || pending[tile] != 0)
+				continue;
+			if (queue_job(job, tile, attempts) != 0)
+				result = -1;
+			pending[tile] = 1;
+			queued++;
+		}
+		closedir(dir);
+	}
+	for (tile = 0; tile < job->num_tiles && result == 0; tile++)
+	{
+		snprintf(path, ENTRY_PATH_LENGTH, "%s/failed/%u", job->work_dir, tile);
+		shard_path(job, tile, shard);
+		if (pending[tile] != 0 || exists(shard) || exists(path))
+			continue;
+		if (queue_job(job, tile, 0) != 0)
+			result = -1;
+		pending[tile] = 1;
+		queued++;
+	}
+	for (tile = 0; tile < job->num_tiles && result == 0 && queued == 0 && *running == 0; tile++)
+	{
+		if (pending[tile] == 2)
+			fprintf(stderr, "\nError, tile %u failed and is out of retries (--retries %u)\n\n", tile, retries);
+	}
+	free(pending);
+	return result != 0 ? result : queued;
+}
+
+///Forks num_workers workers and waits for them
+static void run_workers(shard_job_t *job, unsigned int num_workers)
+{
+	unsigned int w = 0, started = 0;
+
+	fflush(stdout);
+	fflush(stderr);
+	for (w = 0; w < num_workers; w++)
+	{
+		pid_t pid = fork();
+		if (pid == 0)
+			_exit(run_worker(job) == 0 ? 0 : 1);
+		if (pid > 0)
+			started++;
+	}
+	// without any worker process the coordinator drains the queue itself
+	if (started == 0)
+		run_worker(job);
+	while (started > 0)
+	{
+		if (wait(NULL) > 0)
+			started--;
+		else if (errno != EINTR)
+			break;
+	}
+}
+
+///Removes the files left in the directory path (the shards, and the temporary files of the workers which died)
+///and the directory itself
+static void remove_dir(const char *path)
+{
+	char name[ENTRY_PATH_LENGTH];
+	DIR *dir = opendir(path);
+	struct dirent *entry = NULL;
+
+	while (dir != NULL && (entry = readdir(dir)) != NULL)
+	{
+		snprintf(name, sizeof(name), "%s/%s", path, entry->d_name);
+		if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+			unlink(name);
+	}
+	if (dir != NULL)
+		closedir(dir);
+	rmdir(path);
+}
+
+///Merges the shards into the container and removes the work directory
+static int merge_shards(shard_job_t *job)
+{
+	const char *states[] = {"queue", "claimed", "failed"};
+	char **shardFiles = NULL;
+	char path[PATH_LENGTH];
+	tiled_report_t report;
+	unsigned int tile = 0, s = 0;
+	int result = 0;
+
+	if ((shardFiles = (char **)calloc(job->num_tiles, sizeof(char *))) == NULL)
+	{
+		fprintf(stderr, "\nError, in allocating the names of the shards\n\n");
+		return -1;
+	}
+	for (tile = 0; tile < job->num_tiles && result == 0; tile++)
+	{
+		if ((shardFiles[tile] = (char *)malloc(PATH_LENGTH)) == NULL)
+			result = -1;
+		else
+			shard_path(job, tile, shardFiles[tile]);
+	}
+	if (result == 0 && (result = merge_tile_shards(&job->config, job->tile_width, job->tile_height, (const char *const *)shardFiles, &report)) == 0)
+	{
+		for (s = 0; s < 3; s++)
+		{
+			snprintf(path, PATH_LENGTH, "%s/%s", job->work_dir, states[s]);
+			remove_dir(path);
+		}
+		remove_dir(job->work_dir);
+		printf("%llu bytes in the container of %u tiles\n", report.container_bytes, report.num_tiles);
+	}
+	for (tile = 0; tile < job->num_tiles; tile++)
+		free(shardFiles[tile]);
+	free(shardFiles);
+	return result;
+}
+
+///Checks the parameters of the compression and parses its tables once, before any job is queued, so that an
+///invalid configuration is not found by every attempt of every tile
+///@return 0 if the configuration is valid, the status code (see ccsds_status_t) of the problem otherwise
+static int check_job(const shard_job_t *job)
+{
+	compressConfig_t config = job->config;
+	arena_t arena;
+	int result = 0;
+
+	if (arena_init(&arena, 0, 0) != 0)
+	{
+		fprintf(stderr, "\nError, in initializing the memory of the checks\n\n");
+		return CCSDS_ERROR_MEMORY;
+	}
+	result = compress_prepare(&config, &arena);
+	arena_release(&arena);
+	return result;
+}
+
+///Creates the directories of the work directory
+static int create_work_dir(const char *work_dir)
+{
+	const char *states[] = {"", "/queue", "/claimed", "/failed"};
+	char path[PATH_LENGTH];
+	unsigned int s = 0;
+
+	for (s = 0; s < 4; s++)
+	{
+		snprintf(path, PATH_LENGTH, "%s%s", work_dir, states[s]);
+		if (mkdir(path, 0777) != 0 && errno != EEXIST)
+		{
+			fprintf(stderr, "\nError, in creating the directory %s\n\n", path);
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	shard_job_t job;
+	tile_grid_t grid;
+	char work_dir[PATH_LENGTH];
+	unsigned int num_workers = 0;
+	unsigned int retries = DEFAULT_RETRIES;
+	int worker_only = 0;
+	int foundOpt = 0;
+	int queued = 0, exhausted = 0;
+	unsigned int running = 0;
+	int result = 0;
+
+	memset(&job, 0, sizeof(shard_job_t));
+	work_dir[0] = '\x0';
+	job.config.encoder_params.k = (unsigned int)-1;
+	job.config.input_params.dyn_range = 16;
+	job.config.input_params.regular_input = 1;
+	job.config.encoder_params.encoding_method = BLOCK;
+	job.config.log_callback = log_to_stdio;
+
+	//Lets do some simple command line option parsing
+	do
+	{
+		foundOpt = getopt_long(argc, argv, "", options, NULL);
+		switch (foundOpt)
+		{
+			case 1:
+				strncpy(job.config.samples_file, optarg, 127);
+				break;
+			case 2:
+				strncpy(job.config.out_file, optarg, 127);
+				break;
+			case 3:
+				job.config.input_params.y_size = (unsigned int)atoi(optarg);
+				break;
+			case 4:
+				job.config.input_params.x_size = (unsigned int)atoi(optarg);
+				break;
+			case 5:
+				job.config.input_params.z_size = (unsigned int)atoi(optarg);
+				break;
+			case 6:
+				if (strcmp(optarg, "BI") == 0 || strcmp(optarg, "bi") == 0)
+				{
+					job.config.input_params.in_interleaving = BI;
+				}
+				else if (strcmp(optarg, "BSQ") == 0 || strcmp(optarg, "bsq") == 0)
+				{
+					job.config.input_params.in_interleaving = BSQ;
+				}
+				else
+				{
+					fprintf(stderr, "\nError, %s unknown input image format\n\n", optarg);
+					fprintf(stderr, USAGE_STRING, argv[0]);
+					return -1;
+				}
+				break;
+			case 7:
+				job.config.input_params.in_interleaving_depth = (unsigned int)atoi(optarg);
+				break;
+			case 8:
+				if (strcmp(optarg, "little") == 0 || strcmp(optarg, "LITTLE") == 0)
+				{
+					job.config.input_params.byte_ordering = LITTLE;
+				}
+				else if (strcmp(optarg, "big") == 0 || strcmp(optarg, "BIG") == 0)
+				{
+					job.config.input_params.byte_ordering = BIG;
+				}
+				else
+				{
+					fprintf(stderr, "\nError, %s unknown input byte ordering\n\n", optarg);
+					fprintf(stderr, USAGE_STRING, argv[0]);
+					return -1;
+				}
+				break;
+			case 9:
+				if (strcmp(optarg, "BI") == 0 || strcmp(optarg, "bi") == 0)
+				{
+					job.config.encoder_params.out_interleaving = BI;
+				}
+				else if (strcmp(optarg, "BSQ") == 0 || strcmp(optarg, "bsq") == 0)
+				{
+					job.config.encoder_params.out_interleaving = BSQ;
+				}
+				else
+				{
+					fprintf(stderr, "\nError, %s unknown image format\n\n", optarg);
+					fprintf(stderr, USAGE_STRING, argv[0]);
+					return -1;
+				}
+				break;
+			case 10:
+				job.config.encoder_params.out_interleaving_depth = (unsigned int)atoi(optarg);
+				break;
+			case 12:
+				job.config.encoder_params.u_max = (unsigned int)atoi(optarg);
+				break;
+			case 13:
+				job.config.encoder_params.y_star = (unsigned int)atoi(optarg);
+				break;
+			case 14:
+				job.config.encoder_params.y_0 = (unsigned int)atoi(optarg);
+				break;
+			case 15:
+				job.config.encoder_params.k = (unsigned int)atoi(optarg);
+				break;
+			case 16:
+				strncpy(job.config.init_table_file, optarg, 127);
+				break;
+			case 17:
+				fprintf(stderr, USAGE_STRING, argv[0]);
+				return 0;
+			case 18:
+				job.config.input_params.dyn_range = (unsigned int)atoi(optarg);
+				break;
+			case 19:
+				job.config.encoder_params.out_wordsize = (unsigned int)atoi(optarg);
+				break;
+			case 20:
+				job.config.input_params.signed_samples = 1;
+				break;
+			case 21:
+				job.config.predictor_params.pred_bands = (unsigned int)atoi(optarg);
+				job.config.predictor_params.user_input_pred_bands = job.config.predictor_params.pred_bands;
+				break;
+			case 22:
+				job.config.predictor_params.full = 1;
+				break;
+			case 23:
+				job.config.predictor_params.neighbour_sum = 1;
+				break;
+			case 24:
+				job.config.predictor_params.register_size = (unsigned int)atoi(optarg);
+				break;
+			case 25:
+				job.config.predictor_params.weight_resolution = (unsigned char)atoi(optarg);
+				break;
+			case 26:
+				job.config.predictor_params.weight_interval = (int)atoi(optarg);
+				break;
+			case 27:
+				job.config.predictor_params.weight_initial = (char)atoi(optarg);
+				break;
+			case 28:
+				job.config.predictor_params.weight_final = (char)atoi(optarg);
+				break;
+			case 29:
+				job.config.predictor_params.weight_init_resolution = (unsigned char)atoi(optarg);
+				break;
+			case 30:
+				strncpy(job.config.init_weight_file, optarg, 127);
+				break;
+			case 31:
+				job.config.encoder_params.encoding_method = SAMPLE;
+				break;
+			case 32:
+				job.config.encoder_params.block_size = (unsigned int)atoi(optarg);
+				break;
+			case 33:
+				job.config.encoder_params.restricted = 1;
+				break;
+			case 34:
+				job.config.encoder_params.ref_interval = (unsigned int)atoi(optarg);
+				break;
+			case 40:
+				job.tile_width = (unsigned int)atoi(optarg);
+				break;
+			case 41:
+				job.tile_height = (unsigned int)atoi(optarg);
+				break;
+			case 42:
+				num_workers = (unsigned int)atoi(optarg);
+				break;
+			case 43:
+				retries = (unsigned int)atoi(optarg);
+				break;
+			case 44:
+				strncpy(work_dir, optarg, PATH_LENGTH - 32);
+				work_dir[PATH_LENGTH - 32] = '\x0';
+				break;
+			case 45:
+				worker_only = 1;
+				break;
+			case -1:
+				//Do nothing, we have finished parsing the options
+				break;
+			case '?':
+			default:
+				fprintf(stderr, "\nError in the program command line!!\n\n");
+				fprintf(stderr, USAGE_STRING, argv[0]);
+				return -1;
+		}
+	} while (foundOpt >= 0);
+
+	//The parameters of the compression are checked by the library (see check_job)
+	if (job.config.samples_file[0] == '\x0' || work_dir[0] == '\x0' || (worker_only == 0 && job.config.out_file[0] == '\x0'))
+	{
+		fprintf(stderr, "\nError, please indicate the input samples, the work directory and the container to be written\n\n");
+		fprintf(stderr, USAGE_STRING, argv[0]);
+		return -1;
+	}
+	if (job.config.input_params.y_size * job.config.input_params.x_size * job.config.input_params.z_size == 0 ||
+			job.tile_width == 0 || job.tile_height == 0)
+	{
+		fprintf(stderr, "\nError, please specify all the x, y, and z dimensions and the size of the tiles with a number > 0\n\n");
+		fprintf(stderr, USAGE_STRING, argv[0]);
+		return -1;
+	}
+	if (num_workers == 0)
+		num_workers = sysconf(_SC_NPROCESSORS_ONLN) > 0 ? (unsigned int)sysconf(_SC_NPROCESSORS_ONLN) : 1;
+	job.work_dir = work_dir;
+	if (gethostname(job.host, HOST_LENGTH) != 0)
+		strcpy(job.host, "localhost");
+	job.host[HOST_LENGTH] = '\x0';
+	tile_grid_init(&grid, job.config.input_params.x_size, job.config.input_params.y_size, job.config.input_params.z_size, job.tile_width,
+			job.tile_height);
+	job.num_tiles = tile_grid_tiles(&grid);
+
+	if (worker_only != 0)
+		return run_worker(&job) == 0 ? 0 : -1;
+	if ((result = check_job(&job)) != 0)
+		return result;
+	if (create_work_dir(work_dir) != 0)
+		return -1;
+	while ((queued = queue_missing(&job, retries, &exhausted, &running)) > 0 || (queued == 0 && running > 0))
+	{
+		if (queued == 0)
+		{
+			printf("Waiting for the %u tiles claimed by other workers\n", running);
+			fflush(stdout);
+			sleep(CLAIM_POLL_SECONDS);
+			continue;
+		}
+		printf("Compressing %d of the %u tiles with %u workers\n", queued, job.num_tiles, num_workers);
+		run_workers(&job, MIN(num_workers, (unsigned int)queued));
+	}
+	if (queued < 0 || exhausted != 0)
+	{
+		fprintf(stderr, "\nError, the shards written so far are kept in %s: run again to resume\n\n", work_dir);
+		return -1;
+	}
+	return merge_shards(&job);
+}